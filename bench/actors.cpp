@@ -0,0 +1,49 @@
+/**
+ * @file
+ * Actor benchmark : bounces a message between the API's thread and an
+ * actor, first a number and then a small dictionary, which has to be
+ * copied each way, and reports round trips per second.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+/// the number of round trips in each pass
+static const int TRIPS = 20000;
+
+void benchActors(API *api,Session *ses){
+    ses->feed("abecho = procedure(n)");
+    ses->feed("    for i in range(0,n)");
+    ses->feed("        send(0,receive())");
+    ses->feed("    endfor");
+    ses->feed("end");
+    ses->feed("abrun = function(n,m)");
+    ses->feed("    a = spawn(abecho,n)");
+    ses->feed("    for i in range(0,n)");
+    ses->feed("        send(a,m)");
+    ses->feed("        m = receive()");
+    ses->feed("    endfor");
+    ses->feed("    join(a)");
+    ses->feed("    return m");
+    ses->feed("end");
+    ses->feed("abd = dict()");
+    ses->feed("abd[\"name\"] = \"customer\"");
+    ses->feed("abd[\"id\"] = 1234");
+    ses->feed("abd[\"items\"] = list()");
+    ses->feed("abd[\"items\"].push(1)");
+    ses->feed("abd[\"items\"].push(2)");
+    
+    char buf[64];
+    Timer tm;
+    sprintf(buf,"abr = abrun(%d,1)",TRIPS);
+    ses->feed(buf);
+    report("actors","number",(double)TRIPS/tm.elapsed(),"trips/s");
+    
+    tm.reset();
+    sprintf(buf,"abr = abrun(%d,abd)",TRIPS);
+    ses->feed(buf);
+    report("actors","dictionary",(double)TRIPS/tm.elapsed(),"trips/s");
+}
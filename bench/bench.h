@@ -0,0 +1,63 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+/**
+ * @file
+ * A very simple benchmark harness. Each benchmark is a function
+ * declared here and listed in the table in main.cpp; it's handed
+ * an API and a session, and prints its results with report().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "lana/api.h"
+
+/// a wall-clock stopwatch, started on construction
+
+class Timer {
+public:
+    Timer(){
+        reset();
+    }
+    
+    /// restart the timer
+    void reset(){
+        gettimeofday(&start,NULL);
+    }
+    
+    /// seconds since construction or the last reset()
+    double elapsed(){
+        struct timeval now;
+        gettimeofday(&now,NULL);
+        return (double)(now.tv_sec-start.tv_sec) +
+              (double)(now.tv_usec-start.tv_usec)*1e-6;
+    }
+private:
+    struct timeval start;
+};
+
+/// print a single result line in a form which is easy to grep and diff
+inline void report(const char *bench,const char *what,double val,const char *units){
+    printf("%-16s %-40s %12.3f %s\n",bench,what,val,units);
+}
+
+// the benchmarks themselves
+
+void benchHashChurn(lana::API *api,lana::Session *ses);
+void benchSort(lana::API *api,lana::Session *ses);
+void benchTypedArray(lana::API *api,lana::Session *ses);
+void benchLoops(lana::API *api,lana::Session *ses);
+void benchRegisterVM(lana::API *api,lana::Session *ses);
+void benchInline(lana::API *api,lana::Session *ses);
+void benchFeed(lana::API *api,lana::Session *ses);
+void benchCall(lana::API *api,lana::Session *ses);
+void benchNatives(lana::API *api,lana::Session *ses);
+void benchThreads(lana::API *api,lana::Session *ses);
+void benchParallel(lana::API *api,lana::Session *ses);
+void benchActors(lana::API *api,lana::Session *ses);
+void benchFreeze(lana::API *api,lana::Session *ses);
+void benchSched(lana::API *api,lana::Session *ses);
+
+#endif /* __BENCH_H */
@@ -0,0 +1,41 @@
+/**
+ * @file
+ * Call handle benchmark : calls a small user function from C++ through
+ * a handle (see API::call()), and by feeding a line which calls it,
+ * reporting the calls per second each manages.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+/// the number of calls made each way
+static const int CALLS = 200000;
+
+void benchCall(API *api,Session *ses){
+    ses->feed("cbf = function(a,b)");
+    ses->feed("    return a+b");
+    ses->feed("end");
+    
+    CallHandle h = api->getFunction("cbf",ses);
+    Value a,b;
+    a.setInt(1);
+    b.setInt(2);
+    
+    for(int i=0;i<1000;i++){ // to warm up
+        api->call(h,a,b);
+        ses->feed("cbres = cbf(1,2)");
+    }
+    
+    Timer tm;
+    for(int i=0;i<CALLS;i++)
+        ses->feed("cbres = cbf(1,2)");
+    report("call","feed(\"cbres = cbf(1,2)\")",CALLS/tm.elapsed(),"calls/s");
+    
+    tm.reset();
+    for(int i=0;i<CALLS;i++)
+        api->call(h,a,b);
+    report("call","API::call(handle,a,b)",CALLS/tm.elapsed(),"calls/s");
+}
@@ -0,0 +1,64 @@
+/**
+ * @file
+ * Feed latency benchmark : feeds trivial statements one at a time, as
+ * a server does with each user command, and reports the average time
+ * each Session::feed() takes. Every feed compiles and runs the line,
+ * and resets the VM before it runs. The same lines are then fed with
+ * the statement cache on, and run as prepared statements, neither of
+ * which compiles them again.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+struct FeedBench {
+    const char *what;
+    const char *line;
+};
+
+static FeedBench benches[] = {
+    {"assignment", "fdx = 1"},
+    {"increment", "fdx = fdx+1"},
+    {"function call", "fdy = fdf(fdx)"},
+    {NULL,NULL}
+};
+
+/// the number of times each line is fed
+static const int FEEDS = 200000;
+
+void benchFeed(API *api,Session *ses){
+    ses->feed("fdx = 0");
+    ses->feed("fdf = function(x)");
+    ses->feed("    return x+1");
+    ses->feed("end");
+    
+    char what[128];
+    for(int cached=0;cached<2;cached++){
+        ses->setStatementCache(cached?16:0);
+        for(FeedBench *b=benches;b->what;b++){
+            for(int i=0;i<1000;i++) // to warm up
+                ses->feed(b->line);
+            Timer tm;
+            for(int i=0;i<FEEDS;i++)
+                ses->feed(b->line);
+            sprintf(what,"%s, per feed%s",b->what,cached?" (cached)":"");
+            report("feed",what,tm.elapsed()*1e9/FEEDS,"ns");
+        }
+    }
+    ses->setStatementCache(0);
+    
+    for(FeedBench *b=benches;b->what;b++){
+        Statement *st = ses->prepare(b->line);
+        for(int i=0;i<1000;i++)
+            ses->execute(st);
+        Timer tm;
+        for(int i=0;i<FEEDS;i++)
+            ses->execute(st);
+        sprintf(what,"%s, per execute",b->what);
+        report("feed",what,tm.elapsed()*1e9/FEEDS,"ns");
+        delete st;
+    }
+}
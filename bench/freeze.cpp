@@ -0,0 +1,64 @@
+/**
+ * @file
+ * Freeze benchmark : builds a large reference table of dictionaries and
+ * lists, and reports how long a garbage collection takes with it live,
+ * before and after freezing it, along with how long freezing took and
+ * how quickly it can be read either way.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+/// the number of rows in the table
+static const int ROWS = 20000;
+/// the number of collections timed
+static const int COLLECTIONS = 3;
+/// the number of lookups timed
+static const int LOOKUPS = 200000;
+
+/// time some collections and some lookups
+static void timeTable(Session *ses,const char *label){
+    char buf[64];
+    Timer tm;
+    for(int i=0;i<COLLECTIONS;i++)
+        ses->feed("fbg = gc()");
+    report("freeze",label,tm.elapsed()*1000.0/COLLECTIONS,"ms/gc");
+    
+    sprintf(buf,"fbr = fbread(fbt,%d)",LOOKUPS);
+    tm.reset();
+    ses->feed(buf);
+    report("freeze",label,(double)LOOKUPS/tm.elapsed(),"lookups/s");
+}
+
+void benchFreeze(API *api,Session *ses){
+    ses->feed("fbmake = function(n)");
+    ses->feed("    t = dict()");
+    ses->feed("    for i in range(0,n)");
+    ses->feed("        row = list()");
+    ses->feed("        row.push(i)");
+    ses->feed("        row.push(\"row\"+str(i))");
+    ses->feed("        t[i] = row");
+    ses->feed("    endfor");
+    ses->feed("    return t");
+    ses->feed("end");
+    ses->feed("fbread = function(t,n)");
+    ses->feed("    s = 0");
+    ses->feed("    for i in range(0,n)");
+    ses->feed("        s = s+t[i%size(t)][0]");
+    ses->feed("    endfor");
+    ses->feed("    return s");
+    ses->feed("end");
+    
+    char buf[64];
+    sprintf(buf,"fbt = fbmake(%d)",ROWS);
+    ses->feed(buf);
+    timeTable(ses,"unfrozen");
+    
+    Timer tm;
+    ses->feed("fbt = freeze(fbt)");
+    report("freeze","freezing",(double)ROWS/tm.elapsed(),"rows/s");
+    timeTable(ses,"frozen");
+}
@@ -0,0 +1,155 @@
+/**
+ * @file
+ * Hash churn benchmark : keeps a sliding window of live keys in a
+ * table while inserting and deleting many others, and reports the
+ * table size, the dummy count and the mean probe length as it goes.
+ * Also checks that a table which has grown large shrinks again once
+ * most of its contents have been deleted.
+ */
+
+#include "bench.h"
+#include "lana/hash.h"
+#include "lana/intkeyedhash.h"
+
+using namespace lana;
+
+#define WINDOW 1000
+#define OPS 1000000
+#define REPORTEVERY 200000
+
+/// number of slots visited when looking up an integer key; this
+/// follows the probe sequence in Hash::look().
+
+static int probes(Hash *h,int key){
+    Value k;
+    k.setInt(key);
+    u64 hash = k.getHash();
+    unsigned int slot = hash & h->mask;
+    HashEnt *ent = h->table+slot;
+    int n=1;
+
+    for(unsigned int perturb = hash;;perturb>>=PERTURB_SHIFT){
+        if(ent->isFree())
+            return n;
+        if(ent->isUsed() && ent->hash == hash && ent->k.equalsForHashTable(&k))
+            return n;
+        slot = (slot<<2)+slot+1+perturb;
+        ent = h->table+(slot&h->mask);
+        n++;
+    }
+}
+
+/// the same, following IntKeyedHash::look().
+
+template <class T> static int probes(IntKeyedHash<T> *h,u32 k){
+    unsigned int slot = k & h->mask;
+    IntKeyedHashEnt<T> *ent = h->table+slot;
+    int n=1;
+
+    for(unsigned int perturb = k;;perturb>>=PERTURB_SHIFT){
+        if(ent->s == HSH_FREE)
+            return n;
+        if(ent->s == HSH_USED && ent->k == k)
+            return n;
+        slot = (slot<<2)+slot+1+perturb;
+        ent = h->table+(slot&h->mask);
+        n++;
+    }
+}
+
+/// scramble the sequence number of a key, so that the keys collide
+/// the way real ones do rather than landing in consecutive slots
+
+static int key(int i){
+    u32 x = (u32)i;
+    x ^= x>>16; x *= 0x85ebca6bU;
+    x ^= x>>13; x *= 0xc2b2ae35U;
+    x ^= x>>16;
+    return (int)(x>>1);
+}
+
+static void setInt(Hash *h,int key,int val){
+    Value k,v;
+    k.setInt(key);
+    v.setInt(val);
+    h->set(&k,&v);
+}
+
+static void delInt(Hash *h,int key){
+    Value k;
+    k.setInt(key);
+    h->del(&k);
+}
+
+/// report the state of a table, given the range of keys currently live
+/// and a key which is definitely absent
+
+template <class H> static void state(const char *name,H *h,int lo,int hi,int op){
+    char buf[64];
+    double hit=0,miss=0;
+    for(int i=lo;i<hi;i++){
+        hit += probes(h,key(i));
+        miss += probes(h,key(i+OPS*2));
+    }
+    hit /= (hi-lo);
+    miss /= (hi-lo);
+
+    sprintf(buf,"%d ops: slots",op);
+    report(name,buf,h->mask+1,"");
+    sprintf(buf,"%d ops: dummies",op);
+    report(name,buf,h->fill-h->used,"");
+    sprintf(buf,"%d ops: mean probes (hit)",op);
+    report(name,buf,hit,"");
+    sprintf(buf,"%d ops: mean probes (miss)",op);
+    report(name,buf,miss,"");
+}
+
+static void churnHash(){
+    Hash h;
+    Timer t;
+
+    for(int i=0;i<OPS;i++){
+        setInt(&h,key(i),i);
+        if(i>=WINDOW)
+            delInt(&h,key(i-WINDOW));
+        if(i && !(i%REPORTEVERY))
+            state("Hash",&h,i-WINDOW+1,i+1,i);
+    }
+    report("Hash","churn time",t.elapsed(),"s");
+
+    // grow large, then delete almost everything
+    for(int i=0;i<OPS;i++)
+        setInt(&h,key(i),i);
+    report("Hash","slots after growing",h.mask+1,"");
+    for(int i=0;i<OPS-WINDOW;i++)
+        delInt(&h,key(i));
+    report("Hash","slots after deleting",h.mask+1,"");
+    state("Hash",&h,OPS-WINDOW,OPS,OPS);
+}
+
+static void churnIntKeyedHash(){
+    IntKeyedHash<int> h;
+    Timer t;
+
+    for(int i=0;i<OPS;i++){
+        *h.set(key(i))=i;
+        if(i>=WINDOW)
+            h.del(key(i-WINDOW));
+        if(i && !(i%REPORTEVERY))
+            state("IntKeyedHash",&h,i-WINDOW+1,i+1,i);
+    }
+    report("IntKeyedHash","churn time",t.elapsed(),"s");
+
+    for(int i=0;i<OPS;i++)
+        *h.set(key(i))=i;
+    report("IntKeyedHash","slots after growing",h.mask+1,"");
+    for(int i=0;i<OPS-WINDOW;i++)
+        h.del(key(i));
+    report("IntKeyedHash","slots after deleting",h.mask+1,"");
+    state("IntKeyedHash",&h,OPS-WINDOW,OPS,OPS);
+}
+
+void benchHashChurn(API *api,Session *ses){
+    churnHash();
+    churnIntKeyedHash();
+}
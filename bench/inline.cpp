@@ -0,0 +1,130 @@
+/**
+ * @file
+ * Inlining benchmark : runs loops which call small user functions,
+ * compiled with and without inlining (see Optimiser::inlineCalls()),
+ * reporting the number of instructions each executes and the time
+ * taken.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+#include "lana/flags.h"
+
+using namespace lana;
+
+/// the small functions which are called
+static const char *callees[] = {
+    "inlsq = function(x)",
+    "    return x*x",
+    "end",
+    "inlclamp = function(x,lo,hi)",
+    "    if x<lo",
+    "        return lo",
+    "    elseif x>hi",
+    "        return hi",
+    "    endif",
+    "    return x",
+    "end",
+    "inlget = function(l,i)",
+    "    return l[i]",
+    "end",
+    "inldata = list()",
+    "inldata.push(3)",
+    NULL
+};
+
+/// the callers, which are compiled twice - the @ is replaced by 0 or 1
+static const char *callers[] = {
+    "inlsqloop@ = function(n)",
+    "    t = 0",
+    "    i = 0",
+    "    while i<n",
+    "        t = t+inlsq(i%10)",
+    "        i = i+1",
+    "    endwhile",
+    "    return t",
+    "end",
+    "inlclamploop@ = function(n)",
+    "    t = 0",
+    "    i = 0",
+    "    while i<n",
+    "        t = t+inlclamp(i%10,2,7)",
+    "        i = i+1",
+    "    endwhile",
+    "    return t",
+    "end",
+    "inlgetloop@ = function(l,n)",
+    "    t = 0",
+    "    i = 0",
+    "    while i<n",
+    "        t = t+inlget(l,0)",
+    "        i = i+1",
+    "    endwhile",
+    "    return t",
+    "end",
+    NULL
+};
+
+struct InlineBench {
+    const char *what;
+    const char *line; //!< again with @ replaced
+};
+
+static InlineBench benches[] = {
+    {"accessor sq(x)", "inlres = inlsqloop@(1000000)"},
+    {"clamp(x,lo,hi)", "inlres = inlclamploop@(1000000)"},
+    {"list item getter", "inlres = inlgetloop@(inldata,1000000)"},
+    {NULL,NULL}
+};
+
+/// feed a line with any @ replaced by a digit
+static void feedWith(Session *ses,const char *line,int n){
+    char buf[256];
+    char *q = buf;
+    for(const char *p=line;*p && q<buf+250;p++){
+        if(*p=='@')
+            *q++ = '0'+n;
+        else
+            *q++ = *p;
+    }
+    *q = 0;
+    ses->feed(buf);
+}
+
+void benchInline(API *api,Session *ses){
+    int oldflags = api->setFlags(0);
+    for(const char **p=callees;*p;p++)
+        ses->feed(*p);
+    for(int inl=0;inl<2;inl++){
+        if(inl)
+            api->setInlineLimits(32,256);
+        else
+            api->setInlineLimits(0,0);
+        for(const char **p=callers;*p;p++)
+            feedWith(ses,*p,inl);
+    }
+
+    char what[128];
+    for(InlineBench *b=benches;b->what;b++){
+        int ct[2];
+        double t[2];
+        for(int inl=0;inl<2;inl++){
+            feedWith(ses,b->line,inl); // once to warm up
+            api->resetInstructionCount();
+            Timer tm;
+            feedWith(ses,b->line,inl);
+            t[inl] = tm.elapsed();
+            ct[inl] = api->getInstructionCount();
+        }
+        sprintf(what,"%s, called",b->what);
+        report("inline",what,t[0]*1000.0,"ms");
+        report("inline",what,ct[0],"instructions");
+        sprintf(what,"%s, inlined",b->what);
+        report("inline",what,t[1]*1000.0,"ms");
+        report("inline",what,ct[1],"instructions");
+    }
+
+    ses->feed("inldata = 0");
+    api->setFlags(oldflags);
+}
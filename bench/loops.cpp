@@ -0,0 +1,118 @@
+/**
+ * @file
+ * For-loop benchmark : iterating over ranges, lists, dictionary keys
+ * and values and object properties, where the loop body does very
+ * little so that the cost of the loop itself dominates. Also reports
+ * how many objects each kind of loop creates.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+#define N 1000000
+#define SMALL 10
+#define SMALLREPS 100000
+
+static const char *setup[] = {
+    "benchrange = function(n)",
+    "    t = 0",
+    "    for i in range(0,n)",
+    "        t = t+i",
+    "    endfor",
+    "    return t",
+    "end",
+    "benchvalues = function(c)",
+    "    t = 0",
+    "    for x in c",
+    "        t = t+1",
+    "    endfor",
+    "    return t",
+    "end",
+    "benchkeys = function(c)",
+    "    t = 0",
+    "    for k in keys(c)",
+    "        t = t+1",
+    "    endfor",
+    "    return t",
+    "end",
+    // many short loops, where the per-loop setup cost shows
+    "benchshort = function(c,n)",
+    "    t = 0",
+    "    for i in range(0,n)",
+    "        for x in c",
+    "            t = t+1",
+    "        endfor",
+    "    endfor",
+    "    return t",
+    "end",
+    "benchfill = procedure(l,d,s,o,n)",
+    "    for i in range(0,n)",
+    "        l.push(i)",
+    "        d[i]=i",
+    "    endfor",
+    "    for i in range(0,10)",
+    "        s.push(i)",
+    "    endfor",
+    "    o.a=1",
+    "    o.b=2",
+    "    o.c=3",
+    "    o.d=4",
+    "end",
+    // the number of objects alive inside a loop which weren't before it
+    "benchcount = function(c)",
+    "    n = gccount()",
+    "    for x in c",
+    "        m = gccount()-n",
+    "    endfor",
+    "    return m",
+    "end",
+    "benchlist = list()",
+    "benchdict = dict()",
+    "benchsmall = list()",
+    "benchobj = create()",
+    NULL
+};
+
+/// time a line fed to the session, reporting the time per item
+static void timeLine(Session *ses,const char *what,const char *line,int items){
+    Timer t;
+    ses->feed(line);
+    report("loops",what,t.elapsed()*1e9/items,"ns/item");
+}
+
+void benchLoops(API *api,Session *ses){
+    for(const char **p=setup;*p;p++)
+        ses->feed(*p);
+
+    char line[128];
+    sprintf(line,"benchfill(benchlist,benchdict,benchsmall,benchobj,%d)",N);
+    ses->feed(line);
+
+    sprintf(line,"benchr = benchrange(%d)",N);
+    timeLine(ses,"range",line,N);
+    timeLine(ses,"list values","benchr = benchvalues(benchlist)",N);
+    timeLine(ses,"list keys","benchr = benchkeys(benchlist)",N);
+    timeLine(ses,"dict values","benchr = benchvalues(benchdict)",N);
+    timeLine(ses,"dict keys","benchr = benchkeys(benchdict)",N);
+    sprintf(line,"benchr = benchshort(benchsmall,%d)",SMALLREPS);
+    timeLine(ses,"10-item list, many loops",line,SMALLREPS*SMALL);
+    sprintf(line,"benchr = benchshort(benchobj,%d)",SMALLREPS);
+    timeLine(ses,"4-property object, many loops",line,SMALLREPS*4);
+
+    // count the objects made by a loop over each kind of thing
+    const char *kinds[] = {"range(0,10)","benchsmall","keys(benchdict)","benchobj",NULL};
+    for(const char **k=kinds;*k;k++){
+        sprintf(line,"benchr = benchcount(%s)",*k);
+        ses->feed(line);
+        sprintf(line,"objects in loop over %s",*k);
+        report("loops",line,ses->getSesVar("benchr")->getInt(),"");
+    }
+
+    ses->feed("benchlist = 0");
+    ses->feed("benchdict = 0");
+    ses->feed("benchsmall = 0");
+    ses->feed("benchobj = 0");
+}
@@ -0,0 +1,50 @@
+#include <string.h>
+
+#include "bench.h"
+
+/*
+ * Benchmark driver : with no arguments, runs everything. Otherwise
+ * runs the benchmarks named on the command line.
+ */
+
+struct BenchEntry {
+    const char *name;
+    void (*fn)(lana::API *api,lana::Session *ses);
+};
+
+static BenchEntry benchmarks[] = {
+    {"hashchurn", benchHashChurn},
+    {"sort", benchSort},
+    {"typedarray", benchTypedArray},
+    {"loops", benchLoops},
+    {"regvm", benchRegisterVM},
+    {"inline", benchInline},
+    {"feed", benchFeed},
+    {"call", benchCall},
+    {"natives", benchNatives},
+    {"threads", benchThreads},
+    {"parallel", benchParallel},
+    {"actors", benchActors},
+    {"freeze", benchFreeze},
+    {"sched", benchSched},
+    {NULL,NULL}
+};
+
+int main(int argc,char *argv[]){
+    lana::API *api = new lana::API;
+    lana::Session *ses = new lana::Session(api);
+    
+    for(BenchEntry *b=benchmarks;b->name;b++){
+        bool run = argc<2;
+        for(int i=1;i<argc;i++){
+            if(!strcmp(argv[i],b->name))
+                run=true;
+        }
+        if(run)
+            (*b->fn)(api,ses);
+    }
+    
+    delete ses;
+    delete api;
+    return 0;
+}
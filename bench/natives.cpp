@@ -0,0 +1,72 @@
+/**
+ * @file
+ * Native call benchmark : calls the core library's sin(), pow() and
+ * int(), which are bound with API::bind(), in a loop, and the same
+ * functions registered the old way, popping and pushing their values
+ * through the API. Reports the time each call takes, loop included;
+ * the loop alone is timed first.
+ */
+
+#include <math.h>
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+// the functions as they were written before API::bind()
+
+static void oldsin(API *a){
+    a->pushFloat(sinf(a->popFloat()));
+}
+static void oldpow(API *a){
+    float y = a->popFloat();
+    float x = a->popFloat();
+    a->pushFloat(powf(x,y));
+}
+static void oldint(API *a){
+    a->pushInt(a->popInt());
+}
+
+struct NativeBench {
+    const char *what;
+    const char *call;
+};
+
+static NativeBench benches[] = {
+    {"loop alone", "nbx = f"},
+    {"sin (bound)", "nbx = sin(f)"},
+    {"sin (API)", "nbx = nbsin(f)"},
+    {"pow (bound)", "nbx = pow(f,2)"},
+    {"pow (API)", "nbx = nbpow(f,2)"},
+    {"int (bound)", "nbx = int(f)"},
+    {"int (API)", "nbx = nbint(f)"},
+    {NULL,NULL}
+};
+
+/// the number of calls timed
+static const int CALLS = 2000000;
+
+void benchNatives(API *api,Session *ses){
+    api->globalNativeFunction("nbsin",1,true,&oldsin);
+    api->globalNativeFunction("nbpow",2,true,&oldpow);
+    api->globalNativeFunction("nbint",1,true,&oldint);
+    
+    char buf[128];
+    for(NativeBench *b=benches;b->what;b++){
+        ses->feed("nbrun = procedure(n)");
+        ses->feed("    f = 1.5");
+        ses->feed("    for i in range(0,n)");
+        sprintf(buf,"        %s",b->call);
+        ses->feed(buf);
+        ses->feed("    endfor");
+        ses->feed("end");
+        
+        ses->feed("nbrun(1000)"); // to warm up
+        sprintf(buf,"nbrun(%d)",CALLS);
+        Timer tm;
+        ses->feed(buf);
+        report("natives",b->what,tm.elapsed()*1e9/CALLS,"ns/call");
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @file
+ * Parallel map benchmark : runs pmap() over a list with a function which
+ * does a little arithmetic, in the work pool with 1, 2, 4... threads up
+ * to the number of cores, and reports items per second against a plain
+ * loop doing the same in one thread.
+ */
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+/// the number of items in the list
+static const int ITEMS = 20000;
+/// the number of times each pass is run
+static const int PASSES = 5;
+
+void benchParallel(API *api,Session *ses){
+    ses->feed("pbwork = function(x)");
+    ses->feed("    t = 0");
+    ses->feed("    for i in range(0,100)");
+    ses->feed("        t = t+x*i");
+    ses->feed("    endfor");
+    ses->feed("    return t");
+    ses->feed("end");
+    ses->feed("pbloop = function(l)");
+    ses->feed("    r = list()");
+    ses->feed("    for x in l");
+    ses->feed("        r.push(pbwork(x))");
+    ses->feed("    endfor");
+    ses->feed("    return r");
+    ses->feed("end");
+    ses->feed("pbl = list()");
+    char buf[64];
+    for(int i=0;i<ITEMS;i++){
+        sprintf(buf,"pbl.push(%d)",i);
+        ses->feed(buf);
+    }
+    
+    Timer tm;
+    for(int i=0;i<PASSES;i++)
+        ses->feed("pbr = pbloop(pbl)");
+    report("parallel","loop, 1 thread",(double)ITEMS*PASSES/tm.elapsed(),"items/s");
+    
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(cores<1)
+        cores=1;
+    for(int n=1;;n*=2){
+        if(n>cores)
+            n=cores;
+        api->setWorkThreads(n);
+        ses->feed("pbr = pmap(pbl,pbwork)"); // to start the threads
+        
+        tm.reset();
+        for(int i=0;i<PASSES;i++)
+            ses->feed("pbr = pmap(pbl,pbwork)");
+        sprintf(buf,"pmap, %d threads",n);
+        report("parallel",buf,(double)ITEMS*PASSES/tm.elapsed(),"items/s");
+        if(n==cores)
+            break;
+    }
+    api->setWorkThreads(0);
+}
@@ -0,0 +1,115 @@
+/**
+ * @file
+ * Register VM benchmark : runs the same user functions on the stack VM
+ * and on the register VM (see lana/regvm.h), reporting the number of
+ * instructions each executes and the time taken.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+#include "lana/flags.h"
+
+using namespace lana;
+
+static const char *setup[] = {
+    // arithmetic on locals in a while loop
+    "regarith = function(n)",
+    "    t = 0",
+    "    i = 0",
+    "    while i<n",
+    "        t = t+i*2-1",
+    "        i = i+1",
+    "    endwhile",
+    "    return t",
+    "end",
+    // recursion, so mostly function calls
+    "regfib = function(n)",
+    "    if n<2",
+    "        return n",
+    "    endif",
+    "    return regfib(n-1)+regfib(n-2)",
+    "end",
+    // reading and writing list items
+    "reglist = function(l,n)",
+    "    i = 0",
+    "    while i<n",
+    "        l[i] = l[i]+1",
+    "        i = i+1",
+    "    endwhile",
+    "    return l[0]",
+    "end",
+    // a for loop over a range
+    "regrange = function(n)",
+    "    t = 0",
+    "    for i in range(0,n)",
+    "        t = t+i",
+    "    endfor",
+    "    return t",
+    "end",
+    // method calls and properties
+    "regobj = create()",
+    "regobj.x = 0",
+    "regobj.inc = procedure(d)",
+    "    this.x = this.x+d",
+    "end",
+    "regmethods = function(o,n)",
+    "    for i in range(0,n)",
+    "        o.inc(1)",
+    "    endfor",
+    "    return o.x",
+    "end",
+    "reglistdata = list()",
+    "reglistfill = procedure(l,n)",
+    "    for i in range(0,n)",
+    "        l.push(i)",
+    "    endfor",
+    "end",
+    NULL
+};
+
+struct RegBench {
+    const char *what;
+    const char *line;
+};
+
+static RegBench benches[] = {
+    {"while loop arithmetic", "regres = regarith(1000000)"},
+    {"fib(24)", "regres = regfib(24)"},
+    {"list item read/write", "regres = reglist(reglistdata,1000000)"},
+    {"for over range", "regres = regrange(1000000)"},
+    {"method calls", "regres = regmethods(regobj,200000)"},
+    {NULL,NULL}
+};
+
+void benchRegisterVM(API *api,Session *ses){
+    int oldflags = api->setFlags(0);
+    for(const char **p=setup;*p;p++)
+        ses->feed(*p);
+    ses->feed("reglistfill(reglistdata,1000000)");
+
+    char what[128];
+    for(RegBench *b=benches;b->what;b++){
+        int ct[2];
+        double t[2];
+        for(int reg=0;reg<2;reg++){
+            api->setFlags(reg ? LOP_REGISTERVM : 0);
+            ses->feed(b->line); // once to warm up (and lower)
+            api->resetInstructionCount();
+            Timer tm;
+            ses->feed(b->line);
+            t[reg] = tm.elapsed();
+            ct[reg] = api->getInstructionCount();
+        }
+        sprintf(what,"%s, stack VM",b->what);
+        report("regvm",what,t[0]*1000.0,"ms");
+        report("regvm",what,ct[0],"instructions");
+        sprintf(what,"%s, register VM",b->what);
+        report("regvm",what,t[1]*1000.0,"ms");
+        report("regvm",what,ct[1],"instructions");
+    }
+
+    ses->feed("reglistdata = 0");
+    ses->feed("regobj = 0");
+    api->setFlags(oldflags);
+}
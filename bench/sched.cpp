@@ -0,0 +1,73 @@
+/**
+ * @file
+ * Scheduler benchmark : runs a few thousand small tasks on one thread,
+ * each a loop of a fixed length, and reports how many turns a second
+ * the scheduler manages, the longest single turn (which is what one
+ * runaway task can keep the others waiting for), and how long the
+ * whole lot takes compared with making the same calls one after the
+ * other.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+#include "lana/sched.h"
+
+using namespace lana;
+
+/// the number of tasks
+static const int TASKS = 4000;
+/// the number of times each task goes round its loop
+static const int ITERS = 2000;
+/// the instructions in a turn
+static const int QUANTUM = 500;
+
+void benchSched(API *api,Session *ses){
+    ses->feed("sbloop = function(n)");
+    ses->feed("    t = 0");
+    ses->feed("    for i in range(0,n)");
+    ses->feed("        t = t+i");
+    ses->feed("    endfor");
+    ses->feed("    return t");
+    ses->feed("end");
+
+    ses->feed("sball = function(k,n)");
+    ses->feed("    for j in range(0,k)");
+    ses->feed("        t = sbloop(n)");
+    ses->feed("    endfor");
+    ses->feed("    return t");
+    ses->feed("end");
+
+    char buf[64];
+    sprintf(buf,"sbr = sball(%d,%d)",TASKS,ITERS);
+    Timer tm;
+    ses->feed(buf);
+    double straight = tm.elapsed();
+    report("sched","calls one after the other",straight*1000.0,"ms");
+
+    Value arg;
+    arg.setInt(ITERS);
+    Value *fn = ses->getSesVar("sbloop");
+    Scheduler s(api,QUANTUM);
+    for(int i=0;i<TASKS;i++)
+        s.add(ses,fn,1,&arg);
+
+    int turns = 0;
+    double worst = 0;
+    tm.reset();
+    Timer turn;
+    for(;;){
+        turn.reset();
+        if(!s.step())
+            break;
+        double t = turn.elapsed();
+        if(t>worst)
+            worst = t;
+        turns++;
+    }
+    double sched = tm.elapsed();
+    report("sched","scheduled",sched*1000.0,"ms");
+    report("sched","turns",(double)turns/sched,"turns/s");
+    report("sched","longest turn",worst*1e6,"us");
+    report("sched","overhead",(sched/straight-1.0)*100.0,"%");
+}
@@ -0,0 +1,86 @@
+/**
+ * @file
+ * Sort benchmark : sorts a million ints and a million strings with
+ * the native List sort, comparing the specialised comparisons with
+ * the general one (forced by putting a single value of another type
+ * in the list). Also times a sort with a comparator written in Lana.
+ */
+
+#include "bench.h"
+#include "lana/list.h"
+
+using namespace lana;
+
+#define N 1000000
+#define NCMP 100000
+
+static List *makeList(API *api){
+    List *l = List::create(api);
+    l->incRefCt();
+    l->reserve(N+1);
+    return l;
+}
+
+static void freeList(List *l){
+    if(l->decRefCt())
+        delete l;
+}
+
+static void fillInts(List *l,int n){
+    srand(1);
+    for(int i=0;i<n;i++)
+        l->list->append()->setInt(rand());
+}
+
+static void fillStrs(List *l,int n){
+    char buf[32];
+    srand(1);
+    for(int i=0;i<n;i++){
+        sprintf(buf,"s%d",rand());
+        l->list->append()->setStrClone(buf);
+    }
+}
+
+static void timeSort(const char *what,List *l){
+    Timer t;
+    l->sort();
+    report("sort",what,t.elapsed(),"s");
+}
+
+void benchSort(API *api,Session *ses){
+    List *l;
+    
+    l = makeList(api);
+    fillInts(l,N);
+    timeSort("1M ints",l);
+    freeList(l);
+    
+    l = makeList(api);
+    fillInts(l,N);
+    l->list->append()->setStrClone("x"); // forces the general comparison
+    timeSort("1M ints, general comparison",l);
+    freeList(l);
+    
+    l = makeList(api);
+    fillStrs(l,N);
+    timeSort("1M strings",l);
+    freeList(l);
+    
+    l = makeList(api);
+    fillStrs(l,N);
+    l->list->append()->setInt(0); // forces the general comparison
+    timeSort("1M strings, general comparison",l);
+    freeList(l);
+    
+    // a comparator written in Lana, called back for every comparison
+    ses->feed("benchcmp = function(a,b)");
+    ses->feed("    return a-b");
+    ses->feed("end");
+    ses->feed("benchlist = list()");
+    l = ses->getSesVar("benchlist")->d.list;
+    fillInts(l,NCMP);
+    Timer t;
+    ses->feed("benchlist.sortcmp(benchcmp)");
+    report("sort","100k ints, Lana comparator",t.elapsed(),"s");
+    ses->feed("benchlist = 0");
+}
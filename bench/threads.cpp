@@ -0,0 +1,72 @@
+/**
+ * @file
+ * Thread benchmark : runs the same fixed amount of work - calls of a
+ * small global function which makes a list - in 1, 2, 4... threads at
+ * once, each attached to the API with a VM of its own, and reports the
+ * total calls per second. With nothing shared but the compiled code this
+ * should scale with the number of cores.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/api.h"
+
+using namespace lana;
+
+/// the number of calls made by each thread
+static const int CALLS = 100000;
+/// the most threads run at once
+static const int MAXTHREADS = 64;
+
+static void *benchThreadMain(void *p){
+    API *api = (API *)p;
+    api->attachThread();
+    Session *s = new Session(api);
+
+    CallHandle h = api->getFunction("$tbwork");
+    Value a;
+    for(int i=0;i<CALLS;i++){
+        a.setInt(i);
+        api->call(h,a);
+    }
+
+    delete s;
+    api->detachThread();
+    return NULL;
+}
+
+void benchThreads(API *api,Session *ses){
+    ses->feed("$tbwork = function(n)");
+    ses->feed("    l = list()");
+    ses->feed("    l.push(n)");
+    ses->feed("    l.push(n*2)");
+    ses->feed("    return l[0]+l[1]");
+    ses->feed("end");
+
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(cores<1)
+        cores=1;
+    if(cores>MAXTHREADS)
+        cores=MAXTHREADS;
+
+    pthread_t threads[MAXTHREADS];
+    for(int n=1;;n*=2){
+        if(n>cores)
+            n=cores;
+        Timer tm;
+        for(int i=0;i<n;i++)
+            pthread_create(threads+i,NULL,benchThreadMain,api);
+        for(int i=0;i<n;i++)
+            pthread_join(threads[i],NULL);
+        double t = tm.elapsed();
+
+        char buf[64];
+        sprintf(buf,"%d threads",n);
+        report("threads",buf,(double)CALLS*n/t,"calls/s");
+        if(n==cores)
+            break;
+    }
+}
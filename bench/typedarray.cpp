@@ -0,0 +1,116 @@
+/**
+ * @file
+ * Typed array benchmark : sum, dot product and axpy over a million
+ * floats, done with loops in Lana over a List, and with the typed
+ * array methods using each available set of kernels.
+ */
+
+#include "bench.h"
+#include "lana/session.h"
+#include "lana/list.h"
+#include "lana/typedarray.h"
+
+using namespace lana;
+
+#define N 1000000
+#define REPS 100
+
+static const char *setup[] = {
+    "benchsum = function(l)",
+    "    t = 0.0",
+    "    for x in l",
+    "        t = t+x",
+    "    endfor",
+    "    return t",
+    "end",
+    "benchdot = function(a,b)",
+    "    t = 0.0",
+    "    for i in range(0,size(a))",
+    "        t = t+a[i]*b[i]",
+    "    endfor",
+    "    return t",
+    "end",
+    "benchaxpy = procedure(y,alpha,x)",
+    "    for i in range(0,size(y))",
+    "        y[i] = y[i]+alpha*x[i]",
+    "    endfor",
+    "end",
+    "benchsumrep = procedure(a,n)",
+    "    for i in range(0,n)",
+    "        r = a.sum()",
+    "    endfor",
+    "end",
+    "benchdotrep = procedure(a,b,n)",
+    "    for i in range(0,n)",
+    "        r = a.dot(b)",
+    "    endfor",
+    "end",
+    "benchaxpyrep = procedure(y,x,n)",
+    "    for i in range(0,n)",
+    "        y.axpy(0.5,x)",
+    "    endfor",
+    "end",
+    "benchlist = list()",
+    "benchlist2 = list()",
+    "benchta = float32array(0)",
+    "benchta2 = float32array(0)",
+    NULL
+};
+
+static void fill(List *l){
+    l->reserve(N);
+    for(int i=0;i<N;i++)
+        l->list->append()->setFloat((float)(i%100)*0.01f);
+}
+
+static void fill(TypedArray *t){
+    t->resize(N);
+    for(int i=0;i<N;i++)
+        t->data<float>()[i] = (float)(i%100)*0.01f;
+}
+
+/// time a line fed to the session, reporting the time per repetition
+static void timeLine(Session *ses,const char *what,const char *line,int reps){
+    Timer t;
+    ses->feed(line);
+    report("typedarray",what,t.elapsed()*1000.0/reps,"ms");
+}
+
+void benchTypedArray(API *api,Session *ses){
+    for(const char **p=setup;*p;p++)
+        ses->feed(*p);
+    fill(ses->getSesVar("benchlist")->d.list);
+    fill(ses->getSesVar("benchlist2")->d.list);
+    fill((TypedArray *)ses->getSesVar("benchta")->d.o);
+    fill((TypedArray *)ses->getSesVar("benchta2")->d.o);
+
+    timeLine(ses,"list: sum loop","benchr = benchsum(benchlist)",1);
+    timeLine(ses,"list: dot loop","benchr = benchdot(benchlist,benchlist2)",1);
+    timeLine(ses,"list: axpy loop","benchaxpy(benchlist,0.5,benchlist2)",1);
+    timeLine(ses,"float32array: sum loop","benchr = benchsum(benchta)",1);
+
+    const char *names[] = {"scalar","sse2","avx2"};
+    const SimdKernelSet *prev = simd::kernels();
+    char buf[64];
+    char line[64];
+
+    for(int i=0;i<3;i++){
+        if(!simd::select(names[i]))
+            continue;
+        sprintf(buf,"float32array: sum (%s)",names[i]);
+        sprintf(line,"benchsumrep(benchta,%d)",REPS);
+        timeLine(ses,buf,line,REPS);
+        sprintf(buf,"float32array: dot (%s)",names[i]);
+        sprintf(line,"benchdotrep(benchta,benchta2,%d)",REPS);
+        timeLine(ses,buf,line,REPS);
+        sprintf(buf,"float32array: axpy (%s)",names[i]);
+        sprintf(line,"benchaxpyrep(benchta,benchta2,%d)",REPS);
+        timeLine(ses,buf,line,REPS);
+    }
+    simd::select(prev->name);
+
+    ses->feed("benchlist = 0");
+    ses->feed("benchlist2 = 0");
+    ses->feed("benchta = 0");
+    ses->feed("benchta2 = 0");
+}
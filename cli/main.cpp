@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <ctype.h>
 
@@ -10,6 +11,7 @@
 
 #include "lana/api.h"
 #include "lana/debug.h"
+#include "lana/prefork.h"
 #include "../tests/asserter.h"
 
 
@@ -33,12 +35,32 @@ int main(int argc,char *argv[]) {
     
     int debflags = 0;
     bool interactive=false;
+    // pre-forking server mode - see lana/prefork.h
+    const char *servePath = NULL;
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    bool immortal = false;
+    lana::PreforkServer server(api,ses);
     opterr=0;
-    while((c=getopt(argc,argv,"dsegtr"))!=-1){
+    while((c=getopt(argc,argv,"dsegtrS:w:iR:M:"))!=-1){
         switch(c){
         case 'r':
             interactive = true;
             break;
+        case 'S':
+            servePath = optarg;
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        case 'i':
+            immortal = true;
+            break;
+        case 'R':
+            server.maxRequests = atoi(optarg);
+            break;
+        case 'M':
+            server.maxMemoryKB = atoi(optarg);
+            break;
         case 'd':
             debflags |= LDEBUG_DUMP;
             break;
@@ -55,7 +77,7 @@ int main(int argc,char *argv[]) {
             debflags |= LDEBUG_SRCDATA;
             break;
         case '?':
-            if (optopt == 'c')
+            if (strchr("SwRM",optopt))
                 fprintf (stderr, "Option -%c requires an argument.\n", optopt);
             else if (isprint (optopt))
                 fprintf (stderr, "Unknown option `-%c'.\n", optopt);
@@ -64,7 +86,15 @@ int main(int argc,char *argv[]) {
                          "Unknown option character `\\x%x'.\n",
                          optopt);
             fprintf(stderr,"usage: lana [-d][-s][-e][-t][-g][-r] [file.l]\n");
+            fprintf(stderr,"       lana -S socket [-w n][-i][-R n][-M kb] file.l\n");
             fprintf(stderr,"   -r : read the file then go into interactive mode\n");
+            fprintf(stderr,"   -S : read the file then answer requests to call its\n");
+            fprintf(stderr,"        functions on a Unix socket, in worker processes\n");
+            fprintf(stderr,"   -w : the number of workers (default: one per CPU)\n");
+            fprintf(stderr,"   -i : make the heap immortal before forking the workers\n");
+            fprintf(stderr,"   -R : restart a worker after this many requests\n");
+            fprintf(stderr,"   -M : restart a worker once this many kB of its memory\n");
+            fprintf(stderr,"        are its own\n");
             fprintf(stderr,"   -d : dump bytecode after each compilation\n");
             fprintf(stderr,"   -s : show lines being fed into compiler\n");
             fprintf(stderr,"   -e : show bytecode emission\n");
@@ -84,10 +114,25 @@ int main(int argc,char *argv[]) {
             ses->feedFile(argv[optind]);
         } catch(lana::Exception &e) {
             printf("error: %s\n",e.what());
+            if(servePath)
+                return 1;
         }
     }
     
-    if(argc<=optind || interactive){
+    if(servePath){
+        try {
+            int fd = lana::PreforkServer::listenUnix(servePath);
+            if(immortal)
+                api->makeHeapImmortal(ses);
+            printf("serving on %s with %d workers\n",servePath,workers);
+            server.run(fd,workers);
+            close(fd);
+            unlink(servePath);
+        } catch(lana::Exception &e) {
+            printf("error: %s\n",e.what());
+            return 1;
+        }
+    } else if(argc<=optind || interactive){
         for(;;){
             char *line;
             const char *prompt = ses->awaitingInput() ? " > " : ". ";
@@ -0,0 +1,584 @@
+/** @file
+ * Actors, their mailboxes and the messages they send (see actor.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include <map>
+
+#include "api.h"
+#include "language.h"
+#include "vm.h"
+#include "vars.h"
+#include "object.h"
+#include "list.h"
+#include "dict.h"
+#include "workpool.h"
+#include "actor.h"
+
+namespace lana {
+
+/// the lists, dictionaries and objects a message has packed so far,
+/// and the items they were packed as
+class PackedSet {
+public:
+    /// the item an object was packed as, or -1
+    int find(GarbageCollected *o){
+        std::map<GarbageCollected *,int>::iterator i = items.find(o);
+        return i==items.end() ? -1 : i->second;
+    }
+    void add(GarbageCollected *o,int item){
+        items[o] = item;
+    }
+private:
+    std::map<GarbageCollected *,int> items;
+};
+
+/// the variables of a session, copied by its thread for an actor's
+/// session (see WorkPool::copyAcross() for what's copied)
+class SessionCopy {
+public:
+    SessionCopy(Session *s){
+        n = 0;
+        names = NULL;
+        slots = NULL;
+        vals = NULL;
+        if(!s)
+            return;
+
+        Vars *v = s->vars;
+        IteratorPtr<int> iterator(v->createIterator());
+        for(iterator->first();!iterator->isDone();iterator->next())
+            n++;
+        names = new int[n];
+        slots = new int[n];
+        vals = new Value[n];
+        int i=0;
+        for(iterator->first();!iterator->isDone();iterator->next(),i++){
+            slots[i] = iterator->current();
+            names[i] = v->getName(slots[i]);
+            WorkPool::copyAcross(vals+i,v->get(slots[i]));
+        }
+    }
+
+    ~SessionCopy(){
+        delete [] names;
+        delete [] slots;
+        delete [] vals;
+    }
+
+    /// make the variables in another session, in the same slots, as
+    /// functions refer to them by slot
+    void restore(Session *s){
+        Vars *v = s->vars;
+        for(int i=0;i<n;i++){
+            int j = v->find(names[i]);
+            if(j<0)
+                j = v->create(names[i]);
+            if(j!=slots[i])
+                throw Exception("session variables can't be copied to an actor");
+            *v->get(j) = vals[i];
+        }
+    }
+
+private:
+    int n;
+    int *names;
+    int *slots;
+    Value *vals;
+};
+
+/*
+ * Messages
+ */
+
+Message::Message(){
+    items = NULL;
+    count = size = 0;
+    next = NULL;
+}
+
+Message::Message(Value *v){
+    items = NULL;
+    count = size = 0;
+    next = NULL;
+    PackedSet seen;
+    try {
+        pack(v,&seen);
+    } catch(...) {
+        clear();
+        throw;
+    }
+}
+
+Message::~Message(){
+    clear();
+}
+
+void Message::clear(){
+    for(int i=0;i<count;i++){
+        if(items[i].kind==MK_STRING)
+            free(items[i].s);
+    }
+    delete [] items;
+    items = NULL;
+    count = 0;
+}
+
+int Message::add(Kind k,int n){
+    if(count==size){
+        size = size ? size*2 : 8;
+        Item *p = new Item[size];
+        for(int i=0;i<count;i++)
+            p[i] = items[i];
+        delete [] items;
+        items = p;
+    }
+    Item *it = items+count;
+    it->kind = k;
+    it->n = n;
+    it->s = NULL;
+    return count++;
+}
+
+void Message::pack(Value *v,PackedSet *seen){
+    switch(v->getAllocType()){
+    case Unmanaged:{
+        // add() may move the items, so it must be called first
+        int i = add(MK_VALUE,0);
+        items[i].v = *v;
+        return;
+    }
+    case SimpleMalloc:
+        if(v->isStr()){
+            if(*(refct_t *)v->d.s==IMMORTAL_REFCT){
+                // a frozen string, which nothing counts
+                int i = add(MK_VALUE,0);
+                items[i].v = *v;
+                return;
+            }
+            int i = add(MK_STRING,0);
+            items[i].s = strdup(v->getStr());
+            return;
+        }
+        break;
+    case SimpleNew:
+    case Complex:{
+        GarbageCollected *gc = v->d.gc;
+        if(gc->frozen){
+            // no thread counts references to it or changes it, so it
+            // can go as it is
+            int i = add(MK_VALUE,0);
+            items[i].v = *v;
+            return;
+        }
+        int prev = seen->find(gc);
+        if(prev>=0){
+            add(MK_SEEN,prev);
+            return;
+        }
+        if(v->type==Types::vtList){
+            List *l = v->d.list;
+            int n = l->list->count();
+            seen->add(gc,add(MK_LIST,n));
+            for(int i=0;i<n;i++)
+                pack(l->get(i),seen);
+            return;
+        }
+        if(v->type==Types::vtDictionary){
+            Dict *d = v->d.dict;
+            seen->add(gc,add(MK_DICT,d->getSize()));
+            IteratorPtr<Value *> iterator(d->createKeyIterator(false));
+            for(iterator->first();!iterator->isDone();iterator->next()){
+                Value *k = iterator->current();
+                pack(k,seen);
+                pack(d->get(k),seen);
+            }
+            return;
+        }
+        // only plain objects - native ones have more to them than
+        // their properties
+        if(v->type==Types::vtObject && !v->d.o->nativeProps){
+            Object *o = v->d.o;
+            seen->add(gc,add(MK_OBJECT,o->properties.used));
+            Value parent;
+            if(o->getSuper())
+                parent.setObj(o->getSuper());
+            pack(&parent,seen);
+            IteratorPtr<u32> iterator(o->properties.createKeyIterator());
+            for(iterator->first();!iterator->isDone();iterator->next()){
+                u32 id = iterator->current();
+                add(MK_PROP,(int)id);
+                pack(o->properties.lookup(id),seen);
+            }
+            return;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    throw Exception(NULL).set("a %s can't be sent to another thread",
+                              v->type->getName());
+}
+
+void Message::unpack(API *api,Value *out){
+    Value *made = new Value[count];
+    int pos=0;
+    try {
+        unpack(api,out,&pos,made);
+    } catch(...) {
+        delete [] made;
+        throw;
+    }
+    delete [] made;
+}
+
+void Message::unpack(API *api,Value *out,int *pos,Value *made){
+    int idx = (*pos)++;
+    Item *it = items+idx;
+    int n = it->n;
+
+    switch(it->kind){
+    case MK_VALUE:
+        *out = it->v;
+        break;
+    case MK_STRING:
+        out->setStrClone(it->s);
+        break;
+    case MK_SEEN:
+        *out = made[n];
+        break;
+    case MK_PROP:
+        throw Exception("bad message");
+    case MK_LIST:{
+        List *l = List::create(api);
+        out->setObj(l);
+        made[idx] = *out;
+        l->reserve(n);
+        for(int i=0;i<n;i++){
+            Value v;
+            unpack(api,&v,pos,made);
+            *l->list->append() = v;
+        }
+        break;
+    }
+    case MK_DICT:{
+        Dict *d = Dict::create(api);
+        out->setObj(d);
+        made[idx] = *out;
+        d->reserve(n);
+        for(int i=0;i<n;i++){
+            Value k,v;
+            unpack(api,&k,pos,made);
+            unpack(api,&v,pos,made);
+            d->set(&k,&v);
+        }
+        break;
+    }
+    case MK_OBJECT:{
+        Object *o = new Object(api);
+        out->setObj(o);
+        made[idx] = *out;
+        Value parent;
+        unpack(api,&parent,pos,made);
+        if(parent.type==Types::vtObject)
+            o->makeCloneOf(parent.d.o);
+        for(int i=0;i<n;i++){
+            int id = items[(*pos)++].n;
+            Value v;
+            unpack(api,&v,pos,made);
+            o->setprop(id,&v);
+        }
+        break;
+    }
+    }
+}
+
+/*
+ * Mailboxes. The queue is Vyukov's: senders swap themselves in at the
+ * head and then link the previous head to themselves, and the receiver
+ * follows the links from the tail. The stub keeps it from ever being
+ * empty, so there's no special case for the first message.
+ */
+
+Mailbox::Mailbox(){
+    head = tail = &stub;
+    waiting = 0;
+    closed = false;
+    pthread_mutex_init(&m,NULL);
+    pthread_cond_init(&c,NULL);
+}
+
+Mailbox::~Mailbox(){
+    while(Message *msg = pop())
+        delete msg;
+    pthread_cond_destroy(&c);
+    pthread_mutex_destroy(&m);
+}
+
+void Mailbox::push(Message *msg){
+    msg->next = NULL;
+    Message *prev = __atomic_exchange_n(&head,msg,__ATOMIC_SEQ_CST);
+    // until this is done the receiver can't see msg, or any after it
+    __atomic_store_n(&prev->next,msg,__ATOMIC_SEQ_CST);
+
+    if(msg!=&stub && __atomic_load_n(&waiting,__ATOMIC_SEQ_CST)){
+        pthread_mutex_lock(&m);
+        pthread_cond_signal(&c);
+        pthread_mutex_unlock(&m);
+    }
+}
+
+Message *Mailbox::pop(){
+    Message *t = tail;
+    Message *n = __atomic_load_n(&t->next,__ATOMIC_SEQ_CST);
+    if(t==&stub){
+        if(!n)
+            return NULL;
+        tail = t = n;
+        n = __atomic_load_n(&t->next,__ATOMIC_SEQ_CST);
+    }
+    if(n){
+        tail = n;
+        return t;
+    }
+    // t is the last message; if a sender is halfway through adding
+    // another, wait for it to finish
+    if(t!=__atomic_load_n(&head,__ATOMIC_SEQ_CST))
+        return NULL;
+    // put the stub back behind it, so that it can be taken
+    push(&stub);
+    n = __atomic_load_n(&t->next,__ATOMIC_SEQ_CST);
+    if(n){
+        tail = n;
+        return t;
+    }
+    return NULL;
+}
+
+Message *Mailbox::wait(int ms){
+    Message *msg = pop();
+    if(msg)
+        return msg;
+
+    struct timespec deadline;
+    if(ms>=0){
+        struct timeval now;
+        gettimeofday(&now,NULL);
+        long long ns = (long long)now.tv_usec*1000 + (long long)(ms%1000)*1000000;
+        deadline.tv_sec = now.tv_sec + ms/1000 + (time_t)(ns/1000000000);
+        deadline.tv_nsec = (long)(ns%1000000000);
+    }
+
+    pthread_mutex_lock(&m);
+    for(;;){
+        // a sender which adds a message after this will see it, and wake us
+        __atomic_store_n(&waiting,1,__ATOMIC_SEQ_CST);
+        msg = pop();
+        if(msg || closed)
+            break;
+        if(ms<0)
+            pthread_cond_wait(&c,&m);
+        else if(pthread_cond_timedwait(&c,&m,&deadline)==ETIMEDOUT){
+            msg = pop();
+            break;
+        }
+    }
+    __atomic_store_n(&waiting,0,__ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&m);
+    return msg;
+}
+
+void Mailbox::close(){
+    pthread_mutex_lock(&m);
+    closed = true;
+    pthread_cond_broadcast(&c);
+    pthread_mutex_unlock(&m);
+}
+
+/*
+ * The actor system
+ */
+
+__thread ActorSystem::Actor *ActorSystem::currentActor = NULL;
+
+ActorSystem::ActorSystem(API *a){
+    api = a;
+    for(int i=0;i<MAXACTORS;i++)
+        actors[i] = NULL;
+
+    // the creating thread is actor 0, which isn't started or joined
+    Actor *z = new Actor;
+    z->id = 0;
+    z->sys = this;
+    z->joined = true;
+    z->finished = 0;
+    z->arg = NULL;
+    z->vars = NULL;
+    z->result = NULL;
+    z->error = NULL;
+    actors[0] = z;
+    count = 1;
+    currentActor = z;
+}
+
+ActorSystem::~ActorSystem(){
+    if(currentActor && currentActor->sys==this)
+        currentActor = NULL;
+    // actors waiting for messages will give up
+    for(int i=1;i<count;i++)
+        actors[i]->mailbox.close();
+    for(int i=0;i<count;i++){
+        Actor *a = actors[i];
+        if(!a->joined)
+            pthread_join(a->thread,NULL);
+        delete a->arg;
+        delete a->vars;
+        delete a->result;
+        free(a->error);
+        delete a;
+    }
+}
+
+void *ActorSystem::threadMain(void *p){
+    Actor *a = (Actor *)p;
+    API *api = a->sys->api;
+    currentActor = a;
+
+    api->lana->attachThread();
+    Session *ses = new Session(api);
+    try {
+        a->vars->restore(ses);
+        Value arg,res;
+        a->arg->unpack(api,&arg);
+        api->getVM()->callWith(ses,&a->fn,1,&arg,&res);
+        a->result = new Message(&res);
+    } catch(std::exception &e) {
+        a->error = strdup(e.what());
+    }
+    // these hold values which now belong to this thread
+    delete a->vars;
+    a->vars = NULL;
+    delete a->arg;
+    a->arg = NULL;
+    delete ses;
+    api->lana->detachThread();
+
+    __atomic_store_n(&a->finished,1,__ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+int ActorSystem::spawn(Value *fn,Value *arg,Session *ses){
+    if(fn->type!=Types::vtFunction && fn->type!=Types::vtNativeFunctionRef)
+        throw Exception("an actor needs a function to run");
+
+    Message *msg = new Message(arg);
+    SessionCopy *vars = new SessionCopy(ses);
+
+    MutexLock l(lock);
+    if(count>=MAXACTORS){
+        delete msg;
+        delete vars;
+        throw Exception("too many actors");
+    }
+    Actor *a = new Actor;
+    a->id = count;
+    a->sys = this;
+    a->joined = false;
+    a->finished = 0;
+    a->fn = *fn;
+    a->arg = msg;
+    a->vars = vars;
+    a->result = NULL;
+    a->error = NULL;
+    if(pthread_create(&a->thread,NULL,threadMain,a)){
+        delete msg;
+        delete vars;
+        delete a;
+        throw Exception("cannot start a thread for an actor");
+    }
+    // senders look actors up without the lock
+    __atomic_store_n(&actors[count],a,__ATOMIC_RELEASE);
+    return count++;
+}
+
+ActorSystem::Actor *ActorSystem::get(int id){
+    if(id<0 || id>=MAXACTORS)
+        return NULL;
+    return __atomic_load_n(&actors[id],__ATOMIC_ACQUIRE);
+}
+
+ActorSystem::Actor *ActorSystem::current(){
+    if(!currentActor || currentActor->sys!=this)
+        throw Exception("this thread isn't an actor");
+    return currentActor;
+}
+
+bool ActorSystem::send(int id,Value *v){
+    Actor *a = get(id);
+    if(!a)
+        throw Exception(NULL).set("there is no actor %d",id);
+    if(__atomic_load_n(&a->finished,__ATOMIC_SEQ_CST))
+        return false;
+    a->mailbox.push(new Message(v));
+    return true;
+}
+
+bool ActorSystem::receive(Value *v,int ms){
+    Actor *a = current();
+    Message *msg = a->mailbox.wait(ms);
+    if(!msg){
+        if(ms<0)
+            throw Exception("no more messages will come, as the API is being deleted");
+        return false;
+    }
+    try {
+        msg->unpack(api,v);
+    } catch(...) {
+        delete msg;
+        throw;
+    }
+    delete msg;
+    return true;
+}
+
+int ActorSystem::self(){
+    return current()->id;
+}
+
+void ActorSystem::join(int id,Value *result){
+    Actor *a = get(id);
+    if(!a)
+        throw Exception(NULL).set("there is no actor %d",id);
+    if(a==currentActor)
+        throw Exception("an actor can't wait for itself");
+    {
+        MutexLock l(lock);
+        if(a->joined)
+            throw Exception(NULL).set("actor %d has already been waited for",id);
+        a->joined = true;
+    }
+    pthread_join(a->thread,NULL);
+
+    if(a->error)
+        throw Exception(NULL).set("actor %d failed: %s",id,a->error);
+    if(a->result){
+        Message *r = a->result;
+        a->result = NULL;
+        try {
+            r->unpack(api,result);
+        } catch(...) {
+            delete r;
+            throw;
+        }
+        delete r;
+    } else
+        result->clr();
+}
+
+}
@@ -0,0 +1,179 @@
+/**
+ * @file
+ * Actors: threads which share nothing they can change, and talk by
+ * sending each other messages.
+ *
+ * An actor is a thread attached to the API (see thread.h) with a session
+ * of its own, which runs a function and then finishes. It has a mailbox,
+ * which any thread can send messages to without taking a lock, and only
+ * the actor takes them from. The API's own thread is actor 0, so that
+ * it can send and receive too.
+ *
+ * A message is a copy of a value, packed up by the sender into memory
+ * no thread owns and unpacked by the receiver into values of its own.
+ * Numbers, booleans, functions and frozen values (see Object::freeze())
+ * go as they are, since nothing counts references to them or changes
+ * them; other strings are copied, and lists, dictionaries and objects
+ * (even immortal ones, which can still be changed) are copied deeply,
+ * keeping any sharing and cycles within them. Anything else, such as a typed array, can't be sent.
+ */
+
+#ifndef __ACTOR_H
+#define __ACTOR_H
+
+#include "thread.h"
+#include "value.h"
+
+namespace lana {
+
+/// a value packed up to be sent to another thread
+
+class Message {
+    friend class Mailbox;
+public:
+    /// pack a value, which belongs to the calling thread
+    Message(Value *v);
+    ~Message();
+
+    /// unpack the value into one belonging to the calling thread
+    void unpack(class API *api,Value *out);
+
+private:
+    /// an empty message, for a mailbox's stub
+    Message();
+
+    /// what each item is
+    enum Kind {
+        MK_VALUE,   //!< a value which can go as it is, in v
+        MK_STRING,  //!< a string, in s
+        MK_LIST,    //!< a list of n items, which follow
+        MK_DICT,    //!< a dictionary of n keys, each followed by its value
+        MK_OBJECT,  //!< an object with n properties; its parent follows,
+                    //!< then an MK_PROP for each property
+        MK_PROP,    //!< the property with ID n, whose value follows
+        MK_SEEN     //!< a list, dictionary or object already packed, as item n
+    };
+
+    struct Item {
+        Kind kind;
+        int n;
+        Value v;
+        char *s;
+    };
+
+    /// add an item, returning its index
+    int add(Kind k,int n);
+    /// free the items
+    void clear();
+    /// pack a value and everything it refers to
+    void pack(Value *v,class PackedSet *seen);
+    /// unpack the item at pos, moving pos past it and what it contains
+    void unpack(class API *api,Value *out,int *pos,Value *made);
+
+    Item *items;
+    int count,size;
+
+    Message *next; //!< the next message in a mailbox
+};
+
+/// a queue of messages with many senders and one receiver. Sending
+/// doesn't take a lock; the receiver only does so to wait.
+
+class Mailbox {
+public:
+    Mailbox();
+    /// delete any messages left
+    ~Mailbox();
+
+    /// add a message, which now belongs to the mailbox
+    void push(Message *m);
+    /// take the oldest message, or NULL if there isn't one. Only
+    /// the mailbox's owner can do this.
+    Message *pop();
+    /// take the oldest message, waiting up to ms milliseconds for one
+    /// (or for ever, if ms is negative). Returns NULL if none comes, or
+    /// the mailbox is closed.
+    Message *wait(int ms);
+    /// wake the receiver and stop it waiting again
+    void close();
+
+private:
+    Message *head;   //!< the newest message, where senders add
+    Message *tail;   //!< the oldest, where the receiver takes
+    Message stub;    //!< always in the queue, so it's never empty
+
+    pthread_mutex_t m;  //!< held to wait, or to wake a waiting receiver
+    pthread_cond_t c;
+    int waiting;        //!< set while the receiver waits
+    bool closed;
+};
+
+/// the actors of an API, and the functions to start them and talk
+/// to them
+
+class ActorSystem {
+public:
+    /// make the actor system, calling the creating thread actor 0
+    ActorSystem(class API *a);
+    /// close all the mailboxes and wait for every actor to finish
+    ~ActorSystem();
+
+    /// the most actors there can be, including those which have finished
+    static const int MAXACTORS = 4096;
+
+    /// start an actor, which calls fn with a copy of arg in a new thread
+    /// and finishes when it returns. The session it runs in gets copies
+    /// of what WorkPool::copyAcross() can copy of the variables of ses,
+    /// so that functions defined there can be called. Returns the new
+    /// actor's ID.
+    int spawn(Value *fn,Value *arg,class Session *ses);
+
+    /// send a copy of a value to an actor, returning false if it's
+    /// finished (in which case nothing is sent)
+    bool send(int id,Value *v);
+
+    /// receive a message sent to the calling thread's actor into v,
+    /// waiting up to ms milliseconds for one, or for ever if ms is
+    /// negative. Returns false if none came.
+    bool receive(Value *v,int ms=-1);
+
+    /// get the ID of the calling thread's actor
+    int self();
+
+    /// wait for an actor to finish, and copy what its function
+    /// returned into result. If it failed, its error is thrown.
+    void join(int id,Value *result);
+
+private:
+    struct Actor {
+        int id;
+        ActorSystem *sys;
+        pthread_t thread;
+        bool joined;        //!< set when join() has been called
+        volatile int finished; //!< set when it has returned
+        Mailbox mailbox;
+        Value fn;
+        Message *arg;       //!< its argument, until it's started
+        class SessionCopy *vars; //!< its session's variables, until then
+        Message *result;    //!< what it returned, until it's joined
+        char *error;        //!< or why it failed
+    };
+
+    /// an actor's thread
+    static void *threadMain(void *a);
+    /// get the calling thread's actor, throwing if it isn't one
+    Actor *current();
+    /// get an actor by ID
+    Actor *get(int id);
+    /// the calling thread's actor, if it's one
+    static __thread Actor *currentActor;
+
+    class API *api;
+    Mutex lock;      //!< held to start or join actors
+    int count;       //!< the number of actors started
+    Actor *actors[MAXACTORS];
+};
+
+}
+
+#endif /* __ACTOR_H */
@@ -2,8 +2,13 @@
 #include "vm.h"
 #include "iterobj.h"
 #include "api.h"
+#include "workpool.h"
+#include "actor.h"
+#include "session.h"
+#include "vars.h"
 
 #include <stdio.h>
+#include <unistd.h>
 
 using namespace lana;
 
@@ -20,9 +25,11 @@ API::API(){
     apiOpen = true;
     
     new Language(this); // this->lana = returned value inside this ctor.
-    vm = lana->vm;
     setDebug(LDEBUG_SRCDATA);
     prefix="";
+    workPool=NULL;
+    workThreads=0;
+    actors = new ActorSystem(this);
     
     // register core library - see libcore.cpp
     coreLib=registerCoreHost(this,lana);
@@ -30,7 +37,11 @@ API::API(){
 }
 
 API::~API(){
-    cycle->detect();
+    // actors still running need the work pool and everything else
+    delete actors;
+    if(workPool)
+        delete workPool;
+    getCycleDetector()->detect();
     delete coreLib;
     delete lana;
     apiOpen = false;
@@ -42,11 +53,139 @@ const char *API::getVersion(){
     
 
 Value *API::getTempValue(){
-  return vm->cvb.alloc();
+  return getVM()->cvb.alloc();
 }
 
 void API::error(const char *s){
-    vm->error(s);
+    getVM()->error(s);
+}
+
+VirtualMachine *API::getVM(){
+    VirtualMachine *vm = lana->getVM();
+    if(!vm)
+        throw Exception("this thread is not attached to the API");
+    return vm;
+}
+
+CycleDetector *API::getCycleDetector(){
+    return &getVM()->cycle;
+}
+
+void API::attachThread(){
+    lana->attachThread();
+}
+
+void API::detachThread(){
+    lana->detachThread();
+}
+
+int API::getThreadCount(){
+    return lana->threads;
+}
+
+void API::setWorkThreads(int n){
+    MutexLock l(lana->lock);
+    workThreads = n<0 ? 0 : n;
+    // it's started again with the new number when it's next needed
+    WorkPool *old = workPool;
+    workPool = NULL;
+    // its threads take the lock to detach
+    l.release();
+    if(old)
+        delete old;
+}
+
+void API::freeze(Value *v){
+    switch(v->getAllocType()){
+    case Unmanaged:
+        return;
+    case SimpleMalloc:
+        if(v->isStr()){
+            lana->makeStringImmortal(v->d.s);
+            return;
+        }
+        break;
+    case Complex:
+        if(v->type==Types::vtObject || v->type==Types::vtList ||
+           v->type==Types::vtDictionary){
+            v->d.o->freeze();
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    throw Exception(NULL).set("a %s can't be frozen",v->type->getName());
+}
+
+bool API::isFrozen(Value *v){
+    switch(v->getAllocType()){
+    case Unmanaged:
+        return true;
+    case SimpleMalloc:
+        return v->isStr() && *(refct_t *)v->d.s==IMMORTAL_REFCT;
+    case SimpleNew:
+    case Complex:
+        return v->d.gc->frozen;
+    default:
+        return false;
+    }
+}
+
+/// make the strings an iterator's values refer to immortal
+static void makeStringsImmortal(Language *lana,Iterator<Value *> *iterator){
+    if(!iterator)
+        return;
+    for(iterator->first();!iterator->isDone();iterator->next()){
+        Value *v = iterator->current();
+        if(v->getAllocType()==SimpleMalloc && v->isStr())
+            lana->makeStringImmortal(v->d.s);
+    }
+    delete iterator;
+}
+
+/// make the strings in a set of variables immortal
+static void makeStringsImmortal(Language *lana,Vars *vars){
+    IteratorPtr<int> iterator(vars->createIterator());
+    for(iterator->first();!iterator->isDone();iterator->next()){
+        Value *v = vars->get(iterator->current());
+        if(v->getAllocType()==SimpleMalloc && v->isStr())
+            lana->makeStringImmortal(v->d.s);
+    }
+}
+
+int API::makeHeapImmortal(Session *ses){
+    if(lana->isThreaded())
+        throw Exception("cannot make the heap immortal while threads are running code");
+    CycleDetector *cycle = getCycleDetector();
+    // don't keep garbage for ever
+    cycle->detect();
+
+    GCList list;
+    cycle->takeAll(list);
+    int n=0;
+    for(GarbageCollected *p=list.head();p;p=list.next(p),n++){
+        p->immortal = true;
+        p->gc_refs = 0; // so that it's never taken for a zombie
+        makeStringsImmortal(lana,p->createValueIterator());
+        makeStringsImmortal(lana,p->createKeyIterator(true));
+    }
+
+    makeStringsImmortal(lana,lana->globs);
+    if(ses)
+        makeStringsImmortal(lana,ses->vars);
+    return n;
+}
+
+WorkPool *API::getWorkPool(){
+    MutexLock l(lana->lock);
+    if(!workPool){
+        int n = workThreads;
+        if(!n)
+            n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        workPool = new WorkPool(this,n);
+    }
+    return workPool;
 }
 
 void API::clearGlobals(){
@@ -54,6 +193,7 @@ void API::clearGlobals(){
 }
 
 Value *API::findGlobal(const char *name){
+    MutexLock l(lana->lock);
     int id = lana->globs->find(name);
     if(id<0)
         return NULL;
@@ -61,6 +201,7 @@ Value *API::findGlobal(const char *name){
 }
 
 Value *API::findOrCreateGlobal(const char *name){
+    MutexLock l(lana->lock);
     // does this name exist? If not, make it. Get the
     // descriptor index for the name constant.
     int desc = lana->consts->findOrCreateString(name);
@@ -73,6 +214,55 @@ Value *API::findOrCreateGlobal(const char *name){
     return lana->globs->get(id);
 }
 
+CallHandle API::getFunction(const char *name,Session *ses){
+    MutexLock l(lana->lock);
+    CallHandle h;
+    h.ses = ses;
+    int desc = lana->consts->findOrCreateString(name);
+    if(ses)
+        h.id = ses->findOrCreateSesVar(desc);
+    else {
+        h.id = lana->globs->find(desc);
+        if(h.id<0)
+            h.id = lana->globs->create(desc);
+    }
+    return h;
+}
+
+void API::call(CallHandle h,int argc,Value *args,Value *result){
+    lana->setValueConsts();
+    // the variable is looked up every time, as variables can move
+    Value *fn = h.ses ? h.ses->getSesVar(h.id) : lana->globs->get(h.id);
+    getVM()->callWith(h.ses,fn,argc,args,result);
+}
+
+Value API::call(CallHandle h){
+    Value r;
+    call(h,0,NULL,&r);
+    return r;
+}
+
+Value API::call(CallHandle h,const Value &a){
+    Value args[1] = {a};
+    Value r;
+    call(h,1,args,&r);
+    return r;
+}
+
+Value API::call(CallHandle h,const Value &a,const Value &b){
+    Value args[2] = {a,b};
+    Value r;
+    call(h,2,args,&r);
+    return r;
+}
+
+Value API::call(CallHandle h,const Value &a,const Value &b,const Value &c){
+    Value args[3] = {a,b,c};
+    Value r;
+    call(h,3,args,&r);
+    return r;
+}
+
 int API::getID(const char *name){
     return lana->registerID(name);
 }
@@ -83,11 +273,15 @@ int API::setDebug(int flags){
 int API::setFlags(int flags){
     return lana->setFlags(flags);
 }
+void API::setInlineLimits(int maxsize,int maxgrowth){
+    lana->setInlineLimits(maxsize,maxgrowth);
+}
 
 NativeFuncData *API::registerNativeMethod(const char *nm,
                                        int argc,
                                        bool returns,HOSTMETHOD m,
                                        class Host *h) {
+    MutexLock l(lana->lock);
     return lana->natFuncs.addMethod(getPrefixedName(nm),argc,returns,m,h);
 }
 
@@ -107,92 +301,100 @@ void API::globalNativeHostedMethod(const char *name,int argc,bool returns,
 
 void API::globalNativeFunction(const char *name,int argc,bool returns,
                                        VOIDFUNC f){
+    MutexLock l(lana->lock);
     NativeFuncData *nd = lana->natFuncs.addFunction(getPrefixedName(name),argc,returns,f,this);
     globalNativeFunctionOrMethod(name,nd);
 }
 
+void API::bindNative(const char *name,int argc,bool returns,
+                     NATIVETHUNK t,BOUNDFUNC f){
+    MutexLock l(lana->lock);
+    NativeFuncData *nd = lana->natFuncs.addBound(getPrefixedName(name),argc,returns,t,f,this);
+    globalNativeFunctionOrMethod(name,nd);
+}
+
 
 int API::popInt(){
-    Value *v = vm->popval();
+    Value *v = getVM()->popval();
     return v->getInt();
 }
 void API::pushInt(int i){
-    Value *v = vm->pushptr();
+    Value *v = getVM()->pushptr();
     return v->setInt(i);
 }
     
 float API::popFloat(){
-    Value *v = vm->popval();
+    Value *v = getVM()->popval();
     return v->getFloat();
 }
 
 void API::pushFloat(float f){
-    Value *v = vm->pushptr();
+    Value *v = getVM()->pushptr();
     return v->setFloat(f);
 }
     
 char *API::popStr(){
-    Value *v = vm->popval();
+    Value *v = getVM()->popval();
     return v->getStr();
 }
 
 Value *API::pushRaw(){
-    return vm->pushptr();
+    return getVM()->pushptr();
 }
 
 Value *API::popRaw(){
-    return vm->popval();
+    return getVM()->popval();
 }
 Value *API::popRawWithoutDeref(){
-    return vm->popvalnoderef();
+    return getVM()->popvalnoderef();
 }
 
 void API::pushStr(char *s){
-    Value *v = vm->pushptr();
+    Value *v = getVM()->pushptr();
     return v->setStrClone(s);
 }
 
 
 int API::popBool(){
-    Value *v = vm->popval();
+    Value *v = getVM()->popval();
     try {
         return v->getBool();
     } catch (Exception &e) {
-        vm->error("boolean expected (by native function), got type '%s'",
+        getVM()->error("boolean expected (by native function), got type '%s'",
                   v->type->getName(false));
     }
 }
 
 void API::pushBool(bool b){
-    Value *v = vm->pushptr();
+    Value *v = getVM()->pushptr();
     return v->setBool(b);
 }
 
 class Object *API::popObj(){
-    Value *v = vm->popval();
+    Value *v = getVM()->popval();
     return v->getObj();
 }
 
 void API::pushObj(class Object *o){
-    Value *v = vm->pushptr();
+    Value *v = getVM()->pushptr();
     return v->setObj(o);
 }
 
 
 
 void API::resetInstructionCount(){
-    vm->resetInstructionCount();
+    getVM()->resetInstructionCount();
 }
 int API::getInstructionCount(){
-    return vm->getInstructionCount();
+    return getVM()->getInstructionCount();
 }
 
 int API::getSourceLine(){
-    return vm->getSourceLine();
+    return getVM()->getSourceLine();
 }
 
 const char *API::getSourceFile(){
-    return vm->getSourceFile();
+    return getVM()->getSourceFile();
 }
 
 void API::setArgcArgv(int argc,char **argv){
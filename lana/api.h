@@ -11,11 +11,22 @@
 #include "value.h"
 #include "listener.h"
 #include "session.h"
+#include "bind.h"
 
 namespace lana {
 
     
 
+/// a function held in a variable, found once by API::getFunction() and
+/// then called by API::call() as often as needed without compiling
+/// anything. It refers to the variable rather than the function in it,
+/// so redefining the function changes what's called.
+
+struct CallHandle {
+    class Session *ses; //!< the session the variable is in, or NULL for a global
+    int id;             //!< the variable's slot
+};
+
 /// The main public Lana API - a facade hiding the Lana classes,
 /// primarily Lana itself. All access to the Lana system should be
 /// through this class.
@@ -63,6 +74,36 @@ public:
     void globalNativeFunction(const char *name,int argc,bool returns,
                                         VOIDFUNC f);
     
+    /// bind a C++ function to a global variable as a native function,
+    /// working out how many arguments it takes and their types and its
+    /// result's from its own type (see bind.h for the types allowed).
+    /// It's called without popping or pushing anything through the
+    /// API, so it's quicker than globalNativeFunction(). The internal name
+    /// is formed from the current prefix, as for globalNativeFunction().
+    template<class R> void bind(const char *name,R (*f)()){
+        bindNative(name,0,BindResult<R>::returns,
+                   &BindThunk0<R>::call,(BOUNDFUNC)f);
+    }
+    /// bind a C++ function of one argument
+    template<class R,class A> void bind(const char *name,R (*f)(A)){
+        bindNative(name,1,BindResult<R>::returns,
+                   &BindThunk1<R,A>::call,(BOUNDFUNC)f);
+    }
+    /// bind a C++ function of two arguments
+    template<class R,class A,class B> void bind(const char *name,R (*f)(A,B)){
+        bindNative(name,2,BindResult<R>::returns,
+                   &BindThunk2<R,A,B>::call,(BOUNDFUNC)f);
+    }
+    /// bind a C++ function of three arguments
+    template<class R,class A,class B,class C> void bind(const char *name,R (*f)(A,B,C)){
+        bindNative(name,3,BindResult<R>::returns,
+                   &BindThunk3<R,A,B,C>::call,(BOUNDFUNC)f);
+    }
+    
+    /// register a function for bind() with the thunk which calls it
+    void bindNative(const char *name,int argc,bool returns,
+                    NATIVETHUNK t,BOUNDFUNC f);
+    
     /// set the internal name prefix used for functions and methods internal names. This
     /// must be a constant
     void setNamePrefix(const char *pre){
@@ -87,6 +128,12 @@ public:
     /// set LOP_ flags, returning previous value
     int setFlags(int flags);
     
+    /// set the largest user function, in instructions, which will be
+    /// inlined where it's called, and the most instructions inlining
+    /// can add to a function. These affect functions compiled from
+    /// now on, and either being 0 turns inlining off.
+    void setInlineLimits(int maxsize,int maxgrowth);
+    
     /// return a pointer to the value of a global or NULL if it
     /// doesn't exist
     Value *findGlobal(const char *name);
@@ -94,6 +141,29 @@ public:
     /// clear all globals - functions, variables, builtins...
     void clearGlobals();
     
+    /// get a handle on the function in a variable: a session variable
+    /// if a session is given, otherwise a global (such as "$name", or a
+    /// native function). The variable is
+    /// created if it doesn't exist, so it can be defined later.
+    CallHandle getFunction(const char *name,Session *ses=NULL);
+    
+    /// call the function a handle refers to with argc arguments, copying
+    /// what it returns into result (which is set to None if it returns
+    /// nothing). Session variables are those of the handle's session, if
+    /// it has one. This can be used between feeds, or by native code
+    /// while the VM is running; errors are thrown as RuntimeException.
+    void call(CallHandle h,int argc,Value *args,Value *result);
+    
+    /// call the function a handle refers to with no arguments,
+    /// returning its result
+    Value call(CallHandle h);
+    /// call the function a handle refers to with one argument
+    Value call(CallHandle h,const Value &a);
+    /// call the function a handle refers to with two arguments
+    Value call(CallHandle h,const Value &a,const Value &b);
+    /// call the function a handle refers to with three arguments
+    Value call(CallHandle h,const Value &a,const Value &b,const Value &c);
+    
     
     /// return a pointer to the value of a global or create it
     /// if it doesn't exist
@@ -145,7 +215,8 @@ public:
     /// also at the end of every statement. They're here for you to wrap data in Value structures
     /// for returning from custom objects in their getprop() methods. Ideally you should use
     /// Value structures in your objects, but the overhead (both in the computer's memory and
-    /// your own brainspace) could get nasty.
+    /// your own brainspace) could get nasty. Fields of the types NativeProperty
+    /// supports are better described with one of its tables, which needs neither.
 
     Value *getTempValue();
     
@@ -154,11 +225,60 @@ public:
     
     /// the lana object hidden by this facade
     class Language *lana;
-    /// and a handy pointer to the VM
-    class VirtualMachine *vm;
-    /// and a handy pointer to the cycle detector
-    class CycleDetector *cycle;
     
+    /// get the calling thread's VM
+    class VirtualMachine *getVM();
+    /// get the calling thread's cycle detector
+    class CycleDetector *getCycleDetector();
+    
+    /// attach the calling thread, giving it a VM of its own so that it
+    /// can create sessions and run code in them alongside other threads.
+    /// The thread which created the API needn't do this. See thread.h
+    /// for what threads share and what they can do with it.
+    void attachThread();
+    /// detach the calling thread, deleting its VM. Its sessions, and
+    /// any values it's holding, must have been deleted first.
+    void detachThread();
+    /// get the number of threads running code besides the one which
+    /// created the API: those attached, and the work pool while it's
+    /// running something
+    int getThreadCount();
+    
+    /// set the number of threads pmap(), pfilter() and preduce() use,
+    /// or 0 (the default) for one per core. Call this between feeds.
+    void setWorkThreads(int n);
+    /// get the work pool, starting its threads if they haven't been
+    class WorkPool *getWorkPool();
+    /// get the actor system, which starts threads which send each other
+    /// messages (see actor.h)
+    class ActorSystem *getActors(){
+        return actors;
+    }
+    
+    /// freeze a value so that it can't be changed, and can be shared
+    /// by threads without copying: an object, list or dictionary is
+    /// frozen with everything it refers to (see Object::freeze()), and
+    /// a string is made immortal. Other values can't be changed anyway,
+    /// apart from typed arrays and the like, which can't be frozen.
+    void freeze(class Value *v);
+    /// is a value frozen, or one which can't be changed anyway?
+    bool isFrozen(class Value *v);
+
+    /// make everything the calling thread has made so far immortal: the
+    /// garbage is collected, and then every object still alive is taken
+    /// out of the cycle detector and stops being reference counted, as
+    /// are the strings in those objects, in the globals and in the
+    /// variables of ses (if given). Constants aren't counted anyway.
+    /// Unlike freeze(), the objects can still be changed, so other threads
+    /// can't use them unless they're frozen afterwards. Nothing ever
+    /// writes to them again just to use them, so a process which sets
+    /// up a large heap, calls this and then forks keeps sharing the
+    /// heap's pages with its children. The objects are never deleted,
+    /// so this is for programs which do it once, before they do their
+    /// work. No other threads can be running code. Returns the number
+    /// of objects made immortal.
+    int makeHeapImmortal(class Session *ses=NULL);
+
     /// a pointer to the object hosting the core native functions
     class Host *coreLib;
     
@@ -169,7 +289,15 @@ private:
     /// internal name prefix for functions and methods
     const char *prefix;
     
-    /// get prefixed name, returns ptr to static buffer
+    /// the work pool, or NULL until something needs it
+    class WorkPool *workPool;
+    /// the number of threads it should have, or 0 for one per core
+    int workThreads;
+    /// the actor system, made with the API
+    class ActorSystem *actors;
+    
+    /// get prefixed name, returns ptr to static buffer (and so must
+    /// be called with the Language's mutex held)
     const char *getPrefixedName(const char *s){
         static char buf[256];
         strncpy(buf,prefix,256);
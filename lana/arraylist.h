@@ -14,9 +14,15 @@ public:
     ArrayListException(const char *e) : Exception(e) {}
 };
 
-/// array list with random access get at  O(1). Insertion at O(n)
-/// except at the end of the list where it's O(1). List will occasionally
-/// resize, more often on grow than on shrink. Docs need improving :)
+/// array list with random access get at O(1). The items are held in
+/// a ring buffer, so adding and removing at either end is O(1) amortised,
+/// while insertion and removal elsewhere is O(n) (moving whichever side
+/// is shorter). The list grows when full and shrinks to half its capacity
+/// when less than a quarter full, so alternating push and pop can't make
+/// it thrash.
+///
+/// Slots outside the live range always hold None values, so nothing
+/// in them is counted as a reference.
 
 class ArrayList {
 public:
@@ -24,6 +30,7 @@ public:
     ArrayList(int n){
         capacity = n;
         ct = 0;
+        start = 0;
         data = new Value [n];
     }
     
@@ -36,57 +43,99 @@ public:
     /// fill in the item. Runs in O(1) time unless the list needs
     /// resizing.
     Value *append(){
-        reallocateifrequired(ct+1);
-        return data+(ct++);
+        growifrequired(ct+1);
+        return slot(ct++);
+    }
+    
+    /// add an item to the start of the list, return a pointer to
+    /// fill in the item. Runs in O(1) time unless the list needs
+    /// resizing.
+    Value *pushFront(){
+        growifrequired(ct+1);
+        start = start ? start-1 : capacity-1;
+        ct++;
+        return data+start;
     }
     
     /// insert an item before position n, returning a pointer to
-    /// fill in the item. Runs in O(n) time unless n==-1, in which
-    /// case it's O(1)
+    /// fill in the item. Runs in O(n) time unless n is 0 or -1 (append),
+    /// in which case it's O(1)
     Value *insert(int n=-1){
         if(n<0 || n>=ct)
             return append();
-        reallocateifrequired(ct+1);
-        memmove(data+n+1,data+n,(ct-n)*sizeof(Value));
+        if(n==0)
+            return pushFront();
+        growifrequired(ct+1);
+        if(n < ct/2){
+            // move the items before n down one
+            start = start ? start-1 : capacity-1;
+            for(int i=0;i<n;i++)
+                move(i,i+1);
+        } else {
+            // move the items from n up one
+            for(int i=ct;i>n;i--)
+                move(i,i-1);
+        }
         ct++;
-        return data+n;
+        Value *v = slot(n);
+        v->initNone(); // it's been moved, so just forget it
+        return v;
+    }
+    
+    /// remove the last item from the list, moving it into dest. Runs
+    /// in O(1) time, unless there's a resize
+    void pop(Value *dest){
+        if(!ct) throw ArrayListException("pop on empty list");
+        ct--;
+        take(dest,slot(ct));
+        shrinkifrequired();
     }
     
-    /// remove an item from the list, runs in O(1) time, unless there's a resize
-    Value *pop(){
+    /// remove the first item from the list, moving it into dest. Runs
+    /// in O(1) time, unless there's a resize
+    void popFront(Value *dest){
         if(!ct) throw ArrayListException("pop on empty list");
-        // make DAMN SURE we still have the old item!
-        reallocateifrequired(ct-1);
+        take(dest,data+start);
+        start = phys(1);
         ct--;
-        return data+ct;
+        shrinkifrequired();
     }
     
     /// peek an item from the list, runs in O(1) time
     Value *peek(){
         if(!ct) throw ArrayListException("peek on empty list");
-        // make DAMN SURE we still have the old item!
-        return data+(ct-1);
+        return slot(ct-1);
     }
     
     
-    /// remove an item from somewhere in the list in O(n) time
+    /// remove an item from somewhere in the list in O(n) time, or
+    /// O(1) at either end.
     bool remove(int n=-1){
         if(n<0||n>=ct)
             return false;
-        data[n].clr();
-        reallocateifrequired(ct-1);
+        slot(n)->clr();
+        if(n < ct/2){
+            // move the items before n up one
+            for(int i=n;i>0;i--)
+                move(i,i-1);
+            data[start].initNone();
+            start = phys(1);
+        } else {
+            // move the items after n down one
+            for(int i=n;i<ct-1;i++)
+                move(i,i+1);
+            slot(ct-1)->initNone();
+        }
         ct--;
-        if(n>=0 && n!=ct)
-            memmove(data+n,data+n+1,(ct-n)*sizeof(Value));
+        shrinkifrequired();
         return true;
     }
     
-    /// get a pointer to the nth item of a list in O(1) time. If n==-1
-    /// will return the last item.
+    /// get a pointer to the nth item of a list in O(1) time.
     Value *get(int n){
         if(n<0||n>=ct)
             throw ArrayListException("get out of range");
-        return data+n;
+        return slot(n);
     }
     
     /// return the size of the list
@@ -102,14 +151,42 @@ public:
     /// set a value in the list
     void set(int n,Value *v){
         if(n>=ct){
-            reallocateifrequired(n+1);
+            // any slots in the gap are already None
+            growifrequired(n+1);
             ct=n+1;
-            
-            for(int i=ct;i<n;i++)
-                data[i].initNone();
         }
-        data[n].clr();
-        data[n]=*v;
+        *slot(n)=*v;
+    }
+    
+    /// make sure there's room for at least n items without
+    /// reallocating. The list may shrink again if items are removed.
+    void reserve(int n){
+        if(n>capacity)
+            resize(n);
+    }
+    
+    /// append copies of all the items in another list, reallocating
+    /// at most once
+    void extend(ArrayList *src){
+        int n = src->ct; // in case src==this
+        reserve(ct+n);
+        for(int i=0;i<n;i++){
+            *slot(ct) = *src->slot(i);
+            ct++;
+        }
+    }
+    
+    /// rearrange the items so that item i is the one which was at
+    /// position order[i]. The order must be a permutation of 0..count()-1.
+    void reorder(const int *order){
+        Value *newdata = new Value [capacity];
+        for(int i=0;i<ct;i++)
+            memcpy(newdata+i,slot(order[i]),sizeof(Value));
+        for(int i=0;i<ct;i++)
+            slot(i)->initNone(); // moved, not copied
+        delete [] data;
+        data = newdata;
+        start = 0;
     }
     
     Iterator<Value *> *createKeyIterator();
@@ -117,34 +194,67 @@ public:
     Iterator<Value *> *createValueIterator();
 private:
     
-    /// reallocate the list if required by the given new count and copy
-    /// all items over. Will NOT change ct.
-    void reallocateifrequired(int newct){
-        Value *newdata;
-//        printf("ct %d, cap %d\n",newct,capacity);
-        if(newct>=capacity){
-            // need to grow the list
-            capacity += (ct>>3) + (ct<9?3:6);
-//            printf("GROW\n");
-        } else if(capacity>16 && newct<(capacity>>1)) {
-            // need to shrink the list. New capacity should still
-            // have at least one empty space left at the end, for popped
-            // items!
-            capacity = capacity>>1;
-//            printf("SHRINK\n");
-        } else
-            return;
-        
-        // do the resize
-        newdata = new Value [capacity];
-        memcpy(newdata,data,sizeof(Value)*ct);
+    /// get the index in the data area of the nth item
+    inline int phys(int n){
+        n+=start;
+        return n>=capacity ? n-capacity : n;
+    }
+    
+    /// get a pointer to the nth item
+    inline Value *slot(int n){
+        return data+phys(n);
+    }
+    
+    /// move item "from" to "to", without touching refcounts. The
+    /// "from" slot must be overwritten or forgotten afterwards.
+    inline void move(int to,int from){
+        memcpy(slot(to),slot(from),sizeof(Value));
+    }
+    
+    /// move a value out of the list into dest, leaving None behind
+    inline void take(Value *dest,Value *v){
+        dest->clr();
+        memcpy(dest,v,sizeof(Value));
+        v->initNone();
+    }
+    
+    /// grow the list if it won't hold newct items.
+    void growifrequired(int newct){
+        if(newct>capacity){
+            int newcap = capacity + (newct>>3) + (newct<9?3:6);
+            resize(newcap);
+        }
+    }
+    
+    /// shrink the list to half its capacity if it's less than
+    /// a quarter full. After a shrink it's still half full, so
+    /// we won't grow again immediately.
+    void shrinkifrequired(){
+        if(capacity>16 && ct<(capacity>>2))
+            resize(capacity>>1);
+    }
+    
+    /// move the items into a new data area of the given capacity,
+    /// which must be at least ct, so that they start at zero.
+    void resize(int newcap){
+        Value *newdata = new Value [newcap];
+        for(int i=0;i<ct;i++){
+            Value *v = slot(i);
+            memcpy(newdata+i,v,sizeof(Value));
+            // the item has moved rather than been copied, so make sure
+            // deleting the old area doesn't decrement its refcount.
+            v->initNone();
+        }
         delete [] data;
         data = newdata;
-
+        capacity = newcap;
+        start = 0;
     }
     
     /// the data area
     Value *data;
+    /// the index in the data area of the first item
+    int start;
     /// the number of items currently stored in the list
     int ct;
     /// the capacity of the list
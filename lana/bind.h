@@ -0,0 +1,166 @@
+/**
+ * @file
+ * Typed native function binding. API::bind() registers a plain C++
+ * function whose argument and return types are worked out by the
+ * compiler, so that it needn't pop and push its own values through the
+ * API. The types are turned into a "thunk" - a function which reads the
+ * arguments where they lie on the stack, calls the C++ function with
+ * them, and writes its result over the function being called. Common
+ * types are checked inline, and anything else is converted as the
+ * API's pop methods would.
+ *
+ * Arguments can be int, float, bool, const char * or Value *, the last
+ * being the argument itself (dereferenced). Results can be void, int,
+ * float, bool or const char *, which is copied.
+ */
+
+#ifndef __BIND_H
+#define __BIND_H
+
+#include "value.h"
+#include "natfunc.h"
+
+namespace lana {
+
+/// reads an argument of type T from its stack slot
+template<class T> struct BindArg;
+
+template<> struct BindArg<int> {
+    static int get(Value *v){
+        if(v->type==Types::vtInteger)
+            return v->d.i;
+        if(v->type==Types::vtFloat)
+            return (int)v->d.f;
+        return v->deref()->getInt();
+    }
+};
+
+template<> struct BindArg<float> {
+    static float get(Value *v){
+        if(v->type==Types::vtFloat)
+            return v->d.f;
+        if(v->type==Types::vtInteger)
+            return (float)v->d.i;
+        return v->deref()->getFloat();
+    }
+};
+
+template<> struct BindArg<bool> {
+    static bool get(Value *v){
+        if(v->type==Types::vtBoolean)
+            return v->d.i!=0;
+        return v->deref()->getBool();
+    }
+};
+
+template<> struct BindArg<const char *> {
+    static const char *get(Value *v){
+        return v->deref()->getStr();
+    }
+};
+
+template<> struct BindArg<Value *> {
+    static Value *get(Value *v){
+        return v->deref();
+    }
+};
+
+/// writes a result of type T into the slot which held the function,
+/// and says whether there is one
+template<class T> struct BindResult;
+
+template<> struct BindResult<void> {
+    static const bool returns = false;
+};
+
+template<> struct BindResult<int> {
+    static const bool returns = true;
+    static void set(Value *v,int r){
+        v->setInt(r);
+    }
+};
+
+template<> struct BindResult<float> {
+    static const bool returns = true;
+    static void set(Value *v,float r){
+        v->setFloat(r);
+    }
+};
+
+template<> struct BindResult<bool> {
+    static const bool returns = true;
+    static void set(Value *v,bool r){
+        v->setBool(r);
+    }
+};
+
+template<> struct BindResult<const char *> {
+    static const bool returns = true;
+    static void set(Value *v,const char *r){
+        v->setStrClone(r);
+    }
+};
+
+/// the thunks for each number of arguments, with a specialisation for
+/// functions returning nothing. The bound function is cast back from
+/// NativeFuncData::bound to its real type.
+
+template<class R> struct BindThunk0 {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef R (*F)();
+        BindResult<R>::set(result,((F)d->bound)());
+    }
+};
+template<> struct BindThunk0<void> {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef void (*F)();
+        ((F)d->bound)();
+    }
+};
+
+template<class R,class A> struct BindThunk1 {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef R (*F)(A);
+        BindResult<R>::set(result,((F)d->bound)(BindArg<A>::get(args)));
+    }
+};
+template<class A> struct BindThunk1<void,A> {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef void (*F)(A);
+        ((F)d->bound)(BindArg<A>::get(args));
+    }
+};
+
+template<class R,class A,class B> struct BindThunk2 {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef R (*F)(A,B);
+        BindResult<R>::set(result,((F)d->bound)(BindArg<A>::get(args),
+                                                BindArg<B>::get(args+1)));
+    }
+};
+template<class A,class B> struct BindThunk2<void,A,B> {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef void (*F)(A,B);
+        ((F)d->bound)(BindArg<A>::get(args),BindArg<B>::get(args+1));
+    }
+};
+
+template<class R,class A,class B,class C> struct BindThunk3 {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef R (*F)(A,B,C);
+        BindResult<R>::set(result,((F)d->bound)(BindArg<A>::get(args),
+                                                BindArg<B>::get(args+1),
+                                                BindArg<C>::get(args+2)));
+    }
+};
+template<class A,class B,class C> struct BindThunk3<void,A,B,C> {
+    static void call(NativeFuncData *d,Value *args,Value *result){
+        typedef void (*F)(A,B,C);
+        ((F)d->bound)(BindArg<A>::get(args),BindArg<B>::get(args+1),
+                      BindArg<C>::get(args+2));
+    }
+};
+
+}
+
+#endif /* __BIND_H */
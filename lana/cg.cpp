@@ -6,6 +6,7 @@
 #include "language.h"
 #include "compiler.h"
 #include "session.h"
+#include "optimise.h"
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -246,18 +247,33 @@ void CodeGen::popContext(){
 const char *CodeGen::writeContextToMemory(){
     
     int size = current->code->getOffset();
-    int *ptr = (int *)malloc(size+sizeof(int));
+    instruction *code = (instruction *)current->code->get(0,0);
+    
+    Optimiser opt(lana->consts,!(lana->opFlags & LOP_NOOPTIMISE));
+    // the register VM can't run inlined code (see lower.cpp)
+    if(!(lana->opFlags & LOP_REGISTERVM))
+        opt.setInlining(ses,lana->globs,lana->inlineMaxSize,lana->inlineMaxGrowth);
+    opt.setCallSites(lana);
+    int optsize = opt.optimise(code,size/sizeof(instruction))*sizeof(instruction);
+    
+    int *ptr = (int *)malloc(size+optsize+2*sizeof(int));
     
     // write the size as a header
     *ptr = size;
     
     // copy the code to just after the header
-    memcpy(ptr+1,current->code->get(0,0),size);
+    memcpy(ptr+1,code,size);
+    
+    // and then the same for the optimised code - see getOptimisedCode()
+    int *optptr = (int *)((char *)(ptr+1)+size);
+    *optptr = optsize;
+    memcpy(optptr+1,opt.getCode(),optsize);
     
     if(lana->debugFlags & LDEBUG_DUMP){
         printf("Function object dump: \n");
-        lana->dumpCode((instruction *)current->code->get(0,0),
-                       current->code->getOffset()/sizeof(instruction),ses);
+        lana->dumpCode(code,size/sizeof(instruction),ses);
+        printf("Optimised: \n");
+        lana->dumpCode(opt.getCode(),optsize/sizeof(instruction),ses);
     }
     
     return (const char *)ptr;
@@ -1,7 +1,7 @@
 /**
  * @file
- * The Lana compiler's core. Each Session has a compiler, but there's only one VM,
- * only one global namespace, only one constant area.
+ * The Lana compiler's core. Each Session has a compiler, but there's only one VM
+ * for each thread, only one global namespace, only one constant area.
  */
 
 #include <stdio.h>
@@ -21,6 +21,7 @@
 #include "session.h"
 #include "compiler.h"
 #include "ser.h"
+#include "optimise.h"
 
 Compiler::Compiler(Session *s,Language *l){
     ses = s;
@@ -32,6 +33,7 @@ Compiler::Compiler(Session *s,Language *l){
     cg = new CodeGen(lana,ses);
     tok = lana->tok;
     eventMgr = new EventMgr;
+    cacheSize = 0;
 }
 
 Compiler::~Compiler(){
@@ -39,6 +41,7 @@ Compiler::~Compiler(){
         free(lastLine);
     if(fileName)
         free(fileName);
+    setCacheSize(0);
     delete cg;
     delete eventMgr;
 }
@@ -72,6 +75,35 @@ void Compiler::feed(const char *buf){
     if(lana->debugFlags & LDEBUG_SHOW)
         lana->dprintf("feed: %s",buf);
     
+    // a line which has been fed before and is still cached just runs
+    // again. Most debugging flags change the code, so they turn the
+    // cache off, as does the first line of a file, which names the file.
+    bool caching = cacheSize && !(lana->debugFlags & ~LDEBUG_SRCDATA) &&
+          !outputFileName && !cg->isCompiling();
+    if(caching){
+        Statement *st = findCached(buf);
+        if(st){
+            // it was compiled for an earlier line (and a line which
+            // failed may have left its own line number before it)
+            for(instruction *p=st->code;INSTOP(*p)==OP_SRCLINE;p++)
+                *p = INST(OP_SRCLINE,lineNumber);
+            for(instruction *p=st->run;INSTOP(*p)==OP_SRCLINE;p++)
+                *p = INST(OP_SRCLINE,lineNumber);
+            if(lastLine)
+                free(lastLine);
+            lastLine = strdup(buf);
+            eventMgr->notify(COMMAND_PARSED, EventData(st->code));
+            if(!(lana->opFlags & LOP_NORUN))
+                execute(st);
+            lineNumber++;
+            return;
+        }
+    }
+    
+    // compiling adds to what all the threads share, so only one
+    // thread does it at once; running the code doesn't (see thread.h)
+    MutexLock lock(lana->lock);
+    
     // output src file and line if in debug mode
     generateDebugInstructions(false);
     
@@ -103,18 +135,26 @@ void Compiler::feed(const char *buf){
             // notify any listener
             eventMgr->notify(COMMAND_PARSED, EventData(p));
             
-            if(!(lana->opFlags & LOP_NORUN)){ // if we want to run the code...
-                if(lana->debugFlags & LDEBUG_TRACE)
-                    printf("EXECUTE and clear\n");
-                lana->vm->interpret(p,ses);
-                
-                Value *v = lana->vm->popvalnoexception();
-                if(v){
-                    printf("%s\n",v->getStr());
-                }
+            // run an optimised copy, keeping the original for the
+            // listener and the dump. The line ending a function isn't
+            // cached, since it's only complete with the lines before it.
+            Statement *st = makeStatement(buf,p,size);
+            lock.release();
+            if(caching)
+                addToCache(st);
+            try {
+                if(!(lana->opFlags & LOP_NORUN)) // if we want to run the code...
+                    execute(st);
+            } catch(Exception &ex){
+                if(!caching)
+                    delete st;
+                throw;
             }
+            if(!caching)
+                delete st;
             
             if(lana->debugFlags & LDEBUG_DUMP){
+                MutexLock dumplock(lana->lock);
                 printf("Dump of interpreter block:\n");
                 lana->dumpCode((instruction *)cg->current->code->get(0,sizeof(instruction)),
                                cg->current->code->getOffset()/sizeof(instruction),ses);
@@ -132,6 +172,116 @@ void Compiler::feed(const char *buf){
     lineNumber++;
 }
 
+void Compiler::execute(Statement *st){
+    if(lana->debugFlags & LDEBUG_TRACE)
+        printf("EXECUTE and clear\n");
+    VirtualMachine *vm = lana->getVM();
+    vm->interpret(st->run,ses);
+    
+    Value *v = vm->popvalnoexception();
+    if(v){
+        printf("%s\n",v->getStr());
+    }
+}
+
+Statement *Compiler::makeStatement(const char *buf,instruction *p,int n){
+    Optimiser opt(lana->consts,!(lana->opFlags & LOP_NOOPTIMISE));
+    int optn = opt.optimise(p,n);
+    return new Statement(ses,buf,p,n,opt.getCode(),optn,
+                         lana->opFlags,lana->debugFlags);
+}
+
+Statement *Compiler::prepare(const char *buf){
+    if(cg->isCompiling())
+        throw ParseException("cannot prepare a statement while a function is being defined");
+    
+    MutexLock lock(lana->lock);
+    try{
+        tok->reset(buf);
+        cg->saveSnapshot();
+        scanStmt();
+    } catch(Exception &ex){
+        if(cg->isCompiling())
+            cg->clearall();
+        else
+            cg->restoreSnapshot();
+        throw;
+    }
+    if(cg->isCompiling()){
+        // it started a function, which needs more lines
+        cg->clearall();
+        throw ParseException("a prepared statement must be complete in one line");
+    }
+    
+    cg->emit(OP_END);
+    Growable *g = cg->getCode();
+    int size = g->getOffset()/sizeof(instruction);
+    instruction *p = (instruction *)g->get(0,sizeof(instruction));
+    Statement *st = makeStatement(buf,p,size);
+    cg->clear();
+    return st;
+}
+
+void Compiler::setCacheSize(int n){
+    cacheSize = n;
+    while((int)cache.size()>cacheSize)
+        dropCached(--cache.end());
+}
+
+Statement *Compiler::findCached(const char *s){
+    std::map<const char *,StatementList::iterator,StrLess>::iterator it =
+          cacheIndex.find(s);
+    if(it==cacheIndex.end())
+        return NULL;
+    Statement *st = *it->second;
+    if(st->opFlags != lana->opFlags || st->debugFlags != lana->debugFlags){
+        // compiled under different flags, so it must be compiled again
+        dropCached(it->second);
+        return NULL;
+    }
+    // splice it to the front
+    cache.splice(cache.begin(),cache,it->second);
+    return st;
+}
+
+void Compiler::addToCache(Statement *st){
+    std::map<const char *,StatementList::iterator,StrLess>::iterator it =
+          cacheIndex.find(st->src);
+    if(it!=cacheIndex.end())
+        dropCached(it->second);
+    while((int)cache.size()>=cacheSize)
+        dropCached(--cache.end());
+    cache.push_front(st);
+    cacheIndex[st->src] = cache.begin();
+}
+
+void Compiler::dropCached(StatementList::iterator it){
+    Statement *st = *it;
+    cacheIndex.erase(st->src);
+    cache.erase(it);
+    delete st;
+}
+
+Statement::Statement(Session *s,const char *source,
+                     const instruction *compiled,int n,
+                     const instruction *optimised,int optn,
+                     int flags,int dflags){
+    ses = s;
+    src = strdup(source);
+    code = (instruction *)malloc(n*sizeof(instruction));
+    memcpy(code,compiled,n*sizeof(instruction));
+    run = (instruction *)malloc(optn*sizeof(instruction));
+    memcpy(run,optimised,optn*sizeof(instruction));
+    opFlags = flags;
+    debugFlags = dflags;
+}
+
+Statement::~Statement(){
+    free(src);
+    free(code);
+    free(run);
+}
+
 void Compiler::feedFile(const char *fileName){
     FILE *a = fopen(fileName,"r");
     
@@ -737,10 +887,9 @@ void Compiler::scanEndFunc() {
 ///                  (varref for loop index)
 ///                  (expression producing iterator)
 ///                  OP_FOR
-/// continuelabel,
 /// label1:          ...
 ///                  ...
-///                  OP_NEXT(label1)
+/// continuelabel:   OP_NEXT(label1)
 /// breaklabel:
 ///                  OP_ENDFOR
 /// \endcode
@@ -765,13 +914,14 @@ void Compiler::scanFor(){
     cg->current->newloop(); // start loop and set continuelabel, 
     // get that pointer because we're going to muck about with it
     LoopData *loop = cg->current->loopstack.peekptr();
+    // "continue" must step the loop, so it goes forwards to the
+    // OP_NEXT, which isn't known yet - see scanEndFor().
+    loop->continuelabel.reset();
     
     // push the FOR *here* although we jump past it; we still need
     // to match with it and modify it for the jump forwards
     cg->current->cpushhere(); 
     cg->emit(OP_FOR); // output FOR
-    // modify the continue so it's *AFTER* the FOR.
-    loop->continuelabel.set(cg->current->getlocptr());
 }
 
 /// see scanFor() for the sequence of instructions
@@ -779,6 +929,8 @@ void Compiler::scanEndFor(){
     instruction *forptr = cg->current->cpoplocandcheck(OP_FOR,OP_FOR);
     if(!forptr)
         error("mismatched 'next'");
+    // resolve any continues to the next
+    cg->current->loopstack.peekptr()->continuelabel.set(cg->current->getlocptr());
     // output the next, with the backward jump - to AFTER the for
     cg->emit(OP_NEXT,cg->current->getdiff(forptr+1));
     // modify the OP_FOR to jump to after the NEXT if the iterator is empty
@@ -7,6 +7,10 @@
 #ifndef __COMPILER_H
 #define __COMPILER_H
 
+#include <string.h>
+#include <list>
+#include <map>
+
 namespace lana {
 
 /// Each user's session has a Compiler class, so that many users can interact with the
@@ -36,6 +40,14 @@ public:
     /// feed text from a file into the interpreter using feed()
     void feedFile(const char *fileName);
     
+    /// compile a line into a Statement without running it (see
+    /// Session::prepare())
+    class Statement *prepare(const char *s);
+    
+    /// set how many lines fed in are kept compiled, 0 for none (see
+    /// Session::setStatementCache())
+    void setCacheSize(int n);
+    
     /// are we awaiting more input for the current function?
     bool awaitingInput();
 
@@ -95,6 +107,35 @@ private:
     /// event listener manager
     class EventMgr *eventMgr;
     
+    /// orders C strings by their contents
+    struct StrLess {
+        bool operator()(const char *a,const char *b) const {
+            return strcmp(a,b)<0;
+        }
+    };
+    typedef std::list<class Statement *> StatementList;
+    
+    /// the lines kept compiled by feed(), most recently used first
+    StatementList cache;
+    /// the cached statements keyed by their source
+    std::map<const char *,StatementList::iterator,StrLess> cacheIndex;
+    /// the most lines to keep compiled
+    int cacheSize;
+    
+    /// find a cached statement for a line, moving it to the front, or
+    /// return NULL (dropping it if it was compiled under other flags)
+    class Statement *findCached(const char *s);
+    /// add a statement to the cache, dropping the least recently used
+    /// if it's full
+    void addToCache(class Statement *st);
+    /// remove a statement from the cache and delete it
+    void dropCached(StatementList::iterator it);
+    
+    /// optimise a compiled line into a new Statement
+    class Statement *makeStatement(const char *s,instruction *p,int n);
+    /// run a statement for feed(), printing any value it leaves
+    void execute(class Statement *st);
+    
     /// we're going to start parsing a new file, will reset line number
     /// and set source name (will copy, deleting old). Will also notify
     /// the system to output a new source file id at next feed.
@@ -111,7 +152,9 @@ private:
     // scanners
     
     void scanStmt();
-    void scanFuncCall();
+    /// scan a function call's arguments; if refArgs is set they're
+    /// compiled as references, which defined() and del() need.
+    void scanFuncCall(bool refArgs=false);
     /// return true if we did a function start or some other oddity which doesn't require a clear.
     /// The argument is true if an identifier followed by a colon is a label - i.e. we are
     /// parsing an expression statement.
@@ -157,12 +200,23 @@ private:
     /// process the end of an expression
     void doExprEnd();
     
-    /// output instructions to stack a variable, looking it 
-    /// up in local, then parameter, then global tables.
-    /// By default this will output a get, but it could
-    /// later get changed to a get..
+    /// output instructions to stack a reference to a variable, looking it 
+    /// up in local, then parameter, then session, then global tables.
+    /// This is for variables which are written to.
     void emitVariableRef(const char *s);
     
+    /// output instructions to stack a copy of a variable's value, for
+    /// variables which are only read. If it turns out that it's being
+    /// written to after all, makeLastRef() will change it back.
+    void emitVariableLoad(const char *s);
+    
+    /// if the last instruction output loads a variable, change it into
+    /// the equivalent reference
+    void makeLastRef();
+    
+    /// is the last instruction output a load of the named global?
+    bool lastLoadIsGlobal(const char *name);
+    
     /// scan a property dereference - we've just scanned a dot, the next thing
     /// has to be a property ident
     void scanPropDeref();
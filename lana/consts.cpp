@@ -7,7 +7,7 @@
 using namespace lana;
 
 Constants::Constants() {
-    constantArea = new Growable(1024,1024,4);
+    constantArea = new Growable(MAXSIZE,0,4,true);
     props.setUp(this);
 }
 
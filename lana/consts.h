@@ -14,6 +14,11 @@
  * descriptor in the Growable's memory, divided by four. This gives us
  * the ability to index up to 64Mbytes of constant data with a 24-bit
  * word (the size of the data field of an instruction.)
+ *
+ * All of that 64Mbytes is allocated when the constants are made, though
+ * only the pages used take up memory, so that constants never move:
+ * threads can read them while another thread is adding more (see
+ * thread.h).
  */
 
 
@@ -94,6 +99,10 @@ public:
     /// this value is returned by various methods if a const is not found
     static const constid NOTFOUND = 0xffffffff;
     
+    /// the most constant data there can be, in bytes: as much as a
+    /// 24-bit constant ID can index
+    static const u32 MAXSIZE = (1<<24)*4;
+    
     /// return an iterator
     Iterator<ConstDesc *>* createIterator();
     
@@ -79,10 +79,27 @@ void CycleDetector::detect(){
     }
     dfprintf("End of loop.\n");
     
-    // now we iterate through the list and set all reference counts of
+    // what's left is garbage
+    deleteAll(mainlist);
+    
+    // and we set the main list to the new list
+    
+    mainlist.copy(newlist);
+    
+//    printf("Objects left:\n");
+//    for(p=mainlist.head();p;p=mainlist.next(p)){
+//        printf("  %x (ref %d)\n",(u32)p,p->refct);
+//    }
+//    printf("DONE\n");
+}
+
+void CycleDetector::deleteAll(GCList &list){
+    GarbageCollected *p,*q;
+    
+    // first we iterate through the list and set all reference counts of
     // the objects we're about to delete to max.
     
-    for(p=mainlist.head();p;p=mainlist.next(p)){
+    for(p=list.head();p;p=list.next(p)){
         dfprintf("maxreffing %lx\n",p);
         p->gc_refs=0xffff;
     }
@@ -92,27 +109,18 @@ void CycleDetector::detect(){
     // Again, as well as the general-purpose calls which run through the value/key iterators,
     // we have a non-iterator version which is usually empty but can be overridden.
     
-    for(p=mainlist.head();p;p=mainlist.next(p)){
+    for(p=list.head();p;p=list.next(p)){
         clearZombieReferencesIterator(p,true);
         clearZombieReferencesIterator(p,false);
         p->clearZombieReferences();
     }
     
-    for(p=mainlist.head();p;p=q){
-        q=mainlist.next(p);
+    for(p=list.head();p;p=q){
+        q=list.next(p);
         dfprintf("%p is in a cycle  - deleting\n",p);
         delete p;
     }
-    
-    // and we set the main list to the new list
-    
-    mainlist.copy(newlist);
-    
-//    printf("Objects left:\n");
-//    for(p=mainlist.head();p;p=mainlist.next(p)){
-//        printf("  %x (ref %d)\n",(u32)p,p->refct);
-//    }
-//    printf("DONE\n");
+    list.reset();
 }
 
 void CycleDetector::decIteratorReferentsCycleRefCounts(GarbageCollected *gc, bool keys) {
@@ -122,7 +130,7 @@ void CycleDetector::decIteratorReferentsCycleRefCounts(GarbageCollected *gc, boo
     
     for(iterator->first();!iterator->isDone();iterator->next()){
         Value *v = iterator->current();
-        if(v->getAllocType() == Complex){
+        if(v->getAllocType() == Complex && !v->d.gc->immortal){
             dfprintf("decrementing cyc %lx\n",v->d.gc);
             v->d.gc->gc_refs--;
         }
@@ -139,7 +147,7 @@ void CycleDetector::traceAndMoveIterator(GarbageCollected *gc, bool keys) {
         Value *v = iterator->current();
         if(v->getAllocType() == Complex){
             GarbageCollected *g = v->d.gc;
-            if(!g->gc_refs) { // if child not done
+            if(!g->gc_refs && !g->immortal) { // if child not done
                 move(g);
                 traceAndMoveIterator(v->d.gc,keys);
                 v->d.gc->traceAndMove(this);
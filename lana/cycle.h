@@ -140,6 +140,9 @@ protected:
 /// 
 /// The algorithm used is described in http://arctrix.com/nas/python/gc/
 ///
+/// Each thread has its own (see thread.h), and immortal objects aren't in
+/// any, so they're never traced or counted.
+///
 
 class CycleDetector {
 public:
@@ -167,6 +170,18 @@ public:
     /// which are not referred to from elsewhere.
     void detect();
     
+    /// delete every object in a list, which may refer to each other,
+    /// as detect() does with a cycle. Nothing outside the list may
+    /// refer to them any more.
+    static void deleteAll(GCList &list);
+
+    /// take every object out of the cycle detector, into a list which
+    /// the caller then looks after (see API::makeHeapImmortal())
+    void takeAll(GCList &list){
+        list.copy(mainlist);
+        mainlist.reset();
+    }
+
     /// return the number of containers in the system
     int count(){
         return mainlist.entries();
@@ -174,7 +189,7 @@ public:
     
     /// move an item from the mainlist to the newlist
     void move(GarbageCollected *gc) {
-        if(gc->gc_refs==0){
+        if(gc->gc_refs==0 && !gc->immortal){
             dfprintf("    MOVE %x into new list\n",gc);
             mainlist.remove(gc);
             newlist.addToTail(gc);
@@ -184,6 +199,8 @@ public:
     
     /// move the entity, and the items referenced by it, into the newlist if appropriate
     void traceAndMoveEntity(GarbageCollected *p){
+      if(p->immortal) // not ours to trace
+          return;
       move(p);
       traceAndMoveIterator(p,true);
       traceAndMoveIterator(p,false);
@@ -205,7 +222,7 @@ private:
     void traceAndMoveIterator(GarbageCollected *gc,bool keys);
     
     /// deletion prepwork - clears all references to objects marked - see detect()
-    void clearZombieReferencesIterator(GarbageCollected *gc,bool keys);
+    static void clearZombieReferencesIterator(GarbageCollected *gc,bool keys);
 };
     
 }
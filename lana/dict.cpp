@@ -9,22 +9,20 @@
 #include "cycle.h"
 #include "pool.h"
 #include "iterobj.h"
+#include "list.h"
+#include "vm.h"
 
 #define MT(xx) (lana::HOSTMETHOD)&lana::Dict::xx
 
 DictionaryType::DictionaryType(API *a): ObjectType(){
     proto = new Dict(a);
     
-    /*     We have no natives for Dict right now, but I'm
-     *     leaving this code here as a reference to how to 
-     *     add native methods as properties to a prototype.
-    
     a->setNamePrefix("dict$");
-    proto->registerNativeMethod("size",0,true,MT(methodSize));
-    proto->registerNativeMethod("del",1,true,MT(methodDel));
-     
-     */
-    proto->incRefCt(); // never die!
+    proto->registerNativeMethod("update",1,false,MT(methodUpdate));
+    proto->registerNativeMethod("reserve",1,false,MT(methodReserve));
+    proto->registerNativeMethod("capacity",0,true,MT(methodCapacity));
+    
+    proto->makeImmortal(); // never die, and be shared by every thread
 
 
 
@@ -45,18 +43,58 @@ Dict *Dict::create(API *a) {
     return d;
 }
 
-static Pool<Value,1024> keyPool;
+Dict *Dict::fromPairs(API *a,List *pairs){
+    int ct = pairs->list->count();
+    
+    // check everything first, so we don't leave a half-built dictionary
+    for(int i=0;i<ct;i++){
+        Value *p = pairs->get(i);
+        if(p->type != Types::vtList || p->d.list->list->count()!=2)
+            throw Exception("frompairs() needs a list of [key,value] lists");
+    }
+    
+    Dict *d = create(a);
+    d->reserve(ct);
+    for(int i=0;i<ct;i++){
+        List *pair = pairs->get(i)->d.list;
+        d->set(pair->get(0),pair->get(1));
+    }
+    return d;
+}
+
+void Dict::methodUpdate(){
+    checkWritable();
+    Object *o = api->popObj();
+    if(o->type != Types::vtDictionary)
+        throw Exception("update() needs a dictionary");
+    update((Dict *)o);
+}
+
+void Dict::methodReserve(){
+    checkWritable();
+    int n = api->popInt();
+    if(n<0 || n>MAXRESERVE)
+        throw Exception(NULL).set("cannot reserve room for %d items",n);
+    reserve(n);
+}
+
+void Dict::methodCapacity(){
+    api->pushInt(capacity());
+}
+
+// the keys are kept by each thread's VM, since the references
+// holding them never leave it
 
 int Dict::allocKey(){
-    return keyPool.alloc();
+    return Language::getVM()->dictKeys.alloc();
 }
 
 void Dict::freeKey(int id){
-    keyPool.free(id);
+    Language::getVM()->dictKeys.free(id);
 }
 
 Value *Dict::getKey(int id){
-    return keyPool.get(id);
+    return Language::getVM()->dictKeys.get(id);
 }
 
 
@@ -76,6 +114,7 @@ const char *DictRefType::repr(const Value *v) const {
 }
 
 void DictRefType::store(Value *ref,Value *v){
+    ref->d.dict->checkWritable();
     Value *k = Dict::getKey(ref->d2.i);
     ref->d.dict->set(k,v);
 }
@@ -91,6 +130,7 @@ bool DictRefType::isDefinedReference(Value *v){
 }
 
 bool DictRefType::deleteElement(Value *v){
+    v->d.dict->checkWritable();
     Value *key = Dict::getKey(v->d2.i);
     return v->d.dict->del(key);
     
@@ -29,20 +29,17 @@ public:
     /// use this to create dictionaries
     static Dict *create(class API *a);
     
+    /// create a dictionary from a list of [key,value] lists
+    static Dict *fromPairs(class API *a,class List *pairs);
+    
     /// clones of dictionaries should copy the dictionary contents
     
     virtual Object *clone(class API *a){
         Dict *d = create(a);
         d->makeCloneOf(this);
         
-        // copy the data into the new object
-        
-        IteratorPtr<Value *>iterator(createKeyIterator(false));
-        for(iterator->first();!iterator->isDone();iterator->next()){
-            Value *key = iterator->current();
-            Value *val = get(key);
-            d->set(key,val);
-        }
+        // copy the table over wholesale
+        d->hash.copyFrom(&hash);
         return d;
     }
     
@@ -66,10 +63,7 @@ public:
     
     /// direct key from value key
     Value *get(Value *k){
-        if(hash.find(k))
-            return hash.getval();
-        else
-            return NULL;
+        return hash.lookup(k);
     }
     
     /// copy a value into the hash
@@ -87,6 +81,43 @@ public:
         return hash.used;
     }
     
+    /// shrink the hash to fit the data
+    virtual void compact(){
+        Object::compact();
+        hash.compact();
+    }
+    
+    /// make sure there's room for n items without resizing
+    void reserve(int n){
+        hash.reserve(n);
+    }
+    
+    /// the number of items which can be stored without resizing
+    int capacity(){
+        return hash.capacity();
+    }
+    
+    /// copy all the items in another dictionary into this one,
+    /// overwriting any with the same keys
+    void update(Dict *src){
+        hash.update(&src->hash);
+    }
+    
+    /// the underlying hash, for iterating in place (see forloop.cpp)
+    Hash *getHash(){
+        return &hash;
+    }
+    
+    /// native method for 'update(d)'
+    void methodUpdate();
+    /// native method for 'reserve(n)'
+    void methodReserve();
+    /// the most items reserve(n) will make room for, which is more
+    /// than anything sensible needs
+    static const int MAXRESERVE = 1<<24;
+    /// native method for 'v=capacity()'
+    void methodCapacity();
+    
     /// allocate a key from the key pool - returns a key handle
     static int allocKey();
     /// free a key to the key pool, given its handle
@@ -127,6 +158,9 @@ struct DictionaryType : public ObjectType {
 /// because values can themselves be keys, so the actual dictref is stored in a pool.
 
 struct DictRefType : public Type {
+    DictRefType(){
+        isRef = true;
+    }
     virtual const char *repr(const Value *v) const;
     virtual void store(Value *ref,Value *v);
     virtual Value *deref(Value *v);
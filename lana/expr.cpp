@@ -148,7 +148,7 @@ bool Compiler::scanExpr(bool topLevel) {
             
             if(!expectingValue)
                 error("invalid id '%s'",tok->getstring());
-            emitVariableRef(tok->getstring());
+            emitVariableLoad(tok->getstring());
             expectingValue=false;
         }
     } else {
@@ -171,6 +171,9 @@ bool Compiler::scanExpr(bool topLevel) {
             // push the token
             if(expectingValue)
                 error("invalid '['");
+            // the container may be written to through the [], so
+            // it's a reference
+            makeLastRef();
             cg->current->epush(t,2);
             expectingValue=true;
             break;
@@ -226,7 +229,7 @@ bool Compiler::scanExpr(bool topLevel) {
                 // it really is an expression
                 if(!expectingValue)
                     error("invalid id '%s'",tok->getstring());
-                emitVariableRef(tok->getstring());
+                emitVariableLoad(tok->getstring());
                 expectingValue=false;
             }
             
@@ -392,8 +395,9 @@ bool Compiler::scanExpr(bool topLevel) {
                 cg->current->epush(t,2);
                 expectingValue=true;
             } else {
-                // it's a function call, or function-call-like pattern
-                scanFuncCall();
+                // it's a function call, or function-call-like pattern.
+                // defined() and del() work on the variable itself.
+                scanFuncCall(lastLoadIsGlobal("defined") || lastLoadIsGlobal("del"));
                 expectingValue=false;
             }
             break;
@@ -466,6 +470,9 @@ void Compiler::scanPropDeref(){
         error("expected a property name after '.'");
     int id = lana->consts->findOrCreateString(tok->getstring());
     
+    // the object is a reference, because using a property of some
+    // values (ranges, for example) changes them in place.
+    makeLastRef();
     // we just output that straight away
     cg->emit(OP_PROPREF,id);
 }
@@ -474,6 +481,10 @@ void Compiler::scanPropDeref(){
 
 void Compiler::doBinOp(int t){
     BinaryOperator *oper = BinaryOperator::getbinopbytok(t);
+    // the left hand side of an assignment is the only thing which
+    // has been output, so make it a reference now we know.
+    if(t==T_ASSIGN)
+        makeLastRef();
     for(;;){
         ExprItem *e = cg->current->epeek();
         if(!e || e->type == T_OPREN || e->type == T_OSQB || (oper->precedence < e->precedence))
@@ -535,10 +546,57 @@ void Compiler::emitVariableRef(const char *s) {
 }
 
 
+void Compiler::emitVariableLoad(const char *s) {
+    emitVariableRef(s);
+    
+    // and turn the reference into the equivalent load
+    instruction *p = cg->current->getlocptr()-1;
+    int op;
+    switch(INSTOP(*p)){
+    case OP_VARREFLOC:op=OP_LOADLOC;break;
+    case OP_VARREFPRM:op=OP_LOADPRM;break;
+    case OP_VARREFSES:op=OP_LOADSES;break;
+    default:op=OP_LOADGLB;break;
+    }
+    *p = INST(op,INSTDATA(*p));
+}
+
+void Compiler::makeLastRef() {
+    int loc = cg->current->getloc();
+    instruction *p = cg->current->getlocptr();
+    // skip back over brackets, so that (a)=1 still works
+    do {
+        if(!loc--)
+            return;
+        p--;
+    } while(INSTOP(*p)==OP_PAREN);
+    
+    int op;
+    switch(INSTOP(*p)){
+    case OP_LOADLOC:op=OP_VARREFLOC;break;
+    case OP_LOADPRM:op=OP_VARREFPRM;break;
+    case OP_LOADSES:op=OP_VARREFSES;break;
+    case OP_LOADGLB:op=OP_VARREFGLB;break;
+    default:
+        return;
+    }
+    *p = INST(op,INSTDATA(*p));
+}
+
+bool Compiler::lastLoadIsGlobal(const char *name) {
+    if(!cg->current->getloc())
+        return false;
+    instruction *p = cg->current->getlocptr()-1;
+    if(INSTOP(*p)!=OP_LOADGLB)
+        return false;
+    constid id = lana->globs->getName(INSTDATA(*p));
+    return id == lana->consts->findOrCreateString(name);
+}
+
 /// scan function call
 /// scan position: varname ( *** expr, expr, expr... )
 
-void Compiler::scanFuncCall() {
+void Compiler::scanFuncCall(bool refArgs) {
     
     // scan and stack the arguments
     
@@ -553,6 +611,8 @@ void Compiler::scanFuncCall() {
             cg->pushestack();
             scanExpr(); // scan the argument and compile it
             cg->popestack();
+            if(refArgs)
+                makeLastRef();
             argc++;
             t = tok->getnext();
             if(t==T_CPREN)
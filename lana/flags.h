@@ -11,5 +11,9 @@
 #define LOP_STRIPCOMMENTS 1
 /// do not attempt to execute the code - just parse it
 #define LOP_NORUN 2
+/// run user functions on the register VM where possible (see regvm.h)
+#define LOP_REGISTERVM 4
+/// do not optimise code as it's compiled (see optimise.h)
+#define LOP_NOOPTIMISE 8
 
 #endif /* __FLAGS_H */
@@ -0,0 +1,167 @@
+/**
+ * @file
+ * Ranges, keys/values views and inline for-loop state - see forloop.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "api.h"
+#include "object.h"
+#include "dict.h"
+#include "list.h"
+#include "iterobj.h"
+#include "forloop.h"
+
+using namespace lana;
+
+/// the hash tables of a viewed container mustn't be reorganised by
+/// deletions while the view exists, or a loop over it could skip items.
+/// This does what the hashes' own iterators do, counting atomically
+/// since an immortal container can be viewed by several threads at once.
+
+static void pinStorage(Object *o,int n){
+    // nothing can be deleted from a frozen container
+    if(o->frozen)
+        return;
+    if(o->type == Types::vtDictionary)
+        __atomic_add_fetch(&((Dict *)o)->getHash()->iterators,n,__ATOMIC_RELAXED);
+    else if(o->type == Types::vtObject)
+        __atomic_add_fetch(&o->properties.iterators,n,__ATOMIC_RELAXED);
+}
+
+void Value::incViewRef(){
+    d.o->incRefCt();
+    pinStorage(d.o,1);
+}
+
+void Value::decViewRef(){
+    pinStorage(d.o,-1);
+    if(d.o->decRefCt())
+        delete d.o;
+}
+
+/// replace a range or view with an iterator object, so that its
+/// iterator methods can be used.
+
+static void promote(API *api,Value *v){
+    IteratorObject *o = IteratorObject::create(api,v,false);
+    v->setIterObj(o);
+}
+
+const char *RangeType::repr(const Value *v) const {
+    startRepr();
+    sprintf(buf+strlen(buf),"%d..%d",v->d.i,v->d2.i);
+    return buf;
+}
+
+Iterator<Value *> *RangeType::createIter(Value *v,bool keys){
+    return new RangeIterator(v->d.i,v->d2.i);
+}
+
+bool RangeType::makePropRef(Value *v,Value *item,u32 prop){
+    promote(api,item);
+    return item->type->makePropRef(v,item,prop);
+}
+
+int RangeType::getSize(Value *v){
+    return v->d2.i>v->d.i ? v->d2.i-v->d.i : 0;
+}
+
+const char *ViewType::repr(const Value *v) const {
+    startRepr();
+    sprintf(buf+strlen(buf),"%p/(ct%d)",v->d.o,v->d.o->refct);
+    return buf;
+}
+
+Iterator<Value *> *ViewType::createIter(Value *v,bool k){
+    // the view decides whether it's keys or values, not the caller
+    return keys ? v->d.o->createKeyIterator(false) : v->d.o->createValueIterator();
+}
+
+bool ViewType::makePropRef(Value *v,Value *item,u32 prop){
+    promote(api,item);
+    return item->type->makePropRef(v,item,prop);
+}
+
+int ViewType::getSize(Value *v){
+    Value c;
+    c.setObj(v->d.o);
+    return c.type->getSize(&c);
+}
+
+bool lana::makeView(Value *v,Value *c,bool keys){
+    Type *t = c->type;
+    if(t!=Types::vtList && t!=Types::vtDictionary && t!=Types::vtObject)
+        return false;
+
+    // build it in a temporary, which holds a reference while v is
+    // cleared - c may be v.
+    Value view;
+    view.type = keys ? Types::vtKeysView : Types::vtValuesView;
+    view.d.o = c->d.o;
+    view.d2.i = 0;
+    view.incRef();
+    *v = view;
+    return true;
+}
+
+bool lana::startLoop(Value *state,Value *src){
+    Type *t = src->type;
+    if(t==Types::vtRange || t==Types::vtKeysView || t==Types::vtValuesView){
+        // copy the range or view, so the loop doesn't change the original
+        if(state!=src)
+            *state = *src;
+        if(t!=Types::vtRange)
+            state->d2.i = 0;
+        return true;
+    }
+    return makeView(state,src,false);
+}
+
+bool lana::stepView(Value *state,Value *ref){
+    bool keys = state->type == Types::vtKeysView;
+    Object *o = state->d.o;
+    int pos = state->d2.i;
+
+    if(o->type == Types::vtList){
+        ArrayList *list = ((List *)o)->list;
+        if(pos >= list->count())
+            return false;
+        if(keys){
+            Value v;
+            v.setInt(pos);
+            ref->store(&v);
+        } else
+            ref->store(list->get(pos));
+    } else if(o->type == Types::vtDictionary){
+        // look up the table each time, the loop body may have grown it
+        Hash *h = ((Dict *)o)->getHash();
+        for(;;pos++){
+            if(pos > (int)h->mask)
+                return false;
+            if(h->table[pos].isUsed())
+                break;
+        }
+        HashEnt *ent = h->table+pos;
+        ref->store(keys ? &ent->k : &ent->v);
+    } else {
+        IntKeyedHash<Value> *h = &o->properties;
+        for(;;pos++){
+            if(pos > (int)h->mask)
+                return false;
+            if(h->table[pos].s == HSH_USED)
+                break;
+        }
+        IntKeyedHashEnt<Value> *ent = h->table+pos;
+        if(keys){
+            Value v;
+            v.setInt(0);
+            v.d.u = ent->k;
+            ref->store(&v);
+        } else
+            ref->store(&ent->v);
+    }
+    state->d2.i = pos+1;
+    return true;
+}
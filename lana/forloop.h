@@ -0,0 +1,119 @@
+/**
+ * @file
+ * Inline state for "for" loops. Wrapping the thing being iterated in an
+ * IteratorObject means allocating an object and an iterator for every
+ * loop, so the common cases keep their state in the loop's slot on the
+ * execution stack instead:
+ * - range(a,b) returns a vtRange value, which is its own loop state.
+ * - keys(x) and values(x), where x is a list, dictionary or plain
+ *   object, return a view of x holding a reference to it. Iterating
+ *   over x directly makes a values view.
+ *
+ * None of these allocate. If one of their iterator methods (first(),
+ * next() etc.) is used, the value is converted into a real IteratorObject
+ * in place. Anything else is still iterated through an IteratorObject.
+ */
+
+#ifndef __FORLOOP_H
+#define __FORLOOP_H
+
+#include "value.h"
+
+namespace lana {
+
+/// the Range iterator, used where a range needs to be wrapped in an
+/// IteratorObject
+
+class RangeIterator : public Iterator<Value *> {
+public:
+    RangeIterator(int b,int t){
+        v.setInt(0);
+        pct = &v.d.i;
+
+        bottom=b;
+        top=t;
+    }
+
+    virtual void first(){
+        *pct = bottom;
+    }
+
+    virtual void next(){
+        (*pct)++;
+    }
+
+    virtual bool isDone() const{
+        return *pct>=top;
+    }
+
+    virtual Value *current(){
+        return &v;
+    }
+
+private:
+    Value v;
+    s32 *pct;
+    int bottom,top;
+};
+
+/// the type of range values
+struct RangeType : public Type {
+    RangeType(API *a){
+        api = a;
+    }
+    virtual const char *repr(const Value *v) const;
+    virtual Iterator<Value *> *createIter(Value *v,bool keys);
+    /// the range's iterator methods, which turn it into an iterator object
+    virtual bool makePropRef(Value *v,Value *item,u32 prop);
+    virtual int getSize(Value *v);
+private:
+    API *api;
+};
+
+/// the type of keys and values views
+struct ViewType : public Type {
+    ViewType(API *a,bool k){
+        api = a;
+        keys = k;
+    }
+    virtual const char *repr(const Value *v) const;
+    virtual Iterator<Value *> *createIter(Value *v,bool keys);
+    /// the view's iterator methods, which turn it into an iterator object
+    virtual bool makePropRef(Value *v,Value *item,u32 prop);
+    virtual int getSize(Value *v);
+
+    bool keys; //!< is this a view of the keys?
+private:
+    API *api;
+};
+
+/// set v to a view of the keys or values of a container, returning
+/// false if the container can't be viewed. c and v may be the same.
+bool makeView(Value *v,Value *c,bool keys);
+
+/// turn a for-loop's slot into inline loop state for iterating over src,
+/// which may be the slot itself. Returns false if this can't be done, in
+/// which case an IteratorObject must be used.
+bool startLoop(Value *state,Value *src);
+
+/// step the inline state of a loop over a view; see stepLoop()
+bool stepView(Value *state,Value *ref);
+
+/// step a for-loop's inline state, storing the next item in the loop
+/// variable reference and returning true, or returning false at the end.
+/// The first call after startLoop() gets the first item.
+inline bool stepLoop(Value *state,Value *ref){
+    if(state->type == Types::vtRange){
+        if(state->d.i >= state->d2.i)
+            return false;
+        Value v;
+        v.setInt(state->d.i++);
+        ref->store(&v);
+        return true;
+    }
+    return stepView(state,ref);
+}
+
+}
+
+#endif /* __FORLOOP_H */
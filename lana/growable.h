@@ -9,6 +9,7 @@
 
 
 #include <memory.h>
+#include <stdlib.h>
 #include <stdio.h>
 
 #include "basetypes.h"
@@ -27,7 +28,9 @@ namespace lana {
 /// then be retrieved with get().
 ///
 /// <b>Caution:</b> do NOT store pointers to things in a Growable -
-/// if the Growable is resized they will no longer be valid!
+/// if the Growable is resized they will no longer be valid! The
+/// exception is a fixed Growable, which allocates all the memory it can
+/// ever have when it's made and so never moves.
 
 class Growable
 {
@@ -50,6 +53,8 @@ protected:
     
     /// a snapshot pointer
     u32 mSnapshot;
+    /// is the block fixed at its starting size?
+    bool mFixed;
     
 public:
     
@@ -58,12 +63,22 @@ public:
     Growable(
              u32 basesize,	//!< starting size in bytes
              u32 growsize,	//!< size to grow when runs out
-             u32 align=4	//!< alignment of each item (including the descriptor,) must be power of 2 
+             u32 align=4,	//!< alignment of each item (including the descriptor,) must be power of 2 
+             bool fixed=false //!< if set, basesize is all it can hold, and it never moves
              )  {
         mCurSize = basesize;
         mGrowSize = growsize;
-        mBase = new char [mCurSize];
-        memset(mBase,0,mCurSize);
+        mFixed = fixed;
+        if(fixed){
+            // a large calloc() comes straight from the system, whose
+            // pages aren't really allocated until they're touched
+            mBase = (char *)calloc(mCurSize,1);
+            if(!mBase)
+                throw GrowableException("out of memory");
+        } else {
+            mBase = new char [mCurSize];
+            memset(mBase,0,mCurSize);
+        }
         mPtr = 0;
         mBase[0]=0;
         mAlignment = align-1;
@@ -71,7 +86,10 @@ public:
     
     /// delete the growable and its memory
     ~Growable() {
-        delete [] mBase;
+        if(mFixed)
+            free(mBase);
+        else
+            delete [] mBase;
     }
     
     /// allocate memory from the block and return an offset,
@@ -82,6 +100,8 @@ public:
         size = (size+mAlignment)&~mAlignment;
         if(mPtr+size >= mCurSize)
         {
+            if(mFixed)
+                throw GrowableException("out of space");
             // out of space, grow!
             
             int grow = (mPtr+size)-mCurSize;
@@ -103,7 +123,9 @@ public:
         u32 ret = mPtr;
         if(mPtr>mCurSize)
             throw GrowableException("oops");
-        mPtr+=size;
+        // a fixed block can be read by other threads while this one
+        // allocates (see get())
+        __atomic_store_n(&mPtr,mPtr+size,__ATOMIC_RELAXED);
         return ret;
     }
     
@@ -149,7 +171,7 @@ public:
     /// the first byte.
     
     void *get(u32 i,u32 size){
-        if(i+size>mPtr)
+        if(i+size>__atomic_load_n(&mPtr,__ATOMIC_RELAXED))
             throw GrowableException("bad offset requested in growable");
         
         return (void *)(mBase+i);
@@ -182,6 +204,10 @@ public:
     
     /// delete memory allocated after the marker. Ugly.
     void restoreSnapshot() {
+        if(mFixed){
+            mPtr = mSnapshot;
+            return;
+        }
         char *oldbase = mBase;
         // shrink
         mCurSize = mSnapshot;
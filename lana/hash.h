@@ -28,6 +28,13 @@ namespace lana {
 #define RESIZE_THRESHOLD_NUMERATOR 2
 #define RESIZE_THRESHOLD_DENOMINATOR 3
 
+// shrink on delete when fewer than 1/8 of the slots are in use; since
+// a shrink leaves the table at least 1/4 full there's a band of
+// hysteresis between the two, so alternate set/del won't thrash.
+#define SHRINK_THRESHOLD_DENOMINATOR 8
+// rehash on delete when more than 1/4 of the slots are dummies
+#define DUMMY_THRESHOLD_DENOMINATOR 4
+
 //#define DEBUG 1
 
 
@@ -83,6 +90,7 @@ public:
         table = new HashEnt[mask+1];
         used=0;
         fill=0;
+        iterators=0;
     }
     
     ~Hash(){
@@ -97,8 +105,11 @@ public:
     /// set a value in the table
     
     virtual void set(Value *k,Value *val){
-        
-        u64 hash = k->getHash();
+        setHashed(k,k->getHash(),val);
+    }
+    
+    /// set a value in the table whose key's hash we already know
+    void setHashed(Value *k,u64 hash,Value *val){
         HashEnt *ent = look(k,hash);
         int n_used = used;
         
@@ -145,7 +156,17 @@ public:
         return storedVal;
     }
     
-    /// delete an item with a given key, returning true if we did it
+    /// find a value, returning NULL if it's not there. Unlike find(),
+    /// this doesn't change the hash, so threads can use it at once.
+    Value *lookup(Value *k){
+        HashEnt *ent = look(k,k->getHash());
+        return ent->isUsed() ? &ent->v : NULL;
+    }
+    
+    /// delete an item with a given key, returning true if we did it.
+    /// If the table has become very sparse it will shrink, and if it's
+    /// clogged up with dummies it will be rehashed - but not while there
+    /// are iterators running over it.
     bool del(Value *k) {
         HashEnt *ent = look(k,k->getHash());
         if(!ent->isUsed())
@@ -156,11 +177,74 @@ public:
         ent->v.clr();
         used--;
         
-        //        if(fill>used*4)
-        //            resize((used>50000 ? 2:4)*used);
+        if(!iterators){
+            unsigned int size = mask+1;
+            if(size>INITIAL_SIZE && used*SHRINK_THRESHOLD_DENOMINATOR < size)
+                resize(4*used);
+            else if((fill-used)*DUMMY_THRESHOLD_DENOMINATOR > size)
+                resize(mask); // same size, just clears out the dummies
+        }
 	return true;
     }
     
+    /// rebuild the table at the smallest size which will hold the
+    /// current contents comfortably, discarding all the dummies.
+    void compact(){
+        if(iterators)
+            throw Exception("cannot compact a hash while iterating over it");
+        resize(2*used);
+    }
+    
+    /// make sure the table can hold n items without resizing. As with
+    /// ArrayList, deleting items may shrink the table again.
+    void reserve(unsigned int n){
+        if((n+fill-used)*RESIZE_THRESHOLD_DENOMINATOR >= (mask+1)*RESIZE_THRESHOLD_NUMERATOR)
+            resize(n+n/2);
+    }
+    
+    /// the number of items the table can hold without resizing
+    unsigned int capacity(){
+        return ((mask+1)*RESIZE_THRESHOLD_NUMERATOR-1)/RESIZE_THRESHOLD_DENOMINATOR;
+    }
+    
+    /// copy all the items in another hash into this one, resizing at
+    /// most once and without recalculating any hashes.
+    void update(Hash *src){
+        if(src==this)
+            return;
+        reserve(used+src->used);
+        HashEnt *ent = src->table;
+        for(unsigned int i=0;i<=src->mask;i++,ent++){
+            if(ent->isUsed())
+                setHashed(&ent->k,ent->hash,&ent->v);
+        }
+    }
+    
+    /// make this hash, which must be empty, an exact copy of
+    /// another by copying the table slot by slot. Dummies are copied
+    /// too, since the probe sequences depend on them.
+    void copyFrom(Hash *src){
+        if(used || fill)
+            throw Exception("copyFrom() on a hash which isn't empty");
+        if(mask!=src->mask){
+            delete [] table;
+            mask = src->mask;
+            table = new HashEnt[mask+1];
+        }
+        HashEnt *ent = src->table;
+        HashEnt *dest = table;
+        for(unsigned int i=0;i<=mask;i++,ent++,dest++){
+            if(ent->isUsed()){
+                dest->k = ent->k;
+                dest->v = ent->v;
+                dest->hash = ent->hash;
+            } else if(ent->isDeleted())
+                dest->k.type = Types::vtDeleted;
+        }
+        used = src->used;
+        fill = src->fill;
+    }
+    
     
     /// create a value iterator
     class Iterator<Value *> *createValueIterator();
@@ -180,14 +264,16 @@ public:
     unsigned int used; //!< number of slots occupied by keys
     unsigned int fill; //!< number of slots occupied by keys or dummies (used only if we implement deletion)
     unsigned int mask; //!< hashtable contains mask+1 slots
+    unsigned int iterators; //!< number of live iterators; we don't shrink or rehash on delete if nonzero
     
-    
+    /// rebuild the table, with the smallest size greater than minused
+    /// (but at least INITIAL_SIZE). This may shrink the table.
     void resize(unsigned int minused){
         unsigned int oldsize = mask+1;
         HashEnt *oldtable = table;
         
         int newsize;
-        for(newsize = oldsize; newsize<=minused && newsize>0;newsize<<=1){}
+        for(newsize = INITIAL_SIZE; newsize<=minused && newsize>0;newsize<<=1){}
         //        printf("resizing to %d\n",newsize);
         
         table = new HashEnt[newsize];
@@ -260,6 +346,12 @@ public:
     HashValueIterator(Hash *h){
         hash = h;
         ent = NULL;
+        // counted atomically, as a frozen hash may be being iterated
+        // over by other threads too
+        __atomic_add_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
+    }
+    virtual ~HashValueIterator(){
+        __atomic_sub_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
     }
     
     virtual void first(){
@@ -295,6 +387,12 @@ public:
     HashKeyIterator(Hash *h){
         hash = h;
         ent = NULL;
+        // counted atomically, as a frozen hash may be being iterated
+        // over by other threads too
+        __atomic_add_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
+    }
+    virtual ~HashKeyIterator(){
+        __atomic_sub_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
     }
     
     virtual void first(){
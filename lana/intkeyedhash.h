@@ -27,6 +27,11 @@ namespace lana {
 #define RESIZE_THRESHOLD_NUMERATOR 2
 #define RESIZE_THRESHOLD_DENOMINATOR 3
 
+// shrink on delete when fewer than 1/8 of the slots are in use, and
+// rehash on delete when more than 1/4 are dummies. See hash.h.
+#define SHRINK_THRESHOLD_DENOMINATOR 8
+#define DUMMY_THRESHOLD_DENOMINATOR 4
+
 //#define DEBUG 1
 
 #define HSH_FREE    0 
@@ -40,11 +45,13 @@ template <class T>struct IntKeyedHashEnt {
     int s;		//!< state: free, used or deleted?
     T v;		//!< the value
     IntKeyedHashEnt(){k=0;s=HSH_FREE;}
-    ~IntKeyedHashEnt(){
-        s = HSH_DELETED;
-        v.~T();
+    
+    /// empty the slot, releasing the value. The value itself is only
+    /// destroyed with the slot, so that it's never destroyed twice.
+    void release(int state){
+        s = state;
+        v = T();
     }
-        
 };
 
 
@@ -73,6 +80,7 @@ public:
         table = new IntKeyedHashEnt<T>[mask+1];
         used=0;
         fill=0;
+        iterators=0;
         recalcresizethreshold();
     }
     
@@ -86,11 +94,8 @@ public:
     /// empty the hash of all values
     void clear(){
         IntKeyedHashEnt<T> *ent = table;
-        for(int i=0;i<=mask;i++){
-            if(ent->s == HSH_USED){
-                ent->v.~T();
-                ent->s = HSH_FREE;
-            }
+        for(unsigned int i=0;i<=mask;i++,ent++){
+            ent->release(HSH_FREE);
         }
         used=0;
         fill=0;
@@ -102,9 +107,12 @@ public:
     virtual  T* set(u32 k){
         //printf("set %d to %d, used %d, size %d\n",k,v,used,mask+1);
         
-        if(used > resizethreshold){
+        // this has to check fill rather than used, otherwise
+        // a table full of dummies will never get resized, and
+        // look() will never find a free slot.
+        if(fill > resizethreshold){
             //printf("RESIZE!!!!!\n");
-            resize();
+            resize(used*RESIZE_FACTOR);
         }
         
         IntKeyedHashEnt<T> *ent = look(k);
@@ -134,18 +142,57 @@ public:
             return false;
     }
     
+    /// finds a value in the hash table, returning a pointer to it or
+    /// NULL. Unlike find() this leaves the table alone, so other threads
+    /// can look things up in it too.
+    T *lookup(u32 k){
+        IntKeyedHashEnt<T> *ent = look(k);
+        return ent->s == HSH_USED ? &ent->v : NULL;
+    }
+    
     /// get the last value found by find()
     T *getval(){
         return v;
     }
     
-    /// delete an item with a given key, returning true if we did it
+    /// delete an item with a given key, returning true if we did it.
+    /// As with Hash, a sparse table will shrink and one clogged with
+    /// dummies will be rehashed, unless it's being iterated over.
     bool del(u32 k) {
         IntKeyedHashEnt<T> *ent = look(k);
         if(ent->s != HSH_USED)
             return false;
-        ent->~IntKeyedHashEnt<T>(); // delete old value!
+        ent->release(HSH_DELETED); // delete old value!
         used--;
+        
+        if(!iterators){
+            unsigned int size = mask+1;
+            if(size>INITIAL_SIZE && used*SHRINK_THRESHOLD_DENOMINATOR < size)
+                resize(used*RESIZE_FACTOR);
+            else if((fill-used)*DUMMY_THRESHOLD_DENOMINATOR > size)
+                resize(mask); // same size, just clears out the dummies
+        }
+        return true;
+    }
+    
+    /// rebuild the table at the smallest size which will hold the
+    /// current contents comfortably, discarding all the dummies.
+    void compact(){
+        if(iterators)
+            throw Exception("cannot compact a hash while iterating over it");
+        resize(used*2);
+    }
+    
+    /// make sure the table can hold n items without resizing. Deleting
+    /// items may shrink the table again.
+    void reserve(unsigned int n){
+        if(n+fill-used > capacity())
+            resize(n+n/2);
+    }
+    
+    /// the number of items the table can hold without resizing
+    unsigned int capacity(){
+        return resizethreshold+1;
     }
     
     
@@ -167,25 +214,29 @@ public:
     unsigned int fill; //!< number of slots occupied by keys or dummies (used only if we implement deletion)
     unsigned int mask; //!< hashtable contains mask+1 slots
     unsigned int resizethreshold;
+    unsigned int iterators; //!< number of live iterators; we don't shrink or rehash on delete if nonzero
     
     void recalcresizethreshold(){
         resizethreshold = (mask+1)*RESIZE_THRESHOLD_NUMERATOR;
         resizethreshold /= RESIZE_THRESHOLD_DENOMINATOR;
     }
     
-    void resize(){
+    /// rebuild the table, with the smallest size greater than minused
+    /// (but at least INITIAL_SIZE). This may shrink the table.
+    void resize(unsigned int minused){
         unsigned int oldsize = mask+1;
         IntKeyedHashEnt<T> *oldtable = table;
-        unsigned int minused = used*RESIZE_FACTOR;
               
         int newsize;
-        for(newsize = oldsize; newsize<=minused && newsize>0;newsize<<=1){}
+        for(newsize = INITIAL_SIZE; (unsigned int)newsize<=minused && newsize>0;newsize<<=1){}
         //printf("resizing to %d\n",newsize);
         
         table = new IntKeyedHashEnt<T>[newsize];
         mask = newsize-1;
         used = 0;
         fill = 0;
+        // do this before reinserting, so set() can't recurse into resize()
+        recalcresizethreshold();
         // iterate values, reinserting into new table
         IntKeyedHashEnt<T> *ent=oldtable;
         T *p;
@@ -197,7 +248,6 @@ public:
             }
         }
         delete [] oldtable;
-        recalcresizethreshold();
         //printf("RESIZE END!\n");
     }
     
@@ -239,6 +289,12 @@ public:
     IntKeyedHashValueIterator(IntKeyedHash<T> *h){
         hash = h;
         ent=NULL;
+        // counted atomically, as a frozen hash may be being iterated
+        // over by other threads too
+        __atomic_add_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
+    }
+    virtual ~IntKeyedHashValueIterator(){
+        __atomic_sub_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
     }
     
     virtual void first(){
@@ -279,6 +335,13 @@ template <class T> class IntKeyedHashKeyIterator : public Iterator<u32> {
 public:
     IntKeyedHashKeyIterator(IntKeyedHash<T> *h){
         hash = h;
+        ent=NULL;
+        // counted atomically, as a frozen hash may be being iterated
+        // over by other threads too
+        __atomic_add_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
+    }
+    virtual ~IntKeyedHashKeyIterator(){
+        __atomic_sub_fetch(&hash->iterators,1,__ATOMIC_RELAXED);
     }
     
     virtual void first(){
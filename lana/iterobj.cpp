@@ -12,7 +12,7 @@ IterObjectType::IterObjectType(API *a) : ObjectType() {
     proto->registerNativeMethod("next",0,false,MT(next));
     proto->registerNativeMethod("isDone",0,true,MT(methodIsDone));
     proto->registerNativeMethod("current",0,true,MT(methodCurrent));
-    proto->incRefCt(); // never die!
+    proto->makeImmortal(); // never die, and be shared by every thread
 }
 
 
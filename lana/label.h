@@ -90,6 +90,8 @@ private:
         int inst = INSTOP(*op);
         if(inst==OP_GOTOFW)
             inst = (diff>0)?OP_GOTOFW:OP_GOTOBK;
+        else if(inst==OP_CONTINUE)
+            inst = (diff>0)?OP_CONTINUEFW:OP_CONTINUE;
         if(diff<0)diff=-diff;
         *op = INST(inst,diff);
     }
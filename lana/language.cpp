@@ -22,6 +22,9 @@ namespace lana {
 extern TokenRegistry tokens[];
 }
 
+__thread VirtualMachine *Language::threadVM = NULL;
+__thread bool Language::threadCounted = false;
+
 Language::Language(class API *a){
     eofdcomment=NULL;
     currentRecreateLDT = NULL;
@@ -37,9 +40,15 @@ Language::Language(class API *a){
     recreateIndent = 0;
     debugFlags = 0;
     opFlags = 0;
+    inlineMaxSize = 32;
+    inlineMaxGrowth = 256;
     tmpgrow = new Growable(1024,1024,1);
+    threads = 0;
+    callSites = 0;
+    immortalStrings = NULL;
+    immortalStringCount = immortalStringSize = 0;
     vm = new VirtualMachine(this); // after everything else
-    a->cycle = &cycle;
+    threadVM = vm;
     Value::setConsts(consts);
     Types::createTypes(a);
     
@@ -51,12 +60,20 @@ Language::Language(class API *a){
 
 
 Language::~Language(){
-    cycle.detect();
+    vm->cycle.detect();
     
     delete tok;
     delete globs;
     delete consts;
     delete vm;
+    threadVM = NULL;
+    
+    // nothing else can refer to frozen objects now. They refer to each
+    // other, so they're deleted together, and then the strings in them.
+    CycleDetector::deleteAll(frozen);
+    for(int i=0;i<immortalStringCount;i++)
+        free(immortalStrings[i]);
+    free(immortalStrings);
 
     delete tmpgrow;
     
@@ -66,6 +83,62 @@ Language::~Language(){
 
 
 
+void Language::attachThread(bool counted){
+    MutexLock l(lock);
+    if(threadVM)
+        throw Exception("thread is already attached");
+    threadVM = new VirtualMachine(this,true);
+    Value::setConsts(consts);
+    threadCounted = counted;
+    if(counted)
+        beginThreaded();
+}
+
+void Language::addFrozen(GarbageCollected *o){
+    MutexLock l(lock);
+    frozen.addToHead(o);
+}
+
+void Language::makeStringImmortal(void *s){
+    refct_t *ct = (refct_t *)s;
+    if(*ct==IMMORTAL_REFCT)
+        return;
+    MutexLock l(lock);
+    if(immortalStringCount==immortalStringSize){
+        immortalStringSize = immortalStringSize ? immortalStringSize*2 : 64;
+        immortalStrings = (void **)realloc(immortalStrings,
+                                           immortalStringSize*sizeof(void *));
+    }
+    immortalStrings[immortalStringCount++] = s;
+    *ct = IMMORTAL_REFCT;
+}
+
+void Language::beginThreaded(){
+    MutexLock l(lock);
+    // globals can't move while another thread might be using them
+    __atomic_add_fetch(&threads,1,__ATOMIC_RELAXED);
+    globs->setLocked(true);
+}
+
+void Language::endThreaded(){
+    MutexLock l(lock);
+    if(!__atomic_sub_fetch(&threads,1,__ATOMIC_RELAXED))
+        globs->setLocked(false);
+}
+
+void Language::detachThread(){
+    MutexLock l(lock);
+    if(!threadVM || threadVM==vm)
+        throw Exception("thread is not attached");
+    // anything left in a cycle goes with the VM
+    threadVM->cycle.detect();
+    delete threadVM;
+    threadVM = NULL;
+    Value::setConsts(NULL);
+    if(threadCounted)
+        endThreaded();
+}
+
 void Language::dprintf(const char *s,...)
 {
     char buf[256];
@@ -82,6 +155,7 @@ void Language::dprintf(const char *s,...)
 
 
 Value *Language::registerGlobalVariable(const char *name){
+    MutexLock l(lock);
     // create a global
     int desc = consts->findOrCreateString(name);
     int id = globs->find(desc);
@@ -101,6 +175,7 @@ void Language::dumpCode(instruction *firstinst,int size,Session *s){
 }    
 
 constid Language::registerID(const char *id){
+    MutexLock l(lock);
     return consts->findOrCreateString(id);
 }
     
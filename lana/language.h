@@ -19,6 +19,7 @@
 #include "intkeyedhash.h"
 #include "listener.h"
 #include "natfunc.h"
+#include "thread.h"
 
 using namespace lana;
 
@@ -44,14 +45,39 @@ private:
     /// the global variables
     GlobalVars *globs;
     
-    /// the virtual machine
+    /// the virtual machine of the thread which created us
     class VirtualMachine *vm;
     
+    /// the virtual machine of the calling thread, or NULL if it isn't
+    /// attached (see attachThread())
+    static __thread class VirtualMachine *threadVM;
+    
+    /// was the calling thread counted by attachThread()?
+    static __thread bool threadCounted;
+    
+    /// the number of threads running code besides the one which
+    /// created us - see beginThreaded()
+    int threads;
+    
+    /// the number of call sites made so far - see newCallSite()
+    int callSites;
+    
+    /// the objects frozen so far, deleted with us - see addFrozen()
+    GCList frozen;
+    /// the strings made immortal so far, and how many there are room for
+    void **immortalStrings;
+    int immortalStringCount,immortalStringSize;
+    
     /// various debugging flags - see debug.h and setDebug()
     int debugFlags;
     /// various operation flags - see flags.h and setFlags()
     int opFlags;
     
+    /// the largest user function, in instructions, which is inlined
+    /// where it's called, and the most instructions inlining can add
+    /// to a function - see setInlineLimits()
+    int inlineMaxSize,inlineMaxGrowth;
+    
 public:
     Language(class API *a);
     ~Language();
@@ -60,6 +86,56 @@ public:
     void setValueConsts(){
         Value::setConsts(consts);
     }
+    
+    /// get the calling thread's virtual machine, or NULL if it
+    /// isn't attached
+    static class VirtualMachine *getVM(){
+        return threadVM;
+    }
+    
+    /// give the calling thread a virtual machine of its own, so that
+    /// it can run code (see thread.h). It's counted as running code
+    /// until it detaches, unless it's only attached to be given work
+    /// (as the work pool's threads are), in which case whoever gives
+    /// it work counts it with beginThreaded().
+    void attachThread(bool counted=true);
+    
+    /// delete the calling thread's virtual machine
+    void detachThread();
+    
+    /// count a thread as running code until endThreaded(). While any
+    /// are, globals can't be created or changed.
+    void beginThreaded();
+    /// stop counting a thread counted by beginThreaded()
+    void endThreaded();
+    
+    /// take an object which has been frozen (see Object::freeze()),
+    /// and so is immortal, and delete it when we're deleted
+    void addFrozen(GarbageCollected *o);
+    /// make a string immortal, as part of a frozen structure or an
+    /// immortal heap (see API::makeHeapImmortal()), and free it when
+    /// we're deleted. The string is the block a value's d.s points to.
+    void makeStringImmortal(void *s);
+    
+    /// are threads other than ours running code?
+    bool isThreaded(){
+        // read without the mutex, so that it costs nothing when
+        // there aren't any
+        return __atomic_load_n(&threads,__ATOMIC_RELAXED)!=0;
+    }
+    
+    /// the mutex held by anything adding to what the threads share,
+    /// such as the compiler (see thread.h)
+    Mutex lock;
+    
+    /// number a new call site, returning -1 if there's no room for any
+    /// more. Each VM keeps its own call sites, under the same numbers,
+    /// as the code which uses them is shared (see OP_CALLSITE).
+    int newCallSite(){
+        if(callSites >= (1<<16)) // the most OP_CALLSITE can index
+            return -1;
+        return callSites++;
+    }
         
     
     /// set debugging flags, returning previous value
@@ -76,6 +152,13 @@ public:
         return old;
     }
     
+    /// set how much inlining is done in functions compiled from now on
+    /// (see Optimiser::inlineCalls()). Either being 0 turns it off.
+    void setInlineLimits(int maxsize,int maxgrowth){
+        inlineMaxSize = maxsize;
+        inlineMaxGrowth = maxgrowth;
+    }
+    
     
     /// are we awaiting more input for the current function?
     bool awaitingInput();
@@ -186,10 +269,6 @@ private:
     
     /// end-of-funcdef comment
     instruction *eofdcomment;
-    
-    /// cycle detector system
-    CycleDetector cycle;
-    
 };    
 
 struct BinaryOperator {
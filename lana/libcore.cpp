@@ -8,51 +8,30 @@
 #include "object.h"
 #include "dict.h"
 #include "list.h"
+#include "typedarray.h"
+#include "forloop.h"
 #include "iterobj.h"
 #include "consts.h"
+#include "workpool.h"
+#include "actor.h"
 
 #include <math.h>
 
 namespace lana {
 
-/// the Range iterator, created by the range() lib function
+/// handy macro to help writing methods
 
-class RangeIterator : public Iterator<Value *> {
-public:
-    RangeIterator(int b,int t){
-        v.setInt(0);
-        pct = &v.d.i;
-        
-        bottom=b;
-        top=t;
-    }
-    
-    virtual void first(){
-        *pct = bottom;
-    }
-    
-    virtual void next(){
-        (*pct)++;
-    }
-    
-    virtual bool isDone() const{
-        return *pct>=top;
-    }
-    
-    virtual Value *current(){
-        return &v;
-    }
-    
-private:
-    Value v;
-    s32 *pct;
-    int bottom,top;
-};
+#define MT(xx) (lana::HOSTMETHOD)&LibCoreHost::xx
 
+// functions bound with API::bind(), which needn't be methods
 
-/// handy macro to help writing methods
+static int intg(int i){
+    return i;
+}
 
-#define MT(xx) (lana::HOSTMETHOD)&LibCoreHost::xx
+static float flt(float f){
+    return f;
+}
 
 /// Useful library functions bound to the API at at startup - note that
 /// Lana itself doesn't get these; they're bound when the API is created.
@@ -72,8 +51,8 @@ public:
         
         a->setNamePrefix("CORE$");
         a->globalNativeHostedMethod("str",1,true,this,MT(str));
-        a->globalNativeHostedMethod("int",1,true,this,MT(intg));
-        a->globalNativeHostedMethod("float",1,true,this,MT(flt));
+        a->bind("int",&intg);
+        a->bind("float",&flt);
         a->globalNativeHostedMethod("hash",1,true,this,MT(hash));
         
         a->globalNativeHostedMethod("print",1,false,this,MT(print));
@@ -96,16 +75,32 @@ public:
         a->globalNativeHostedMethod("size",1,true,this,MT(size));
         a->globalNativeHostedMethod("keys",1,true,this,MT(keys));
         a->globalNativeHostedMethod("values",1,true,this,MT(values));
+        a->globalNativeHostedMethod("compact",1,false,this,MT(compact));
+        a->globalNativeHostedMethod("frompairs",1,true,this,MT(frompairs));
+        a->globalNativeHostedMethod("freeze",1,true,this,MT(freeze));
+        a->globalNativeHostedMethod("isfrozen",1,true,this,MT(isfrozen));
+        a->globalNativeHostedMethod("immortalize",0,true,this,MT(immortalize));
+        a->globalNativeHostedMethod("pmap",2,true,this,MT(pmap));
+        a->globalNativeHostedMethod("pfilter",2,true,this,MT(pfilter));
+        a->globalNativeHostedMethod("preduce",3,true,this,MT(preduce));
+        a->globalNativeHostedMethod("spawn",2,true,this,MT(spawn));
+        a->globalNativeHostedMethod("send",2,true,this,MT(send));
+        a->globalNativeHostedMethod("receive",0,true,this,MT(receive));
+        a->globalNativeHostedMethod("self",0,true,this,MT(self));
+        a->globalNativeHostedMethod("join",1,true,this,MT(join));
+        a->globalNativeHostedMethod("int32array",1,true,this,MT(int32array));
+        a->globalNativeHostedMethod("float32array",1,true,this,MT(float32array));
+        a->globalNativeHostedMethod("float64array",1,true,this,MT(float64array));
         
         
 	a->globalNativeHostedMethod("native",1,true,this,MT(native));
         
         a->globalNativeHostedMethod("args",0,true,this,MT(args));
         
-        a->globalNativeHostedMethod("pow",2,true,this,MT(pow));
-        a->globalNativeHostedMethod("sin",1,true,this,MT(sin));
-        a->globalNativeHostedMethod("cos",1,true,this,MT(cos));
-        a->globalNativeHostedMethod("tan",1,true,this,MT(tan));
+        a->bind("pow",&powf);
+        a->bind("sin",&sinf);
+        a->bind("cos",&cosf);
+        a->bind("tan",&tanf);
         
         a->globalNativeHostedMethod("instring",1,true,this,MT(instring));
     }
@@ -135,14 +130,6 @@ private:
         api->pushStr(s);
     }
     
-    void intg(){
-        api->pushInt(api->popInt());
-    }
-    
-    void flt(){
-        api->pushFloat(api->popFloat());
-    }
-    
     void print(){
         char *s = api->popStr();
         printf("%s\n",s);
@@ -176,12 +163,12 @@ private:
     }
     
     void gc(){
-        api->cycle->detect();
-        api->pushInt(api->cycle->count());
+        api->getCycleDetector()->detect();
+        api->pushInt(api->getCycleDetector()->count());
     }
     
     void gccount(){
-        api->pushInt(api->cycle->count());
+        api->pushInt(api->getCycleDetector()->count());
     }
     
     void hash(){
@@ -203,10 +190,7 @@ private:
     void range(){
         int top = api->popInt();
         int bottom = api->popInt();
-        
-        IteratorObject *o = IteratorObject::create(api,new RangeIterator(bottom,top));
-        Value *v = api->pushRaw();
-        v->setIterObj(o);
+        api->pushRaw()->setRange(bottom,top);
     }
     
     ////////// these only work on container references //////////////////
@@ -228,34 +212,142 @@ private:
         api->pushInt(v->type->getSize(v));
     }
     
+    // keys() and values() return views where they can, which
+    // don't allocate; see forloop.h.
+    
     void keys(){
-        Value *src = api->popRaw();
-        IteratorObject *o = IteratorObject::create(api,src,true);
+        Value src = *api->popRaw();
         Value *v = api->pushRaw();
-        v->setIterObj(o);
+        if(!makeView(v,&src,true))
+            v->setIterObj(IteratorObject::create(api,&src,true));
     }
     
     void values(){
-        Value *src = api->popRaw();
-        IteratorObject *o = IteratorObject::create(api,src,false);
+        Value src = *api->popRaw();
         Value *v = api->pushRaw();
-        v->setIterObj(o);
+        if(!makeView(v,&src,false))
+            v->setIterObj(IteratorObject::create(api,&src,false));
     }
     
-    //////////// maths functions /////////////////////////////////////////
+    void compact(){
+        Object *o = api->popObj();
+        // frozen objects were compacted when they were frozen, and
+        // may be being read by other threads
+        if(!o->frozen)
+            o->compact();
+    }
     
+    // freezing, which returns what it froze so that it can be used
+    // in an assignment (see API::freeze())
     
-    void pow() { 
-        float y = api->popFloat();
-        float x = api->popFloat();
-        api->pushFloat(powf(x,y));
+    void freeze(){
+        Value v = *api->popRaw();
+        api->freeze(&v);
+        *api->pushRaw() = v;
+    }
+    
+    void isfrozen(){
+        Value *v = api->popRaw();
+        api->pushBool(api->isFrozen(v));
     }
     
-    void cos() { api->pushFloat(cosf(api->popFloat()));}
-    void sin() { api->pushFloat(sinf(api->popFloat()));}
-    void tan() { api->pushFloat(tanf(api->popFloat()));}
+    // making everything made so far immortal, returning how many
+    // objects that was (see API::makeHeapImmortal())
     
+    void immortalize(){
+        api->pushInt(api->makeHeapImmortal(api->getVM()->curSession));
+    }
+    
+    void frompairs(){
+        Object *o = api->popObj();
+        if(o->type != Types::vtList)
+            throw Exception("frompairs() needs a list");
+        Value *v = api->pushRaw();
+        v->setOther(Types::vtDictionary,(void *)Dict::fromPairs(api,(List *)o));
+        v->incRef();
+    }
+    
+    // the parallel functions, which run in the work pool. The list is
+    // copied off the stack, as calling functions will overwrite it.
+    
+    List *popList(Value *v,const char *name){
+        *v = *api->popRaw();
+        if(v->type != Types::vtList)
+            throw Exception(NULL).set("%s() needs a list",name);
+        return v->d.list;
+    }
+    
+    void pmap(){
+        Value fn = *api->popRaw();
+        Value l,r;
+        parallelMap(api,popList(&l,"pmap"),&fn,&r,false);
+        *api->pushRaw() = r;
+    }
+    
+    void pfilter(){
+        Value fn = *api->popRaw();
+        Value l,r;
+        parallelMap(api,popList(&l,"pfilter"),&fn,&r,true);
+        *api->pushRaw() = r;
+    }
+    
+    void preduce(){
+        Value init = *api->popRaw();
+        Value fn = *api->popRaw();
+        Value l,r;
+        parallelReduce(api,popList(&l,"preduce"),&fn,&init,&r);
+        *api->pushRaw() = r;
+    }
+    
+    // the actor functions (see actor.h)
+    
+    void spawn(){
+        Value arg = *api->popRaw();
+        Value fn = *api->popRaw();
+        int id = api->getActors()->spawn(&fn,&arg,api->getVM()->curSession);
+        api->pushInt(id);
+    }
+    
+    void send(){
+        Value msg = *api->popRaw();
+        int id = api->popInt();
+        api->pushBool(api->getActors()->send(id,&msg));
+    }
+    
+    void receive(){
+        Value v;
+        api->getActors()->receive(&v);
+        *api->pushRaw() = v;
+    }
+    
+    void self(){
+        api->pushInt(api->getActors()->self());
+    }
+    
+    void join(){
+        int id = api->popInt();
+        Value v;
+        api->getActors()->join(id,&v);
+        *api->pushRaw() = v;
+    }
+    
+    /// create a typed array from the argument, which is either a
+    /// size (the array is zero filled) or a list to convert
+    void typedarray(TypedArrayKind k){
+        Value src = *api->popRaw();
+        TypedArray *t;
+        if(src.type == Types::vtList)
+            t = TypedArray::fromList(api,k,src.d.list);
+        else
+            t = TypedArray::create(api,k,src.getInt());
+        Value *v = api->pushRaw();
+        v->setOther(t->type,(void *)t);
+        v->incRef();
+    }
     
+    void int32array(){ typedarray(TA_INT32); }
+    void float32array(){ typedarray(TA_FLOAT32); }
+    void float64array(){ typedarray(TA_FLOAT64); }
     
     //////////// other stuff     /////////////////////////////////////////
     
@@ -29,7 +29,19 @@ ListType::ListType(API *a) : ObjectType() {
     proto->registerNativeMethod("insert",2,false,MT(methodInsert));
     proto->registerNativeMethod("remove",1,false,MT(methodRemove));
     
-    proto->incRefCt();
+    proto->registerNativeMethod("extend",1,false,MT(methodExtend));
+    proto->registerNativeMethod("reserve",1,false,MT(methodReserve));
+    proto->registerNativeMethod("capacity",0,true,MT(methodCapacity));
+    
+    proto->registerNativeMethod("sort",0,false,MT(methodSort));
+    proto->registerNativeMethod("sortby",1,false,MT(methodSortBy));
+    proto->registerNativeMethod("sortcmp",1,false,MT(methodSortCmp));
+    proto->registerNativeMethod("bsearch",1,true,MT(methodBsearch));
+    proto->registerNativeMethod("min",0,true,MT(methodMin));
+    proto->registerNativeMethod("max",0,true,MT(methodMax));
+    proto->registerNativeMethod("nth",1,true,MT(methodNth));
+    
+    proto->makeImmortal(); // never die, and be shared by every thread
 }
 
 List *List::create(API *a) {
@@ -51,6 +63,7 @@ List::~List(){
 }
 
 void List::methodAppend(){
+    checkWritable();
     Value *dest = list->append();
     Value *src = api->popRaw();
     
@@ -58,6 +71,7 @@ void List::methodAppend(){
 }
 
 void List::methodInsert(){
+    checkWritable();
     Value *v = api->popRaw();
     int i = api->popInt();
     
@@ -65,12 +79,14 @@ void List::methodInsert(){
 }
 
 void List::methodPop(){
-    Value *v = list->pop();
-    *api->pushRaw() = *v;
-    
+    checkWritable();
+    if(!list->count())
+        throw ArrayListException("pop on empty list");
+    list->pop(api->pushRaw());
 }
 
 void List::methodRemove(){
+    checkWritable();
     int i = api->popInt();
     list->remove(i);
 }
@@ -81,22 +97,38 @@ void List::methodPeek(){
 }
 
 void List::methodShift(){
-    Value *dest = list->insert(0);
+    checkWritable();
+    Value *dest = list->pushFront();
     Value *src = api->popRaw();
     
     *dest = *src; // SHOULD result in an incref
 }
 
 void List::methodUnshift(){
+    checkWritable();
     if(!list->count())
         throw ArrayListException("unshift on empty list");
-    
-    // note the order here - remove() will clear the item, so
-    // we need to copy it into the destination first.
-    
-    Value *v = list->get(0);
-    *api->pushRaw() = *v;
-    list->remove(0);
+    list->popFront(api->pushRaw());
+}
+
+void List::methodExtend(){
+    checkWritable();
+    Object *o = api->popObj();
+    if(o->type != Types::vtList)
+        throw Exception("extend() needs a list");
+    extend((List *)o);
+}
+
+void List::methodReserve(){
+    checkWritable();
+    int n = api->popInt();
+    if(n<0 || n>MAXRESERVE)
+        throw Exception(NULL).set("cannot reserve room for %d items",n);
+    reserve(n);
+}
+
+void List::methodCapacity(){
+    api->pushInt(list->getCapacity());
 }
 
 
@@ -114,6 +146,7 @@ const char *ListRefType::repr(const Value *v) const {
 }
 
 void ListRefType::store(Value *ref,Value *v){
+    ref->d.list->checkWritable();
     ref->d.list->set(ref->d2.i,v);
 }
 Value *ListRefType::deref(Value *v){
@@ -128,6 +161,7 @@ bool ListRefType::isDefinedReference(Value *v){
 }
 
 bool ListRefType::deleteElement(Value *v){
+    v->d.list->checkWritable();
     return v->d.list->remove(v->d2.i);
     
 }
@@ -47,12 +47,20 @@ public:
         l->makeCloneOf(this);
         
         // copy the data into the new object
-        int ct = list->count();
-        for(int i=0;i<ct;i++)
-            l->set(i,list->get(i));
+        l->extend(this);
         return l;
     }
     
+    /// append copies of all the items in another list
+    void extend(List *src){
+        list->extend(src->list);
+    }
+    
+    /// make sure there's room for n items without reallocating
+    void reserve(int n){
+        list->reserve(n);
+    }
+    
     /// change the value of an existing slot
     void set(int i,Value *v){
         list->set(i,v);
@@ -91,6 +99,51 @@ public:
     /// native function for "shift(x)"
     void methodShift();
     
+    /// native function for "extend(l)"
+    void methodExtend();
+    
+    /// native function for "reserve(n)"
+    void methodReserve();
+    /// the most items reserve(n) will make room for, which is more
+    /// than anything sensible needs
+    static const int MAXRESERVE = 1<<24;
+    
+    /// native function for "v=capacity()"
+    void methodCapacity();
+    
+    /// sort the list in place into ascending order, stably. If keyfn
+    /// is non-NULL it's a function called on each item to get the key
+    /// to sort on; if cmpfn is non-NULL it's a function taking two items
+    /// and returning a negative, zero or positive int, as with strcmp().
+    void sort(Value *keyfn=NULL,Value *cmpfn=NULL);
+    
+    /// binary search a sorted list, returning the index of the
+    /// item if found. If not, returns -(i+1) where i is the index
+    /// at which it would be inserted.
+    int bsearch(Value *v);
+    
+    /// return the smallest (or largest) item
+    Value *min(bool largest=false);
+    
+    /// return the item which would be at position n if the list were sorted,
+    /// without sorting it
+    Value *nth(int n);
+    
+    /// native function for "sort()"
+    void methodSort();
+    /// native function for "sortby(keyfunction)"
+    void methodSortBy();
+    /// native function for "sortcmp(comparefunction)"
+    void methodSortCmp();
+    /// native function for "i=bsearch(x)"
+    void methodBsearch();
+    /// native function for "v=min()"
+    void methodMin();
+    /// native function for "v=max()"
+    void methodMax();
+    /// native function for "v=nth(n)"
+    void methodNth();
+    
     // also need to add the special get properties
     // for size and capacity
     
@@ -133,6 +186,9 @@ struct ListType : public ObjectType {
 /// the type object for a reference to an item in a list
 
 struct ListRefType : public Type {
+    ListRefType(){
+        isRef = true;
+    }
     virtual const char *repr(const Value *v) const;
     /// store a value in a list reference
     virtual void store(Value *ref,Value *v);
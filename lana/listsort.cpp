@@ -0,0 +1,321 @@
+/** @file
+ * Sorting, searching and order statistics for lists. Where all the
+ * values being compared are ints, floats or strings the comparison
+ * is done directly on extracted keys, rather than going through the
+ * types' comparison operators for every pair.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "api.h"
+#include "language.h"
+#include "arraylist.h"
+#include "list.h"
+#include "opcodes.h"
+#include "vm.h"
+
+using namespace lana;
+
+/// compare two values, returning negative, zero or positive as
+/// with strcmp(). Common cases are done without virtual calls.
+
+static int compareValues(Value *a,Value *b){
+    Type *ta = a->type;
+    Type *tb = b->type;
+
+    if(ta==Types::vtInteger && tb==Types::vtInteger)
+        return a->d.i<b->d.i ? -1 : (a->d.i>b->d.i ? 1 : 0);
+    if((ta==Types::vtInteger || ta==Types::vtFloat) &&
+       (tb==Types::vtInteger || tb==Types::vtFloat)){
+        float x = ta==Types::vtFloat ? a->d.f : (float)a->d.i;
+        float y = tb==Types::vtFloat ? b->d.f : (float)b->d.i;
+        return x<y ? -1 : (x>y ? 1 : 0);
+    }
+    if(a->isStr() && b->isStr())
+        return strcmp(a->getStr(),b->getStr());
+
+    // the general case
+    Value r;
+    ta->doBinComparisonOp(&r,OP_LT,a,b);
+    if(r.getBool())
+        return -1;
+    ta->doBinComparisonOp(&r,OP_GT,a,b);
+    return r.getBool() ? 1 : 0;
+}
+
+// sort keys - each is a key extracted from a value, and the index of that value.
+
+struct IntKey {
+    int k,i;
+    bool operator<(const IntKey& o) const { return k<o.k; }
+};
+
+struct FloatKey {
+    float k;
+    int i;
+    bool operator<(const FloatKey& o) const { return k<o.k; }
+};
+
+struct StrKey {
+    const char *k;
+    int i;
+    bool operator<(const StrKey& o) const { return strcmp(k,o.k)<0; }
+};
+
+struct GenericKey {
+    Value *k;
+    int i;
+    bool operator<(const GenericKey& o) const { return compareValues(k,o.k)<0; }
+};
+
+/// comparison using a user function
+
+struct UserCompare {
+    VirtualMachine *vm;
+    Value *fn;
+    Value *args; //!< two values, reused for every call
+    Value *result;
+
+    bool operator()(const GenericKey& a,const GenericKey& b) const {
+        args[0] = *a.k;
+        args[1] = *b.k;
+        vm->call(fn,2,args,result);
+        return result->getInt()<0;
+    }
+};
+
+/// sort the keys (if nth<0) or partition them so the nth is in place,
+/// then write the indices out in the new order.
+
+template <class K,class C> static void orderKeys(K *keys,int n,int nth,int *order,C cmp){
+    try {
+        if(nth<0)
+            std::stable_sort(keys,keys+n,cmp);
+        else
+            std::nth_element(keys,keys+nth,keys+n,cmp);
+    } catch(...) {
+        delete [] keys;
+        throw;
+    }
+    for(int i=0;i<n;i++)
+        order[i]=keys[i].i;
+    delete [] keys;
+}
+
+template <class K> static void orderKeys(K *keys,int n,int nth,int *order){
+    orderKeys(keys,n,nth,order,std::less<K>());
+}
+
+/// given n values, work out the order in which they should go, either
+/// fully sorted (nth<0) or so that order[nth] is correct. If cmp is
+/// non-NULL, the comparison is done by a user function.
+
+static void orderValues(Value **vals,int n,int nth,int *order,UserCompare *cmp){
+    if(cmp){
+        GenericKey *keys = new GenericKey[n];
+        for(int i=0;i<n;i++){
+            keys[i].k = vals[i];
+            keys[i].i = i;
+        }
+        orderKeys(keys,n,nth,order,*cmp);
+        return;
+    }
+
+    // find out what sort of values we have
+    bool allInt=true,allNum=true,allStr=true;
+    for(int i=0;i<n;i++){
+        Type *t = vals[i]->type;
+        if(t!=Types::vtInteger){
+            allInt=false;
+            if(t!=Types::vtFloat)
+                allNum=false;
+        }
+        if(!vals[i]->isStr())
+            allStr=false;
+    }
+
+    if(allInt){
+        IntKey *keys = new IntKey[n];
+        for(int i=0;i<n;i++){
+            keys[i].k = vals[i]->d.i;
+            keys[i].i = i;
+        }
+        orderKeys(keys,n,nth,order);
+    } else if(allNum){
+        FloatKey *keys = new FloatKey[n];
+        for(int i=0;i<n;i++){
+            Value *v = vals[i];
+            keys[i].k = v->type==Types::vtFloat ? v->d.f : (float)v->d.i;
+            keys[i].i = i;
+        }
+        orderKeys(keys,n,nth,order);
+    } else if(allStr){
+        StrKey *keys = new StrKey[n];
+        for(int i=0;i<n;i++){
+            keys[i].k = vals[i]->getStr();
+            keys[i].i = i;
+        }
+        orderKeys(keys,n,nth,order);
+    } else {
+        GenericKey *keys = new GenericKey[n];
+        for(int i=0;i<n;i++){
+            keys[i].k = vals[i];
+            keys[i].i = i;
+        }
+        orderKeys(keys,n,nth,order);
+    }
+}
+
+/// work out the order of the items in a list, calling keyfn on each item
+/// first if it's non-NULL, and comparing with cmpfn if it's non-NULL.
+
+static void orderList(API *api,ArrayList *list,int nth,int *order,Value *keyfn,Value *cmpfn){
+    int n = list->count();
+    Value **vals = new Value* [n];
+    Value *keys = NULL;
+
+    try {
+        if(keyfn){
+            // get all the keys up front, so the function is only called once per item
+            keys = new Value[n];
+            for(int i=0;i<n;i++){
+                api->getVM()->call(keyfn,1,list->get(i),keys+i);
+                vals[i] = keys+i;
+            }
+        } else if(cmpfn){
+            // the comparator could change the list, so work on a copy
+            keys = new Value[n];
+            for(int i=0;i<n;i++){
+                keys[i] = *list->get(i);
+                vals[i] = keys+i;
+            }
+        } else {
+            for(int i=0;i<n;i++)
+                vals[i] = list->get(i);
+        }
+
+        if(cmpfn){
+            Value args[2],result;
+            UserCompare cmp;
+            cmp.vm = api->getVM();
+            cmp.fn = cmpfn;
+            cmp.args = args;
+            cmp.result = &result;
+            orderValues(vals,n,nth,order,&cmp);
+        } else
+            orderValues(vals,n,nth,order,NULL);
+    } catch(...) {
+        delete [] vals;
+        if(keys)
+            delete [] keys;
+        throw;
+    }
+    delete [] vals;
+    if(keys)
+        delete [] keys;
+}
+
+void List::sort(Value *keyfn,Value *cmpfn){
+    int n = list->count();
+    if(n<2)
+        return;
+    int *order = new int[n];
+    try {
+        orderList(api,list,-1,order,keyfn,cmpfn);
+    } catch(...) {
+        delete [] order;
+        throw;
+    }
+
+    // the user functions could have changed the list under our feet
+    if(list->count()!=n){
+        delete [] order;
+        throw Exception("list changed size while sorting");
+    }
+    list->reorder(order);
+    delete [] order;
+}
+
+int List::bsearch(Value *v){
+    int lo=0,hi=list->count();
+    while(lo<hi){
+        int mid = (lo+hi)/2;
+        int c = compareValues(list->get(mid),v);
+        if(!c)
+            return mid;
+        if(c<0)
+            lo=mid+1;
+        else
+            hi=mid;
+    }
+    return -(lo+1);
+}
+
+Value *List::min(bool largest){
+    int n = list->count();
+    if(!n)
+        throw ArrayListException("min/max of empty list");
+    Value *best = list->get(0);
+    for(int i=1;i<n;i++){
+        Value *v = list->get(i);
+        int c = compareValues(v,best);
+        if(largest ? c>0 : c<0)
+            best = v;
+    }
+    return best;
+}
+
+Value *List::nth(int nth){
+    int n = list->count();
+    if(nth<0 || nth>=n)
+        throw ArrayListException("nth out of range");
+    int *order = new int[n];
+    try {
+        orderList(api,list,nth,order,NULL,NULL);
+    } catch(...) {
+        delete [] order;
+        throw;
+    }
+    Value *v = list->get(order[nth]);
+    delete [] order;
+    return v;
+}
+
+void List::methodSort(){
+    checkWritable();
+    sort();
+}
+
+void List::methodSortBy(){
+    checkWritable();
+    Value fn = *api->popRaw();
+    sort(&fn,NULL);
+}
+
+void List::methodSortCmp(){
+    checkWritable();
+    Value fn = *api->popRaw();
+    sort(NULL,&fn);
+}
+
+void List::methodBsearch(){
+    Value v = *api->popRaw();
+    api->pushInt(bsearch(&v));
+}
+
+void List::methodMin(){
+    *api->pushRaw() = *min(false);
+}
+
+void List::methodMax(){
+    *api->pushRaw() = *min(true);
+}
+
+void List::methodNth(){
+    int n = api->popInt();
+    *api->pushRaw() = *nth(n);
+}
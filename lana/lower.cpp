@@ -0,0 +1,656 @@
+/**
+ * @file
+ * Lowering stack VM bytecode into register VM code - see regvm.h.
+ *
+ * The lowerer runs through the bytecode keeping a symbolic execution
+ * stack. Each entry says where the value the stack VM would have pushed
+ * can be found, which is usually a frame slot or constant, so that loads
+ * and references to locals don't generate any code at all. Entries which
+ * need work to turn into values - list items, properties and so on - are
+ * only turned into instructions when they're used, which is when we
+ * know whether they're being read or written to. Each entry has its own
+ * temporary, the one for its depth on the stack, for any value it has
+ * to compute.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "consts.h"
+#include "opcodes.h"
+#include "regvm.h"
+
+using namespace lana;
+
+namespace {
+
+/// thrown when the bytecode uses something the register VM can't do
+struct CannotLower {};
+
+/// kinds of symbolic stack entry
+enum EntryKind {
+    E_VAL,    //!< a value in operand a
+    E_LOCREF, //!< a reference to frame slot a
+    E_GLBREF, //!< a reference to global variable a
+    E_SESREF, //!< a reference to session variable a
+    E_IDX,    //!< a reference to item b of container a
+    E_PROP,   //!< a reference to property b of object a
+    E_REF,    //!< a real reference, held in the entry's temporary
+    E_FOR,    //!< for-loop state, held in the entry's temporary
+};
+
+struct Entry {
+    int kind;
+    int a,b;
+};
+
+/// a constant operand - they're turned into Values at the end
+struct KConst {
+    int kind; //!< the ConstType, or -1 for a boolean
+    u32 data;
+};
+
+class Lowerer {
+public:
+    Lowerer(Constants *c,const instruction *p,int n){
+        consts = c;
+        code = p;
+        ninsts = n;
+        maxdepth = 0;
+        estmt = 0;
+    }
+
+    RegisterCode *lower();
+
+private:
+    Constants *consts;
+    const instruction *code;
+    int ninsts;
+
+    int tbase;    //!< the first temporary slot
+    int maxdepth; //!< the deepest the stack gets
+    int estmt;    //!< stack depth at the start of an expression statement
+
+    std::vector<Entry> stack;
+    std::vector<RegInst> out;
+    std::vector<KConst> k;
+    std::vector<s32> args;
+
+    std::vector<int> map;     //!< bytecode index to register code index
+    std::vector<int> depthAt; //!< stack depth at each jump target, or -1
+    std::vector<bool> isTarget;
+    std::vector<std::pair<int,int> > fixups; //!< jumps: register code index, bytecode target
+
+    /// the temporary for a stack depth
+    int temp(int depth){
+        return tbase+depth;
+    }
+
+    void push(int kind,int a,int b=0){
+        Entry e = {kind,a,b};
+        stack.push_back(e);
+        if((int)stack.size()>maxdepth)
+            maxdepth=stack.size();
+    }
+
+    int depth(){
+        return stack.size();
+    }
+
+    int emit(int op,int d,int a=0,int b=0,int x=0,int sub=0){
+        RegInst i;
+        i.op=op;i.sub=sub;i.d=d;i.a=a;i.b=b;i.x=x;
+        out.push_back(i);
+        return out.size()-1;
+    }
+
+    int constant(int kind,u32 data);
+    int value(int d);
+    int ref(int d);
+    int arg(int d);
+    void store(int d,int v);
+    bool producedBy(int v);
+    void jump(int op,int a,int to,int sub=0);
+    void checkTarget(int i);
+    void condJump(int to);
+    void binop(int op,int sub=0);
+};
+
+}
+
+/// get the operand for a constant, reusing an existing one if possible
+int Lowerer::constant(int kind,u32 data){
+    for(unsigned int i=0;i<k.size();i++){
+        if(k[i].kind==kind && k[i].data==data)
+            return ~(int)i;
+    }
+    KConst c = {kind,data};
+    k.push_back(c);
+    return ~(int)(k.size()-1);
+}
+
+/// get the entry at a depth as a value, generating code to read it
+/// into the entry's temporary if need be
+int Lowerer::value(int d){
+    Entry &e = stack[d];
+    int t = temp(d);
+    switch(e.kind){
+    case E_VAL:
+    case E_LOCREF:
+        return e.a;
+    case E_GLBREF:
+        emit(R_GETGLB,t,0,0,e.a);
+        return t;
+    case E_SESREF:
+        emit(R_GETSES,t,0,0,e.a);
+        return t;
+    case E_IDX:
+        emit(R_GETIDX,t,e.a,e.b);
+        return t;
+    case E_PROP:
+        emit(R_GETPROP,t,e.a,0,e.b);
+        return t;
+    case E_REF:
+        emit(R_DEREF,t,t);
+        return t;
+    default:
+        throw CannotLower();
+    }
+}
+
+/// turn the entry at a depth into a real reference in its temporary,
+/// for the things which need one
+int Lowerer::ref(int d){
+    Entry &e = stack[d];
+    int t = temp(d);
+    switch(e.kind){
+    case E_LOCREF:
+        emit(R_LOCREF,t,e.a);
+        break;
+    case E_GLBREF:
+        emit(R_GLBREF,t,0,0,e.a);
+        break;
+    case E_SESREF:
+        emit(R_SESREF,t,0,0,e.a);
+        break;
+    case E_IDX:
+        emit(R_IDXREF,t,e.a,e.b);
+        break;
+    case E_PROP:
+        emit(R_PROPREF,t,e.a,0,e.b);
+        break;
+    case E_REF:
+        break;
+    default:
+        throw CannotLower();
+    }
+    return t;
+}
+
+/// get a function argument. The stack VM passes references as
+/// references, which defined() and del() rely on.
+int Lowerer::arg(int d){
+    if(stack[d].kind == E_VAL)
+        return stack[d].a;
+    return ref(d);
+}
+
+/// is v a temporary which the last instruction has just computed, which
+/// could have been computed straight into where it's wanted instead?
+bool Lowerer::producedBy(int v){
+    if(v<tbase || out.empty() || out.back().d!=v)
+        return false;
+    switch(out.back().op){
+    case R_MOV:case R_GETGLB:case R_GETSES:case R_ADD:case R_SUB:
+    case R_MUL:case R_DIV:case R_MOD:case R_CMP:case R_LOGAND:
+    case R_LOGOR:case R_BITAND:case R_BITOR:case R_XOR:case R_BITNOT:
+    case R_NEG:case R_NOT:case R_THIS:case R_GETIDX:case R_GETPROP:
+    case R_DEREF:case R_CALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// store operand v through the entry at depth d, as OP_SET does
+void Lowerer::store(int d,int v){
+    Entry &e = stack[d];
+    switch(e.kind){
+    case E_LOCREF:
+        if(producedBy(v)){
+            // compute the value straight into the variable
+            RegInst &i = out.back();
+            i.d = e.a;
+            switch(i.op){
+            case R_MOV:case R_GETGLB:case R_GETSES:case R_GETIDX:
+            case R_GETPROP:case R_DEREF:case R_CALL:
+                i.sub |= RF_CHECKSTORE; // these could get anything
+            }
+        } else
+            emit(R_MOV,e.a,v,0,0,RF_CHECKSTORE);
+        break;
+    case E_GLBREF:
+        emit(R_SETGLB,0,v,0,e.a);
+        break;
+    case E_SESREF:
+        emit(R_SETSES,0,v,0,e.a);
+        break;
+    case E_IDX:
+        emit(R_SETIDX,v,e.a,e.b);
+        break;
+    case E_PROP:
+        emit(R_SETPROP,0,e.a,v,e.b);
+        break;
+    case E_REF:
+        emit(R_STORE,temp(d),v);
+        break;
+    default:
+        throw CannotLower();
+    }
+}
+
+/// check the stack is in a fit state to jump to or from - only for-loop
+/// state can be on it - and that it's the same depth at both ends.
+void Lowerer::checkTarget(int i){
+    for(unsigned int j=0;j<stack.size();j++){
+        if(stack[j].kind!=E_FOR)
+            throw CannotLower();
+    }
+    if(depthAt[i]<0)
+        depthAt[i]=depth();
+    else if(depthAt[i]!=depth())
+        throw CannotLower();
+}
+
+void Lowerer::jump(int op,int a,int to,int sub){
+    if(to<0 || to>=ninsts || !isTarget[to])
+        throw CannotLower();
+    checkTarget(to);
+    fixups.push_back(std::make_pair(emit(op,0,a,0,0,sub),to));
+}
+
+/// a jump if the condition on the stack is false. If the condition has
+/// just been computed by a comparison, that turns into the jump.
+void Lowerer::condJump(int to){
+    int d = depth()-1;
+    int v = value(d);
+    stack.pop_back();
+    if(v==temp(d) && producedBy(v) && out.back().op==R_CMP){
+        RegInst c = out.back();
+        out.pop_back();
+        jump(R_JCMP,c.a,to,c.sub);
+        out.back().b = c.b;
+    } else
+        jump(R_JF,v,to);
+}
+
+/// a binary operator. The right hand side is read first, as the stack
+/// VM pops it first.
+void Lowerer::binop(int op,int sub){
+    if(depth()<2)
+        throw CannotLower();
+    int d = depth()-2;
+    int b = value(d+1);
+    int a = value(d);
+    stack.pop_back();
+    stack.pop_back();
+    emit(op,temp(d),a,b,0,sub);
+    push(E_VAL,temp(d));
+}
+
+RegisterCode *Lowerer::lower(){
+    if(ninsts<1 || INSTOP(code[0])!=OP_LOCALS)
+        throw CannotLower();
+    LDTHeader *h = (LDTHeader *)consts->get(INSTDATA(code[0]))->get();
+    tbase = h->numparams+h->numlocals;
+
+    // find the jump targets first, so we know where the stack has to be
+    // empty of anything but loop state
+    map.resize(ninsts);
+    depthAt.assign(ninsts,-1);
+    isTarget.assign(ninsts,false);
+    for(int i=0;i<ninsts;i++){
+        instruction op = code[i];
+        int t=-1;
+        switch(INSTOP(op)){
+        case OP_IF:case OP_ELSEIF:case OP_QUICKIF:case OP_WHILE:
+        case OP_ELSE:case OP_JMPELSEIF:case OP_GOTOFW:case OP_BREAK:
+        case OP_CONTINUEFW:case OP_FOR:
+            t = i+INSTDATA(op);
+            break;
+        case OP_ENDWHILE:case OP_UNTIL:case OP_GOTOBK:case OP_CONTINUE:
+        case OP_NEXT:
+            t = i-INSTDATA(op);
+            break;
+        }
+        if(t>=0 && t<ninsts)
+            isTarget[t]=true;
+    }
+
+    for(int i=1;i<ninsts;i++){
+        instruction op = code[i];
+        map[i] = out.size();
+        if(isTarget[i])
+            checkTarget(i);
+        int d = depth()-1; // the top of the stack
+        switch(INSTOP(op)){
+        case OP_LIT:
+            {
+                ConstDesc *c = consts->get(INSTDATA(op));
+                if(!c)
+                    throw CannotLower();
+                switch(c->getType()){
+                case CT_FUNC:
+                case CT_STRING:
+                    push(E_VAL,constant(c->getType(),INSTDATA(op)));
+                    break;
+                case CT_INT:
+                    push(E_VAL,constant(CT_INT,*(u32 *)c->get()));
+                    break;
+                case CT_FLOAT:
+                    push(E_VAL,constant(CT_FLOAT,*(u32 *)c->get()));
+                    break;
+                default:
+                    throw CannotLower();
+                }
+            }
+            break;
+        case OP_LITIDENT:
+        case OP_IMMED:
+            push(E_VAL,constant(CT_INT,INSTDATA(op)));
+            break;
+        case OP_TRUE:
+            push(E_VAL,constant(-1,1));
+            break;
+        case OP_FALSE:
+            push(E_VAL,constant(-1,0));
+            break;
+        case OP_THIS:
+            emit(R_THIS,temp(d+1));
+            push(E_VAL,temp(d+1));
+            break;
+        case OP_LOADLOC:
+        case OP_LOADPRM:
+            push(E_VAL,INSTDATA(op));
+            break;
+        case OP_VARREFLOC:
+        case OP_VARREFPRM:
+            push(E_LOCREF,INSTDATA(op));
+            break;
+        case OP_LOADGLB:
+            emit(R_GETGLB,temp(d+1),0,0,INSTDATA(op));
+            push(E_VAL,temp(d+1));
+            break;
+        case OP_LOADSES:
+            emit(R_GETSES,temp(d+1),0,0,INSTDATA(op));
+            push(E_VAL,temp(d+1));
+            break;
+        case OP_VARREFGLB:
+            push(E_GLBREF,INSTDATA(op));
+            break;
+        case OP_VARREFSES:
+            push(E_SESREF,INSTDATA(op));
+            break;
+        case OP_SQB:
+            {
+                if(d<1)
+                    throw CannotLower();
+                int c = value(d-1);
+                int x = value(d);
+                stack.pop_back();
+                stack.pop_back();
+                // the index can't stay in the temporary above this entry,
+                // which the next thing pushed will use.
+                int t = temp(d-1);
+                if(x==temp(d)){
+                    if(c==t){
+                        emit(R_IDXREF,t,c,x);
+                        push(E_REF,t);
+                        break;
+                    }
+                    if(producedBy(x))
+                        out.back().d = t;
+                    else
+                        emit(R_MOV,t,x);
+                    x = t;
+                }
+                push(E_IDX,c,x);
+            }
+            break;
+        case OP_PROPREF:
+            {
+                if(d<0)
+                    throw CannotLower();
+                int o = value(d);
+                stack.pop_back();
+                push(E_PROP,o,INSTDATA(op));
+            }
+            break;
+        case OP_SET:
+            {
+                if(d<1)
+                    throw CannotLower();
+                int v = value(d);
+                store(d-1,v);
+                stack.pop_back();
+                stack.pop_back();
+            }
+            break;
+        case OP_STARTESTMT:
+            estmt = depth();
+            break;
+        case OP_ENDESTMT:
+        case OP_ENDESTMT2:
+            while(depth()>estmt){
+                if(stack.back().kind==E_FOR)
+                    throw CannotLower();
+                stack.pop_back();
+            }
+            break;
+        case OP_ADD:
+            binop(R_ADD);break;
+        case OP_SUB:
+            binop(R_SUB);break;
+        case OP_MUL:
+            binop(R_MUL);break;
+        case OP_DIV:
+            binop(R_DIV);break;
+        case OP_MOD:
+            binop(R_MOD);break;
+        case OP_EQUALS:case OP_NEQUALS:case OP_NEAREQ:case OP_NNEAREQ:
+        case OP_LT:case OP_LTE:case OP_GT:case OP_GTE:
+            binop(R_CMP,INSTOP(op));break;
+        case OP_LOGAND:
+            binop(R_LOGAND);break;
+        case OP_LOGOR:
+            binop(R_LOGOR);break;
+        case OP_BITAND:
+            binop(R_BITAND);break;
+        case OP_BITOR:
+            binop(R_BITOR);break;
+        case OP_XOR:
+            binop(R_XOR);break;
+        case OP_BITNOT:
+        case OP_NEGATE:
+        case OP_NOT:
+            {
+                if(d<0)
+                    throw CannotLower();
+                int a = value(d);
+                stack.pop_back();
+                int o = INSTOP(op);
+                emit(o==OP_BITNOT?R_BITNOT:(o==OP_NEGATE?R_NEG:R_NOT),temp(d),a);
+                push(E_VAL,temp(d));
+            }
+            break;
+        case OP_CALL:
+        case OP_CALLSITE:
+        case OP_TAILCALL: // the OP_RETURN after it does the return
+            {
+                int argc = INSTDATA(op) & 0xff; // see OP_CALLSITE
+                int f = d-argc;
+                if(f<0)
+                    throw CannotLower();
+                int first = args.size();
+                for(int j=0;j<argc;j++)
+                    args.push_back(arg(f+1+j));
+                int fn;
+                if(stack[f].kind==E_PROP)
+                    fn = ref(f); // a method, which needs to know its object
+                else
+                    fn = value(f);
+                emit(R_CALL,temp(f),fn,first,argc);
+                stack.resize(f);
+                push(E_VAL,temp(f));
+            }
+            break;
+        case OP_IF:case OP_ELSEIF:case OP_QUICKIF:case OP_WHILE:
+            if(d<0)
+                throw CannotLower();
+            condJump(i+INSTDATA(op));
+            break;
+        case OP_UNTIL:
+            if(d<0)
+                throw CannotLower();
+            condJump(i-INSTDATA(op));
+            break;
+        case OP_ELSE:case OP_JMPELSEIF:case OP_GOTOFW:case OP_BREAK:
+        case OP_CONTINUEFW:
+            jump(R_JMP,0,i+INSTDATA(op));
+            break;
+        case OP_ENDWHILE:case OP_GOTOBK:case OP_CONTINUE:
+            jump(R_JMP,0,i-INSTDATA(op));
+            break;
+        case OP_FOR:
+            {
+                if(d<1)
+                    throw CannotLower();
+                int src = value(d);
+                int var = ref(d-1);
+                stack[d-1].kind = E_FOR;
+                stack[d].kind = E_FOR;
+                jump(R_FOR,temp(d),i+INSTDATA(op));
+                out.back().d = var;
+                out.back().b = src;
+            }
+            break;
+        case OP_NEXT:
+            if(d<1 || stack[d].kind!=E_FOR || stack[d-1].kind!=E_FOR)
+                throw CannotLower();
+            jump(R_NEXT,temp(d),i-INSTDATA(op));
+            out.back().d = temp(d-1);
+            break;
+        case OP_ENDFOR:
+            if(d<1 || stack[d].kind!=E_FOR || stack[d-1].kind!=E_FOR)
+                throw CannotLower();
+            emit(R_ENDFOR,temp(d-1),temp(d));
+            stack.pop_back();
+            stack.pop_back();
+            break;
+        case OP_RETURN:
+            if(INSTDATA(op)){
+                if(d<0)
+                    throw CannotLower();
+                emit(R_RET,0,value(d),0,0,1);
+                stack.pop_back();
+            } else
+                emit(R_RET,0);
+            break;
+        case OP_END:
+            emit(R_RET,0);
+            break;
+        case OP_SRCLINE:
+            emit(R_LINE,0,0,0,INSTDATA(op));
+            break;
+        case OP_SRCFILE:
+            emit(R_FILE,0,0,0,INSTDATA(op));
+            break;
+            // no-ops
+        case OP_DUMMY:case OP_ENDIF:case OP_REPEAT:case OP_PAREN:
+        case OP_BLANKLINE:case OP_COMMENT_SOL:case OP_COMMENT_EOL:
+        case OP_COMMENT_EOFD:case OP_GOTOMARKER:case OP_LABEL:
+            break;
+        default:
+            throw CannotLower();
+        }
+    }
+    if(out.empty() || out.back().op!=R_RET)
+        throw CannotLower();
+
+    for(unsigned int i=0;i<fixups.size();i++)
+        out[fixups[i].first].x = map[fixups[i].second];
+
+    RegisterCode *rc = new RegisterCode;
+    rc->ninsts = out.size();
+    rc->insts = new RegInst[rc->ninsts];
+    memcpy(rc->insts,&out[0],rc->ninsts*sizeof(RegInst));
+    rc->nk = k.size();
+    rc->k = new Value[rc->nk+1];
+    for(int i=0;i<rc->nk;i++){
+        Value *v = rc->k+i;
+        switch(k[i].kind){
+        case -1:
+            v->setBool(k[i].data!=0);break;
+        case CT_INT:
+            v->setInt((int)k[i].data);break;
+        case CT_FLOAT:
+            v->setFloat(*(float *)&k[i].data);break;
+        case CT_STRING:
+            v->setStrConst(k[i].data);break;
+        case CT_FUNC:
+            v->setFunc(k[i].data);break;
+        }
+    }
+    rc->args = new s32[args.size()+1];
+    if(!args.empty())
+        memcpy(rc->args,&args[0],args.size()*sizeof(s32));
+    rc->numparams = h->numparams;
+    rc->numlocals = h->numlocals;
+    rc->framesize = tbase+maxdepth+1;
+    rc->next = NULL;
+    return rc;
+}
+
+RegisterCode *RegisterCode::lower(Constants *consts,const instruction *code,int n){
+    try {
+        Lowerer l(consts,code,n);
+        return l.lower();
+    } catch(CannotLower &e){
+        return NULL;
+    }
+}
+
+RegisterCode::~RegisterCode(){
+    delete [] insts;
+    delete [] k;
+    delete [] args;
+}
+
+static const char *regOpNames[] = {
+    "mov","getglb","getses","setglb","setses","add","sub","mul","div",
+    "mod","cmp","logand","logor","bitand","bitor","xor","bitnot","neg",
+    "not","this","getidx","setidx","getprop","setprop","idxref",
+    "propref","locref","glbref","sesref","deref","store","call","jmp",
+    "jf","jcmp","for","next","endfor","ret","line","file",
+};
+
+/// print an operand
+static void dumpOperand(RegisterCode *rc,int o){
+    if(o>=0)
+        printf(" r%-3d",o);
+    else
+        printf(" %-4s",rc->k[~o].repr());
+}
+
+void RegisterCode::dump(Constants *consts){
+    printf("Register code: %d params, %d locals, frame %d\n",
+           numparams,numlocals,framesize);
+    for(int n=0;n<ninsts;n++){
+        RegInst *i = insts+n;
+        printf("%4d %8s r%-3d",n,regOpNames[i->op],i->d);
+        dumpOperand(this,i->a);
+        dumpOperand(this,i->b);
+        printf(" x=%d sub=%d\n",i->x,i->sub);
+    }
+}
@@ -11,6 +11,14 @@
 
 namespace lana {
 
+/// a function bound by API::bind(), cast to a common type; its thunk
+/// casts it back
+typedef void (*BOUNDFUNC)();
+
+/// calls a bound function with the arguments at args, writing any
+/// result into result (see bind.h)
+typedef void (*NATIVETHUNK)(struct NativeFuncData *d,Value *args,Value *result);
+
 /// data for a native function.
 
 struct NativeFuncData {
@@ -29,6 +37,11 @@ struct NativeFuncData {
         VOIDFUNC f;
     } d;
     
+    /// if set, this is a function bound by API::bind(), which the VM
+    /// calls through this rather than d.
+    NATIVETHUNK thunk;
+    BOUNDFUNC bound; //!< the bound function
+    
     NativeFuncData *next; //!< linked list link
     
     NativeFuncData(const char *nm,int a,bool r){
@@ -37,6 +50,7 @@ struct NativeFuncData {
         strcpy(name,nm);
         argc=a;
         returns=r;
+        thunk=NULL;
     }
 };
 
@@ -82,6 +96,18 @@ public:
         return d;
     }
 
+    NativeFuncData *addBound(const char *nm,int argc,bool returns,
+                             NATIVETHUNK t,BOUNDFUNC f,class API *a) {
+        NativeFuncData *d = new NativeFuncData(nm,argc,returns);
+        d->ismethod=false;
+        d->h = (class Host *)a;
+        d->thunk = t;
+        d->bound = f;
+        d->next = head;
+        head = d;
+        return d;
+    }
+
     NativeFuncData *getByName(const char *s){
       for(NativeFuncData *d = head;d;d=d->next){
 	if(!strcmp(s,d->name))
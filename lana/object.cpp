@@ -3,24 +3,105 @@
 #include <string.h>
 #include <stdarg.h>
 
+#include <vector>
+
 #include "language.h"
 #include "object.h"
 #include "cycle.h"
 #include "ser.h"
+#include "api.h"
 
 using namespace lana;
 
 Object::Object(API *a) : Iterable(a) {
-    a->cycle->add(this);
+    a->getCycleDetector()->add(this);
     type = Types::vtObject;
     parent = NULL;
+    nativeProps = NULL;
 }
 
 Object::~Object(){
 //    printf("DELETING %x\n",this);
-    api->cycle->remove(this);
+    if(!immortal)
+        api->getCycleDetector()->remove(this);
     if(parent && parent->decRefCt())
         delete parent;
+    
+    // the subclass has gone, but its fields are still here
+    if(nativeProps){
+        for(NativeProperty *p=nativeProps;p->name;p++){
+            void *field = (char *)this + p->offset;
+            if(p->type == NP_STRING)
+                free(*(char **)field);
+            else if(p->type == NP_OBJECT){
+                Object *o = *(Object **)field;
+                if(o && o->decRefCt())
+                    delete o;
+            }
+        }
+    }
+}
+
+void Object::registerNativeProperties(API *a,NativeProperty *props){
+    for(NativeProperty *p=props;p->name;p++)
+        p->id = a->getID(p->name);
+}
+
+void Object::getNativeProperty(NativeProperty *p,Value *v){
+    void *field = (char *)this + p->offset;
+    switch(p->type){
+    case NP_INT:
+        v->setInt(*(int *)field);
+        break;
+    case NP_FLOAT:
+        v->setFloat(*(float *)field);
+        break;
+    case NP_BOOL:
+        v->setBool(*(bool *)field);
+        break;
+    case NP_STRING:
+        if(!*(char **)field)
+            throw Exception("undefined property");
+        v->setStrClone(*(char **)field);
+        break;
+    case NP_OBJECT:
+        if(!*(Object **)field)
+            throw Exception("undefined property");
+        v->setObj(*(Object **)field);
+        break;
+    }
+}
+
+void Object::setNativeProperty(NativeProperty *p,Value *v){
+    if(p->readonly)
+        throw Exception(NULL).set("property '%s' is read-only",p->name);
+    void *field = (char *)this + p->offset;
+    switch(p->type){
+    case NP_INT:
+        *(int *)field = v->getInt();
+        break;
+    case NP_FLOAT:
+        *(float *)field = v->getFloat();
+        break;
+    case NP_BOOL:
+        *(bool *)field = v->getBool();
+        break;
+    case NP_STRING:{
+        char *s = strdup(v->getStr());
+        free(*(char **)field);
+        *(char **)field = s;
+        break;
+    }
+    case NP_OBJECT:{
+        Object *o = v->getObj();
+        o->incRefCt();
+        Object *old = *(Object **)field;
+        *(Object **)field = o;
+        if(old && old->decRefCt())
+            delete old;
+        break;
+    }
+    }
 }
 
 void Object::setprop(int id,Value *v){
@@ -40,8 +121,8 @@ Value *Object::getprop(int id){
     // its parents until we find it, returning NULL if we don't.
     
     for(Object *o=this;o;o=o->parent){
-        if(o->properties.find(id))
-            return o->properties.getval();
+        if(Value *v = o->properties.lookup(id))
+            return v;
     }
     return NULL;
 }
@@ -60,9 +141,39 @@ Value *PropRefType::deref(Value *v){
 }
 
 void PropRefType::store(Value *ref,Value *v){
+    ref->d.o->checkWritable();
     ref->d.o->setprop(ref->d2.u,v);
 }
 
+Value *FieldRefType::deref(Value *v){
+    // the value holds the only reference to the object we know of, so
+    // keep it alive while the field is loaded over the reference
+    Object *o = v->d.o;
+    o->incRefCt();
+    try {
+        o->getNativeProperty(v->d2.np,v);
+    } catch(Exception &e){
+        o->decRefCt();
+        throw;
+    }
+    if(o->decRefCt())
+        delete o;
+    return v;
+}
+
+void FieldRefType::store(Value *ref,Value *v){
+    ref->d.o->checkWritable();
+    ref->d.o->setNativeProperty(ref->d2.np,v);
+}
+
+bool FieldRefType::isDefinedReference(Value *v){
+    // only strings and objects can be unset
+    NativeProperty *p = v->d2.np;
+    if(p->type != NP_STRING && p->type != NP_OBJECT)
+        return true;
+    return *(void **)((char *)v->d.o + p->offset) != NULL;
+}
+
 
 /// an iterator for running through property keys and converting them
 /// to Values. Note that we don't need to keep the object pointer
@@ -123,6 +234,13 @@ bool ObjectType::makePropRef(Value *v,Value *item,u32 prop){
     if(IterableType::makePropRef(v,item,prop)) // try the standard GC props
         return true;
     
+    // then C++ fields
+    NativeProperty *p = o->findNativeProperty(prop);
+    if(p){
+        v->setFieldRef(o,p);
+        return true;
+    }
+    
     // otherwise it's a user property 
     v->setPropRef(item->d.o,prop);
     return true;
@@ -139,6 +257,7 @@ bool PropRefType::isDefinedReference(Value *v){
 
 bool PropRefType::deleteElement(Value *v){
     Object *o = v->d.o;
+    o->checkWritable();
     return o->properties.del(v->d2.u);
 }
 
@@ -156,22 +275,156 @@ void Object::registerNativeMethod(const char *name,int argc,bool returns,HOSTMET
 
 
 
+void Object::makeImmortal(){
+    frozen = true;
+    if(immortal)
+        return;
+    api->getCycleDetector()->remove(this);
+    immortal = true;
+    gc_refs = 0; // so that it's never taken for a zombie
+}
+
+/// finds everything a freeze() will freeze, marking the objects as
+/// frozen as it goes so that each is only visited once
+
+struct Freezer {
+    std::vector<Object *> objects;
+    std::vector<void *> strings;
+    std::vector<Object *> todo;
+    
+    void add(Object *o){
+        // an immortal object which isn't frozen (see
+        // API::makeHeapImmortal()) can still be changed, so is frozen too
+        if(o->frozen)
+            return;
+        if(o->type!=Types::vtObject && o->type!=Types::vtList &&
+           o->type!=Types::vtDictionary)
+            throw Exception(NULL).set("a %s can't be frozen",o->type->getName());
+        o->frozen = true;
+        objects.push_back(o);
+        todo.push_back(o);
+    }
+    
+    void add(Value *v){
+        switch(v->getAllocType()){
+        case Unmanaged:
+            return;
+        case SimpleMalloc:
+            if(v->isStr()){
+                strings.push_back(v->d.s);
+                return;
+            }
+            break;
+        case Complex:
+            if(v->type==Types::vtObject || v->type==Types::vtList ||
+               v->type==Types::vtDictionary ||
+               v->type==Types::vtNativeMethodRef){
+                add(v->d.o);
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        throw Exception(NULL).set("a %s can't be frozen",v->type->getName());
+    }
+    
+    void addAll(Iterator<Value *> *i){
+        if(!i)
+            return;
+        IteratorPtr<Value *> iterator(i);
+        for(iterator->first();!iterator->isDone();iterator->next())
+            add(iterator->current());
+    }
+};
+
+void Object::freeze(){
+    Freezer f;
+    try {
+        f.add(this);
+        // a stack rather than recursion, as a long chain of lists
+        // would run out of C++ stack
+        while(!f.todo.empty()){
+            Object *o = f.todo.back();
+            f.todo.pop_back();
+            if(o->parent)
+                f.add(o->parent);
+            if(o->nativeProps){
+                for(NativeProperty *p=o->nativeProps;p->name;p++){
+                    Object **fld = o->getObjectField(p);
+                    if(fld && *fld)
+                        f.add(*fld);
+                }
+            }
+            f.addAll(o->properties.createValueIterator());
+            // lists and dictionaries keep their contents elsewhere
+            f.addAll(o->createValueIterator());
+            f.addAll(o->createKeyIterator(true));
+        }
+    } catch(Exception &e) {
+        for(unsigned int i=0;i<f.objects.size();i++)
+            f.objects[i]->frozen = false;
+        throw;
+    }
+    
+    Language *lana = api->lana;
+    for(unsigned int i=0;i<f.objects.size();i++){
+        Object *o = f.objects[i];
+        try {
+            o->compact();
+        } catch(Exception &e) {
+            // it's being iterated over, so is left as it is
+        }
+        // one which was already immortal is never deleted
+        if(o->immortal){
+            o->frozen = true;
+            continue;
+        }
+        o->makeImmortal();
+        lana->addFrozen(o);
+    }
+    for(unsigned int i=0;i<f.strings.size();i++)
+        lana->makeStringImmortal(f.strings[i]);
+}
+
 void Object::traceAndMove(CycleDetector *cycle){
     if(parent)
         cycle->traceAndMoveEntity(parent);
+    if(nativeProps){
+        for(NativeProperty *p=nativeProps;p->name;p++){
+            Object **f = getObjectField(p);
+            if(f && *f && (*f)->gc_refs==0)
+                cycle->traceAndMoveEntity(*f);
+        }
+    }
 }
 
 void Object::decReferentsCycleRefCounts(){
-    if(parent)
+    if(parent && !parent->immortal)
         parent->gc_refs--;
+    if(nativeProps){
+        for(NativeProperty *p=nativeProps;p->name;p++){
+            Object **f = getObjectField(p);
+            if(f && *f && !(*f)->immortal)
+                (*f)->gc_refs--;
+        }
+    }
 }
 
 void Object::clearZombieReferences(){
     // this basically says that if my parent class is also about to be deleted
     // (has been "maxreffed" in detect()) then just set it to null. Otherwise
-    // we could end up with a free-twice.
+    // we could end up with a free-twice. The same goes for objects in
+    // native properties.
     if(parent && parent->gc_refs == 0xffff)
         parent = NULL;
+    if(nativeProps){
+        for(NativeProperty *p=nativeProps;p->name;p++){
+            Object **f = getObjectField(p);
+            if(f && *f && (*f)->gc_refs == 0xffff)
+                *f = NULL;
+        }
+    }
 }
 
 
@@ -225,6 +478,22 @@ void Object::serialisePropertyHash(Serialiser *s,const char *name,FILE *out) {
         if(tempused)
             fprintf(out,"%s%s.%s = %s\n",indents,name,propname,buf);
     }
+    
+    // and the native properties Lana code can set
+    if(nativeProps){
+        for(NativeProperty *p=nativeProps;p->name;p++){
+            if(p->readonly)
+                continue;
+            Value v;
+            try {
+                getNativeProperty(p,&v);
+            } catch(Exception &e){
+                continue; // a NULL string or object
+            }
+            sprintf(buf,"%s.%s",name,p->name);
+            s->serialiseValue(out,&v,buf);
+        }
+    }
     s->lana->recreateIndent--; // decrease indenting!
 }
 
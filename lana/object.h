@@ -14,7 +14,53 @@
 
 namespace lana {
 
+/// the types of C++ field a NativeProperty can describe
+enum NativePropertyType {
+    NP_INT,    //!< an int
+    NP_FLOAT,  //!< a float
+    NP_BOOL,   //!< a bool
+    NP_STRING, //!< a char *, malloc()ed and owned by the object, or NULL
+    NP_OBJECT  //!< an Object *, which the object holds a reference to, or NULL
+};
+
+/// describes a C++ field of an Object subclass which Lana code can read
+/// and write as a property, without the class overriding getprop() and
+/// setprop(). A class lists its fields in a static table ending with an
+/// entry whose name is NULL, most easily written with NATIVE_PROPERTY():
+/// \code
+///     NativeProperty Ship::props[] = {
+///         NATIVE_PROPERTY(Ship,speed,NP_FLOAT),
+///         NATIVE_PROPERTY(Ship,name,NP_STRING),
+///         NATIVE_READONLY_PROPERTY(Ship,crew,NP_INT),
+///         {NULL}
+///     };
+/// \endcode
+/// The table is given to Object::registerNativeProperties() when the
+/// class is registered with the API, and to setNativeProperties() by each
+/// object's constructor. The object frees string fields and releases
+/// object fields when it's deleted, and cycle detection and
+/// serialisation see them.
+
+struct NativeProperty {
+    const char *name;        //!< the property's name, or NULL to end the table
+    NativePropertyType type; //!< the field's type
+    int offset;              //!< the field's offset in the object
+    bool readonly;           //!< if set, Lana code can't change it
+    int id;                  //!< the property ID, set by registerNativeProperties()
+};
+
+/// the offset of a field in a class. This is offsetof(), which C++
+/// doesn't allow for classes with virtual methods such as Object's
+/// subclasses, although it works for them with single inheritance.
+#define NATIVE_PROPERTY_OFFSET(cls,field) \
+    ((int)((char *)&((cls *)64)->field - (char *)64))
 
+/// an entry in a NativeProperty table
+#define NATIVE_PROPERTY(cls,field,type) \
+    {#field,type,NATIVE_PROPERTY_OFFSET(cls,field),false,-1}
+/// an entry in a NativeProperty table for a field Lana code can only read
+#define NATIVE_READONLY_PROPERTY(cls,field,type) \
+    {#field,type,NATIVE_PROPERTY_OFFSET(cls,field),true,-1}
 
 
 /// a full Lana object : native functions can run in it, as with a Host,
@@ -23,6 +69,7 @@ namespace lana {
 /// usable with Lana, and create subclasses in Lana by cloning these.
 
 class Object : public Iterable {
+    friend class Message;
 public:
     
     Object(API *a);
@@ -61,6 +108,27 @@ public:
                               HOSTMETHOD m);
     
     
+    /// set the property IDs in a table of native properties (see
+    /// NativeProperty). Call this once when the class is registered
+    /// with the API.
+    static void registerNativeProperties(API *a,NativeProperty *props);
+    
+    /// find the native property with the given ID, or return NULL
+    NativeProperty *findNativeProperty(int id){
+        if(nativeProps){
+            for(NativeProperty *p=nativeProps;p->name;p++){
+                if(p->id == id)
+                    return p;
+            }
+        }
+        return NULL;
+    }
+    
+    /// read one of this object's native properties into a value
+    void getNativeProperty(NativeProperty *p,Value *v);
+    /// write a value into one of this object's native properties
+    void setNativeProperty(NativeProperty *p,Value *v);
+    
     /// return the value iterator of the properties
     virtual Iterator<Value *> *createValueIterator(){
         return properties.createValueIterator();
@@ -71,6 +139,13 @@ public:
     /// our properties
     IntKeyedHash<Value> properties;
     
+    /// shrink the storage of this object to fit its contents, after
+    /// a lot of deletions. Subclasses with their own storage should
+    /// override this and call it.
+    virtual void compact(){
+        properties.compact();
+    }
+    
     /// return the superclass
     Object *getSuper(){
         return parent;
@@ -116,8 +191,41 @@ public:
     /// see traceAndMove()
     virtual void clearZombieReferences();
     
+    /// make this object immortal, taking it out of the cycle detector
+    /// so that it's no longer reference counted or collected, and frozen
+    /// so that Lana code can't change it; so it can be used by any thread
+    /// (see thread.h). It must be deleted
+    /// explicitly, once nothing uses it - as the prototypes of the
+    /// built-in types are when the types are deleted.
+    void makeImmortal();
+    
+    /// freeze this object and everything it refers to - its parent,
+    /// properties and contents, and whatever they refer to in turn -
+    /// so that none of it can be changed again. Frozen objects are
+    /// immortal, and compacted, so they can be shared by threads and
+    /// cost nothing to copy or collect; the strings in them are made
+    /// immortal too. They're deleted with the API. Only objects, lists
+    /// and dictionaries can be frozen: if anything else is reachable
+    /// an exception is thrown and nothing is frozen.
+    void freeze();
+    
+    /// throw an exception if this object is frozen. Anything which
+    /// lets Lana code change an object should call this first.
+    void checkWritable(){
+        if(frozen)
+            throw Exception(NULL).set("cannot change a frozen %s",
+                                      type->getName());
+    }
+    
     
 protected:
+    /// give the object C++ fields which Lana code can use as properties,
+    /// described by a table which has been through
+    /// registerNativeProperties(). Typically done in the constructor.
+    void setNativeProperties(NativeProperty *props){
+        nativeProps = props;
+    }
+    
     /// make this object a clone of another by setting the parent
     /// value. Make DAMN SURE that parent object isn't deleted :)
     
@@ -140,6 +248,16 @@ private:
     /// the object we look in for properties we don't have. Should really
     /// be called 'superclass', I suppose :)
     Object *parent;
+    
+    /// the table of C++ fields used as properties, or NULL
+    NativeProperty *nativeProps;
+    
+    /// get a native property's Object * field, or NULL if it isn't one
+    Object **getObjectField(NativeProperty *p){
+        if(p->type != NP_OBJECT)
+            return NULL;
+        return (Object **)((char *)this + p->offset);
+    }
 };
 
 
@@ -173,6 +291,9 @@ struct ObjectType : public IterableType {
 
 /// the type for references to properties of objects
 struct PropRefType : public Type {
+    PropRefType(){
+        isRef = true;
+    }
     virtual const char *repr(const Value *v) const {
         startRepr();
         sprintf(buf+strlen(buf),"%p(ct%d)/%d",v->d.o,
@@ -186,6 +307,28 @@ struct PropRefType : public Type {
 
 };
 
+/// the type for references to C++ fields of objects, described by
+/// NativeProperty. Dereferencing one loads the field's value into the
+/// reference itself, which is then an ordinary value, so no temporary
+/// is needed to hold it; storing through one writes the field.
+struct FieldRefType : public Type {
+    FieldRefType(){
+        isRef = true;
+    }
+    virtual const char *repr(const Value *v) const {
+        startRepr();
+        sprintf(buf+strlen(buf),"%p(ct%d)/%s",v->d.o,
+                v->d.gc->refct,v->d2.np->name);
+        return buf;
+    } 
+    virtual Value *deref(Value *v);
+    virtual void store(Value *ref,Value *v);
+    virtual bool isDefinedReference(Value *v);
+    virtual bool deleteElement(Value *v){
+        return false;
+    }
+};
+
 }
 
 #endif /* __OBJECTx_H */
@@ -26,29 +26,35 @@ const char *opcodes[] = {
     "true","false","quickif","this","immed","sqb",
     "logand","logor","bitand","bitor","bitnot","xor","for","next","endfor",
     "startestmt","endestmt","endestmt2","varrefloc","varrefprm","varrefses",
-    "varrefglb","litident","mod",
+    "varrefglb","litident","mod","continuefw",
+    "loadloc","loadprm","loadses","loadglb","inline","inlineret",
+    "callsite","tailcall",
 };
 
 char *Language::dumpInst(instruction *p,Session *ses){
-    static char buf[256];
+    static __thread char buf[256];
     char *name;
     
     int op = INSTOP(*p);
     int d = INSTDATA(*p);
     switch(op){
     case OP_VARREFLOC:
+    case OP_LOADLOC:
         name = getLocalName(d);
         sprintf(buf,"%8x   %2d: %10s (%s) (%d)",p,op,opcodes[op],name,d);
         break;
     case OP_VARREFPRM:
+    case OP_LOADPRM:
         name = getParamName(d);
         sprintf(buf,"%8x   %2d: %10s (%s) (%d)",p,op,opcodes[op],name,d);
         break;
     case OP_VARREFGLB:
+    case OP_LOADGLB:
         name = getGlobalName(d);
         sprintf(buf,"%8x   %2d: %10s (%s) (%d)",p,op,opcodes[op],name,d);
         break;
     case OP_VARREFSES:
+    case OP_LOADSES:
         name = ses->getSesVarName(d);
         sprintf(buf,"%8x   %2d: %10s (%s) (%d)",p,op,opcodes[op],name,d);
         break;
@@ -60,7 +66,10 @@ char *Language::dumpInst(instruction *p,Session *ses){
     case OP_JMPELSEIF:
     case OP_GOTOFW:
     case OP_BREAK:
+    case OP_CONTINUEFW:
     case OP_QUICKIF:
+    case OP_INLINE:
+    case OP_INLINERET:
     case OP_IF: {
             instruction *dest = p+INSTDATA(*p);
             sprintf(buf,"%8x   %2d: %10s (-> %8x) (0x%x)",p,op,opcodes[op],dest,d);
@@ -86,5 +86,30 @@
 #define OP_VARREFGLB	70
 #define OP_LITIDENT	71
 #define OP_MOD		72
+#define OP_CONTINUEFW	73
+#define OP_LOADLOC	74
+#define OP_LOADPRM	75
+#define OP_LOADSES	76
+#define OP_LOADGLB	77
+/// the start of a user function's body inlined where it's called, with
+/// the call's arguments on the stack above the function. It's followed
+/// by three operands which aren't run: the OP_CALL which would have
+/// been made, an OP_LIT of the function which was inlined, and an
+/// OP_IMMED of the frame slot its parameters go in. If the function
+/// isn't the one that was inlined, the call is made as usual and the
+/// body is skipped - see Optimiser::inlineCalls().
+#define OP_INLINE	78
+/// a return with a value from an inlined function body
+#define OP_INLINERET	79
+/// a call in a user function, which remembers what it called last time
+/// so that it can call it again more quickly. The data is the argument
+/// count in the low 8 bits, and the VirtualMachine::CallSite above them.
+#define OP_CALLSITE	80
+/// a call in a user function whose result is returned straight away,
+/// always followed by that OP_RETURN. A user function is run in the
+/// caller's frame, which it replaces; anything else is called as
+/// OP_CALL would, and the OP_RETURN returns its result. The data is
+/// the argument count.
+#define OP_TAILCALL	81
 
 #endif /* __OPCODES_H */
@@ -0,0 +1,781 @@
+/**
+ * @file
+ * The bytecode optimiser - see optimise.h.
+ *
+ * The code is decoded into a list of instructions whose jumps hold the
+ * index of their destination, rather than a relative offset, so that
+ * instructions can be removed without upsetting the jumps. Each pass
+ * marks instructions as removed, and compact() then takes them out,
+ * moving any jumps to them onto the next instruction which remains.
+ * The passes are repeated until none of them finds anything to do,
+ * since each can give the others more work. Inlining is done once, at
+ * the end, because the code it brings in has already been optimised.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "language.h"
+#include "session.h"
+#include "vm.h"
+#include "optimise.h"
+#include "opcodes.h"
+#include "exception.h"
+
+using namespace lana;
+
+/// how a jump instruction behaves
+enum JumpKind {
+    J_NONE,     //!< not a jump
+    J_FWDCOND,  //!< pops a condition and jumps forwards if false
+    J_BACKCOND, //!< pops a condition and jumps backwards if false
+    J_FWD,      //!< always jumps forwards
+    J_BACK,     //!< always jumps backwards
+    J_FOR,      //!< OP_FOR, which may jump forwards
+    J_NEXT,     //!< OP_NEXT, which may jump backwards
+    J_INLINE,   //!< OP_INLINE or OP_INLINERET, which may jump forwards
+};
+
+static JumpKind jumpKind(instruction op){
+    switch(INSTOP(op)){
+    case OP_IF:case OP_ELSEIF:case OP_QUICKIF:case OP_WHILE:
+        return J_FWDCOND;
+    case OP_UNTIL:
+        return J_BACKCOND;
+    case OP_ELSE:case OP_JMPELSEIF:case OP_GOTOFW:case OP_BREAK:
+    case OP_CONTINUEFW:
+        return J_FWD;
+    case OP_ENDWHILE:case OP_GOTOBK:case OP_CONTINUE:
+        return J_BACK;
+    case OP_FOR:
+        return J_FOR;
+    case OP_NEXT:
+        return J_NEXT;
+    case OP_INLINE:case OP_INLINERET:
+        return J_INLINE;
+    default:
+        return J_NONE;
+    }
+}
+
+/// is this kind of jump encoded as a forward offset?
+static bool isForward(JumpKind k){
+    return k==J_FWDCOND || k==J_FWD || k==J_FOR || k==J_INLINE;
+}
+
+void Optimiser::decode(std::vector<Inst> &v,const instruction *code,int n){
+    v.resize(n);
+    for(int i=0;i<n;i++){
+        Inst *p = &v[i];
+        p->op = code[i];
+        p->removed = false;
+        JumpKind k = jumpKind(code[i]);
+        if(k==J_NONE)
+            p->target = -1;
+        else if(isForward(k))
+            p->target = i+INSTDATA(code[i]);
+        else
+            p->target = i-INSTDATA(code[i]);
+    }
+}
+
+void Optimiser::encode(){
+    int n = insts.size();
+    out.resize(n);
+    for(int i=0;i<n;i++){
+        instruction op = insts[i].op;
+        JumpKind k = jumpKind(op);
+        if(k!=J_NONE){
+            int t = insts[i].target;
+            op = INST(INSTOP(op),isForward(k) ? t-i : i-t);
+        }
+        out[i] = op;
+    }
+}
+
+void Optimiser::findTargets(){
+    int n = insts.size();
+    for(int i=0;i<n;i++)
+        insts[i].isTarget = false;
+    for(int i=0;i<n;i++){
+        int t = insts[i].target;
+        if(t>=0 && t<n)
+            insts[t].isTarget = true;
+    }
+}
+
+bool Optimiser::compact(){
+    int n = insts.size();
+    // where each instruction ends up; a removed instruction's jumps go
+    // to the next one which isn't removed.
+    std::vector<int> map(n+1);
+    int ct = 0;
+    for(int i=0;i<n;i++){
+        map[i] = ct;
+        if(!insts[i].removed)
+            ct++;
+    }
+    map[n] = ct;
+    if(ct==n)
+        return false;
+
+    int j=0;
+    for(int i=0;i<n;i++){
+        if(insts[i].removed)
+            continue;
+        Inst inst = insts[i];
+        if(inst.target>=0)
+            inst.target = map[inst.target];
+        insts[j++] = inst;
+    }
+    insts.resize(ct);
+    return true;
+}
+
+int Optimiser::prevLive(int i){
+    while(--i>=0){
+        if(!insts[i].removed)
+            return i;
+    }
+    return -1;
+}
+
+int Optimiser::nextLive(int i){
+    int n = insts.size();
+    while(++i<n){
+        if(!insts[i].removed)
+            return i;
+    }
+    return -1;
+}
+
+/// remove instructions which do nothing when run, and source line
+/// numbers which are immediately replaced by another.
+bool Optimiser::removeNoOps(){
+    int n = insts.size();
+    for(int i=0;i<n;i++){
+        switch(INSTOP(insts[i].op)){
+        case OP_DUMMY:case OP_PAREN:case OP_COMMENT_SOL:case OP_COMMENT_EOL:
+        case OP_COMMENT_EOFD:case OP_BLANKLINE:case OP_REPEAT:case OP_ENDIF:
+        case OP_LABEL:case OP_GOTOMARKER:
+            insts[i].removed = true;
+            break;
+        }
+    }
+    for(int i=0;i<n;i++){
+        if(insts[i].removed || INSTOP(insts[i].op)!=OP_SRCLINE)
+            continue;
+        int j = nextLive(i);
+        if(j>=0 && INSTOP(insts[j].op)==OP_SRCLINE)
+            insts[i].removed = true;
+    }
+    return compact();
+}
+
+/// get the value of a numeric or boolean literal, returning false if
+/// the instruction isn't one.
+bool Optimiser::getLiteral(instruction op,Value *v){
+    switch(INSTOP(op)){
+    case OP_IMMED:
+        v->setInt(INSTDATA(op));
+        return true;
+    case OP_TRUE:
+        v->setBool(true);
+        return true;
+    case OP_FALSE:
+        v->setBool(false);
+        return true;
+    case OP_LIT:
+        {
+            ConstDesc *e = consts->get(INSTDATA(op));
+            if(e->getType()==CT_INT){
+                v->setInt(*(int *)e->get());
+                return true;
+            } else if(e->getType()==CT_FLOAT){
+                v->setFloat(*(float *)e->get());
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/// make the instruction which pushes a value produced by folding,
+/// in the same way as the compiler would
+instruction Optimiser::makeLiteral(Value *v){
+    if(v->type == Types::vtBoolean)
+        return INST(v->d.i ? OP_TRUE : OP_FALSE,0);
+    else if(v->type == Types::vtInteger){
+        int i = v->d.i;
+        if(i>=0 && i<(1<<24))
+            return INST(OP_IMMED,i);
+        return INST(OP_LIT,consts->findOrCreateInt(i));
+    } else
+        return INST(OP_LIT,consts->findOrCreateFloat(v->d.f));
+}
+
+/// fold arithmetic, bitwise, logical and comparison operations on
+/// literals into a single literal, using the types' own operations so
+/// the results are exactly what running the code would give. Anything
+/// which would throw, or which depends on something which could change
+/// at run time (float comparisons use arithEpsilon), is left alone.
+bool Optimiser::foldConstants(){
+    bool changed = false;
+    findTargets();
+    int n = insts.size();
+    for(int i=0;i<n;i++){
+        instruction op = insts[i].op;
+        bool unary;
+        switch(INSTOP(op)){
+        case OP_ADD:case OP_SUB:case OP_MUL:case OP_DIV:case OP_MOD:
+        case OP_EQUALS:case OP_NEQUALS:case OP_NEAREQ:case OP_NNEAREQ:
+        case OP_LT:case OP_LTE:case OP_GT:case OP_GTE:
+        case OP_BITAND:case OP_BITOR:case OP_XOR:
+        case OP_LOGAND:case OP_LOGOR:
+            unary = false;
+            break;
+        case OP_NEGATE:case OP_NOT:case OP_BITNOT:
+            unary = true;
+            break;
+        default:
+            continue;
+        }
+        if(insts[i].isTarget)
+            continue;
+
+        // find the operand literals, which must run straight into
+        // the operation
+        Value a,b,r;
+        int pb = prevLive(i);
+        if(pb<0 || !getLiteral(insts[pb].op,&b))
+            continue;
+        int pa = pb;
+        if(!unary){
+            if(insts[pb].isTarget)
+                continue;
+            pa = prevLive(pb);
+            if(pa<0 || !getLiteral(insts[pa].op,&a))
+                continue;
+        }
+
+        Type *ta = a.type, *tb = b.type;
+        Type *ti = Types::vtInteger, *tf = Types::vtFloat, *tbool = Types::vtBoolean;
+        try {
+            switch(INSTOP(op)){
+            case OP_DIV:case OP_MOD:
+                if(b.getFloat()==0)
+                    continue;
+                // fall through
+            case OP_ADD:case OP_SUB:case OP_MUL:
+                if((ta!=ti && ta!=tf) || (tb!=ti && tb!=tf))
+                    continue;
+                a.type->doBinArithOp(&r,INSTOP(op),&a,&b);
+                break;
+            case OP_EQUALS:case OP_NEQUALS:case OP_NEAREQ:case OP_NNEAREQ:
+            case OP_LT:case OP_LTE:case OP_GT:case OP_GTE:
+                if(ta!=ti || tb!=ti)
+                    continue;
+                a.type->doBinComparisonOp(&r,INSTOP(op),&a,&b);
+                break;
+            case OP_BITAND:
+                if(ta!=ti || tb!=ti)
+                    continue;
+                r.setInt(a.d.i & b.d.i);
+                break;
+            case OP_BITOR:
+                if(ta!=ti || tb!=ti)
+                    continue;
+                r.setInt(a.d.i | b.d.i);
+                break;
+            case OP_XOR:
+                if(ta!=ti || tb!=ti)
+                    continue;
+                r.setInt(a.d.i ^ b.d.i);
+                break;
+            case OP_LOGAND:
+                if(ta!=tbool || tb!=tbool)
+                    continue;
+                r.setBool(a.d.i && b.d.i);
+                break;
+            case OP_LOGOR:
+                if(ta!=tbool || tb!=tbool)
+                    continue;
+                r.setBool(a.d.i || b.d.i);
+                break;
+            case OP_BITNOT:
+                if(tb!=ti)
+                    continue;
+                r.setInt(~b.d.i);
+                break;
+            case OP_NEGATE:
+                if(!b.type->negate(&b,&r))
+                    continue;
+                break;
+            case OP_NOT:
+                if(!b.type->unarynot(&b,&r))
+                    continue;
+                break;
+            }
+        } catch(Exception &e){
+            continue; // leave it to fail when it runs
+        }
+        if(r.type!=ti && r.type!=tf && r.type!=tbool)
+            continue;
+
+        insts[pa].op = makeLiteral(&r);
+        if(pb!=pa)
+            insts[pb].removed = true;
+        insts[i].removed = true;
+        changed = true;
+    }
+    return compact() || changed;
+}
+
+/// turn conditional jumps on a literal true or false into either
+/// nothing or an unconditional jump. Other literals are left alone,
+/// because they aren't booleans and so throw when they run.
+bool Optimiser::foldConditions(){
+    findTargets();
+    int n = insts.size();
+    for(int i=0;i<n;i++){
+        JumpKind k = jumpKind(insts[i].op);
+        if((k!=J_FWDCOND && k!=J_BACKCOND) || insts[i].isTarget)
+            continue;
+        int p = prevLive(i);
+        if(p<0)
+            continue;
+        int lit = INSTOP(insts[p].op);
+        if(lit==OP_TRUE){
+            insts[p].removed = true;
+            insts[i].removed = true;
+        } else if(lit==OP_FALSE){
+            insts[p].op = INST(k==J_FWDCOND ? OP_GOTOFW : OP_GOTOBK,0);
+            insts[p].target = insts[i].target;
+            insts[i].removed = true;
+        }
+    }
+    return compact();
+}
+
+/// make jumps to unconditional jumps go straight to where they end up,
+/// and remove unconditional jumps to the next instruction.
+bool Optimiser::threadJumps(){
+    bool changed = false;
+    int n = insts.size();
+    for(int i=0;i<n;i++){
+        JumpKind k = jumpKind(insts[i].op);
+        if(k==J_NONE)
+            continue;
+        int t = insts[i].target;
+        // follow the chain, giving up if it's a loop
+        for(int ct=0;ct<n && t>=0 && t<n;ct++){
+            JumpKind tk = jumpKind(insts[t].op);
+            if((tk!=J_FWD && tk!=J_BACK) || insts[t].target==t)
+                break;
+            t = insts[t].target;
+        }
+        if(t!=insts[i].target && t>=0 && t<n){
+            if(k==J_FWD || k==J_BACK){
+                // unconditional jumps can change direction
+                if(t>i && k==J_BACK)
+                    insts[i].op = INST(OP_GOTOFW,0);
+                else if(t<=i && k==J_FWD)
+                    insts[i].op = INST(OP_GOTOBK,0);
+                insts[i].target = t;
+                changed = true;
+            } else if(isForward(k) ? t>i : t<=i){
+                insts[i].target = t;
+                changed = true;
+            }
+        }
+        if((k==J_FWD || k==J_BACK) && insts[i].target==i+1){
+            insts[i].removed = true;
+            changed = true;
+        }
+    }
+    return compact() || changed;
+}
+
+/// remove code which can't be reached from the start, such as that
+/// following a return or an unconditional jump. The last instruction
+/// is always kept, so that the code is still terminated.
+bool Optimiser::removeUnreachable(){
+    int n = insts.size();
+    std::vector<bool> reached(n,false);
+    std::vector<int> todo;
+    todo.push_back(0);
+    while(!todo.empty()){
+        int i = todo.back();
+        todo.pop_back();
+        while(i>=0 && i<n && !reached[i]){
+            reached[i]=true;
+            instruction op = insts[i].op;
+            JumpKind k = jumpKind(op);
+            if(k!=J_NONE)
+                todo.push_back(insts[i].target);
+            if(k==J_FWD || k==J_BACK || INSTOP(op)==OP_RETURN || INSTOP(op)==OP_END)
+                break;
+            i++;
+        }
+    }
+    for(int i=0;i<n-1;i++){
+        if(!reached[i])
+            insts[i].removed = true;
+    }
+    return compact();
+}
+
+/// if a load is of a variable holding a user function which can be
+/// inlined, fill in the site with it. The function must be small, and
+/// mustn't use anything which depends on it having its own frame on the
+/// return stack: "this", for-loops (whose state a return drops), its
+/// own variable, as recursion can't be inlined, or tail calls, which
+/// would no longer run in constant stack.
+bool Optimiser::getInlinable(instruction load,Site *s){
+    Value *v;
+    if(INSTOP(load)==OP_LOADSES)
+        v = ses->getSesVar(INSTDATA(load));
+    else
+        v = globs->get(INSTDATA(load));
+    if(!v || v->type != Types::vtFunction)
+        return false;
+    
+    s->func = v->d.u;
+    s->code = getOptimisedCode(v->getPtr(),&s->n);
+    if(s->n<2 || s->n-1>inlineMaxSize || INSTOP(s->code[0])!=OP_LOCALS)
+        return false;
+    
+    for(int i=1;i<s->n;i++){
+        instruction op = s->code[i];
+        switch(INSTOP(op)){
+        case OP_THIS:case OP_FOR:case OP_NEXT:case OP_ENDFOR:case OP_LOCALS:
+        case OP_TAILCALL:
+            return false;
+        case OP_LOADSES:case OP_VARREFSES:
+            if(INSTOP(load)==OP_LOADSES && INSTDATA(op)==INSTDATA(load))
+                return false;
+            break;
+        case OP_LOADGLB:case OP_VARREFGLB:
+            if(INSTOP(load)==OP_LOADGLB && INSTDATA(op)==INSTDATA(load))
+                return false;
+            break;
+        }
+        JumpKind k = jumpKind(op);
+        if(k!=J_NONE && !isForward(k) && (int)INSTDATA(op)>=i)
+            return false; // a jump back to the OP_LOCALS
+    }
+    return true;
+}
+
+/// find the call which uses the function pushed by a load, by following
+/// the stack through the arguments. Only straight-line expressions are
+/// followed; the index of the OP_CALL is returned, or -1.
+int Optimiser::findCall(int load){
+    int n = insts.size();
+    int depth = 0; // values pushed above the function
+    for(int i=load+1;i<n;i++){
+        if(insts[i].isTarget)
+            return -1;
+        instruction op = insts[i].op;
+        switch(INSTOP(op)){
+        case OP_CALL:
+            if(depth==(int)INSTDATA(op))
+                return i;
+            if(depth<(int)INSTDATA(op)+1)
+                return -1;
+            depth -= INSTDATA(op); // the function and arguments for the result
+            break;
+        case OP_LIT:case OP_IMMED:case OP_LITIDENT:case OP_TRUE:case OP_FALSE:
+        case OP_THIS:case OP_VARREFLOC:case OP_VARREFPRM:case OP_VARREFSES:
+        case OP_VARREFGLB:case OP_LOADLOC:case OP_LOADPRM:case OP_LOADSES:
+        case OP_LOADGLB:
+            depth++;
+            break;
+        case OP_NEGATE:case OP_NOT:case OP_BITNOT:case OP_PROPREF:
+            break;
+        case OP_ADD:case OP_SUB:case OP_MUL:case OP_DIV:case OP_MOD:
+        case OP_EQUALS:case OP_NEQUALS:case OP_NEAREQ:case OP_NNEAREQ:
+        case OP_LT:case OP_LTE:case OP_GT:case OP_GTE:
+        case OP_BITAND:case OP_BITOR:case OP_XOR:
+        case OP_LOGAND:case OP_LOGOR:case OP_SQB:
+            if(--depth<0)
+                return -1;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/// does an instruction always push a plain value, rather than a
+/// reference which a return would have to dereference?
+static bool pushesValue(instruction op){
+    switch(INSTOP(op)){
+    case OP_LIT:case OP_IMMED:case OP_TRUE:case OP_FALSE:
+    case OP_LOADLOC:case OP_LOADPRM:case OP_LOADSES:case OP_LOADGLB:
+    case OP_ADD:case OP_SUB:case OP_MUL:case OP_DIV:case OP_MOD:
+    case OP_EQUALS:case OP_NEQUALS:case OP_NEAREQ:case OP_NNEAREQ:
+    case OP_LT:case OP_LTE:case OP_GT:case OP_GTE:
+    case OP_BITAND:case OP_BITOR:case OP_XOR:case OP_BITNOT:
+    case OP_LOGAND:case OP_LOGOR:case OP_NEGATE:case OP_NOT:
+    case OP_INLINERET:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// write the inlined code for a site, with the function's frame
+/// starting at slot base in the caller's. Its source lines go, so
+/// errors in it are reported at the call, and returns become jumps to
+/// the end, or nothing if they're at the end already.
+void Optimiser::emitInline(std::vector<Inst> &v,Site *s,int base){
+    const instruction *code = s->code;
+    int n = s->n;
+    
+    // find the operands of nested inlined functions, which aren't
+    // run, and the jump targets
+    std::vector<bool> operand(n,false), target(n+1,false);
+    for(int i=1;i<n;i++){
+        if(operand[i])
+            continue;
+        if(INSTOP(code[i])==OP_INLINE){
+            for(int j=1;j<=3 && i+j<n;j++)
+                operand[i+j] = true;
+        }
+        JumpKind k = jumpKind(code[i]);
+        if(k!=J_NONE)
+            target[isForward(k) ? i+INSTDATA(code[i]) : i-INSTDATA(code[i])] = true;
+    }
+    
+    // work out what each instruction becomes, 0 if it's dropped;
+    // backwards, so we know if the rest are dropped.
+    std::vector<instruction> ops(n,0);
+    bool atEnd = true;
+    for(int i=n-1;i>=1;i--){
+        instruction op = code[i];
+        if(operand[i]){
+            // the frame slot of a nested inlined function's parameters
+            if(operand[i-1] && operand[i-2])
+                op = INST(OP_IMMED,INSTDATA(op)+base);
+        } else switch(INSTOP(op)){
+        case OP_SRCLINE:case OP_SRCFILE:
+            op = 0;
+            break;
+        case OP_LOADLOC:case OP_LOADPRM:case OP_VARREFLOC:case OP_VARREFPRM:
+            op = INST(INSTOP(op),INSTDATA(op)+base);
+            break;
+        case OP_RETURN:
+        case OP_END:
+            // a value which might be a reference must be dereferenced
+            if(INSTOP(op)==OP_RETURN && INSTDATA(op) &&
+               (target[i] || operand[i-1] || !pushesValue(code[i-1])))
+                op = INST(OP_INLINERET,0);
+            else
+                op = atEnd ? 0 : INST(OP_GOTOFW,0);
+            break;
+        }
+        ops[i] = op;
+        if(op)
+            atEnd = false;
+    }
+    
+    // where each instruction goes, the dropped ones going where the
+    // next one does
+    std::vector<int> map(n+1);
+    int pos = v.size()+4;
+    for(int i=1;i<n;i++){
+        map[i] = pos;
+        if(ops[i])
+            pos++;
+    }
+    map[n] = pos;
+    int end = pos;
+    
+    Inst inst;
+    inst.removed = false;
+    inst.target = end;
+    inst.op = INST(OP_INLINE,0);
+    v.push_back(inst);
+    inst.target = -1;
+    inst.op = insts[s->call].op;
+    v.push_back(inst);
+    inst.op = INST(OP_LIT,s->func);
+    v.push_back(inst);
+    inst.op = INST(OP_IMMED,base);
+    v.push_back(inst);
+    
+    for(int i=1;i<n;i++){
+        instruction op = ops[i];
+        if(!op)
+            continue;
+        switch(INSTOP(op)){
+        case OP_INLINERET:
+        case OP_GOTOFW:
+            if(INSTOP(code[i])==OP_RETURN || INSTOP(code[i])==OP_END){
+                inst.target = end;
+                break;
+            }
+            // fall through
+        default:
+            {
+                JumpKind k = operand[i] ? J_NONE : jumpKind(op);
+                if(k==J_NONE)
+                    inst.target = -1;
+                else
+                    inst.target = map[isForward(k) ? i+INSTDATA(op) : i-INSTDATA(op)];
+            }
+        }
+        inst.op = op;
+        v.push_back(inst);
+    }
+}
+
+/// for putting the sites in the order of their calls, which in nested
+/// calls isn't the order of their functions
+static bool callOrder(const Optimiser::Site &a,const Optimiser::Site &b){
+    return a.call<b.call;
+}
+
+/// replace calls to small user functions held in session or global
+/// variables with their code. The function is still pushed and the
+/// arguments evaluated as before, and OP_INLINE then checks the
+/// function is still the one which was inlined. If it is, the
+/// arguments go into extra slots at the end of the caller's frame,
+/// which all the inlined functions share, and the inlined code runs;
+/// if not, the call is made. A new LDT gives the bigger frame.
+bool Optimiser::inlineCalls(){
+    int n = insts.size();
+    if(!ses || inlineMaxSize<=0 || !n || INSTOP(insts[0].op)!=OP_LOCALS)
+        return false;
+    
+    LDTHeader *ldt = (LDTHeader *)consts->get(INSTDATA(insts[0].op))->get();
+    int base = ldt->numparams+ldt->numlocals;
+    int extra = 0;
+    int growth = 0;
+    
+    findTargets();
+    std::vector<Site> sites;
+    for(int i=1;i<n;i++){
+        int op = INSTOP(insts[i].op);
+        if(op!=OP_LOADSES && op!=OP_LOADGLB)
+            continue;
+        Site s;
+        if(!getInlinable(insts[i].op,&s))
+            continue;
+        s.call = findCall(i);
+        if(s.call<0)
+            continue;
+        LDTHeader *h = (LDTHeader *)consts->get(INSTDATA(s.code[0]))->get();
+        if((int)INSTDATA(insts[s.call].op)!=h->numparams)
+            continue; // leave it to fail when it runs
+        int frame = h->numparams+h->numlocals;
+        if(growth+s.n+3 > inlineMaxGrowth || base+frame > MAXLOCALS*2)
+            continue;
+        growth += s.n+3;
+        if(frame>extra)
+            extra = frame;
+        sites.push_back(s);
+    }
+    if(sites.empty())
+        return false;
+    std::sort(sites.begin(),sites.end(),callOrder);
+    
+    // copy the code, putting in the inlined functions
+    std::vector<Inst> v;
+    std::vector<int> map(n+1);
+    std::vector<bool> moved; // the caller's jumps, which need remapping
+    unsigned int next = 0;
+    for(int i=0;i<n;i++){
+        map[i] = v.size();
+        if(next<sites.size() && sites[next].call==i){
+            emitInline(v,&sites[next++],base);
+            moved.resize(v.size(),false);
+        } else {
+            v.push_back(insts[i]);
+            moved.push_back(true);
+        }
+    }
+    map[n] = v.size();
+    for(unsigned int i=0;i<v.size();i++){
+        if(moved[i] && v[i].target>=0)
+            v[i].target = map[v[i].target];
+    }
+    
+    // and give the frame room for them, with an LDT whose extra slots
+    // have the names of the inlined functions' variables for dumps
+    int size = sizeof(LDTHeader)+sizeof(short)*(base+extra);
+    constid id = consts->create(CT_LDT,NULL,0,size);
+    LDTHeader *newldt = (LDTHeader *)consts->get(id)->get();
+    ldt = (LDTHeader *)consts->get(INSTDATA(insts[0].op))->get();
+    *newldt = *ldt;
+    newldt->numlocals += extra;
+    short *names = (short *)(newldt+1);
+    memcpy(names,ldt+1,sizeof(short)*base);
+    for(unsigned int i=0;i<sites.size();i++){
+        LDTHeader *h = (LDTHeader *)consts->get(INSTDATA(sites[i].code[0]))->get();
+        memcpy(names+base,h+1,sizeof(short)*(h->numparams+h->numlocals));
+    }
+    v[0].op = INST(OP_LOCALS,id);
+    
+    insts = v;
+    return true;
+}
+
+/// turn the calls in a user function into OP_CALLSITE, each with its
+/// own call site in each VM. Calls in immediate code are left alone,
+/// since it only runs once, as are the calls OP_INLINE holds.
+void Optimiser::makeCallSites(){
+    int n = insts.size();
+    if(!lana || !n || INSTOP(insts[0].op)!=OP_LOCALS)
+        return;
+    for(int i=1;i<n;i++){
+        instruction op = insts[i].op;
+        if(INSTOP(op)==OP_INLINE)
+            i+=3; // skip the operands
+        else if(INSTOP(op)==OP_CALL){
+            int site = lana->newCallSite();
+            if(site<0)
+                return;
+            insts[i].op = INST(OP_CALLSITE,INSTDATA(op)|(site<<8));
+        }
+    }
+}
+
+/// turn calls in a user function whose results are returned straight
+/// away into OP_TAILCALL, which runs the function called in the current
+/// frame. The OP_RETURN stays for when it can't.
+void Optimiser::makeTailCalls(){
+    int n = insts.size();
+    if(!n || INSTOP(insts[0].op)!=OP_LOCALS)
+        return;
+    for(int i=1;i<n-1;i++){
+        instruction op = insts[i].op;
+        if(INSTOP(op)==OP_INLINE)
+            i+=3; // skip the operands
+        else if(INSTOP(op)==OP_CALL && insts[i+1].op==INST(OP_RETURN,1))
+            insts[i].op = INST(OP_TAILCALL,INSTDATA(op));
+    }
+}
+
+int Optimiser::optimise(const instruction *code,int n){
+    decode(insts,code,n);
+    if(enabled){
+        for(int pass=0;pass<8;pass++){
+            bool changed = removeNoOps();
+            changed |= foldConstants();
+            changed |= foldConditions();
+            changed |= threadJumps();
+            changed |= removeUnreachable();
+            if(!changed)
+                break;
+        }
+        inlineCalls();
+        makeTailCalls();
+        makeCallSites();
+    }
+    encode();
+    return out.size();
+}
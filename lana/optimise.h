@@ -0,0 +1,141 @@
+/**
+ * @file
+ * The bytecode optimiser. This is run over the code of each user
+ * function when it's finished (see CodeGen::writeContextToMemory()) and
+ * over each block of immediate-mode code before it runs. It does
+ * \li constant folding - "1+2*3" becomes a single literal, and a
+ * condition which is always true or always false becomes no jump or an
+ * unconditional jump
+ * \li jump threading - a jump to an unconditional jump goes straight to
+ * the final destination
+ * \li dead code elimination - code which can't be reached, such as that
+ * after a return or in an "if false", is removed
+ * \li no-op removal - comments, blank lines, brackets, labels, endifs
+ * and so on, which are only there so that the code can be recreated
+ * \li inlining - calls in a user function to small user functions held
+ * in session or global variables are replaced by a copy of their code,
+ * guarded in case the variable is later changed (see inlineCalls())
+ * \li tail calls - a call in a user function whose result is returned
+ * at once becomes OP_TAILCALL, which reuses the function's frame
+ * \li call sites - the remaining calls in a user function become
+ * OP_CALLSITE, which remembers what it last called (in each VM).
+ *
+ * The compiled code is always kept as well, because it's what is
+ * recreated into source and serialised. A function's block holds both
+ * (see getOptimisedCode()).
+ */
+
+#ifndef __OPTIMISE_H
+#define __OPTIMISE_H
+
+#include <vector>
+#include "consts.h"
+#include "vars.h"
+
+namespace lana {
+
+/// optimises bytecode, producing a new copy of it
+class Optimiser {
+public:
+    /// create an optimiser, which will just copy the code if
+    /// enabled is false (see LOP_NOOPTIMISE)
+    Optimiser(Constants *c,bool enabled=true){
+        consts = c;
+        this->enabled = enabled;
+        ses = NULL;
+        lana = NULL;
+    }
+    
+    /// inline calls to user functions of up to maxsize instructions,
+    /// adding no more than maxgrowth instructions in all. The functions
+    /// are those the session and global variables hold now.
+    void setInlining(class Session *s,GlobalVars *g,int maxsize,int maxgrowth){
+        ses = s;
+        globs = g;
+        inlineMaxSize = maxsize;
+        inlineMaxGrowth = maxgrowth;
+    }
+
+    /// turn calls into OP_CALLSITE, with call sites numbered by
+    /// the Language
+    void setCallSites(class Language *l){
+        lana = l;
+    }
+
+    /// optimise n instructions, returning the number of instructions
+    /// in the optimised code
+    int optimise(const instruction *code,int n);
+
+    /// get the optimised code, valid until the next optimise()
+    instruction *getCode(){
+        return &out[0];
+    }
+
+    /// a call to inline
+    struct Site {
+        int call;                //!< index of the OP_CALL
+        constid func;            //!< the function being called
+        const instruction *code; //!< its optimised code
+        int n;                   //!< the number of instructions in it
+    };
+
+private:
+    /// an instruction being optimised
+    struct Inst {
+        instruction op;
+        int target;   //!< index of the jump target, or -1
+        bool removed; //!< to be removed by compact()
+        bool isTarget;//!< something jumps here
+    };
+
+    Constants *consts;
+    bool enabled;
+    std::vector<Inst> insts;
+    std::vector<instruction> out;
+    
+    class Session *ses; //!< NULL if not inlining
+    GlobalVars *globs;
+    int inlineMaxSize,inlineMaxGrowth;
+    class Language *lana; //!< NULL if not making call sites
+
+    void decode(std::vector<Inst> &v,const instruction *code,int n);
+    void encode();
+    void findTargets();
+    bool compact();
+    int prevLive(int i);
+    int nextLive(int i);
+
+    bool removeNoOps();
+    bool foldConstants();
+    bool foldConditions();
+    bool threadJumps();
+    bool removeUnreachable();
+    bool inlineCalls();
+    void makeTailCalls();
+    void makeCallSites();
+    
+    bool getInlinable(instruction load,Site *s);
+    int findCall(int load);
+    void emitInline(std::vector<Inst> &v,Site *s,int base);
+
+    bool getLiteral(instruction op,Value *v);
+    instruction makeLiteral(Value *v);
+};
+
+/// The data of a CT_FUNC constant is a pointer to a block written by
+/// CodeGen::writeContextToMemory(), which holds the size in bytes of
+/// the code as compiled followed by that code, which is what recreation
+/// and serialisation use; and then the size and code of the optimised
+/// version, which is what runs. This gets the latter from the block,
+/// and the number of instructions in it.
+
+inline instruction *getOptimisedCode(const char *block,int *n){
+    const int *p = (const int *)block;
+    p = (const int *)((const char *)(p+1) + *p); // skip the compiled code
+    *n = *p/sizeof(instruction);
+    return (instruction *)(p+1);
+}
+
+}
+
+#endif /* __OPTIMISE_H */
@@ -0,0 +1,158 @@
+/** @file
+ * pmap(), pfilter() and preduce(), which call a function on the items
+ * of a list in the work pool's threads (see workpool.h). The items are
+ * copied into the threads and the results copied back, so only what
+ * WorkPool::copyAcross() can copy will do for either.
+ */
+
+#include <stdio.h>
+
+#include "api.h"
+#include "language.h"
+#include "list.h"
+#include "vm.h"
+#include "workpool.h"
+
+namespace lana {
+
+/// how many items each thread should take at a time, if there are n:
+/// few enough that a slow share can be stolen from several times
+static int grainFor(WorkPool *pool,int n){
+    int g = n/(pool->getThreadCount()*8);
+    return g<1 ? 1 : g;
+}
+
+/// get an item of a list, copied for the calling thread
+static void copyItem(Value *dest,List *l,int i){
+    if(!WorkPool::copyAcross(dest,l->get(i)))
+        throw Exception(NULL).set("item %d can't be passed to another thread",i);
+}
+
+/// copy a result back for the thread which gave out the job
+static void copyResult(Value *dest,Value *src,int i){
+    if(!WorkPool::copyAcross(dest,src))
+        throw Exception(NULL).set("the result for item %d can't be passed back from another thread",i);
+}
+
+/// pmap() and pfilter(): call a function on each item, keeping the
+/// results or whether each was true
+
+struct MapJob : public WorkJob {
+    List *in;
+    Value *fn;
+    Value *out;     //!< the results, for pmap()
+    bool *keep;     //!< whether to keep each item, for pfilter()
+
+    virtual void runRange(Session *ses,int from,int to){
+        VirtualMachine *vm = Language::getVM();
+        Value arg,res;
+        for(int i=from;i<to;i++){
+            copyItem(&arg,in,i);
+            vm->callWith(ses,fn,1,&arg,&res);
+            if(keep)
+                keep[i] = res.getBool();
+            else
+                copyResult(out+i,&res,i);
+        }
+    }
+};
+
+/// preduce(): fold each range into a partial result, stored under the
+/// range's first item, so that they can be put together in order
+
+struct ReduceJob : public WorkJob {
+    List *in;
+    Value *fn;
+    Value *partial;
+    bool *has;      //!< whether there's a partial result at each item
+
+    virtual void runRange(Session *ses,int from,int to){
+        VirtualMachine *vm = Language::getVM();
+        Value args[2],acc;
+        copyItem(&acc,in,from);
+        for(int i=from+1;i<to;i++){
+            copyItem(args+1,in,i);
+            args[0] = acc;
+            vm->callWith(ses,fn,2,args,&acc);
+        }
+        copyResult(partial+from,&acc,from);
+        has[from] = true;
+    }
+};
+
+/// check a function can be called by other threads
+static void checkFunction(Value *fn,const char *name){
+    if(fn->getAllocType()!=Unmanaged)
+        throw Exception(NULL).set("%s() needs a function",name);
+}
+
+void parallelMap(API *api,List *l,Value *fn,Value *result,bool filter){
+    checkFunction(fn,filter?"pfilter":"pmap");
+    WorkPool *pool = api->getWorkPool();
+    int n = l->list->count();
+    MapJob job;
+    job.in = l;
+    job.fn = fn;
+    job.out = filter ? NULL : new Value[n];
+    job.keep = filter ? new bool[n] : NULL;
+
+    List *r = List::create(api);
+    result->setOther(Types::vtList,(void *)r);
+    result->incRef();
+    try {
+        pool->run(&job,api->getVM()->curSession,n,grainFor(pool,n));
+    } catch(...) {
+        delete [] job.out;
+        delete [] job.keep;
+        throw;
+    }
+
+    if(filter){
+        for(int i=0;i<n;i++){
+            if(job.keep[i])
+                *r->list->append() = *l->get(i);
+        }
+        delete [] job.keep;
+    } else {
+        r->reserve(n);
+        for(int i=0;i<n;i++)
+            *r->list->append() = job.out[i];
+        delete [] job.out;
+    }
+}
+
+void parallelReduce(API *api,List *l,Value *fn,Value *init,Value *result){
+    checkFunction(fn,"preduce");
+    WorkPool *pool = api->getWorkPool();
+    int n = l->list->count();
+    ReduceJob job;
+    job.in = l;
+    job.fn = fn;
+    job.partial = new Value[n];
+    job.has = new bool[n];
+    for(int i=0;i<n;i++)
+        job.has[i] = false;
+
+    try {
+        pool->run(&job,api->getVM()->curSession,n,grainFor(pool,n));
+
+        // put the partial results together in order, here
+        Value args[2];
+        *result = *init;
+        for(int i=0;i<n;i++){
+            if(job.has[i]){
+                args[0] = *result;
+                args[1] = job.partial[i];
+                api->getVM()->call(fn,2,args,result);
+            }
+        }
+    } catch(...) {
+        delete [] job.partial;
+        delete [] job.has;
+        throw;
+    }
+    delete [] job.partial;
+    delete [] job.has;
+}
+
+}
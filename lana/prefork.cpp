@@ -0,0 +1,390 @@
+/** @file
+ * The pre-forking server's workers, and the process which looks after
+ * them (see prefork.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "api.h"
+#include "session.h"
+#include "prefork.h"
+
+using namespace lana;
+
+/// reads lines from a connection, a buffer at a time
+
+struct LineReader {
+    LineReader(int f){
+        fd = f;
+        start = end = 0;
+        line = NULL;
+        size = 0;
+    }
+    ~LineReader(){
+        free(line);
+    }
+
+    /// get the next line, without its end, or NULL if the connection
+    /// was closed
+    const char *next(){
+        int len = 0;
+        for(;;){
+            if(start==end){
+                int n = read(fd,buf,sizeof(buf));
+                if(n<0 && errno==EINTR)
+                    continue;
+                if(n<=0)
+                    return NULL; // any unfinished line is dropped
+                start = 0;
+                end = n;
+            }
+            char c = buf[start++];
+            if(len+1>=size){
+                size = size ? size*2 : 256;
+                line = (char *)realloc(line,size);
+            }
+            if(c=='\n')
+                break;
+            line[len++] = c;
+        }
+        if(len && line[len-1]=='\r')
+            len--;
+        line[len] = 0;
+        return line;
+    }
+
+    int fd;
+    char buf[4096];
+    int start,end;
+    char *line;
+    int size;
+};
+
+/// undo the escapes in a field, in place
+static void unescape(char *s){
+    char *out = s;
+    while(*s){
+        if(*s=='\\' && s[1]){
+            s++;
+            *out++ = *s=='n' ? '\n' : *s=='t' ? '\t' : *s;
+            s++;
+        } else
+            *out++ = *s++;
+    }
+    *out = 0;
+}
+
+/// make a reply line, escaping the text
+static char *makeReply(const char *status,const char *s){
+    char *r = (char *)malloc(strlen(status)+strlen(s)*2+3);
+    char *out = r+sprintf(r,"%s\t",status);
+    for(;*s;s++){
+        switch(*s){
+        case '\n':*out++='\\';*out++='n';break;
+        case '\t':*out++='\\';*out++='t';break;
+        case '\\':*out++='\\';*out++='\\';break;
+        default:*out++=*s;break;
+        }
+    }
+    *out++ = '\n';
+    *out = 0;
+    return r;
+}
+
+/// set an argument from a field, which is a number if it looks like a
+/// decimal one: an integer if it fits in one, otherwise a float
+static void setArg(Value *v,const char *s){
+    if((*s>='0' && *s<='9') || ((*s=='-' || *s=='.') && s[1])){
+        char *end;
+        errno = 0;
+        long i = strtol(s,&end,10);
+        if(!*end && !errno && i>=INT_MIN && i<=INT_MAX){
+            v->setInt((int)i);
+            return;
+        }
+        // strtod() would also read hex, infinities and NaNs
+        if(!strpbrk(s,"xXiInN")){
+            errno = 0;
+            double f = strtod(s,&end);
+            if(!*end && !errno){
+                v->setFloat((float)f);
+                return;
+            }
+        }
+    }
+    v->setStrClone(s);
+}
+
+/// write all of a string, returning false if the connection's gone
+static bool writeAll(int fd,const char *s){
+    int len = strlen(s);
+    while(len){
+        int n = write(fd,s,len);
+        if(n<0 && errno==EINTR)
+            continue;
+        if(n<=0)
+            return false;
+        s += n;
+        len -= n;
+    }
+    return true;
+}
+
+PreforkServer::PreforkServer(API *a,Session *s){
+    api = a;
+    ses = s;
+    maxRequests = 0;
+    maxMemoryKB = 0;
+    requests = 0;
+}
+
+char *PreforkServer::runRequest(const char *line){
+    char *fields = strdup(line);
+    int argc = 0;
+    for(char *p=fields;*p;p++){
+        if(*p=='\t'){
+            *p = 0;
+            argc++;
+        }
+    }
+    const char *name = fields;
+    Value *args = new Value[argc ? argc : 1];
+    char *reply;
+    try {
+        char *p = fields;
+        for(int i=0;i<argc;i++){
+            p += strlen(p)+1;
+            unescape(p);
+            setArg(args+i,p);
+        }
+
+        CallHandle h;
+        if(ses->getSesVar(name))
+            h = api->getFunction(name,ses);
+        else if(*name && api->findGlobal(name))
+            h = api->getFunction(name);
+        else
+            throw Exception(NULL).set("there is no function called '%s'",name);
+
+        Value result;
+        api->call(h,argc,args,&result);
+        // a procedure returns nothing, which has no string
+        reply = makeReply("ok",result.type ? result.getStr() : "");
+    } catch(Exception &e){
+        reply = makeReply("error",e.what());
+    }
+    delete [] args;
+    free(fields);
+    return reply;
+}
+
+bool PreforkServer::serveConnection(int fd){
+    LineReader r(fd);
+    const char *line;
+    while((line=r.next())){
+        char *reply = runRequest(line);
+        bool sent = writeAll(fd,reply);
+        free(reply);
+        if(!sent)
+            break;
+        requests++;
+        if(maxRequests && requests>=maxRequests)
+            return false;
+        if(maxMemoryKB && privateKB()>maxMemoryKB)
+            return false;
+    }
+    return true;
+}
+
+bool PreforkServer::workerMain(int listenfd){
+    requests = 0;
+    for(;;){
+        int fd = accept(listenfd,NULL,NULL);
+        if(fd<0){
+            if(errno==EINTR || errno==ECONNABORTED)
+                continue;
+            return false;
+        }
+        bool more = serveConnection(fd);
+        close(fd);
+        if(!more)
+            return true;
+    }
+}
+
+/// only there so that SIGCHLD isn't discarded
+static void onChild(int){
+}
+
+pid_t PreforkServer::forkWorker(int listenfd,sigset_t *mask,
+                                struct sigaction *chld){
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if(pid)
+        return pid;
+    sigaction(SIGCHLD,chld,NULL);
+    sigprocmask(SIG_SETMASK,mask,NULL);
+    // a client which goes away only ends its connection
+    signal(SIGPIPE,SIG_IGN);
+    // the server tells a failure from a worker which stopped as it
+    // should by the exit status
+    _exit(workerMain(listenfd) ? 0 : 1);
+}
+
+/// the time on the monotonic clock, in milliseconds
+static long long nowMS(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+int PreforkServer::run(int listenfd,int n){
+    if(n<1)
+        n = 1;
+
+    // the signals we wait for are blocked, and taken with sigwaitinfo()
+    sigset_t waitfor,mask;
+    sigemptyset(&waitfor);
+    sigaddset(&waitfor,SIGTERM);
+    sigaddset(&waitfor,SIGINT);
+    sigaddset(&waitfor,SIGCHLD);
+    sigprocmask(SIG_BLOCK,&waitfor,&mask);
+    struct sigaction sa,chld;
+    memset(&sa,0,sizeof(sa));
+    sa.sa_handler = onChild;
+    sigaction(SIGCHLD,&sa,&chld);
+
+    // a worker which isn't running has an ID of zero, and is started
+    // once the wait after any failure is over
+    pid_t *workers = new pid_t[n];
+    for(int i=0;i<n;i++)
+        workers[i] = 0;
+
+    int restarts = 0;
+    int failures = 0;           // in a row
+    long long lastFailure = 0;
+    long long retryAt = 0;      // when workers can be started again
+    for(;;){
+        int failed = 0;
+        bool stopped = false;   // is any worker not running?
+        if(nowMS()>=retryAt){
+            for(int i=0;i<n && !failed;i++){
+                if(workers[i])
+                    continue;
+                workers[i] = forkWorker(listenfd,&mask,&chld);
+                if(workers[i]<0){
+                    workers[i] = 0;
+                    failed++;
+                }
+            }
+        }
+        for(int i=0;i<n;i++)
+            if(!workers[i])
+                stopped = true;
+
+        int sig;
+        if(stopped){
+            long long wait = retryAt-nowMS();
+            if(wait<0)
+                wait = 0;
+            struct timespec ts;
+            ts.tv_sec = wait/1000;
+            ts.tv_nsec = (wait%1000)*1000000;
+            sig = sigtimedwait(&waitfor,NULL,&ts);
+        } else
+            sig = sigwaitinfo(&waitfor,NULL);
+        if(sig==SIGTERM || sig==SIGINT)
+            break;
+        if(sig==SIGCHLD){
+            pid_t pid;
+            int status;
+            while((pid=waitpid(-1,&status,WNOHANG))>0){
+                for(int i=0;i<n;i++){
+                    if(workers[i]==pid){
+                        workers[i] = 0;
+                        restarts++;
+                        if(WIFEXITED(status) && WEXITSTATUS(status))
+                            failed++;
+                        else if(WIFEXITED(status))
+                            failures = 0; // it worked for a while
+                    }
+                }
+            }
+        }
+
+        if(failed){
+            long long now = nowMS();
+            if(now-lastFailure>FAILUREWINDOW)
+                failures = 0;
+            lastFailure = now;
+            failures += failed;
+            if(failures>=MAXFAILURES)
+                break;
+            long long wait = MINBACKOFF;
+            for(int i=1;i<failures && wait<MAXBACKOFF;i++)
+                wait *= 2;
+            retryAt = now+(wait<MAXBACKOFF ? wait : MAXBACKOFF);
+        }
+    }
+
+    for(int i=0;i<n;i++)
+        if(workers[i]>0)
+            kill(workers[i],SIGTERM);
+    for(int i=0;i<n;i++)
+        if(workers[i]>0)
+            waitpid(workers[i],NULL,0);
+    delete [] workers;
+
+    sigaction(SIGCHLD,&chld,NULL);
+    sigprocmask(SIG_SETMASK,&mask,NULL);
+    if(failures>=MAXFAILURES)
+        throw Exception(NULL).set("workers failed %d times in a row",failures);
+    return restarts;
+}
+
+int PreforkServer::listenUnix(const char *path){
+    struct sockaddr_un addr;
+    if(strlen(path)>=sizeof(addr.sun_path))
+        throw Exception(NULL).set("socket path too long: %s",path);
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,path);
+
+    int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd<0)
+        throw Exception(NULL).set("cannot make a socket: %s",strerror(errno));
+    unlink(path);
+    if(bind(fd,(struct sockaddr *)&addr,sizeof(addr))<0 || listen(fd,64)<0){
+        int e = errno;
+        close(fd);
+        throw Exception(NULL).set("cannot listen at %s: %s",path,strerror(e));
+    }
+    return fd;
+}
+
+int PreforkServer::privateKB(){
+    FILE *f = fopen("/proc/self/smaps_rollup","r");
+    if(!f)
+        f = fopen("/proc/self/smaps","r");
+    if(!f)
+        return -1;
+    char buf[256];
+    int kb = 0;
+    while(fgets(buf,sizeof(buf),f)){
+        if(!strncmp(buf,"Private_Dirty:",14))
+            kb += atoi(buf+14);
+    }
+    fclose(f);
+    return kb;
+}
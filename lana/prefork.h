@@ -0,0 +1,107 @@
+/**
+ * @file
+ * A pre-forking server, which runs requests to call Lana functions in
+ * several worker processes so that a script can use every core without
+ * running code in threads.
+ *
+ * The script is loaded once, in the server's own process, which may
+ * then make its heap immortal (see API::makeHeapImmortal()) so that the
+ * workers keep sharing it. The workers are forked from there: each
+ * accepts connections on a listening Unix socket, and answers requests
+ * on them one at a time. The server restarts any worker which stops,
+ * and a worker stops once it has answered a given number of requests
+ * or a given amount of its memory has become its own, so that whatever
+ * a request leaves behind doesn't build up for ever.
+ *
+ * A request is a line of fields separated by tabs: the name of a
+ * function, defined in the session or globally, and its arguments. An
+ * argument which is a decimal number is passed as one - an integer if it
+ * fits in one, otherwise a float - and anything else as a string. The
+ * reply is a line too: "ok", a tab and what the function returned as a
+ * string (nothing, if it returned nothing); or "error", a tab and why it
+ * failed. Tabs,
+ * newlines and backslashes in arguments and replies are written as
+ * "\t", "\n" and "\\".
+ *
+ * Nothing in the script loaded may start threads (see thread.h), as
+ * only the forking thread carries on in the workers.
+ */
+
+#ifndef __PREFORK_H
+#define __PREFORK_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+namespace lana {
+
+/// runs requests, in worker processes it forks and looks after or on
+/// connections it's given
+
+class PreforkServer {
+public:
+    /// make a server which runs functions in a session
+    PreforkServer(class API *a,class Session *s);
+
+    /// a worker stops after this many requests, or never if zero
+    int maxRequests;
+    /// a worker stops once this many kilobytes of its memory are no
+    /// longer shared with the server, or never if zero
+    int maxMemoryKB;
+
+    /// answer requests on a connection until it's closed, returning
+    /// true; or until a worker should stop, returning false
+    bool serveConnection(int fd);
+
+    /// answer a single request, returning the reply
+    /// (which is the caller's to free)
+    char *runRequest(const char *line);
+
+    /// fork n workers which answer requests on connections to a
+    /// listening socket, and fork another whenever one stops, until
+    /// this process is sent SIGTERM or SIGINT. The workers are then
+    /// stopped too. Returns how many workers were restarted. If a
+    /// worker can't be forked, or can't accept connections, it's tried
+    /// again after a wait which doubles each time; after MAXFAILURES
+    /// such failures in a row the workers are stopped and an exception
+    /// thrown.
+    int run(int listenfd,int n);
+
+    /// the number of failures in a row after which run() gives up
+    static const int MAXFAILURES = 5;
+    /// the wait in milliseconds before trying again after the first
+    /// failure in a row, and the longest wait
+    static const int MINBACKOFF = 50;
+    static const int MAXBACKOFF = 2000;
+    /// a failure more than this many milliseconds after the last
+    /// starts a new row
+    static const int FAILUREWINDOW = 60000;
+
+    /// make a Unix socket listening at a path, replacing anything
+    /// there, and return it
+    static int listenUnix(const char *path);
+
+    /// get how many kilobytes of the calling process's memory are its
+    /// own, and not shared with the process it was forked from, or -1
+    /// if that can't be found out
+    static int privateKB();
+
+private:
+    /// a worker's process: accept connections and answer requests on
+    /// them until it should stop, returning false if it stopped because
+    /// connections couldn't be accepted
+    bool workerMain(int listenfd);
+    /// fork a worker, returning its process ID, or -1 if it couldn't
+    /// be forked. It starts with the signal mask and SIGCHLD handler
+    /// the server had before run().
+    pid_t forkWorker(int listenfd,sigset_t *mask,struct sigaction *chld);
+
+    class API *api;
+    class Session *ses;
+    /// the requests answered by this worker
+    int requests;
+};
+
+}
+
+#endif /* __PREFORK_H */
@@ -124,16 +124,20 @@ char *Language::recreate(instruction *p,Session *ses){
             recreateLiteral(INSTDATA(*p),p+1,ses);
             break;
         case OP_VARREFLOC:
+        case OP_LOADLOC:
             recpush(getLocalName(INSTDATA(*p)));
             break;
         case OP_VARREFPRM:
+        case OP_LOADPRM:
             recpush(getParamName(INSTDATA(*p)));
             break;
         case OP_VARREFGLB:
+        case OP_LOADGLB:
     	  recpush(getGlobalName(INSTDATA(*p)));
 	  break;	    
 
         case OP_VARREFSES:
+        case OP_LOADSES:
             recpush(ses->getSesVarName(INSTDATA(*p)));
             break;
         case OP_TRUE:
@@ -252,6 +256,7 @@ char *Language::recreate(instruction *p,Session *ses){
             recreateStmtEnd(g,p+1);
             break;
         case OP_CONTINUE:
+        case OP_CONTINUEFW:
             recpush("continue");
             recreateStmtEnd(g,p+1);
             break;
@@ -0,0 +1,471 @@
+/**
+ * @file
+ * The register VM interpreter - see regvm.h. Each instruction does the
+ * same as the stack VM instructions it was lowered from, with fast paths
+ * for integer and float arithmetic and comparisons and for list items.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "language.h"
+#include "opcodes.h"
+#include "vm.h"
+#include "session.h"
+#include "list.h"
+#include "iterobj.h"
+#include "forloop.h"
+#include "regvm.h"
+#include "optimise.h"
+
+using namespace lana;
+
+extern float *neareq_epsilon;
+
+RegisterCode *VirtualMachine::getRegisterCode(Value *fv){
+    if(lowered.find(fv->d.u))
+        return *lowered.getval();
+
+    int n;
+    instruction *code = getOptimisedCode(fv->getPtr(),&n);
+    RegisterCode *rc = RegisterCode::lower(consts,code,n);
+    if(rc){
+        rc->next = regcode;
+        regcode = rc;
+        if(lana->debugFlags & LDEBUG_DUMP)
+            rc->dump(consts);
+    }
+    // failures are remembered too, so we only try once
+    *lowered.set(fv->d.u) = rc;
+    return rc;
+}
+
+/// check an operand has a value, as popval() does
+static inline Value *defined(Value *v){
+    if(!v->type)
+        throw Exception("cannot use an undefined value");
+    return v;
+}
+
+/// check a value can be stored in a variable, as OP_SET does
+static inline Value *storable(Value *v){
+    defined(v);
+    if(v->type == Types::vtNativeMethodRef)
+        throw Exception("cannot store a reference to a native method in user code");
+    return v;
+}
+
+/// do the OP_SET checks on a value an instruction has just computed
+/// straight into a variable
+static inline void checkStore(RegInst *i,Value *v){
+    if(i->sub & RF_CHECKSTORE)
+        storable(v);
+}
+
+/// move a value into a slot. References made by the register VM are
+/// moved rather than copied, as copies of a dictionary reference would
+/// share its key.
+static inline void move(Value *dst,Value *src){
+    dst->clr();
+    memcpy((void *)dst,src,sizeof(Value));
+    src->initNone();
+}
+
+/// compare two values. The numeric cases are done here as the types
+/// would do them (see intCompare() and floatCompare() in vtypes.cpp),
+/// the rest by the types.
+static inline bool compare(int op,Value *a,Value *b){
+    Type *ta = a->type;
+    Type *tb = b->type;
+    if(ta==Types::vtInteger && tb==Types::vtInteger){
+        float x = a->d.i;
+        float y = b->d.i;
+        switch(op){
+        case OP_NEAREQ:
+        case OP_EQUALS: return x==y;
+        case OP_NNEAREQ:
+        case OP_NEQUALS:return x!=y;
+        case OP_LT:     return x<y;
+        case OP_LTE:    return x<=y;
+        case OP_GT:     return x>y;
+        case OP_GTE:    return x>=y;
+        default:        return false;
+        }
+    }
+    if((ta==Types::vtInteger || ta==Types::vtFloat) &&
+       (tb==Types::vtInteger || tb==Types::vtFloat)){
+        float x = ta==Types::vtFloat ? a->d.f : (float)a->d.i;
+        float y = tb==Types::vtFloat ? b->d.f : (float)b->d.i;
+        float e = *neareq_epsilon;
+        switch(op){
+        case OP_EQUALS: return x==y;
+        case OP_NEQUALS:return x!=y;
+        case OP_NEAREQ: return x-y<e && x-y>-e;
+        case OP_NNEAREQ:return !(x-y<e && x-y>-e);
+        case OP_LT:     return x<y;
+        case OP_LTE:    return x<=y;
+        case OP_GT:     return x>y;
+        case OP_GTE:    return x>=y;
+        default:        return false;
+        }
+    }
+    Value r;
+    defined(a)->type->doBinComparisonOp(&r,op,a,defined(b));
+    return r.getBool();
+}
+
+/// arithmetic other than on two integers, which is done inline
+static void arith(Value *out,int op,Value *a,Value *b){
+    Type *ta = defined(a)->type;
+    Type *tb = defined(b)->type;
+    if(op!=OP_MOD && (ta==Types::vtInteger || ta==Types::vtFloat) &&
+       (tb==Types::vtInteger || tb==Types::vtFloat) &&
+       (ta==Types::vtFloat || tb==Types::vtFloat)){
+        float x = ta==Types::vtFloat ? a->d.f : (float)a->d.i;
+        float y = tb==Types::vtFloat ? b->d.f : (float)b->d.i;
+        switch(op){
+        case OP_ADD:out->setFloat(x+y);break;
+        case OP_SUB:out->setFloat(x-y);break;
+        case OP_MUL:out->setFloat(x*y);break;
+        case OP_DIV:out->setFloat(x/y);break;
+        }
+        return;
+    }
+    // the type may write the result before it's finished with the
+    // operands, one of which may be out
+    Value r;
+    ta->doBinArithOp(&r,op,a,b);
+    *out = r;
+}
+
+void VirtualMachine::runRegisters(RegisterCode *rc,Object *newthis){
+    Session *ses = curSession;
+
+    // make room for the frame, as OP_LOCALS does, and pop the
+    // parameters into it
+    int oldseg = vstack.segment();
+    int oldbase = vstackbase;
+    int oldnext = vstacknext;
+    reserveFrame(rc->framesize);
+    regdepth++;
+    Object *oldthis = thisptr;
+    int oldfile = file;
+    int oldline = line;
+
+    vstackbase = vstacknext;
+    vstacknext += rc->framesize;
+    Value *frame = locals = vstack.stack+vstackbase;
+    for(int i=rc->numparams-1;i>=0;i--)
+        frame[i] = *popval();
+    xstack.popptr(); // the function
+
+    thisptr = newthis;
+    if(thisptr)
+        thisptr->incRefCt(); // going into a method implies a 'this' reference
+
+    Value *k = rc->k;
+    int tbase = rc->numparams+rc->numlocals;
+    RegInst *insts = rc->insts;
+    RegInst *pc = insts;
+    Value *a,*b,*d;
+
+#define OPA (i->a>=0 ? frame+i->a : k+~i->a)
+#define OPB (i->b>=0 ? frame+i->b : k+~i->b)
+#define ARITH(rop,sop,o) case rop: \
+            a=OPA;b=OPB; \
+            if(a->type==Types::vtInteger && b->type==Types::vtInteger) \
+                frame[i->d].setInt(a->d.i o b->d.i); \
+            else \
+                arith(frame+i->d,sop,a,b); \
+            break;
+
+    for(;;){
+        instct++;
+        RegInst *i = pc++;
+        switch(i->op){
+        case R_MOV:
+            a = storable(OPA);
+            frame[i->d] = *a;
+            break;
+        case R_GETGLB:
+            d = frame+i->d;
+            a = globs->get(i->x);
+            if(worker && !a->isShareable())
+                unshareableGlobal(i->x);
+            *d = *a;
+            checkStore(i,d);
+            break;
+        case R_GETSES:
+            d = frame+i->d;
+            *d = *ses->getSesVar(i->x);
+            checkStore(i,d);
+            break;
+        case R_SETGLB:
+            if(lana->isThreaded())
+                error("cannot change global variables while threads are attached");
+            *globs->get(i->x) = *storable(OPA);
+            break;
+        case R_SETSES:
+            *ses->getSesVar(i->x) = *storable(OPA);
+            break;
+            ARITH(R_ADD,OP_ADD,+)
+            ARITH(R_SUB,OP_SUB,-)
+            ARITH(R_MUL,OP_MUL,*)
+            ARITH(R_DIV,OP_DIV,/)
+            ARITH(R_MOD,OP_MOD,%)
+        case R_CMP:
+            a=OPA;b=OPB;
+            frame[i->d].setBool(compare(i->sub,a,b));
+            break;
+        case R_LOGAND:
+            a=OPA;b=OPB;
+            frame[i->d].setBool(defined(b)->getBool() && defined(a)->getBool());
+            break;
+        case R_LOGOR:
+            a=OPA;b=OPB;
+            frame[i->d].setBool(defined(b)->getBool() || defined(a)->getBool());
+            break;
+        case R_BITAND:
+            a=OPA;b=OPB;
+            frame[i->d].setInt(defined(b)->getInt() & defined(a)->getInt());
+            break;
+        case R_BITOR:
+            a=OPA;b=OPB;
+            frame[i->d].setInt(defined(b)->getInt() | defined(a)->getInt());
+            break;
+        case R_XOR:
+            a=OPA;b=OPB;
+            frame[i->d].setInt(defined(b)->getInt() ^ defined(a)->getInt());
+            break;
+        case R_BITNOT:
+            a=OPA;
+            frame[i->d].setInt(~defined(a)->getInt());
+            break;
+        case R_NEG:
+            a=OPA;
+            if(a->type == Types::vtInteger)
+                frame[i->d].setInt(-a->d.i);
+            else {
+                Value r;
+                if(!defined(a)->type->negate(a,&r))
+                    error("invalid value for unary minus: %s",a->type->getName());
+                frame[i->d] = r;
+            }
+            break;
+        case R_NOT:
+            a=OPA;
+            {
+                Value r;
+                if(!defined(a)->type->unarynot(a,&r))
+                    error("invalid value for unary not: %s",a->type->getName());
+                frame[i->d] = r;
+            }
+            break;
+        case R_THIS:
+            if(!thisptr)
+                error("cannot use 'this' outside a method function/procedure");
+            frame[i->d].setObj(thisptr);
+            break;
+        case R_GETIDX:
+            a=defined(OPA);b=defined(OPB);
+            d=frame+i->d;
+            if(a->type==Types::vtList && b->type==Types::vtInteger){
+                // a list item, which is the common case
+                Value *v = defined(a->d.list->get(b->d.i));
+                if(d==a){
+                    Value t = *v; // d holds the list
+                    *d = t;
+                } else
+                    *d = *v;
+            } else {
+                Value r; // holds the container while we copy out of it
+                if(!a->type->makeSQBRef(&r,a,b))
+                    error("cannot use x[] when x is %s",a->type->getName());
+                *d = *r.deref();
+            }
+            checkStore(i,d);
+            break;
+        case R_SETIDX:
+            d=storable(i->d>=0 ? frame+i->d : k+~i->d); // an operand here
+            a=defined(OPA);b=defined(OPB);
+            if(a->type==Types::vtList && b->type==Types::vtInteger &&
+               !a->d.list->frozen)
+                a->d.list->set(b->d.i,d);
+            else {
+                Value r;
+                if(!a->type->makeSQBRef(&r,a,b))
+                    error("cannot use x[] when x is %s",a->type->getName());
+                r.store(d);
+            }
+            break;
+        case R_IDXREF:
+            a=defined(OPA);b=defined(OPB);
+            {
+                Value r;
+                if(!a->type->makeSQBRef(&r,a,b))
+                    error("cannot use x[] when x is %s",a->type->getName());
+                move(frame+i->d,&r);
+            }
+            break;
+        case R_GETPROP:
+            a=defined(OPA);
+            d=frame+i->d;
+            {
+                Value r;
+                if(!a->type->makePropRef(&r,a,i->x))
+                    error("cannot get non-standard property of non-object");
+                *d = *r.deref();
+            }
+            checkStore(i,d);
+            break;
+        case R_SETPROP:
+            b=storable(OPB);
+            a=defined(OPA);
+            {
+                Value r;
+                if(!a->type->makePropRef(&r,a,i->x))
+                    error("cannot get non-standard property of non-object");
+                r.store(b);
+            }
+            break;
+        case R_PROPREF:
+            a=defined(OPA);
+            {
+                Value r;
+                if(!a->type->makePropRef(&r,a,i->x))
+                    error("cannot get non-standard property of non-object");
+                move(frame+i->d,&r);
+            }
+            break;
+        case R_LOCREF:
+            frame[i->d].setOther(Types::vtRef,(void *)(frame+i->a));
+            break;
+        case R_GLBREF:
+            if(worker && !globs->get(i->x)->isShareable())
+                unshareableGlobal(i->x);
+            frame[i->d].setOther(Types::vtGlobalRef,(void *)globs->get(i->x),
+                                 (void *)globs);
+            break;
+        case R_SESREF:
+            frame[i->d].setOther(Types::vtRef,(void *)ses->getSesVar(i->x));
+            break;
+        case R_DEREF:
+            d=frame+i->d;
+            {
+                Value t = *OPA->deref(); // the reference may hold the container
+                *d = t;
+            }
+            checkStore(i,d);
+            break;
+        case R_STORE:
+            frame[i->d].store(storable(OPA));
+            break;
+        case R_CALL:
+            {
+                // stack the function and arguments as OP_CALL expects.
+                // Temporaries are used up by the call, so they're moved.
+                s32 *args = rc->args+i->b;
+                for(int j=-1;j<i->x;j++){
+                    s32 o = j<0 ? i->a : args[j];
+                    if(o>=tbase)
+                        move(xstack.pushptr(),frame+o);
+                    else
+                        *xstack.pushptr() = *(o>=0 ? frame+o : k+~o);
+                }
+                d=frame+i->d;
+                callStacked(i->x,d);
+                checkStore(i,d);
+            }
+            break;
+        case R_JMP:
+            pc = insts+i->x;
+            break;
+        case R_JF:
+            if(!defined(OPA)->getBool())
+                pc = insts+i->x;
+            break;
+        case R_JCMP:
+            a=OPA;b=OPB;
+            if(!compare(i->sub,a,b))
+                pc = insts+i->x;
+            break;
+        case R_FOR:
+            {
+                Value *var = frame+i->d;
+                Value *state = frame+i->a;
+                Value *src = defined(OPB);
+                if(src->type == Types::vtIterObj){
+                    if(state!=src)
+                        *state = *src;
+                } else if(!startLoop(state,src)) {
+                    // not something we can iterate inline (see forloop.h)
+                    IteratorObject *iterator = IteratorObject::create(lana->getAPI(),src,false);
+                    state->setIterObj(iterator);
+                }
+                if(state->type != Types::vtIterObj){
+                    if(!stepLoop(state,var))
+                        pc = insts+i->x;
+                    break;
+                }
+                IteratorObject *it = state->d.iterobj;
+                it->first();
+                if(it->isDone())
+                    pc = insts+i->x;
+                else
+                    var->store(it->current());
+            }
+            break;
+        case R_NEXT:
+            {
+                Value *var = frame+i->d;
+                Value *state = frame+i->a;
+                if(state->type != Types::vtIterObj){
+                    if(stepLoop(state,var))
+                        pc = insts+i->x;
+                    break;
+                }
+                IteratorObject *it = state->d.iterobj;
+                it->next();
+                if(!it->isDone()){
+                    pc = insts+i->x;
+                    var->store(it->current());
+                }
+            }
+            break;
+        case R_ENDFOR:
+            frame[i->d].clr();
+            frame[i->a].clr();
+            break;
+        case R_RET:
+            if(i->sub)
+                *xstack.pushptr() = *defined(OPA);
+            goto done;
+        case R_LINE:
+            line = i->x;
+            break;
+        case R_FILE:
+            file = i->x;
+            break;
+        }
+    }
+#undef OPA
+#undef OPB
+#undef ARITH
+
+done:
+    // clear the temporaries, which may hold loop state and references
+    for(int j=tbase;j<rc->framesize;j++)
+        frame[j].clr();
+
+    if(thisptr)
+        thisptr->decRefCt();
+    thisptr = oldthis;
+    regdepth--;
+    while(vstack.segment()!=oldseg)
+        vstack.leave();
+    vstackbase = oldbase;
+    vstacknext = oldnext;
+    locals = vstack.stack+vstackbase;
+    file = oldfile;
+    line = oldline;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file
+ * The register-based alternative to the stack VM. A user function's
+ * bytecode can be lowered into three-address instructions which work
+ * directly on slots in the function's area of the variable stack, so
+ * that "t = t+i" is a single instruction rather than the five
+ * (varref, load, load, add, set) the stack VM runs, and no references
+ * need to be built to store into locals.
+ *
+ * The frame of a lowered function is its parameters and locals,
+ * laid out as the stack VM lays them out, followed by temporaries - one
+ * for each level of the execution stack the bytecode would have used.
+ * An operand of 0 or more is a frame slot, a negative operand is an
+ * index into the code's constant table (see RegisterCode::operand()).
+ *
+ * The bytecode is always kept: it's what is recreated into source,
+ * and it's what runs under the debugger or when lowering isn't possible
+ * (see RegisterCode::lower()). Lowering is turned on with the
+ * LOP_REGISTERVM flag, and done lazily the first time each function is
+ * called; top-level code always runs on the stack VM.
+ */
+
+#ifndef __REGVM_H
+#define __REGVM_H
+
+#include "value.h"
+
+namespace lana {
+
+/// register VM opcodes. Unless stated otherwise d is the destination
+/// slot, and a and b are operands.
+enum RegOp {
+    R_MOV,      //!< d = a
+    R_GETGLB,   //!< d = global variable x
+    R_GETSES,   //!< d = session variable x
+    R_SETGLB,   //!< global variable x = a
+    R_SETSES,   //!< session variable x = a
+    R_ADD,      //!< d = a+b (and so on for the other arithmetic ops)
+    R_SUB,
+    R_MUL,
+    R_DIV,
+    R_MOD,
+    R_CMP,      //!< d = a (comparison sub) b, sub being the stack VM opcode
+    R_LOGAND,
+    R_LOGOR,
+    R_BITAND,
+    R_BITOR,
+    R_XOR,
+    R_BITNOT,   //!< d = ~a
+    R_NEG,      //!< d = -a
+    R_NOT,      //!< d = !a
+    R_THIS,     //!< d = this
+    R_GETIDX,   //!< d = a[b]
+    R_SETIDX,   //!< a[b] = d (d is an operand here)
+    R_GETPROP,  //!< d = a.x
+    R_SETPROP,  //!< a.x = b
+    R_IDXREF,   //!< d = reference to a[b]
+    R_PROPREF,  //!< d = reference to a.x
+    R_LOCREF,   //!< d = reference to frame slot a
+    R_GLBREF,   //!< d = reference to global variable x
+    R_SESREF,   //!< d = reference to session variable x
+    R_DEREF,    //!< d = the value referred to by the reference in a
+    R_STORE,    //!< store a through the reference in slot d
+    R_CALL,     //!< d = call a with x arguments, whose operands start at args[b]
+    R_JMP,      //!< jump to x
+    R_JF,       //!< jump to x if a is false
+    R_JCMP,     //!< jump to x unless a (comparison sub) b
+    R_FOR,      //!< start looping over a, with state in slot a and var ref in d - see below
+    R_NEXT,     //!< step the loop with state in slot a and var ref in d, jumping to x if not done
+    R_ENDFOR,   //!< clear the loop state in slot a and the var ref in d
+    R_RET,      //!< return a if sub is set, otherwise return nothing
+    R_LINE,     //!< set the source line to x
+    R_FILE,     //!< set the source file to x
+};
+
+/// R_FOR is d=var ref slot, a=state slot, b=source operand, x=target if
+/// the loop is empty.
+
+/// set in the sub field of an instruction which writes straight into a
+/// variable, so that it checks it isn't storing a native method
+/// reference, as OP_SET does.
+#define RF_CHECKSTORE 1
+
+/// a register VM instruction
+struct RegInst {
+    u16 op;  //!< the RegOp
+    u16 sub; //!< flags, or the comparison for R_JCMP
+    s32 d;   //!< destination slot
+    s32 a;   //!< first operand
+    s32 b;   //!< second operand
+    s32 x;   //!< jump target, variable or property ID, or other data
+};
+
+/// a user function lowered into register VM code
+class RegisterCode {
+public:
+    ~RegisterCode();
+
+    /// try to lower the bytecode of a function (starting with its
+    /// OP_LOCALS) into register code, returning NULL if the function
+    /// uses something the register VM can't do. n is the number of
+    /// instructions.
+    static RegisterCode *lower(class Constants *consts,const instruction *code,int n);
+
+    /// get the value of an operand, given the frame
+    Value *operand(Value *frame,int o){
+        return o>=0 ? frame+o : k+~o;
+    }
+
+    /// print the code, for LDEBUG_DUMP
+    void dump(class Constants *consts);
+
+    RegInst *insts;     //!< the instructions
+    int ninsts;         //!< how many instructions there are
+    Value *k;           //!< the constants used as operands
+    int nk;             //!< how many constants there are
+    s32 *args;          //!< the argument operands of all the calls
+    int numparams;      //!< number of parameters
+    int numlocals;      //!< number of locals
+    int framesize;      //!< parameters, locals and temporaries
+
+    RegisterCode *next; //!< the next in the VM's list of lowered code
+};
+
+}
+
+#endif /* __REGVM_H */
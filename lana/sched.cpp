@@ -0,0 +1,196 @@
+/** @file
+ * The scheduler's tasks, and how they take turns (see sched.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "language.h"
+#include "vm.h"
+#include "api.h"
+#include "session.h"
+#include "sched.h"
+
+using namespace lana;
+
+struct Scheduler::Task {
+    int id;
+    Session *ses;
+    int priority;
+    Value fn;
+    Value *args;    //!< the arguments, until it's started
+    int argc;
+    bool started,finished;
+    VirtualMachine::State state;
+    Value result;
+    char *error;    //!< why it failed, if it did
+    Task *prev,*next; //!< the tasks still running, in a ring
+};
+
+Scheduler::Scheduler(API *a,int q){
+    api = a;
+    vm = a->getVM();
+    quantum = q<1 ? 1 : q;
+    current = NULL;
+    runnable = 0;
+    nextID = 0;
+    stepping = false;
+}
+
+Scheduler::~Scheduler(){
+    while(!tasks.empty())
+        cancel(tasks.begin()->first);
+}
+
+int Scheduler::add(Session *ses,Value *fn,int argc,Value *args,int priority){
+    if(fn->type != Types::vtFunction && fn->type != Types::vtNativeFunctionRef)
+        throw Exception(NULL).set("a task can't call a %s",fn->type->getName());
+    Task *t = new Task;
+    t->id = nextID++;
+    t->ses = ses;
+    t->priority = priority<1 ? 1 : priority;
+    t->fn = *fn;
+    t->argc = argc;
+    t->args = new Value[argc ? argc : 1];
+    for(int i=0;i<argc;i++)
+        t->args[i] = args[i];
+    t->started = t->finished = false;
+    t->error = NULL;
+
+    // it goes in the ring just before the next task to run, so that it
+    // has its first turn after all the others have had theirs
+    if(current){
+        t->prev = current;
+        t->next = current->next;
+        current->next->prev = t;
+        current->next = t;
+        current = t;
+    } else
+        current = t->prev = t->next = t;
+    runnable++;
+    tasks[t->id] = t;
+    return t->id;
+}
+
+void Scheduler::setPriority(int id,int priority){
+    get(id)->priority = priority<1 ? 1 : priority;
+}
+
+Scheduler::Task *Scheduler::get(int id){
+    std::map<int,Task *>::iterator i = tasks.find(id);
+    if(i==tasks.end())
+        throw Exception(NULL).set("there is no task %d",id);
+    return i->second;
+}
+
+void Scheduler::unlink(Task *t){
+    if(t->next==t)
+        current = NULL;
+    else {
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        if(current==t)
+            current = t->prev;
+    }
+    runnable--;
+}
+
+bool Scheduler::turn(Task *t){
+    // whatever the VM was doing is kept in the task's state meanwhile
+    vm->swapState(&t->state);
+    int n = quantum*t->priority;
+    bool done;
+    try {
+        if(!t->started){
+            t->started = true;
+            done = vm->startCall(t->ses,&t->fn,t->argc,t->args);
+            delete [] t->args;
+            t->args = NULL;
+            if(!done)
+                done = vm->resumeCall(t->ses,n);
+        } else
+            done = vm->resumeCall(t->ses,n);
+        if(done)
+            vm->finishCall(&t->result);
+    } catch(RuntimeException &e) {
+        t->error = strdup(e.what());
+        vm->abandonCall();
+        done = true;
+    } catch(Exception &e) {
+        // such as a stack overflow, which doesn't say where it was
+        RuntimeException r(e.what(),vm->getSourceFile(),vm->getSourceLine());
+        t->error = strdup(r.what());
+        vm->abandonCall();
+        done = true;
+    }
+    vm->swapState(&t->state);
+    return done;
+}
+
+bool Scheduler::step(){
+    if(!current)
+        return false;
+    if(stepping)
+        throw Exception("a task can't run the scheduler it's in");
+    if(api->getVM()!=vm)
+        throw Exception("tasks can only be run by the thread which made the scheduler");
+
+    Task *t = current->next;
+    current = t;
+    stepping = true;
+    bool done;
+    try {
+        done = turn(t);
+    } catch(Exception &) {
+        stepping = false;
+        throw;
+    }
+    stepping = false;
+    if(done){
+        t->finished = true;
+        unlink(t);
+    }
+    return true;
+}
+
+void Scheduler::run(){
+    while(step()){}
+}
+
+bool Scheduler::isFinished(int id){
+    return get(id)->finished;
+}
+
+void Scheduler::getResult(int id,Value *result){
+    Task *t = get(id);
+    if(!t->finished)
+        throw Exception(NULL).set("task %d hasn't finished",id);
+    if(t->error){
+        Exception e(NULL);
+        e.set("task %d failed: %s",id,t->error);
+        cancel(id);
+        throw e;
+    }
+    *result = t->result;
+    cancel(id);
+}
+
+void Scheduler::cancel(int id){
+    Task *t = get(id);
+    if(stepping && t==current)
+        throw Exception("a task can't cancel itself");
+    if(!t->finished){
+        unlink(t);
+        if(t->started){
+            // it's swapped in to release what its stacks hold
+            vm->swapState(&t->state);
+            vm->abandonCall();
+            vm->swapState(&t->state);
+        }
+    }
+    tasks.erase(id);
+    delete [] t->args;
+    free(t->error);
+    delete t;
+}
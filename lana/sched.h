@@ -0,0 +1,102 @@
+/**
+ * @file
+ * The scheduler, which runs many calls of Lana functions on one thread
+ * by giving each a turn in time slices, so that no call can keep the
+ * others waiting for long.
+ *
+ * Each call is a task, with a VM state of its own (see
+ * VirtualMachine::State) which is swapped into the thread's VM for its
+ * turn and out again afterwards. A turn lasts for a number of
+ * instructions: the quantum, times the task's priority. The tasks take
+ * turns in the order they were added, so each waits for at most one
+ * turn of each of the others between its own.
+ *
+ * A turn can only end between the instructions of the call's own Lana
+ * code: native code, such as a sort calling a comparator written in
+ * Lana, always returns within the turn it started in, and the Lana code
+ * it calls back isn't counted. Calls made by a task aren't run by the
+ * register VM
+ * (see regvm.h), which can't be stopped part way through.
+ *
+ * Tasks belong to the thread which made the scheduler, and their values
+ * to its VM, as if each were a call in progress.
+ */
+
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#include <map>
+
+namespace lana {
+
+/// runs calls on one thread a turn at a time
+
+class Scheduler {
+public:
+    /// make a scheduler for the calling thread's VM, whose turns last
+    /// for quantum instructions at priority 1
+    Scheduler(class API *a,int quantum=DEFAULTQUANTUM);
+    /// give up any tasks left, finished or not
+    ~Scheduler();
+
+    /// the default number of instructions in a turn at priority 1
+    static const int DEFAULTQUANTUM = 1000;
+
+    /// the number of instructions in a turn at priority 1
+    int quantum;
+
+    /// add a task which calls fn with argc arguments in a session,
+    /// getting turns of quantum times priority instructions. Returns
+    /// the task's ID. Nothing runs until step() or run() is called.
+    int add(class Session *ses,class Value *fn,int argc,class Value *args,
+            int priority=1);
+
+    /// change the priority of a task
+    void setPriority(int id,int priority);
+
+    /// give the next task its turn, returning false if there aren't
+    /// any left to run
+    bool step();
+
+    /// run all the tasks until they've finished
+    void run();
+
+    /// the number of tasks which haven't finished
+    int running(){
+        return runnable;
+    }
+
+    /// has a task finished, either returning or failing?
+    bool isFinished(int id);
+
+    /// get what a finished task returned, and forget the task. If it
+    /// failed, its error is thrown instead.
+    void getResult(int id,class Value *result);
+
+    /// stop a task, whether it's finished or not, and forget it
+    void cancel(int id);
+
+private:
+    /// a call and its VM state (see sched.cpp)
+    struct Task;
+
+    /// get a task by ID, throwing if there isn't one
+    Task *get(int id);
+    /// take a finished task out of the ring
+    void unlink(Task *t);
+    /// run a task's turn in the VM, swapped in, returning true if it's
+    /// finished
+    bool turn(Task *t);
+
+    class API *api;
+    class VirtualMachine *vm;
+    std::map<int,Task *> tasks;
+    Task *current;   //!< the task which had the last turn, in the ring
+    int runnable;    //!< the number of tasks in the ring
+    int nextID;
+    bool stepping;   //!< set during a turn, which can't call step()
+};
+
+}
+
+#endif /* __SCHED_H */
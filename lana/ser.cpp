@@ -5,6 +5,7 @@
 #include "dict.h"
 #include "ser.h"
 #include "list.h"
+#include "typedarray.h"
 
 using namespace lana;
 
@@ -271,3 +272,19 @@ const char *Serialiser::preSerialise(FILE *out, u64 target,Type *tp){
 void ListType::serialiseAssignment(Serialiser *s,const char *name,FILE *out,Value *v) const {
 }
 
+void TypedArrayType::serialiseAssignment(Serialiser *s,const char *name,FILE *out,Value *v) const {
+    TypedArray *t = (TypedArray *)v->d.o;
+    int n = t->count();
+    
+    fprintf(out,"%s%s = %s(%d)\n",s->indents(),name,getName(),n);
+    s->setHash((u64)t,name);
+    
+    Value item;
+    for(int i=0;i<n;i++){
+        t->get(i,&item);
+        fprintf(out,"%s%s[%d] = ",s->indents(),name,i);
+        item.type->serialise(s,out,&item);
+        fputs("\n",out);
+    }
+}
+
@@ -21,6 +21,7 @@ Session::Session(API *a){
     lana = a->lana;
     vars = new Vars(lana->consts);
     compiler = new Compiler(this,lana);
+    setStackLimits(DEFAULTMAXDEPTH,DEFAULTMAXSTACKVALUES);
 }
 
 Session::~Session(){
@@ -40,7 +41,33 @@ void Session::feedFile(const char *fileName){
     compiler->feedFile(fileName);
 }
 
+Statement *Session::prepare(const char *s){
+    lana->setValueConsts();
+    return compiler->prepare(s);
+}
+
+void Session::execute(Statement *st,Value *result){
+    if(st->ses!=this)
+        throw Exception("statement was prepared by another session");
+    lana->setValueConsts();
+    VirtualMachine *vm = lana->getVM();
+    vm->interpret(st->run,this);
+    
+    Value *v = vm->popvalnoexception();
+    if(result){
+        if(v)
+            *result = *v;
+        else
+            result->clr();
+    }
+}
+
+void Session::setStatementCache(int n){
+    compiler->setCacheSize(n);
+}
+
 const char *Session::recreate(instruction *op){
+    MutexLock l(lana->lock);
     const char *s = lana->recreate(op,this);
     return s;
 }
@@ -77,7 +104,7 @@ Value *Session::getSesVar(int svk){
 }
     
 Value *Session::getSesVar(const char *name,bool create){
-    int desc = lana->consts->findOrCreateString(name);
+    int desc = lana->registerID(name);
     int slot = vars->find(desc);
     if(slot<0){
         if(create)slot = vars->create(desc);
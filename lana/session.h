@@ -11,6 +11,46 @@
 
 namespace lana {
 
+/// a line of immediate-mode code compiled once by Session::prepare(),
+/// which Session::execute() can then run as often as needed without
+/// compiling it again. Like a function, it refers to variables rather
+/// than to their values, so each run sees their current values. It
+/// belongs to the caller, who deletes it when it's no longer needed
+/// (and before the session which prepared it).
+
+class Statement {
+    friend class Compiler;
+    friend class Session;
+public:
+    /// delete the statement's code
+    ~Statement();
+    
+    /// get the line the statement was compiled from
+    const char *getSource(){
+        return src;
+    }
+    
+    /// get the code as compiled, which is what COMMAND_PARSED listeners
+    /// and recreate() are given
+    instruction *getCode(){
+        return code;
+    }
+    
+private:
+    /// make a statement from a compiled line and its optimised code
+    Statement(class Session *s,const char *source,
+              const instruction *compiled,int n,
+              const instruction *optimised,int optn,
+              int flags,int dflags);
+    
+    class Session *ses; //!< the session whose variables it uses
+    char *src;          //!< the source line
+    instruction *code;  //!< the code as compiled
+    instruction *run;   //!< the optimised code, which is what runs
+    int opFlags;        //!< the LOP_ flags it was compiled under
+    int debugFlags;     //!< and the LDEBUG_ flags
+};
+
 /// this is a session object, through which the embedding application
 /// communicates with Lana to compile and run code.. Because multiple users
 /// may be using Lana (for example, in a server) each needs to create one of
@@ -39,6 +79,25 @@ public:
     /// feed text from a file into the interpreter using feed()
     void feedFile(const char *fileName);
     
+    /// compile a single line of immediate-mode code without running it,
+    /// returning a statement which execute() can run. The line must be
+    /// complete in itself, so it can't start or be part of a function
+    /// definition. Syntax errors throw ParseException.
+    class Statement *prepare(const char *s);
+    
+    /// run a statement prepared by this session, copying any value it
+    /// leaves into result if one is given (which is set to None if it
+    /// leaves nothing). Call this between feeds, not from native code
+    /// while the VM is running; errors are thrown as RuntimeException.
+    void execute(class Statement *st,class Value *result=NULL);
+    
+    /// keep up to n of the lines fed to feed() compiled, so that feeding
+    /// a line again runs it without tokenising or compiling it. The least
+    /// recently fed lines are dropped first, and 0 (the default) turns
+    /// this off. Only lines which are complete statements are kept, and
+    /// none while debugging flags other than LDEBUG_SRCDATA are set.
+    void setStatementCache(int n);
+    
     /// true if the compiler is building a function or procedure.
     /// Typically used to modify the prompt.
     bool awaitingInput();
@@ -71,11 +130,39 @@ public:
     /// get the session variable name given the pool index
     char *getSesVarName(int idx);
     
+    /// the default for the most calls which can be nested
+    static const int DEFAULTMAXDEPTH = 4096;
+    /// the default for the most values the VM's stacks can hold
+    static const int DEFAULTMAXSTACKVALUES = 1<<20;
+    
+    /// limit the stacks while this session's code runs: depth is the
+    /// most calls which can be nested and values the most values the
+    /// execution and variable stacks can hold between them. Exceeding
+    /// either is a runtime error.
+    void setStackLimits(int depth,int values){
+        maxDepth = depth;
+        maxStackValues = values;
+    }
+    
+    /// get the most calls which can be nested
+    int getMaxDepth(){
+        return maxDepth;
+    }
+    
+    /// get the most values the stacks can hold
+    int getMaxStackValues(){
+        return maxStackValues;
+    }
+    
     /// the API
     class API *api;
     
     /// a namespace for variables
     class Vars *vars;
+    
+private:
+    int maxDepth;       //!< see setStackLimits()
+    int maxStackValues; //!< see setStackLimits()
 };
     
     
@@ -0,0 +1,153 @@
+/**
+ * @file
+ * The scalar and SSE2 kernel sets, and selection of the best set for
+ * the CPU we're running on. The AVX2 set is in simdavx.cpp, which is
+ * compiled with different flags.
+ */
+
+#include <string.h>
+
+#include "simdkernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LANA_SSE2
+#endif
+
+namespace lana {
+namespace {
+
+#ifdef LANA_SSE2
+
+struct SSE2Float {
+    typedef float T;
+    typedef __m128 R;
+    static const int W=4;
+    static R load(const T *p){ return _mm_loadu_ps(p); }
+    static void store(T *p,R x){ _mm_storeu_ps(p,x); }
+    static R set1(T x){ return _mm_set1_ps(x); }
+    static R add(R a,R b){ return _mm_add_ps(a,b); }
+    static R mul(R a,R b){ return _mm_mul_ps(a,b); }
+    static R min(R a,R b){ return _mm_min_ps(a,b); }
+    static R max(R a,R b){ return _mm_max_ps(a,b); }
+    static R scan(R x){
+        x = _mm_add_ps(x,_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x),4)));
+        return _mm_add_ps(x,_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x),8)));
+    }
+};
+
+struct SSE2Double {
+    typedef double T;
+    typedef __m128d R;
+    static const int W=2;
+    static R load(const T *p){ return _mm_loadu_pd(p); }
+    static void store(T *p,R x){ _mm_storeu_pd(p,x); }
+    static R set1(T x){ return _mm_set1_pd(x); }
+    static R add(R a,R b){ return _mm_add_pd(a,b); }
+    static R mul(R a,R b){ return _mm_mul_pd(a,b); }
+    static R min(R a,R b){ return _mm_min_pd(a,b); }
+    static R max(R a,R b){ return _mm_max_pd(a,b); }
+    static R scan(R x){
+        return _mm_add_pd(x,_mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(x),8)));
+    }
+};
+
+struct SSE2Int {
+    typedef s32 T;
+    typedef __m128i R;
+    static const int W=4;
+    static R load(const T *p){ return _mm_loadu_si128((const __m128i *)p); }
+    static void store(T *p,R x){ _mm_storeu_si128((__m128i *)p,x); }
+    static R set1(T x){ return _mm_set1_epi32(x); }
+    static R add(R a,R b){ return _mm_add_epi32(a,b); }
+    // SSE2 has no 32-bit multiply keeping the low halves, so do the
+    // even and odd lanes separately and shuffle them back together
+    static R mul(R a,R b){
+        R even = _mm_mul_epu32(a,b);
+        R odd = _mm_mul_epu32(_mm_srli_si128(a,4),_mm_srli_si128(b,4));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),
+                                  _mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+    }
+    // nor min/max, which arrive with SSE4.1
+    static R select(R mask,R a,R b){
+        return _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b));
+    }
+    static R min(R a,R b){ return select(_mm_cmplt_epi32(a,b),a,b); }
+    static R max(R a,R b){ return select(_mm_cmpgt_epi32(a,b),a,b); }
+    static R scan(R x){
+        x = _mm_add_epi32(x,_mm_slli_si128(x,4));
+        return _mm_add_epi32(x,_mm_slli_si128(x,8));
+    }
+};
+
+#endif
+
+}
+
+namespace simd {
+
+static const SimdKernelSet *current=NULL;
+
+const SimdKernelSet *scalarKernels(){
+    static SimdKernelSet k = {
+        "scalar",
+        makeKernels<ScalarVec<s32> >(),
+        makeKernels<ScalarVec<float> >(),
+        makeKernels<ScalarVec<double> >()
+    };
+    return &k;
+}
+
+const SimdKernelSet *sse2Kernels(){
+#ifdef LANA_SSE2
+    static SimdKernelSet k = {
+        "sse2",
+        makeKernels<SSE2Int>(),
+        makeKernels<SSE2Float>(),
+        makeKernels<SSE2Double>()
+    };
+    return &k;
+#else
+    return NULL;
+#endif
+}
+
+/// does the CPU we're running on support AVX2 (and the OS save the registers)?
+static bool cpuHasAVX2(){
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+const SimdKernelSet *find(const char *name){
+    const SimdKernelSet *k=NULL;
+    if(!strcmp(name,"scalar"))
+        k = scalarKernels();
+    else if(!strcmp(name,"sse2"))
+        k = sse2Kernels();
+    else if(!strcmp(name,"avx2") && cpuHasAVX2())
+        k = avx2Kernels();
+    return k;
+}
+
+const SimdKernelSet *kernels(){
+    if(!current){
+        if(!(current = find("avx2")) && !(current = find("sse2")))
+            current = scalarKernels();
+    }
+    return current;
+}
+
+bool select(const char *name){
+    const SimdKernelSet *k = find(name);
+    if(!k)
+        return false;
+    current = k;
+    return true;
+}
+
+}
+}
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * Vectorised numeric kernels used by the typed arrays. There are
+ * several implementations of each kernel - plain scalar code, SSE2
+ * and AVX2 - and the best one the CPU supports is chosen at run time.
+ * Each set is a table of function pointers, so adding another
+ * instruction set is a matter of filling in another table.
+ */
+
+#ifndef __SIMD_H
+#define __SIMD_H
+
+#include "basetypes.h"
+
+namespace lana {
+
+/// kernels for a single element type. Arrays may be unaligned, and
+/// the destination of add() and mul() may be the same as a source.
+template <class T> struct SimdKernels {
+    /// return the sum of n items
+    T (*sum)(const T *a,int n);
+    /// return the dot product of two arrays of n items
+    T (*dot)(const T *a,const T *b,int n);
+    /// multiply n items by k in place
+    void (*scale)(T *a,int n,T k);
+    /// y = y + alpha*x
+    void (*axpy)(T *y,const T *x,int n,T alpha);
+    /// elementwise dst = a+b
+    void (*add)(T *dst,const T *a,const T *b,int n);
+    /// elementwise dst = a*b
+    void (*mul)(T *dst,const T *a,const T *b,int n);
+    /// return the smallest of n>0 items
+    T (*min)(const T *a,int n);
+    /// return the largest of n>0 items
+    T (*max)(const T *a,int n);
+    /// replace each item with the sum of itself and all the items before it
+    void (*prefixSum)(T *a,int n);
+};
+
+/// a complete set of kernels for one instruction set
+struct SimdKernelSet {
+    const char *name; //!< "scalar", "sse2" or "avx2"
+    SimdKernels<s32> i32;
+    SimdKernels<float> f32;
+    SimdKernels<double> f64;
+};
+
+namespace simd {
+
+/// return the kernels currently in use - the first call detects the
+/// best set the CPU can run.
+const SimdKernelSet *kernels();
+
+/// select a kernel set by name, returning false if it isn't available on
+/// this CPU or wasn't compiled in. Used by tests and benchmarks to
+/// compare implementations.
+bool select(const char *name);
+
+/// return the set of kernels with the given name, or NULL if it isn't
+/// available.
+const SimdKernelSet *find(const char *name);
+
+/// the scalar kernels, always available
+const SimdKernelSet *scalarKernels();
+/// the SSE2 kernels, or NULL if this isn't an x86 build
+const SimdKernelSet *sse2Kernels();
+/// the AVX2 kernels, or NULL if they weren't compiled in
+const SimdKernelSet *avx2Kernels();
+
+}
+
+}
+
+#endif /* __SIMD_H */
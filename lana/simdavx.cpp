@@ -0,0 +1,96 @@
+/**
+ * @file
+ * The AVX2 kernel set. This file is compiled with -mavx2 where the
+ * compiler supports it (see CMakeLists.txt); the kernels are only
+ * selected if the CPU supports AVX2 at run time. Without the flag,
+ * avx2Kernels() returns NULL.
+ */
+
+#include "simdkernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace lana {
+namespace {
+
+// AVX shifts and permutes work within 128-bit halves, so the scans do
+// each half and then add the total of the low half into the high half.
+
+struct AVXFloat {
+    typedef float T;
+    typedef __m256 R;
+    static const int W=8;
+    static R load(const T *p){ return _mm256_loadu_ps(p); }
+    static void store(T *p,R x){ _mm256_storeu_ps(p,x); }
+    static R set1(T x){ return _mm256_set1_ps(x); }
+    static R add(R a,R b){ return _mm256_add_ps(a,b); }
+    static R mul(R a,R b){ return _mm256_mul_ps(a,b); }
+    static R min(R a,R b){ return _mm256_min_ps(a,b); }
+    static R max(R a,R b){ return _mm256_max_ps(a,b); }
+    static R scan(R x){
+        x = _mm256_add_ps(x,_mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x),4)));
+        x = _mm256_add_ps(x,_mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x),8)));
+        R t = _mm256_permute_ps(x,_MM_SHUFFLE(3,3,3,3));
+        return _mm256_add_ps(x,_mm256_permute2f128_ps(t,t,0x08));
+    }
+};
+
+struct AVXDouble {
+    typedef double T;
+    typedef __m256d R;
+    static const int W=4;
+    static R load(const T *p){ return _mm256_loadu_pd(p); }
+    static void store(T *p,R x){ _mm256_storeu_pd(p,x); }
+    static R set1(T x){ return _mm256_set1_pd(x); }
+    static R add(R a,R b){ return _mm256_add_pd(a,b); }
+    static R mul(R a,R b){ return _mm256_mul_pd(a,b); }
+    static R min(R a,R b){ return _mm256_min_pd(a,b); }
+    static R max(R a,R b){ return _mm256_max_pd(a,b); }
+    static R scan(R x){
+        x = _mm256_add_pd(x,_mm256_castsi256_pd(_mm256_slli_si256(_mm256_castpd_si256(x),8)));
+        R t = _mm256_permute_pd(x,0xf);
+        return _mm256_add_pd(x,_mm256_permute2f128_pd(t,t,0x08));
+    }
+};
+
+struct AVXInt {
+    typedef s32 T;
+    typedef __m256i R;
+    static const int W=8;
+    static R load(const T *p){ return _mm256_loadu_si256((const __m256i *)p); }
+    static void store(T *p,R x){ _mm256_storeu_si256((__m256i *)p,x); }
+    static R set1(T x){ return _mm256_set1_epi32(x); }
+    static R add(R a,R b){ return _mm256_add_epi32(a,b); }
+    static R mul(R a,R b){ return _mm256_mullo_epi32(a,b); }
+    static R min(R a,R b){ return _mm256_min_epi32(a,b); }
+    static R max(R a,R b){ return _mm256_max_epi32(a,b); }
+    static R scan(R x){
+        x = _mm256_add_epi32(x,_mm256_slli_si256(x,4));
+        x = _mm256_add_epi32(x,_mm256_slli_si256(x,8));
+        R t = _mm256_shuffle_epi32(x,_MM_SHUFFLE(3,3,3,3));
+        return _mm256_add_epi32(x,_mm256_permute2x128_si256(t,t,0x08));
+    }
+};
+
+}
+
+const SimdKernelSet *simd::avx2Kernels(){
+    static SimdKernelSet k = {
+        "avx2",
+        makeKernels<AVXInt>(),
+        makeKernels<AVXFloat>(),
+        makeKernels<AVXDouble>()
+    };
+    return &k;
+}
+
+}
+
+#else
+
+const lana::SimdKernelSet *lana::simd::avx2Kernels(){
+    return 0;
+}
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * @file
+ * The generic kernel bodies used to build each SimdKernelSet. This is a
+ * private header included by simd.cpp and simdavx.cpp: each includes it
+ * with different compiler flags and instantiates the kernels with its
+ * own vector traits. Everything here is in an anonymous namespace, so
+ * instantiations in different files can't be merged by the linker (which
+ * could otherwise run AVX2 code on a CPU without it).
+ *
+ * A traits class V describes a vector register: the element type T,
+ * the register type R, the number of lanes W, and static load(),
+ * store(), set1(), add(), mul(), min(), max() and scan() functions, the
+ * last of which does an inclusive prefix sum across the lanes.
+ */
+
+#ifndef __SIMDKERNELS_H
+#define __SIMDKERNELS_H
+
+#include "simd.h"
+
+namespace lana {
+namespace {
+
+/// scalar "vectors" of one lane, used for the fallback kernels
+template <class TT> struct ScalarVec {
+    typedef TT T;
+    typedef TT R;
+    static const int W=1;
+    static R load(const T *p){ return *p; }
+    static void store(T *p,R x){ *p=x; }
+    static R set1(T x){ return x; }
+    static R add(R a,R b){ return a+b; }
+    static R mul(R a,R b){ return a*b; }
+    static R min(R a,R b){ return b<a ? b : a; }
+    static R max(R a,R b){ return b>a ? b : a; }
+    static R scan(R x){ return x; }
+};
+
+template <class V> typename V::T ksum(const typename V::T *a,int n){
+    typedef typename V::T T;
+    typedef typename V::R R;
+    const int W = V::W;
+    // two accumulators to hide the latency of the adds
+    R acc0=V::set1(0),acc1=V::set1(0);
+    int i=0;
+    for(;i+2*W<=n;i+=2*W){
+        acc0 = V::add(acc0,V::load(a+i));
+        acc1 = V::add(acc1,V::load(a+i+W));
+    }
+    for(;i+W<=n;i+=W)
+        acc0 = V::add(acc0,V::load(a+i));
+
+    T lanes[W];
+    V::store(lanes,V::add(acc0,acc1));
+    T r=0;
+    for(int j=0;j<W;j++)
+        r+=lanes[j];
+    for(;i<n;i++)
+        r+=a[i];
+    return r;
+}
+
+template <class V> typename V::T kdot(const typename V::T *a,const typename V::T *b,int n){
+    typedef typename V::T T;
+    typedef typename V::R R;
+    const int W = V::W;
+    R acc0=V::set1(0),acc1=V::set1(0);
+    int i=0;
+    for(;i+2*W<=n;i+=2*W){
+        acc0 = V::add(acc0,V::mul(V::load(a+i),V::load(b+i)));
+        acc1 = V::add(acc1,V::mul(V::load(a+i+W),V::load(b+i+W)));
+    }
+    for(;i+W<=n;i+=W)
+        acc0 = V::add(acc0,V::mul(V::load(a+i),V::load(b+i)));
+
+    T lanes[W];
+    V::store(lanes,V::add(acc0,acc1));
+    T r=0;
+    for(int j=0;j<W;j++)
+        r+=lanes[j];
+    for(;i<n;i++)
+        r+=a[i]*b[i];
+    return r;
+}
+
+template <class V> void kscale(typename V::T *a,int n,typename V::T k){
+    typedef typename V::R R;
+    const int W = V::W;
+    R kk = V::set1(k);
+    int i=0;
+    for(;i+W<=n;i+=W)
+        V::store(a+i,V::mul(V::load(a+i),kk));
+    for(;i<n;i++)
+        a[i]*=k;
+}
+
+template <class V> void kaxpy(typename V::T *y,const typename V::T *x,int n,typename V::T alpha){
+    typedef typename V::R R;
+    const int W = V::W;
+    R aa = V::set1(alpha);
+    int i=0;
+    for(;i+W<=n;i+=W)
+        V::store(y+i,V::add(V::load(y+i),V::mul(aa,V::load(x+i))));
+    for(;i<n;i++)
+        y[i]+=alpha*x[i];
+}
+
+template <class V> void kadd(typename V::T *dst,const typename V::T *a,const typename V::T *b,int n){
+    const int W = V::W;
+    int i=0;
+    for(;i+W<=n;i+=W)
+        V::store(dst+i,V::add(V::load(a+i),V::load(b+i)));
+    for(;i<n;i++)
+        dst[i]=a[i]+b[i];
+}
+
+template <class V> void kmul(typename V::T *dst,const typename V::T *a,const typename V::T *b,int n){
+    const int W = V::W;
+    int i=0;
+    for(;i+W<=n;i+=W)
+        V::store(dst+i,V::mul(V::load(a+i),V::load(b+i)));
+    for(;i<n;i++)
+        dst[i]=a[i]*b[i];
+}
+
+/// min (or max, if largest is set) of n>0 items
+template <class V,bool largest> typename V::T kminmax(const typename V::T *a,int n){
+    typedef typename V::T T;
+    typedef typename V::R R;
+    const int W = V::W;
+    R acc = V::set1(a[0]);
+    int i=0;
+    for(;i+W<=n;i+=W){
+        R x = V::load(a+i);
+        acc = largest ? V::max(acc,x) : V::min(acc,x);
+    }
+
+    T lanes[W];
+    V::store(lanes,acc);
+    T r=lanes[0];
+    for(int j=1;j<W;j++)
+        r = largest ? (lanes[j]>r ? lanes[j] : r) : (lanes[j]<r ? lanes[j] : r);
+    for(;i<n;i++)
+        r = largest ? (a[i]>r ? a[i] : r) : (a[i]<r ? a[i] : r);
+    return r;
+}
+
+template <class V> typename V::T kmin(const typename V::T *a,int n){
+    return kminmax<V,false>(a,n);
+}
+template <class V> typename V::T kmax(const typename V::T *a,int n){
+    return kminmax<V,true>(a,n);
+}
+
+/// prefix sum: scan each vector in registers, then add the running
+/// total carried over from the previous one
+template <class V> void kprefixsum(typename V::T *a,int n){
+    typedef typename V::T T;
+    typedef typename V::R R;
+    const int W = V::W;
+    T carry=0;
+    int i=0;
+    for(;i+W<=n;i+=W){
+        R x = V::add(V::scan(V::load(a+i)),V::set1(carry));
+        V::store(a+i,x);
+        carry = a[i+W-1];
+    }
+    for(;i<n;i++){
+        carry+=a[i];
+        a[i]=carry;
+    }
+}
+
+/// fill in a kernel table from a traits class
+template <class V> SimdKernels<typename V::T> makeKernels(){
+    SimdKernels<typename V::T> k;
+    k.sum = ksum<V>;
+    k.dot = kdot<V>;
+    k.scale = kscale<V>;
+    k.axpy = kaxpy<V>;
+    k.add = kadd<V>;
+    k.mul = kmul<V>;
+    k.min = kmin<V>;
+    k.max = kmax<V>;
+    k.prefixSum = kprefixsum<V>;
+    return k;
+}
+
+}
+}
+
+#endif /* __SIMDKERNELS_H */
@@ -2,10 +2,12 @@
 #define __STACK_H
 
 /** @file
- * Stack classes SimpleStack and StackableStack, and their associated
- * exceptions
+ * Stack classes SimpleStack, SegmentedStack and StackableStack, and
+ * their associated exceptions
  */
 
+#include <vector>
+#include <algorithm>
 #include "exception.h"
 
 namespace lana {
@@ -119,6 +121,234 @@ public:
     int ct;
 };
 
+/// a stack of items of type T which grows as it's needed, in segments
+/// of at least N items. Segments never move, so pointers into the stack
+/// stay valid however deep it gets. Items are pushed onto the current
+/// segment, which can overflow just as a SimpleStack can; code which
+/// knows how much room it needs (such as a function being entered)
+/// checks room() and calls enter() to move on to another segment, and
+/// leave() goes back to the one before. The highest point used in each
+/// segment is kept, so that flush() only has to clear what was used.
+
+template <class T,int N> class SegmentedStack {
+    /// a segment, which is kept to be used again once it's been left
+    struct Segment {
+        T *items;
+        int size;
+        int ct; //!< the number of items in it when the next was entered
+        int top; //!< the most items it's had since flush()
+    };
+    
+public:
+    SegmentedStack(){
+        Segment s;
+        s.items = new T[N];
+        s.size = N;
+        s.top = 0;
+        segs.push_back(s);
+        reset();
+    }
+    
+    ~SegmentedStack(){
+        for(unsigned int i=0;i<segs.size();i++)
+            delete [] segs[i].items;
+    }
+    
+    /// get an item from the top of the stack, discarding n items first.
+    T pop(int n=0) {
+        if(ct<=n)
+            throw StackUnderflowException();
+        ct -= n+1;
+        return stack[ct];
+    }
+    
+    /// get the nth item from the top of the stack
+    T peek(int n=0) {
+        if(ct<=n)
+            throw StackUnderflowException();
+        return stack[ct-(n+1)];
+    }
+    
+    /// get a pointer to the nth item from the top of the current segment
+    T *peekptr(int n=0) {
+        if(ct<=n)
+            return NULL;
+        return stack+(ct-(n+1));
+    }
+    
+    /// get a pointer to an item from the top of the stack, discarding n items first,
+    /// return NULL if there are not enough items instead of throwing an exception.
+    T *popptrnoex(int n=0) {
+        if(ct<=n)
+            return NULL;
+        ct -= n+1;
+        return stack+ct;
+    }
+    
+    /// get a pointer to an item from the top of the stack, discarding n items first
+    T *popptr(int n=0) {
+        if(ct<=n)
+            throw StackUnderflowException();
+        ct -= n+1;
+        return stack+ct;
+    }
+    
+    /// push an item onto the current segment, returning the new item slot
+    /// to be written into.
+    T* pushptr() {
+        if(ct==size)
+            throw StackOverflowException();
+        if(ct==top)
+            top++;
+        return stack+(ct++);
+    }
+    
+    /// push an item onto the current segment, passing the object in
+    void push(T o){
+        *pushptr()=o;
+    }
+    
+    /// swap the top two items on the stack
+    void swap(){
+        if(ct<2)
+            throw StackUnderflowException();
+        T x;
+        x=stack[ct-1];
+        stack[ct-1]=stack[ct-2];
+        stack[ct-2]=x;
+    }
+    
+    /// is the current segment empty?
+    bool isempty(){
+        return ct==0;
+    }
+    
+    /// the number of items which can be pushed before the current
+    /// segment is full
+    int room(){
+        return size-ct;
+    }
+    
+    /// the number of items in all the segments in use
+    int depth(){
+        return below+ct;
+    }
+    
+    /// the number of items all the segments in use can hold
+    int capacity(){
+        return held+size;
+    }
+    
+    /// the index of the current segment
+    int segment(){
+        return cur;
+    }
+    
+    /// note that the first n items of the current segment have been
+    /// used without being pushed, so that flush() clears them
+    void mark(int n){
+        if(n>top)
+            top = n;
+    }
+    
+    /// move on to a segment with room for at least n items, leaving
+    /// the items in this one where they are
+    void enter(int n){
+        segs[cur].ct = ct;
+        segs[cur].top = top;
+        below += ct;
+        held += size;
+        cur++;
+        if(cur==(int)segs.size()){
+            Segment s;
+            s.items = NULL;
+            s.size = 0;
+            s.top = 0;
+            segs.push_back(s);
+        }
+        if(n<N)
+            n = N;
+        if(segs[cur].size<n){
+            delete [] segs[cur].items;
+            segs[cur].items = new T[n];
+            segs[cur].size = n;
+            segs[cur].top = 0;
+        }
+        if(cur>used)
+            used = cur;
+        stack = segs[cur].items;
+        size = segs[cur].size;
+        top = segs[cur].top;
+        ct = 0;
+    }
+    
+    /// go back to the segment before, with the items it had
+    void leave(){
+        if(!cur)
+            throw StackUnderflowException();
+        segs[cur].top = top;
+        cur--;
+        stack = segs[cur].items;
+        size = segs[cur].size;
+        top = segs[cur].top;
+        ct = segs[cur].ct;
+        below -= ct;
+        held -= size;
+    }
+    
+    /// go back to an empty first segment, keeping the others for later
+    void reset(){
+        cur = 0;
+        used = 0;
+        below = 0;
+        held = 0;
+        stack = segs[0].items;
+        size = segs[0].size;
+        top = segs[0].top;
+        ct = 0;
+    }
+    
+    /// exchange everything in this stack with another of the same
+    /// kind. The segments themselves don't move.
+    void exchange(SegmentedStack &o){
+        std::swap(stack,o.stack);
+        std::swap(ct,o.ct);
+        std::swap(size,o.size);
+        std::swap(top,o.top);
+        segs.swap(o.segs);
+        std::swap(cur,o.cur);
+        std::swap(used,o.used);
+        std::swap(below,o.below);
+        std::swap(held,o.held);
+    }
+    
+    /// call clr() on every item used since the last flush, so that
+    /// nothing left in them is kept alive, and reset. This takes time
+    /// in proportion to the number of items used, not the capacity.
+    void flush(){
+        segs[cur].top = top;
+        for(int i=0;i<=used;i++){
+            for(int j=0;j<segs[i].top;j++)
+                segs[i].items[j].clr();
+            segs[i].top = 0;
+        }
+        reset();
+    }
+    
+    /// the current segment's items, left public like SimpleStack's
+    T *stack;
+    int ct;   //!< the number of items in the current segment
+    int size; //!< the size of the current segment
+    int top;  //!< the most items the current segment has had
+    
+private:
+    std::vector<Segment> segs;
+    int cur;   //!< the current segment
+    int used;  //!< the last segment used since flush()
+    int below; //!< the number of items in the segments before this one
+    int held;  //!< the size of the segments before this one
+};
+
 /// a class to encapsulate a "stackable stack" - a stack of 16 stacks of
 /// N items of type T.
 
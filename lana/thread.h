@@ -0,0 +1,114 @@
+/**
+ * @file
+ * Threads, and the mutex which keeps them out of each other's way.
+ *
+ * \section threads Running Lana in more than one thread
+ *
+ * There's one API (and so one Language) per process, and any number of
+ * threads can run code in it. The thread which created the API can do
+ * so straight away; any other thread must call API::attachThread() first
+ * and API::detachThread() when it's finished. Each thread has
+ * \li its own VirtualMachine, with its own stacks, call sites, lowered
+ * register code, temporary values and dictionary keys
+ * \li its own CycleDetector, which holds the objects it creates
+ * \li its own Sessions, which it creates itself and must delete before
+ * it detaches.
+ *
+ * What the threads share is the program: the constants (including the
+ * compiled code), the types, the native functions and the global
+ * variables. These are only read while code runs, and the constants are
+ * allocated up front so that they never move (see Constants). Anything
+ * which adds to them - compiling, loading, finding IDs and names, and
+ * registering natives or globals - holds the Language's mutex, so that
+ * only one thread does it at once.
+ *
+ * Global variables follow these rules:
+ * \li they can't be created or changed by Lana code while threads are
+ * attached; that's done first, by the thread which made the API
+ * \li an attached thread can only read those holding values which aren't
+ * reference counted - numbers, booleans, functions, natives, constant
+ * and immortal strings, and frozen objects (see Value::isShareable()). Reading one holding any other object, list or
+ * string made at run time is an error, since its reference count can only
+ * be changed by the thread which owns it.
+ *
+ * Objects are owned by the thread which made them, and must not be
+ * handed to another. The exception is frozen objects, such as the
+ * prototypes of lists and dictionaries, which any thread can use (see
+ * Object::makeImmortal()). So a large table can be built once, frozen
+ * (see Object::freeze()) and then read by every thread. Objects made
+ * immortal by API::makeHeapImmortal() aren't frozen, and so still
+ * belong to the thread which made them.
+ *
+ * The work pool (see workpool.h) is a set of threads attached like
+ * this, which pmap(), pfilter() and preduce() use. Actors (see actor.h)
+ * are attached threads too, which pass copies of values to each other
+ * as messages rather than sharing them; globals stay read-only while
+ * any is running.
+ */
+
+#ifndef __THREAD_H
+#define __THREAD_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+namespace lana {
+
+/// a recursive mutex: a thread which holds it can lock it again, as
+/// loading a file while compiling does
+
+class Mutex {
+public:
+    Mutex(){
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&m,&attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    ~Mutex(){
+        pthread_mutex_destroy(&m);
+    }
+
+    void lock(){
+        pthread_mutex_lock(&m);
+    }
+
+    void unlock(){
+        pthread_mutex_unlock(&m);
+    }
+
+private:
+    pthread_mutex_t m;
+};
+
+/// holds a mutex from construction until destruction (or release()),
+/// so that it's unlocked when an exception is thrown
+
+class MutexLock {
+public:
+    MutexLock(Mutex &mutex){
+        m = &mutex;
+        m->lock();
+    }
+
+    ~MutexLock(){
+        release();
+    }
+
+    /// unlock the mutex before the end of the scope
+    void release(){
+        if(m){
+            m->unlock();
+            m = NULL;
+        }
+    }
+
+private:
+    Mutex *m;
+};
+
+}
+
+#endif /* __THREAD_H */
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "api.h"
+#include "language.h"
+#include "list.h"
+#include "typedarray.h"
+
+using namespace lana;
+
+#define MT(xx) (lana::HOSTMETHOD)&lana::TypedArray::xx
+
+TypedArrayType::TypedArrayType(API *a,TypedArrayKind k) : ObjectType() {
+    kind = k;
+    proto = new TypedArray(a,k);
+
+    switch(k){
+    case TA_INT32:a->setNamePrefix("int32array$");break;
+    case TA_FLOAT32:a->setNamePrefix("float32array$");break;
+    case TA_FLOAT64:a->setNamePrefix("float64array$");break;
+    }
+
+    proto->registerNativeMethod("size",0,true,MT(methodSize));
+    proto->registerNativeMethod("append",1,false,MT(methodAppend));
+    proto->registerNativeMethod("push",1,false,MT(methodAppend));
+    proto->registerNativeMethod("resize",1,false,MT(methodResize));
+    proto->registerNativeMethod("capacity",0,true,MT(methodCapacity));
+    proto->registerNativeMethod("tolist",0,true,MT(methodToList));
+
+    proto->registerNativeMethod("sum",0,true,MT(methodSum));
+    proto->registerNativeMethod("dot",1,true,MT(methodDot));
+    proto->registerNativeMethod("scale",1,false,MT(methodScale));
+    proto->registerNativeMethod("axpy",2,false,MT(methodAxpy));
+    proto->registerNativeMethod("add",1,false,MT(methodAdd));
+    proto->registerNativeMethod("mul",1,false,MT(methodMul));
+    proto->registerNativeMethod("min",0,true,MT(methodMin));
+    proto->registerNativeMethod("max",0,true,MT(methodMax));
+    proto->registerNativeMethod("prefixsum",0,false,MT(methodPrefixSum));
+
+    proto->makeImmortal(); // never die, and be shared by every thread
+}
+
+Type *TypedArrayType::get(TypedArrayKind k){
+    switch(k){
+    case TA_INT32:return Types::vtInt32Array;
+    case TA_FLOAT32:return Types::vtFloat32Array;
+    default:return Types::vtFloat64Array;
+    }
+}
+
+TypedArray *TypedArray::create(API *a,TypedArrayKind k,int n){
+    TypedArray *t = new TypedArray(a,k);
+    /// make it a clone of the prototype, without using clone()
+    /// because there's no data to clone out.
+    t->makeCloneOf(((TypedArrayType *)TypedArrayType::get(k))->proto);
+    t->type = TypedArrayType::get(k);
+    t->resize(n);
+    return t;
+}
+
+TypedArray *TypedArray::fromList(API *a,TypedArrayKind k,List *l){
+    int n = l->list->count();
+    TypedArray *t = create(a,k,n);
+    for(int i=0;i<n;i++)
+        t->set(i,l->get(i));
+    return t;
+}
+
+Object *TypedArray::clone(API *a){
+    TypedArray *t = create(a,kind,ct);
+    t->makeCloneOf(this);
+    memcpy(t->items,items,ct*itemSize());
+    return t;
+}
+
+TypedArray::TypedArray(API *a,TypedArrayKind k) : Object(a) {
+    kind = k;
+    items = NULL;
+    ct = capacity = 0;
+}
+
+TypedArray::~TypedArray(){
+    free(items);
+}
+
+void TypedArray::reserve(int n){
+    if(n>capacity){
+        char *p = (char *)realloc(items,n*itemSize());
+        if(!p)
+            throw Exception("out of memory in typed array");
+        items = p;
+        capacity = n;
+    }
+}
+
+void TypedArray::resize(int n){
+    if(n<0)
+        throw Exception("negative typed array size");
+    if(n>capacity)
+        reserve(n<capacity*2 ? capacity*2 : n);
+    if(n>ct)
+        memset(items+ct*itemSize(),0,(n-ct)*itemSize());
+    ct = n;
+}
+
+void TypedArray::get(int i,Value *out){
+    if(i<0||i>=ct)
+        throw Exception("typed array index out of range");
+    switch(kind){
+    case TA_INT32:out->setInt(data<s32>()[i]);break;
+    case TA_FLOAT32:out->setFloat(data<float>()[i]);break;
+    case TA_FLOAT64:out->setFloat((float)data<double>()[i]);break;
+    }
+}
+
+void TypedArray::set(int i,Value *v){
+    if(i<0)
+        throw Exception("typed array index out of range");
+    if(i>=ct)
+        resize(i+1);
+    switch(kind){
+    case TA_INT32:data<s32>()[i] = v->getInt();break;
+    case TA_FLOAT32:data<float>()[i] = v->getFloat();break;
+    case TA_FLOAT64:data<double>()[i] = v->getFloat();break;
+    }
+}
+
+bool TypedArray::remove(int i){
+    if(i<0||i>=ct)
+        return false;
+    int sz = itemSize();
+    memmove(items+i*sz,items+(i+1)*sz,(ct-i-1)*sz);
+    ct--;
+    return true;
+}
+
+void TypedArray::methodSize(){
+    api->pushInt(ct);
+}
+
+void TypedArray::methodAppend(){
+    Value *v = api->popRaw();
+    set(ct,v);
+}
+
+void TypedArray::methodResize(){
+    resize(api->popInt());
+}
+
+void TypedArray::methodCapacity(){
+    api->pushInt(capacity);
+}
+
+void TypedArray::methodToList(){
+    List *l = List::create(api);
+    Value *v = api->pushRaw();
+    v->setOther(Types::vtList,(void *)l);
+    v->incRef();
+    l->reserve(ct);
+    for(int i=0;i<ct;i++)
+        get(i,l->list->append());
+}
+
+TypedArray *TypedArray::popOperand(const char *op){
+    Object *o = api->popObj();
+    if(o->type != type)
+        throw Exception(NULL).set("%s() needs a %s",op,type->getName());
+    TypedArray *t = (TypedArray *)o;
+    if(t->ct != ct)
+        throw Exception(NULL).set("%s() needs arrays of the same size",op);
+    return t;
+}
+
+void TypedArray::methodSum(){
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:api->pushInt(k->i32.sum(data<s32>(),ct));break;
+    case TA_FLOAT32:api->pushFloat(k->f32.sum(data<float>(),ct));break;
+    case TA_FLOAT64:api->pushFloat((float)k->f64.sum(data<double>(),ct));break;
+    }
+}
+
+void TypedArray::methodDot(){
+    TypedArray *t = popOperand("dot");
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:
+        api->pushInt(k->i32.dot(data<s32>(),t->data<s32>(),ct));break;
+    case TA_FLOAT32:
+        api->pushFloat(k->f32.dot(data<float>(),t->data<float>(),ct));break;
+    case TA_FLOAT64:
+        api->pushFloat((float)k->f64.dot(data<double>(),t->data<double>(),ct));break;
+    }
+}
+
+void TypedArray::methodScale(){
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:k->i32.scale(data<s32>(),ct,api->popInt());break;
+    case TA_FLOAT32:k->f32.scale(data<float>(),ct,api->popFloat());break;
+    case TA_FLOAT64:k->f64.scale(data<double>(),ct,api->popFloat());break;
+    }
+}
+
+void TypedArray::methodAxpy(){
+    TypedArray *x = popOperand("axpy");
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:
+        k->i32.axpy(data<s32>(),x->data<s32>(),ct,api->popInt());break;
+    case TA_FLOAT32:
+        k->f32.axpy(data<float>(),x->data<float>(),ct,api->popFloat());break;
+    case TA_FLOAT64:
+        k->f64.axpy(data<double>(),x->data<double>(),ct,api->popFloat());break;
+    }
+}
+
+void TypedArray::methodAdd(){
+    TypedArray *t = popOperand("add");
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:
+        k->i32.add(data<s32>(),data<s32>(),t->data<s32>(),ct);break;
+    case TA_FLOAT32:
+        k->f32.add(data<float>(),data<float>(),t->data<float>(),ct);break;
+    case TA_FLOAT64:
+        k->f64.add(data<double>(),data<double>(),t->data<double>(),ct);break;
+    }
+}
+
+void TypedArray::methodMul(){
+    TypedArray *t = popOperand("mul");
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:
+        k->i32.mul(data<s32>(),data<s32>(),t->data<s32>(),ct);break;
+    case TA_FLOAT32:
+        k->f32.mul(data<float>(),data<float>(),t->data<float>(),ct);break;
+    case TA_FLOAT64:
+        k->f64.mul(data<double>(),data<double>(),t->data<double>(),ct);break;
+    }
+}
+
+void TypedArray::methodMin(){
+    if(!ct)
+        throw Exception("min/max of empty typed array");
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:api->pushInt(k->i32.min(data<s32>(),ct));break;
+    case TA_FLOAT32:api->pushFloat(k->f32.min(data<float>(),ct));break;
+    case TA_FLOAT64:api->pushFloat((float)k->f64.min(data<double>(),ct));break;
+    }
+}
+
+void TypedArray::methodMax(){
+    if(!ct)
+        throw Exception("min/max of empty typed array");
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:api->pushInt(k->i32.max(data<s32>(),ct));break;
+    case TA_FLOAT32:api->pushFloat(k->f32.max(data<float>(),ct));break;
+    case TA_FLOAT64:api->pushFloat((float)k->f64.max(data<double>(),ct));break;
+    }
+}
+
+void TypedArray::methodPrefixSum(){
+    const SimdKernelSet *k = simd::kernels();
+    switch(kind){
+    case TA_INT32:k->i32.prefixSum(data<s32>(),ct);break;
+    case TA_FLOAT32:k->f32.prefixSum(data<float>(),ct);break;
+    case TA_FLOAT64:k->f64.prefixSum(data<double>(),ct);break;
+    }
+}
+
+
+/// iterator over the items or indices of a typed array. Each item is
+/// converted into a value held by the iterator.
+
+class TypedArrayIterator : public Iterator<Value *> {
+public:
+    TypedArrayIterator(TypedArray *a,bool k){
+        idx=-1;
+        array = a;
+        keys = k;
+    }
+
+    virtual void first(){
+        idx = 0;
+    }
+    virtual void next(){
+        idx++;
+    }
+    virtual bool isDone() const {
+        return idx>=array->count();
+    }
+
+    virtual Value *current() {
+        if(idx<0)
+            throw Exception("first() not called on iterator");
+        if(isDone())
+            throw Exception("typed array iterator done");
+        if(keys)
+            v.setInt(idx);
+        else
+            array->get(idx,&v);
+        return &v;
+    }
+private:
+    int idx;
+    bool keys;
+    TypedArray *array;
+    Value v;
+};
+
+
+// TypedArray type methods
+
+bool TypedArrayType::makeSQBRef(Value *v,Value *item,Value *idx){
+    int i = idx->getInt();
+    // v may be the slot item was in, so take the reference first
+    Object *o = item->d.o;
+    o->incRefCt();
+    v->clr();
+    v->d.o = o;
+    v->d2.i = i;
+    v->type = Types::vtTypedArrayRef;
+    return true;
+}
+
+Iterator<Value *> *TypedArrayType::createIter(Value *v,bool keys){
+    return new TypedArrayIterator((TypedArray *)v->d.o,keys);
+}
+
+int TypedArrayType::getSize(Value *v){
+    return ((TypedArray *)v->d.o)->count();
+}
+
+const char *TypedArrayRefType::repr(const Value *v) const {
+    startRepr();
+    sprintf(buf+strlen(buf),"%p/(ct%d)[%d]",v->d.o,
+            v->d.gc->refct,v->d2.i);
+    return buf;
+}
+
+void TypedArrayRefType::store(Value *ref,Value *v){
+    ((TypedArray *)ref->d.o)->set(ref->d2.i,v);
+}
+
+Value *TypedArrayRefType::deref(Value *v){
+    TypedArray *t = (TypedArray *)v->d.o;
+    Value *out = t->api->getTempValue();
+    t->get(v->d2.i,out);
+    return out;
+}
+
+bool TypedArrayRefType::isDefinedReference(Value *v){
+    int i = v->d2.i;
+    return i>=0 && i<((TypedArray *)v->d.o)->count();
+}
+
+bool TypedArrayRefType::deleteElement(Value *v){
+    return ((TypedArray *)v->d.o)->remove(v->d2.i);
+}
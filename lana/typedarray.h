@@ -0,0 +1,185 @@
+/**
+ * @file
+ * Typed arrays: lists of unboxed numbers, stored contiguously, with
+ * vectorised kernels for arithmetic on the whole array.
+ */
+
+#ifndef __TYPEDARRAY_H
+#define __TYPEDARRAY_H
+
+#include "value.h"
+#include "object.h"
+#include "simd.h"
+
+namespace lana {
+
+/// the kinds of element a typed array can hold. Note that Lana's own
+/// floats are single precision, so items of a float64 array lose
+/// precision when they're read into a Value, but arithmetic done by
+/// the array's own methods is done in double precision.
+enum TypedArrayKind {
+    TA_INT32,
+    TA_FLOAT32,
+    TA_FLOAT64,
+};
+
+/// a garbage-collected array of unboxed numbers. Items are read and
+/// written with [], like a list, and setting an item past the end
+/// extends the array, filling the gap with zero. The bulk methods
+/// run vectorised kernels from simd.h.
+
+class TypedArray : public Object {
+    friend struct TypedArrayType;
+
+private:
+    // private constructor, use create() instead.
+    TypedArray(class API *a,TypedArrayKind k);
+
+public:
+    virtual ~TypedArray();
+
+    /// create a zero-filled array of n items
+    static TypedArray *create(class API *a,TypedArrayKind k,int n=0);
+
+    /// create an array holding the items of a list, converted to numbers
+    static TypedArray *fromList(class API *a,TypedArrayKind k,class List *l);
+
+    /// clone the array and its contents
+    virtual Object *clone(class API *a);
+
+    /// the kind of items held
+    TypedArrayKind getKind(){
+        return kind;
+    }
+
+    /// the number of items
+    int count(){
+        return ct;
+    }
+
+    /// the number of items which can be held without reallocating
+    int getCapacity(){
+        return capacity;
+    }
+
+    /// direct access to the items, which must be of the right type
+    template <class T> T *data(){
+        return (T *)items;
+    }
+
+    /// make sure there's room for n items without reallocating
+    void reserve(int n);
+
+    /// change the number of items, zero-filling any new ones
+    void resize(int n);
+
+    /// get item i as a Lana value
+    void get(int i,Value *out);
+
+    /// set item i from a Lana value, extending the array if required
+    void set(int i,Value *v);
+
+    /// remove item i, moving the following items down
+    bool remove(int i);
+
+    /// native function for 'v=size()'
+    void methodSize();
+    /// native function for 'append(x)' and 'push(x)'
+    void methodAppend();
+    /// native function for 'resize(n)'
+    void methodResize();
+    /// native function for 'v=capacity()'
+    void methodCapacity();
+    /// native function for 'l=tolist()'
+    void methodToList();
+
+    /// native function for 'v=sum()'
+    void methodSum();
+    /// native function for 'v=dot(a)', where a is an array of the same kind and size
+    void methodDot();
+    /// native function for 'scale(k)', multiplying every item by k
+    void methodScale();
+    /// native function for 'axpy(alpha,x)', adding alpha*x to this array
+    void methodAxpy();
+    /// native function for 'add(a)', adding a to this array item by item
+    void methodAdd();
+    /// native function for 'mul(a)', multiplying this array by a item by item
+    void methodMul();
+    /// native function for 'v=min()'
+    void methodMin();
+    /// native function for 'v=max()'
+    void methodMax();
+    /// native function for 'prefixsum()', replacing each item by the running total
+    void methodPrefixSum();
+
+private:
+    /// pop another array of the same kind and size for a binary operation
+    TypedArray *popOperand(const char *op);
+
+    /// the size of each item in bytes
+    int itemSize(){
+        return kind==TA_FLOAT64 ? 8 : 4;
+    }
+
+    TypedArrayKind kind;
+    /// the data, capacity*itemSize() bytes
+    char *items;
+    /// the number of items in use
+    int ct;
+    /// the number of items allocated
+    int capacity;
+};
+
+/// the type object for typed arrays; there's one for each kind.
+
+struct TypedArrayType : public ObjectType {
+    /// create a square-bracket-ref value for an item in the array
+    virtual bool makeSQBRef(Value *v,Value *item,Value *idx);
+
+    /// iterate over the items (or their indices, if keys is true)
+    virtual Iterator<Value *> *createIter(Value *v,bool keys);
+
+    /// serialise an assignment of an array to a variable
+    virtual void serialiseAssignment(Serialiser *s,const char *name,FILE *out,Value *v) const;
+
+    /// get the size of an array
+    virtual int getSize(Value *v);
+
+    /// the prototype array
+    TypedArray *proto;
+    /// the kind of item held by arrays of this type
+    TypedArrayKind kind;
+
+    /// create the type, creating the prototype
+    TypedArrayType(API *a,TypedArrayKind k);
+
+    /// delete the type, which deletes the prototype
+    virtual ~TypedArrayType(){
+        delete proto;
+    }
+
+    /// return the type for a kind of array
+    static Type *get(TypedArrayKind k);
+};
+
+/// the type object for a reference to an item in a typed array. d.o is
+/// the array, and d2.i is the index.
+
+struct TypedArrayRefType : public Type {
+    TypedArrayRefType(){
+        isRef = true;
+    }
+    virtual const char *repr(const Value *v) const;
+    /// store a value in the array
+    virtual void store(Value *ref,Value *v);
+    /// get the item, in a temporary value (see API::getTempValue())
+    virtual Value *deref(Value *v);
+    /// is the index within the array?
+    virtual bool isDefinedReference(Value *v);
+    /// delete an item from the array
+    virtual bool deleteElement(Value *v);
+};
+
+}
+
+#endif /* __TYPEDARRAY_H */
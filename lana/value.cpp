@@ -18,10 +18,10 @@
 
 using namespace lana;
 
-class Constants *Value::consts = NULL;
+__thread class Constants *Value::consts = NULL;
 
-char Type::buf[1024];
-char Type::buf2[1024];
+__thread char Type::buf[1024];
+__thread char Type::buf2[1024];
 
 void Value::setStrClone(const char *s){
     
@@ -55,9 +55,13 @@ Value *Value::deref() {
     for(;;) {
         if(!v->type)
             throw Exception("cannot use an undefined value");
+        if(!v->type->isRef)
+            break;
         Value *v2 = v->type->deref(v);
         if(!v2)
             break;
+        if(v2==v) // it's loaded what it refers to into itself (see FieldRefType)
+            continue;
         v=v2;
         if(v==this)
             throw Exception("infinite ref loop");
@@ -105,6 +109,7 @@ void Value::setListRef(List *list,Value *idx){
 
 
 Type::Type(){
+    isRef = false;
 }
     
 
@@ -25,6 +25,10 @@ namespace lana {
 
 typedef u16 refct_t; //!< reference count - make sure it's unsigned
 
+/// the reference count of a string which is never counted or freed,
+/// such as one in a frozen container (see Object::freeze())
+static const refct_t IMMORTAL_REFCT = 0xffff;
+
 class Value;
 
 /// a garbage-collected value. Note the required virtual destructor!
@@ -36,6 +40,8 @@ class GarbageCollected {
 public:
     GarbageCollected() {
         refct=0;
+        immortal=false;
+        frozen=false;
     }
     
     virtual ~GarbageCollected(){}
@@ -47,6 +53,17 @@ public:
     /// comes from the original doc (see CycleDetector).
     refct_t gc_refs;
     
+    /// an immortal object isn't reference counted and isn't in a cycle
+    /// detector; it lives until it's deleted explicitly (see
+    /// Object::makeImmortal()). Only a frozen one can be used by any
+    /// thread, as others can still be changed (see
+    /// API::makeHeapImmortal()).
+    bool immortal;
+    
+    /// a frozen object can't be changed, and is immortal
+    /// (see Object::freeze())
+    bool frozen;
+    
     /// pointer for maintaining container list
     GarbageCollected *next; 
     /// pointer for maintaining container list
@@ -54,6 +71,8 @@ public:
     
     /// increment the refct, throwing an exception if it wraps
     void incRefCt(){
+        if(immortal)
+            return;
         refct++;
         dfprintf("++ incrementing count for %p, now %d\n",this,refct);
         if(refct==0)
@@ -62,6 +81,8 @@ public:
     
     /// decrement the reference count returning true if it became zero
     bool decRefCt(){
+        if(immortal)
+            return false;
         --refct;
         dfprintf("-- decrementing count for %p, now %d\n",this,refct);
         return refct==0;
@@ -126,6 +147,10 @@ enum AllocType{
           /// the d2 field contains a pool handle (see dict.h) for a dictionary key, which
           /// is a value. The d field contains a pointer to the dictionary itself.
           DictRefAlloc,
+          /// the d field points to a container Object being iterated (see forloop.h).
+          /// As well as counting a reference to it, the value stops the container's
+          /// hash table being reorganised while it exists.
+          ContainerView,
 };
 
 
@@ -144,8 +169,9 @@ enum AllocType{
 ///
 
 struct Type {
-    static char buf[1024];
-    static char buf2[1024];
+    /// scratch buffers for getStr() and repr(), one pair per thread
+    static __thread char buf[1024];
+    static __thread char buf2[1024];
     
     /// initialisation, just sets up the properties.
     Type();
@@ -167,6 +193,11 @@ struct Type {
         return this;
     }
     
+    /// is this a reference type, whose deref() returns another value? This
+    /// lets plain values skip the virtual deref() call, so any type which
+    /// overrides deref() must set it in its constructor.
+    bool isRef;
+    
     /// controls whether referents of this value are hashed at serialisation, so
     /// a=..., b=a outputs as "a=..., b=a" or "a=..., b=...". This would be silly for ints,
     /// but makes sense for objects.
@@ -337,6 +368,9 @@ struct Types {
     /// d.s is a pointer to another value, which this value
     /// references
     static Type *vtRef;
+    /// a reference to a global variable: d.s is a pointer to the
+    /// variable, as vtRef, and d2.s to the GlobalVars it's in
+    static Type *vtGlobalRef;
     /// d.s is a pointer to a NativeFuncData structure allocated
     /// on the heap
     static Type *vtNativeFunctionRef;
@@ -349,6 +383,10 @@ struct Types {
     /// for a property defined or undefined in the object. Because
     /// this refers to an object, it's VT_COMPLEX.
     static Type *vtPropRef;
+    /// d.o is a pointer to an object and d2.np describes one of its
+    /// C++ fields (see NativeProperty), which can be read and written
+    /// directly. Dereferencing it loads the field into the value itself.
+    static Type *vtFieldRef;
     /// the value is a string, to which the d.s pointer points.
     static Type *vtString;
     /// the value is a reference to an object
@@ -371,6 +409,23 @@ struct Types {
     static Type *vtListRef;
     /// a reference to a list object
     static Type *vtList;
+    /// a reference to a typed array of 32-bit ints
+    static Type *vtInt32Array;
+    /// a reference to a typed array of single-precision floats
+    static Type *vtFloat32Array;
+    /// a reference to a typed array of double-precision floats
+    static Type *vtFloat64Array;
+    /// a reference to an item in a typed array
+    static Type *vtTypedArrayRef;
+    /// a range of integers, created by range(). d.i is the bottom, d2.i
+    /// the top. When used as a for-loop's state, d.i is the next value.
+    static Type *vtRange;
+    /// a view of the keys of a container, created by keys(). d.o is the
+    /// container; when used as a for-loop's state, d2.i is the next position.
+    static Type *vtKeysView;
+    /// a view of the values of a container, created by values() or by
+    /// iterating over the container directly. As vtKeysView.
+    static Type *vtValuesView;
 };
 
 
@@ -381,6 +436,8 @@ inline void decRefSimpleMalloc(void *p){
     refct_t *ct;
     
     ct = (refct_t *)p;
+    if(*ct==IMMORTAL_REFCT)
+        return;
     (*ct)--;
     if(*ct==0){
         dfprintf("freeing %s\n",(((char *)p)+sizeof(refct_t)));
@@ -400,9 +457,13 @@ inline void dumprefsimplemalloc(const char *msg,void *p){
 inline void incRefSimpleMalloc(void *p){
     refct_t *ct;
     ct = (refct_t *)p;
+    if(*ct==IMMORTAL_REFCT)
+        return;
     (*ct)++;
-    if(!*ct)
+    if(*ct==IMMORTAL_REFCT){
+        (*ct)--;
         throw Exception("ref count too large");
+    }
 }
 
 
@@ -421,6 +482,7 @@ union ValUnion {
     u32 u;
     float f;
     class NativeFuncData *nd;
+    struct NativeProperty *np;
 };
 
 /// A Lana value, which can hold several different types of data
@@ -483,6 +545,9 @@ public:
         case DictRefAlloc:
             incDictKeyRef();
             break;
+        case ContainerView:
+            incViewRef();
+            break;
         default:break;
         }
     }
@@ -496,6 +561,7 @@ public:
         }
         case SimpleNew:
         case Complex:
+        case ContainerView:
             return d.gc->refct;
         case DictRefAlloc:
             // might not be accurate, since the key will also have a refct
@@ -504,6 +570,23 @@ public:
         }
     }
     
+    /// can any thread use this value, because it isn't reference counted
+    /// and can't be changed, as numbers, frozen objects and immortal
+    /// strings can't? (see thread.h)
+    bool isShareable(){
+        switch(getAllocType()){
+        case Unmanaged:
+            return true;
+        case SimpleMalloc:
+            return isStr() && *(refct_t *)d.s==IMMORTAL_REFCT;
+        case SimpleNew:
+        case Complex:
+            return d.gc->frozen;
+        default:
+            return false;
+        }
+    }
+    
     /// decrement a reference count and delete if it becomes zero. Or do nothing,
     /// depending on the type.
     
@@ -521,6 +604,10 @@ public:
             break;
         case DictRefAlloc:
             decDictKeyRef();
+            break;
+        case ContainerView:
+            decViewRef();
+            break;
         default:break;
         }
     }
@@ -531,6 +618,10 @@ public:
     /// separate out-of-line method to avoid making inlining all
     /// if decRef()
     void decDictKeyRef();
+    /// out-of-line reference counting for container views (see forloop.cpp)
+    void incViewRef();
+    /// out-of-line reference counting for container views (see forloop.cpp)
+    void decViewRef();
     
     
     /// comparison operator, used in hashes
@@ -552,8 +643,8 @@ public:
     /// used by copy ctor/operator
     void copy(const Value& source){
         clr();
-        d.u = source.d.u; 
-        d2.u = source.d2.u;
+        d = source.d;
+        d2 = source.d2;
         type = source.type;
         incRef();
     }
@@ -561,8 +652,8 @@ public:
     /// a copy constructor. Will increment reference counts.
     /// \todo{don't copy d2 if it's not used - perhaps have a d2-used bit?}
     Value(const Value& source){
-        d.u = source.d.u; 
-        d2.u = source.d2.u;
+        d = source.d;
+        d2 = source.d2;
         type = source.type;
         incRef();
     }
@@ -572,6 +663,7 @@ public:
         if(this != &source){
             copy(source);
         }
+        return *this;
     }
     
     /// get the type of the value
@@ -592,6 +684,14 @@ public:
         d2.u = id;
         type = Types::vtPropRef;
     }
+    /// set the value to a reference to a C++ field of an object
+    void setFieldRef(Object *o,struct NativeProperty *p) {
+        ((GarbageCollected *)o)->incRefCt();
+        clr();
+        d.o = o;
+        d2.np = p;
+        type = Types::vtFieldRef;
+    }
     /// set to a reference to a native method, containing the object pointer
     void setNativeMethodRef(Object *o,class NativeFuncData *nd){
         ((GarbageCollected *)o)->incRefCt();
@@ -622,6 +722,14 @@ public:
         d.i = i;
     }
     
+    /// set the value to a range of integers from b up to but not including t
+    void setRange(int b,int t){
+        clr();
+        type = Types::vtRange;
+        d.i = b;
+        d2.i = t;
+    }
+    
     /// set the value to a float
     void setFloat(float f){
         clr();
@@ -765,7 +873,8 @@ public:
     }
     
     /// this stores where we get constants from; Lana can change it.
-    static class Constants *consts;
+    /// It's set for each thread which runs code (see thread.h).
+    static __thread class Constants *consts;
     
     /// set the value of consts
     static void setConsts(class Constants *c){ 
@@ -92,6 +92,7 @@ public:
     
     GlobalVars(Constants *c) : Vars(c) {
         userFlag = false;
+        locked = false;
     }
     
     /// used by serialiser, and only for globals - is this a user defined global, or a system one
@@ -108,12 +109,25 @@ public:
     
     /// overrides create, setting the VARF_USER flag if setSystemGlobMarker() has been called.
     virtual int create(int namedesc,int flags=0){
-        Vars::create(namedesc,userFlag?VARF_USER:0);
+        if(locked)
+            throw Exception("cannot create global variables while threads are attached");
+        return Vars::create(namedesc,userFlag?VARF_USER:0);
     }
     
+    /// stop variables being created, which would move the others while
+    /// other threads might be using them (see thread.h)
+    void setLocked(bool l){
+        __atomic_store_n(&locked,l,__ATOMIC_RELAXED);
+    }
+    
+    /// are variables locked, because other threads are running?
+    bool isLocked(){
+        return __atomic_load_n(&locked,__ATOMIC_RELAXED);
+    }
     
 private:
     bool userFlag; //!< create all variables after this as user vars, which will get saved.
+    bool locked; //!< no variables can be created
     
 };
 
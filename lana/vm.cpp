@@ -13,17 +13,17 @@
 #include "vm.h"
 #include "object.h"
 #include "iterobj.h"
+#include "forloop.h"
+#include "regvm.h"
+#include "optimise.h"
+#include "session.h"
 
 
 
 void VirtualMachine::clearstacks(){
     // make sure all stack is cleared
-    while(!xstack.isempty()){
-        Value *v = xstack.popptr();
-        v->clr();
-    }
-    for(int i=0;i<vstacknext;i++)
-        vstack[i].clr();
+    xstack.flush();
+    vstack.flush();
     vstackbase=0;
     vstacknext=0;
     stkbase=0;
@@ -32,25 +32,32 @@ void VirtualMachine::clearstacks(){
 }
 
 void VirtualMachine::clearAndFlush(){
-    for(int i=0;i<EXSTACKSIZE;i++){
-        xstack.stack[i].clr();
-    }
-    for(int i=0;i<VSTACKSIZE;i++){
-        vstack[i].clr();
-    }
-    xstack.ct=0;
+    // only what's been used needs clearing
+    xstack.flush();
+    vstack.flush();
+    // an error in a function leaves its caller's return data behind,
+    // which would otherwise be returned to by the next OP_END
+    retstack.reset();
+    regdepth=0;
+    thisptr=NULL;
     
     vstackbase=0;
     vstacknext=0;
     stkbase=0;
     cvb.clear();
     locals = NULL;
+    retfloor = -1;
 }
 
 
 
 VirtualMachine::~VirtualMachine(){
     clearAndFlush();
+    while(regcode){
+        RegisterCode *n = regcode->next;
+        delete regcode;
+        regcode = n;
+    }
 }
     
 
@@ -83,13 +90,21 @@ void VirtualMachine::run(Session *ses){
     curSession = ses;
     for(;;){
         instct++;
+        // a call run a slice at a time stops when the slice is over
+        // (callStacked() turns slicing off while native code calls back)
+        if(slicing){
+            if(budget>0)
+                budget--;
+            else
+                return;
+        }
         if(df & LDEBUG_TRACE){
             const char *s = getSourceFile();
             if(line>=0)
-                printf("%2d EXEC %-45s\t%20s:%3d\t%s\n",retstack.ct,lana->dumpInst(ip,ses),s?s:"??",line,
+                printf("%2d EXEC %-45s\t%20s:%3d\t%s\n",retstack.depth(),lana->dumpInst(ip,ses),s?s:"??",line,
                        stkDump());
             else
-                printf("%2d EXEC %-45s\t%20s\t%s\n",retstack.ct,lana->dumpInst(ip,ses),s?s:"??",
+                printf("%2d EXEC %-45s\t%20s\t%s\n",retstack.depth(),lana->dumpInst(ip,ses),s?s:"??",
                        stkDump());
         }
         instruction op = *ip++;
@@ -98,13 +113,17 @@ void VirtualMachine::run(Session *ses){
             if(INSTDATA(op)) {
                 // if we do actually return a value, make sure it's dereferenced!
                 Value v = *popval();
+                dropLoops();
                 *xstack.pushptr() = v;
-            }
+            } else
+                dropLoops();
         case OP_END:
             if(rpop()){  // exit if out of stack!
                 curSession = NULL;
                 return;
             }
+            if(retstack.depth() == retfloor) // back out of a call()
+                return;
             break;
         case OP_FOR:
             // we look at the iterator and var but keep
@@ -116,13 +135,22 @@ void VirtualMachine::run(Session *ses){
             // stack is not an iterator object, we must change the value of the reference on the stack, NOT
             // the contents of the referred to variable, into an IterObj.
             b=a->deref(); // dereference into b
-            if(b->type != Types::vtIterObj) { // not an iterator object already
+            if(b->type == Types::vtIterObj)
+                a=b; // use the dereffed value
+            else if(!startLoop(a,b)) { // not something we can iterate inline (see forloop.h)
                 // here, we fudge up an iterator object out
                 // of the object if we can - and it's a value iterator.
                 IteratorObject *iterator = IteratorObject::create(lana->getAPI(),b,false);
                 a->setIterObj(iterator); // and we use that from now on, on the STACK - we do NOT set 'a', the referred to value.
-            } else
-                a=b; // use the dereffed value
+            }
+            
+            if(a->type != Types::vtIterObj){
+                // inline loop state; get the first item into the loop
+                // index ref, skipping the loop if there isn't one
+                if(!stepLoop(a,xstack.peekptr(1)))
+                    ip+=INSTDATA(op)-1;
+                break;
+            }
             
             a->d.iterobj->first(); // start iterator
             // are we already done (i.e iterator empty?)
@@ -145,8 +173,12 @@ void VirtualMachine::run(Session *ses){
             if(!a)
                 error("stack underflow");
             a=a->deref();
-            if(a->getType() != Types::vtIterObj)
-                error("can only iterate an iterator object");
+            if(a->getType() != Types::vtIterObj){
+                // inline loop state, which can only have been set up by OP_FOR
+                if(stepLoop(a,xstack.peekptr(1)))
+                    ip-=INSTDATA(op)+1;
+                break;
+            }
             
             a->d.iterobj->next(); // step the iterator
             // if not done, jump back to just after the FOR
@@ -162,7 +194,9 @@ void VirtualMachine::run(Session *ses){
             // which have been lying around on the stack all
             // through the loop. This needs to be separate from
             // the OP_NEXT because a lana "break" will jump here.
-            xstack.popptr(1); // pop 1 extra item, i.e. 2
+            // The loop state is cleared so that the container it
+            // refers to is released (and unpinned) now.
+            xstack.popptr(1)[1].clr(); // pop 1 extra item, i.e. 2
             break;
         case OP_THIS:
             if(!thisptr)
@@ -233,26 +267,9 @@ void VirtualMachine::run(Session *ses){
         case OP_LOCALS:
             {
                 LDTHeader *h = (LDTHeader *)consts->get(INSTDATA(op))->get();
-                
-                // make room for params and locals
-                vstackbase = vstacknext;
-                vstacknext += h->numlocals+h->numparams;
                 if(df & LDEBUG_TRACE)
                     printf("Locals : %d locals, %d parameters\n",h->numlocals,h->numparams);
-                
-                // pop params into first part of that space
-                int paramtop = vstacknext-h->numlocals;
-                for(int i=0;i<h->numparams;i++){
-                    vstack[paramtop-(i+1)] = *popval();
-                    if(df & LDEBUG_TRACE)
-                        printf("param n-%d : %s\n",i,a->deref()->repr());
-                }
-                
-                // set up the locals pointer
-                locals = vstack+vstackbase;
-                
-                // finally, drop the unneeded function pointer
-                xstack.popptr();
+                enterFrame(h->numparams,h->numlocals);
             }
             break;
         case OP_VARREFLOC:
@@ -266,10 +283,14 @@ void VirtualMachine::run(Session *ses){
             break;
         case OP_VARREFGLB:
             {
+                // reading through it is fine while threads are
+                // attached; storing through it isn't (see GlobalRefType)
                 int n = INSTDATA(op);
                 a = globs->get(n);
+                if(worker && !a->isShareable())
+                    unshareableGlobal(n);
                 b = xstack.pushptr();
-                b->setOther(Types::vtRef,(void *)a);
+                b->setOther(Types::vtGlobalRef,(void *)a,(void *)globs);
             }
             break;
         case OP_VARREFSES:
@@ -280,6 +301,21 @@ void VirtualMachine::run(Session *ses){
                 b->setOther(Types::vtRef,(void *)a);
             }
             break;
+            // the loads push a copy of a variable's value, for when it's
+            // only being read - see Compiler::emitVariableLoad()
+        case OP_LOADLOC:
+        case OP_LOADPRM:
+            *xstack.pushptr() = locals[INSTDATA(op)];
+            break;
+        case OP_LOADGLB:
+            a = globs->get(INSTDATA(op));
+            if(worker && !a->isShareable())
+                unshareableGlobal(INSTDATA(op));
+            *xstack.pushptr() = *a;
+            break;
+        case OP_LOADSES:
+            *xstack.pushptr() = *ses->getSesVar(INSTDATA(op));
+            break;
         case OP_SET:
             a = popval();
 	    if(a->type == Types::vtNativeMethodRef)
@@ -377,7 +413,51 @@ void VirtualMachine::run(Session *ses){
             doFuncCall(op);
             df = lana->debugFlags; // a bit of a waste, but a native call can change it
             break;
-        
+        case OP_CALLSITE:
+            doCallSite(op);
+            df = lana->debugFlags;
+            break;
+        case OP_TAILCALL:
+            // if it can't reuse the frame, the OP_RETURN after it
+            // returns the result
+            if(!tailCall(INSTDATA(op))){
+                doFuncCall(INST(OP_CALL,INSTDATA(op)));
+                df = lana->debugFlags;
+            }
+            break;
+            // an inlined function body - see Optimiser::inlineCalls().
+            // The operands are the call, the function and the slot of
+            // its first parameter.
+        case OP_INLINE:
+            j = INSTDATA(ip[0]);
+            a = xstack.peekptr(j);
+            if(a->type == Types::vtFunction && a->d.u == INSTDATA(ip[1])){
+                // it's still the same function, so pop the arguments
+                // into its parameters as OP_LOCALS would, and the
+                // function itself
+                b = locals+INSTDATA(ip[2]);
+                while(j--)
+                    b[j] = *popval();
+                xstack.popptr();
+                ip += 3;
+            } else {
+                // the variable has changed, so make the call after all,
+                // returning to just after the body
+                instruction call = *ip;
+                ip += INSTDATA(op)-1;
+                doFuncCall(call);
+                df = lana->debugFlags;
+            }
+            break;
+        case OP_INLINERET:
+            {
+                // the value is dereferenced, as OP_RETURN does
+                Value v = *popval();
+                *xstack.pushptr() = v;
+                ip += INSTDATA(op)-1;
+            }
+            break;
+
         case OP_ELSEIF:
         case OP_IF:
         case OP_QUICKIF:
@@ -431,6 +511,7 @@ void VirtualMachine::run(Session *ses){
             
         case OP_GOTOFW:
         case OP_BREAK:
+        case OP_CONTINUEFW:
             ip += INSTDATA(op)-1;
             break;
         case OP_GOTOBK:
@@ -468,28 +549,58 @@ void VirtualMachine::error(const char *s,...)
 }
 
 void VirtualMachine::rpush(){
+    if(!retstack.room())
+        retstack.enter(1);
     ReturnData *r = retstack.pushptr();
     r->ret = ip;
     r->thisptr = thisptr;
     r->vstackbase = vstackbase;
     r->vstacknext = vstacknext;
+    r->vseg = vstack.segment();
     r->stkbase = stkbase;
+    r->xseg = xstack.segment();
+    r->exprstackct = exprstackct;
     r->file = file;
     r->line = line;
 }
 
+void VirtualMachine::dropLoops(){
+    // a return from inside for-loops leaves their index refs and
+    // iterators on the stack, above where the function body started.
+    while(xstack.ct>stkbase)
+        xstack.popptr()->clr();
+}
+
 bool VirtualMachine::rpop(){
+    if(!retstack.ct && retstack.segment())
+        retstack.leave();
     ReturnData *r = retstack.popptrnoex();
     if(!r)
         return true;
     ip = r->ret;
     
+    // if the function had its own execution stack segment, what it
+    // returned is carried back to the caller's
+    if(xstack.segment()!=r->xseg){
+        int n = xstack.ct-stkbase;
+        Value *ret = xstack.stack+stkbase;
+        while(xstack.segment()!=r->xseg)
+            xstack.leave();
+        for(int i=0;i<n;i++){
+            *xstack.pushptr() = ret[i];
+            ret[i].clr();
+        }
+    }
+    while(vstack.segment()!=r->vseg)
+        vstack.leave();
+    
     file = r->file;
     line = r->line;
     vstackbase = r->vstackbase;
     vstacknext = r->vstacknext;
-    locals = vstack+vstackbase;
+    locals = vstack.stack+vstackbase;
     stkbase = r->stkbase;
+    exprstackct = r->exprstackct;
     
     // coming out of a method releases a reference
     if(thisptr)
@@ -501,7 +612,7 @@ bool VirtualMachine::rpop(){
 
 
 char *VirtualMachine::stkDump(){
-    static char stbuf[1024];
+    static __thread char stbuf[1024];
     stbuf[0]=0;
     for(int i=0;i<xstack.ct;i++){
     Value *v = xstack.stack+i;
@@ -547,26 +658,7 @@ void VirtualMachine::doFuncCall(instruction op){
         NativeFuncData *d = (NativeFuncData*)(fv->getPtr());
         if(d->argc!=argc)
             error("expected %d arguments, got %d",d->argc,argc);
-        
-        // we let the function run, popping its arguments off and pushing a return
-        // value on (perhaps)
-        
-        if(d->ismethod){
-            if(d->h) //a "hosted function", a bit like a delegate
-                (d->h->*(d->d.m))();
-            else
-                error("badly created hosted function ref with null host");
-        } else 
-            // it's just a function, taking the API as a pointer.
-            (*(d->d.f))((class API *)(d->h));
-        
-        // if the function returned a value, we swap the top two elements
-        // on the stack so that the function ref is on top.
-        if(d->returns)
-            xstack.swap();
-        
-        // We then drop the function ref, leaving the return value if there was one.
-        xstack.popptr();
+        callNative(d);
     } else if(fv->type == Types::vtNativeMethodRef){
         // The other native C++ code option. In this case, it's a reference to something
         // which is a method in a C++ object. The data contains both the object and the native func data.
@@ -577,22 +669,23 @@ void VirtualMachine::doFuncCall(instruction op){
         NativeFuncData *d = fv->d2.nd;
         if(d->argc!=argc)
             error("expected %d arguments, got %d",d->argc,argc);
-        
-        // we let the function run, popping its arguments off and pushing a return
-        // value on (perhaps)
-        
-        (o->*(d->d.m))();
-        
-        // if the function returned a value, we swap the top two elements
-        // on the stack so that the function ref is on top.
-        if(d->returns)
-            xstack.swap();
-        
-        // We then drop the function ref, leaving the return value if there was one.
-        xstack.popptr();
+        callNativeMethod(o,d);
     } else if(fv->type == Types::vtFunction){  
-        int *sizePtr = (int *)fv->getPtr(); // skip size data
-        instruction *p = (instruction *)(sizePtr+1);
+        // run it on the register VM if we can. It isn't used when
+        // tracing, which is done by the stack VM, or when running a
+        // call a slice at a time.
+        if((lana->opFlags & LOP_REGISTERVM) && !(lana->debugFlags & LDEBUG_TRACE) && !slicing){
+            RegisterCode *rc = getRegisterCode(fv);
+            if(rc){
+                if(rc->numparams!=argc)
+                    error("expected %d arguments, got %d",rc->numparams,argc);
+                runRegisters(rc,newthis);
+                return;
+            }
+        }
+        
+        int n;
+        instruction *p = getOptimisedCode(fv->getPtr(),&n);
         
         // this bit is a bit slow and revolting. See how it goes, it's just an extra check.
         // get the value of argc from the OP_LOCALS instruction, the first in the function
@@ -605,7 +698,6 @@ void VirtualMachine::doFuncCall(instruction op){
             error("expected %d arguments, got %d",ldt->numparams,argc);
         
         // now the check's done - we can push the context
-        stkbase=xstack.ct;
         rpush();
         thisptr = newthis;
         
@@ -626,12 +718,378 @@ void VirtualMachine::doFuncCall(instruction op){
 }
 
 
+void VirtualMachine::callNative(NativeFuncData *d){
+    if(d->thunk){
+        // a bound function: the thunk reads the arguments where they are
+        // and writes any result over the function, leaving us to drop
+        // the arguments and, if there's no result, the function
+        Value *args = xstack.stack+xstack.ct-d->argc;
+        (*d->thunk)(d,args,args-1);
+        xstack.ct -= d->returns ? d->argc : d->argc+1;
+        return;
+    }
+    
+    // we let the function run, popping its arguments off and pushing a return
+    // value on (perhaps)
+    
+    if(d->ismethod){
+        if(d->h) //a "hosted function", a bit like a delegate
+            (d->h->*(d->d.m))();
+        else
+            error("badly created hosted function ref with null host");
+    } else 
+        // it's just a function, taking the API as a pointer.
+        (*(d->d.f))((class API *)(d->h));
+    
+    // if the function returned a value, we swap the top two elements
+    // on the stack so that the function ref is on top.
+    if(d->returns)
+        xstack.swap();
+    
+    // We then drop the function ref, leaving the return value if there was one.
+    xstack.popptr();
+}
+
+void VirtualMachine::callNativeMethod(Object *o,NativeFuncData *d){
+    // as above, but calling a method of the object
+    (o->*(d->d.m))();
+    if(d->returns)
+        xstack.swap();
+    xstack.popptr();
+}
+
+void VirtualMachine::reserveFrame(int n){
+    Session *s = curSession;
+    int maxdepth = s ? s->getMaxDepth() : Session::DEFAULTMAXDEPTH;
+    if(retstack.depth()+regdepth > maxdepth)
+        error("too many nested calls (the limit is %d)",maxdepth);
+    if(vstacknext+n > vstack.size){
+        checkStackValues(n>VSEGSIZE ? n : VSEGSIZE);
+        vstack.enter(n);
+        vstacknext = 0;
+    }
+    vstack.mark(vstacknext+n);
+}
+
+void VirtualMachine::checkStackValues(int n){
+    Session *s = curSession;
+    int max = s ? s->getMaxStackValues() : Session::DEFAULTMAXSTACKVALUES;
+    if(xstack.capacity()+vstack.capacity()+n > max)
+        error("stacks too big (the limit is %d values)",max);
+}
+
+void VirtualMachine::enterFrame(int numparams,int numlocals){
+    // make room for params and locals
+    reserveFrame(numlocals+numparams);
+    vstackbase = vstacknext;
+    vstacknext += numlocals+numparams;
+    
+    // pop params into first part of that space
+    int paramtop = vstacknext-numlocals;
+    for(int i=0;i<numparams;i++)
+        vstack.stack[paramtop-(i+1)] = *popval();
+    
+    // set up the locals pointer
+    locals = vstack.stack+vstackbase;
+    
+    // drop the unneeded function pointer, and make sure the function
+    // has room for its expressions
+    xstack.popptr();
+    if(xstack.room()<XHEADROOM){
+        checkStackValues(XSEGSIZE);
+        xstack.enter(XHEADROOM);
+    }
+    stkbase=xstack.ct;
+}
+
+void VirtualMachine::growCallSites(int n){
+    CallSite c;
+    c.type = NULL;
+    callsites.resize(n+1,c);
+}
+
+void VirtualMachine::unshareableGlobal(int id){
+    error("global '%s' holds a value which only its own thread can use",
+          consts->getStr(globs->getName(id)));
+}
+
+void VirtualMachine::doCallSite(instruction op){
+    int argc = INSTDATA(op) & 0xff;
+    int site = INSTDATA(op)>>8;
+    if(site >= (int)callsites.size())
+        growCallSites(site);
+    CallSite *c = &callsites[site];
+    
+    // the register VM and tracing are left to doFuncCall()
+    if(c->type && !((lana->opFlags & LOP_REGISTERVM) && !slicing) && !(lana->debugFlags & LDEBUG_TRACE)){
+        Value *fv = xstack.peekptr(argc);
+        if(!fv)
+            error("no function on stack in call");
+        Object *newthis = fv->type==Types::vtPropRef ? fv->d.o : NULL;
+        fv = fv->deref();
+        
+        // if it's what was called last time, the checks have been done
+        if(fv->type == c->type){
+            if(fv->type == Types::vtFunction){
+                if(fv->d.u == c->func){
+                    rpush();
+                    thisptr = newthis;
+                    if(thisptr)
+                        thisptr->incRefCt();
+                    enterFrame(c->numparams,c->numlocals);
+                    ip = c->code;
+                    return;
+                }
+            } else if(fv->type == Types::vtNativeFunctionRef){
+                if(fv->d.nd == c->nd){
+                    callNative(c->nd);
+                    return;
+                }
+            } else if(fv->d2.nd == c->nd){
+                callNativeMethod(newthis?newthis:fv->d.o,c->nd);
+                return;
+            }
+        }
+    }
+    
+    // otherwise remember what's being called, if the checks pass, and
+    // call it as usual
+    c->type = NULL;
+    Value *fv = xstack.peekptr(argc);
+    if(fv){
+        fv = fv->deref();
+        if(fv->type == Types::vtFunction){
+            int n;
+            instruction *p = getOptimisedCode(fv->getPtr(),&n);
+            LDTHeader *ldt = INSTOP(p[0])==OP_LOCALS ?
+                  (LDTHeader *)consts->get(INSTDATA(p[0]))->get() : NULL;
+            if(ldt && ldt->numparams==argc){
+                c->type = fv->type;
+                c->func = fv->d.u;
+                c->code = p+1;
+                c->numparams = ldt->numparams;
+                c->numlocals = ldt->numlocals;
+            }
+        } else if(fv->type == Types::vtNativeFunctionRef || fv->type == Types::vtNativeMethodRef){
+            NativeFuncData *d = fv->type == Types::vtNativeFunctionRef ? fv->d.nd : fv->d2.nd;
+            if(d->argc==argc){
+                c->type = fv->type;
+                c->nd = d;
+            }
+        }
+    }
+    doFuncCall(INST(OP_CALL,argc));
+}
+
+bool VirtualMachine::tailCall(int argc){
+    // the register VM and tracing are left to doFuncCall(), as are the
+    // errors it reports
+    if(((lana->opFlags & LOP_REGISTERVM) && !slicing) || (lana->debugFlags & LDEBUG_TRACE))
+        return false;
+    Value *fv = xstack.peekptr(argc);
+    if(!fv)
+        error("no function on stack in call");
+    Object *newthis = fv->type==Types::vtPropRef ? fv->d.o : NULL;
+    Value *f = fv->deref();
+    if(f->type != Types::vtFunction)
+        return false;
+    int n;
+    instruction *p = getOptimisedCode(f->getPtr(),&n);
+    if(INSTOP(p[0])!=OP_LOCALS)
+        return false;
+    LDTHeader *ldt = (LDTHeader *)consts->get(INSTDATA(p[0]))->get();
+    if(ldt->numparams!=argc)
+        return false;
+    
+    // the arguments may refer to the frame which is about to be reused
+    for(int i=0;i<argc;i++){
+        Value *a = xstack.peekptr(i);
+        if(!a->type || a->type->isRef){
+            Value v = *a->deref();
+            *a = v;
+        }
+    }
+    
+    // the function and arguments replace any for-loop state left
+    // above the frame's base, as a return would drop it
+    int top = xstack.ct-(argc+1);
+    if(top>stkbase){
+        for(int i=stkbase;i<top;i++)
+            xstack.stack[i].clr();
+        for(int i=0;i<=argc;i++){
+            xstack.stack[stkbase+i] = xstack.stack[top+i];
+            xstack.stack[top+i].clr();
+        }
+        xstack.ct = stkbase+argc+1;
+    }
+    
+    // leave the current method, keeping what's being called alive
+    if(newthis)
+        newthis->incRefCt();
+    if(thisptr)
+        thisptr->decRefCt();
+    thisptr = newthis;
+    
+    // and enter the function where the current one's frame started,
+    // returning to where it would have returned
+    vstacknext = vstackbase;
+    enterFrame(ldt->numparams,ldt->numlocals);
+    ip = p+1;
+    return true;
+}
+
+void VirtualMachine::call(Value *fn,int argc,Value *args,Value *result){
+    // stack the function and arguments as OP_CALL expects
+    *xstack.pushptr() = *fn;
+    for(int i=0;i<argc;i++)
+        *xstack.pushptr() = args[i];
+    callStacked(argc,result);
+}
+
+void VirtualMachine::callWith(Session *s,Value *fn,int argc,Value *args,Value *result){
+    Session *oldses = curSession;
+    curSession = s;
+    try {
+        call(fn,argc,args,result);
+    } catch(RuntimeException &r) {
+        curSession = oldses;
+        throw r;
+    } catch(Exception &e) {
+        // such as a stack overflow, which leaves the stacks as they were
+        RuntimeException r(e.what(),getSourceFile(),getSourceLine());
+        clearAndFlush();
+        curSession = oldses;
+        throw r;
+    }
+    curSession = oldses;
+}
+
+void VirtualMachine::callStacked(int argc,Value *result){
+    int base = xstack.ct-argc-1;
+    Session *ses = curSession;
+    int oldexpr = exprstackct;
+    int oldfloor = retfloor;
+    int depth = retstack.depth();
+    // native code calling back into Lana needs the answer now, so even
+    // in a call being run a slice at a time (see resumeCall()) this runs
+    // to the end
+    bool oldslicing = slicing;
+    slicing = false;
+    
+    try {
+        doFuncCall(INST(OP_CALL,argc));
+        
+        if(retstack.depth() > depth){
+            // it's a user function, which has pushed a context - run it
+            // until it pops that context again.
+            retfloor = depth;
+            run(ses);
+            curSession = ses;
+        }
+    } catch(Exception &) {
+        retfloor = oldfloor;
+        slicing = oldslicing;
+        throw;
+    }
+    retfloor = oldfloor;
+    slicing = oldslicing;
+    exprstackct = oldexpr;
+    
+    if(xstack.ct > base){
+        Value *v = xstack.popptr();
+        *result = *v->deref();
+        v->clr();
+    } else
+        result->clr();
+}
+
+VirtualMachine::State::State(){
+    ip = NULL;
+    locals = NULL;
+    thisptr = NULL;
+    vstackbase = vstacknext = stkbase = exprstackct = 0;
+    file = line = Constants::NOTFOUND;
+    retfloor = -1;
+    regdepth = 0;
+    curSession = NULL;
+}
+
+void VirtualMachine::swapState(State *s){
+    xstack.exchange(s->xstack);
+    vstack.exchange(s->vstack);
+    retstack.exchange(s->retstack);
+    std::swap(ip,s->ip);
+    std::swap(locals,s->locals);
+    std::swap(thisptr,s->thisptr);
+    std::swap(vstackbase,s->vstackbase);
+    std::swap(vstacknext,s->vstacknext);
+    std::swap(stkbase,s->stkbase);
+    std::swap(exprstackct,s->exprstackct);
+    std::swap(file,s->file);
+    std::swap(line,s->line);
+    std::swap(retfloor,s->retfloor);
+    std::swap(regdepth,s->regdepth);
+    std::swap(curSession,s->curSession);
+    cvb.exchange(s->cvb);
+}
+
+bool VirtualMachine::startCall(Session *s,Value *fn,int argc,Value *args){
+    curSession = s;
+    *xstack.pushptr() = *fn;
+    for(int i=0;i<argc;i++)
+        *xstack.pushptr() = args[i];
+    // resumeCall()'s run() stops when the function returns, rather than
+    // going on into whatever's below it; slicing keeps the function off
+    // the register VM, which can't be stopped part way through
+    retfloor = 0;
+    slicing = true;
+    try {
+        doFuncCall(INST(OP_CALL,argc));
+    } catch(Exception &) {
+        slicing = false;
+        throw;
+    }
+    slicing = false;
+    return retstack.depth()==0;
+}
+
+bool VirtualMachine::resumeCall(Session *s,int n){
+    slicing = true;
+    budget = n;
+    try {
+        run(s);
+    } catch(Exception &) {
+        slicing = false;
+        throw;
+    }
+    slicing = false;
+    return retstack.depth()==0;
+}
+
+void VirtualMachine::finishCall(Value *result){
+    if(xstack.ct > 0){
+        Value *v = xstack.popptr();
+        *result = *v->deref();
+        v->clr();
+    } else
+        result->clr();
+    clearAndFlush();
+}
+
+void VirtualMachine::abandonCall(){
+    // return from every function, releasing the objects of methods
+    while(!rpop()){}
+    if(thisptr)
+        thisptr->decRefCt();
+    clearAndFlush();
+}
+
 void VirtualMachine::doSpecial(int spec){
     switch(spec){
     case 0: // dump locals
         printf("LOCALS DUMP\n");
         for(int i=vstackbase;i<vstacknext;i++){
-            Value *v = vstack+i;
+            Value *v = vstack.stack+i;
             printf("Local/param %d = %s\n",i,v->deref()->repr());
         }
         break;
@@ -7,8 +7,14 @@
  * the code.
  */
 
+#include <vector>
+#include <string.h>
+#include "stack.h"
 #include "object.h"
 #include "dict.h"
+#include "intkeyedhash.h"
+#include "cycle.h"
+#include "pool.h"
 
 namespace lana {
 
@@ -19,7 +25,10 @@ struct ReturnData {
     Object *thisptr; //!< "this"
     int vstackbase; //!< start of current function's local area on vstack
     int vstacknext; //!< where the next function's local area will start on vstack
-    int stkbase; //!< the depth of the main stack on function entry
+    int vseg; //!< the vstack segment they're in
+    int stkbase; //!< the depth of the main stack at the start of the function body
+    int xseg; //!< the main stack segment it's in
+    int exprstackct; //!< the depth of the main stack when the call's statement started
     constid file; //!< debugging data - filename constant string desc.
     constid line; //!< debugging data - current line
 };
@@ -35,6 +44,8 @@ struct ReturnData {
 /// being done and the dereffed value being used. There will also be a slight delay to finalisation
 /// of GC data, because the last reference will only be lost once the buffer wraps round and a value
 /// is overwritten. To deal with this, the buffer can be cleared from time to time.
+/// Plain C++ fields are better described with a NativeProperty table (see object.h),
+/// which the VM reads and writes directly without getprop() or this buffer.
 ///
 
 class CyclicValueBuffer {
@@ -67,13 +78,31 @@ public:
 	    count=0;
 	return v;
     }
+
+    /// exchange the contents with another buffer, without changing
+    /// any reference counts
+    void exchange(CyclicValueBuffer &o){
+	char tmp[sizeof(Value)];
+	for(int i=0;i<SIZE;i++){
+	    memcpy(tmp,(void *)&d[i],sizeof(Value));
+	    memcpy((void *)&d[i],(void *)&o.d[i],sizeof(Value));
+	    memcpy((void *)&o.d[i],tmp,sizeof(Value));
+	}
+	int c = count;
+	count = o.count;
+	o.count = c;
+    }
 };
 
 
-/// this is the Virtual Machine for Lana
+/// this is the Virtual Machine for Lana. There's one for each thread
+/// running code (see thread.h).
 class VirtualMachine {
 public:
-    VirtualMachine(class Language *l){
+    /// make a VM; a worker is one for a thread other than the one
+    /// which created the API
+    VirtualMachine(class Language *l,bool worker=false){
+        this->worker = worker;
         file = Constants::NOTFOUND;
         line = Constants::NOTFOUND;
         lana = l;
@@ -82,11 +111,61 @@ public:
         vstacknext=0;
         vstackbase=0;
         thisptr=NULL;
+        retfloor=-1;
+        regdepth=0;
+        instct=0;
+        regcode=NULL;
+        slicing=false;
+        budget=0;
     }
     ~VirtualMachine();
     
-    static const int VSTACKSIZE = 1024; //!< size of the variable stack
-    static const int EXSTACKSIZE = 128; //!< size of the execution stack
+    static const int VSEGSIZE = 256; //!< size of a variable stack segment
+    static const int XSEGSIZE = 128; //!< size of an execution stack segment
+    /// the execution stack room a function is given when it's entered
+    static const int XHEADROOM = 64;
+    
+    /// everything run() works on: the state of the code the VM is
+    /// running, which can be swapped out of the VM and back in again
+    /// later, so that one VM can take turns running many calls (see
+    /// sched.h). A new one is empty, as a new VM's is.
+    struct State {
+        State();
+        SegmentedStack<Value,XSEGSIZE> xstack;
+        SegmentedStack<Value,VSEGSIZE> vstack;
+        SegmentedStack<ReturnData,64> retstack;
+        instruction *ip;
+        Value *locals;
+        Object *thisptr;
+        int vstackbase,vstacknext,stkbase,exprstackct;
+        int file,line;
+        int retfloor,regdepth;
+        class Session *curSession;
+        CyclicValueBuffer cvb;
+    };
+    
+    /// exchange the state of the code being run with another
+    void swapState(State *s);
+    
+    /// start a call of a function in the state swapped in, which must
+    /// be empty, without running any of it. Returns true if it's
+    /// already finished, as a call of a native function will have.
+    /// Errors are thrown as usual.
+    bool startCall(class Session *s,Value *fn,int argc,Value *args);
+    
+    /// carry on with the call in the state swapped in for n
+    /// instructions, not counting those run by native code calling back
+    /// into Lana (which runs to the end), returning true once it's
+    /// finished. Calls made while it runs aren't handed to
+    /// the register VM, which can't be stopped part way through.
+    bool resumeCall(class Session *s,int n);
+    
+    /// get what a finished call returned, leaving the state empty again
+    void finishCall(Value *result);
+    
+    /// give up a call which hasn't finished, releasing everything it
+    /// holds and leaving the state empty again
+    void abandonCall();
     
     /// set the start and reset the system, then call run(). We need to tell
     /// the system what the session is so it can find session variables.
@@ -94,12 +173,35 @@ public:
     
     /// the core of the interpreter - run from current instruction address
     /// until OP_RETURN or OP_END executes with an empty return stack,
+    /// or returns to the level at which call() was made.
     void run(Session *s);
     
+    /// what an OP_CALLSITE called last time, so that calling it again can
+    /// skip straight to running it
+    struct CallSite {
+        Type *type;          //!< the type of the function, NULL if none yet
+        u32 func;            //!< a user function's constant ID
+        class NativeFuncData *nd; //!< a native function's data
+        instruction *code;   //!< a user function's code after its OP_LOCALS
+        int numparams,numlocals;
+    };
+    
+    /// call a function (user or native) from inside native code which
+    /// is itself running in the VM - for example, a sort comparator.
+    /// The result is copied into result, which is set to None if
+    /// the function doesn't return anything.
+    void call(Value *fn,int argc,Value *args,Value *result);
+    
+    /// call a function as call() does, but from outside the VM as well
+    /// as from inside it, with a session for its session variables
+    /// (see API::call()). Any error leaves the VM reset.
+    void callWith(class Session *s,Value *fn,int argc,Value *args,Value *result);
+    
     /// pop a value and deference until it's just a plain value
     Value *popval(){
         Value *v = xstack.popptr();
-        v=v->deref();
+        if(!v->type || v->type->isRef) // most values are already plain
+            v=v->deref();
         if(v->type == Types::vtObject){
             if(v->d.gc->refct==0)
                 error("snark");
@@ -160,10 +262,27 @@ public:
     class Session *curSession;
     
 
+    /// the cycle detector holding the objects this VM's thread makes
+    CycleDetector cycle;
+    
+    /// the keys of the dictionary references this VM's thread makes
+    /// (see Dict::allocKey())
+    Pool<Value,1024> dictKeys;
+    
     /// the cyclic value buffer for user value allocations. Ugh.
     CyclicValueBuffer cvb;
     
 private:
+    /// is this VM running in a thread other than the one which created the API?
+    bool worker;
+    
+    /// throw the error for a global a worker can't read (see thread.h)
+    void unshareableGlobal(int id);
+    
+    /// make room for call sites up to n, which may have been numbered
+    /// after this VM was made (see Language::newCallSite())
+    void growCallSites(int n);
+
     class Language *lana;
     class Constants *consts;
     class Vars *globs;
@@ -171,12 +290,55 @@ private:
     /// debugging instruction counter
     int instct;
     
+    /// set while resumeCall() runs a call a slice at a time
+    bool slicing;
+    /// the instructions left in the slice, which ends when there are
+    /// none left
+    int budget;
+    
     
     /// do a function call
     void doFuncCall(instruction op);
+    /// do a function call from an OP_CALLSITE
+    void doCallSite(instruction op);
+    /// do an OP_TAILCALL in the current frame if it's to a user function
+    /// the stack VM can run, returning false if it must be called as usual
+    bool tailCall(int argc);
+    /// set up a user function's frame, as OP_LOCALS does
+    void enterFrame(int numparams,int numlocals);
+    /// check the session's limits before entering a frame of n values,
+    /// moving on to a new segment of the variable stack if it won't fit
+    /// in this one. The stacks are only checked on entry to a function.
+    void reserveFrame(int n);
+    /// check that the stacks can take another segment of n values
+    void checkStackValues(int n);
+    /// call a native function which isn't a method
+    void callNative(class NativeFuncData *d);
+    /// call a native method of an object
+    void callNativeMethod(Object *o,class NativeFuncData *d);
+    
+    /// the call sites, indexed by OP_CALLSITE
+    std::vector<CallSite> callsites;
+    
+    /// call the function below argc arguments on the stack, as call()
+    /// does, but with the function and arguments already stacked
+    void callStacked(int argc,Value *result);
+    
+    /// get the register code for a user function, lowering it the first
+    /// time, or NULL if it can't be lowered (see regvm.h)
+    class RegisterCode *getRegisterCode(Value *fv);
+    
+    /// run a lowered function whose arguments are on the stack, leaving
+    /// the result (if any) on the stack as a native function does
+    void runRegisters(class RegisterCode *rc,Object *newthis);
+    
+    /// lowered code by function constant ID, NULL where lowering failed
+    IntKeyedHash<class RegisterCode *> lowered;
+    class RegisterCode *regcode; //!< list of all lowered code, to delete
     
     void rpush(); //!< push execution context
     bool rpop(); //!< pop execution context, return false if there isn't any more
+    void dropLoops(); //!< clear the main stack down to the start of the function body
     
     /// completely clear the execution stack
     /// and the variable stack
@@ -188,20 +350,23 @@ private:
     
     // execution context
     
-    SimpleStack<Value,EXSTACKSIZE> xstack;	//!< execution stack
+    SegmentedStack<Value,XSEGSIZE> xstack;	//!< execution stack
     instruction *ip; 	//!< instruction pointer
     Value *locals;	//!< local variable table
     Object *thisptr;	//!< current object pointer
     
-    Value vstack[VSTACKSIZE]; //!< variable stack    
+    /// variable stack, in whose current segment frames start at vstackbase
+    SegmentedStack<Value,VSEGSIZE> vstack;
     int vstackbase;           //!< variable stack base for current function
     int vstacknext;           //!< variable stack base for next function: vstackbase+nlocals+nparams
-    int stkbase; //!< the depth of the main stack on function entry
+    int stkbase; //!< the depth of the main stack at the start of the function body
     int exprstackct; //!< the depth of the main stack on entering a stmt-expr - is reset to this afterwards. See OP_STARTESTMT/OP_ENDESTMT
     int file; //!< debugging data - filename constant string desc.
     int line; //!< debugging data - current line
     
-    SimpleStack<ReturnData,128> retstack; //!< return stack
+    SegmentedStack<ReturnData,64> retstack; //!< return stack
+    int retfloor; //!< depth of the return stack at which a call() should stop running, or -1
+    int regdepth; //!< the number of register VM frames being run
     
     char *stkDump(); //!< debugging routine, returns a representation of the stack
     
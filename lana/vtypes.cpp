@@ -17,6 +17,9 @@
 #include "intkeyedhash.h"
 #include "dict.h"
 #include "list.h"
+#include "typedarray.h"
+#include "forloop.h"
+#include "vars.h"
 
 using namespace lana;
 
@@ -26,10 +29,12 @@ Type *Types::vtComment=NULL;
 Type *Types::vtFunction=NULL;
 Type *Types::vtLDT=NULL;
 Type *Types::vtRef=NULL;
+Type *Types::vtGlobalRef=NULL;
 Type *Types::vtNativeFunctionRef=NULL;
 Type *Types::vtStringConst=NULL;
 Type *Types::vtBoolean=NULL;
 Type *Types::vtPropRef=NULL;
+Type *Types::vtFieldRef=NULL;
 Type *Types::vtString=NULL;
 Type *Types::vtObject=NULL;
 Type *Types::vtDictionary=NULL;
@@ -39,6 +44,13 @@ Type *Types::vtListRef=NULL;
 Type *Types::vtDictRef=NULL;
 Type *Types::vtDeleted=NULL;
 Type *Types::vtNativeMethodRef=NULL;
+Type *Types::vtInt32Array=NULL;
+Type *Types::vtFloat32Array=NULL;
+Type *Types::vtFloat64Array=NULL;
+Type *Types::vtTypedArrayRef=NULL;
+Type *Types::vtRange=NULL;
+Type *Types::vtKeysView=NULL;
+Type *Types::vtValuesView=NULL;
 
 #include "fasthash.h"
 /// head of list
@@ -69,11 +81,17 @@ void Types::createTypes(API *a){
     vtStringConst=addt((new StringConstType)->set(Unmanaged,false,"stringconst","SC"));
     vtBoolean=addt((new BooleanType)->set(Unmanaged,false,"boolean","B"));
     vtPropRef=addt((new PropRefType)->set(Complex,false,"propref","PR"));
+    vtFieldRef=addt((new FieldRefType)->set(Complex,false,"fieldref","FR"));
     vtString=addt((new StringType)->set(SimpleMalloc,false,"string","S"));
     vtObject=addt((new ObjectType)->set(Complex,true,"object","O"));
     vtDictRef=addt((new DictRefType)->set(DictRefAlloc,false,"dictref","DR"));
     vtListRef=addt((new ListRefType)->set(Complex,false,"listref","LR"));
     vtDeleted=addt((new Type)->set(Unmanaged,false,"deletedkey","DelKey"));
+    vtTypedArrayRef=addt((new TypedArrayRefType)->set(Complex,false,"typedarrayref","TAR"));
+    vtRange=addt((new RangeType(a))->set(Unmanaged,false,"range","RNG"));
+    vtKeysView=addt((new ViewType(a,true))->set(ContainerView,false,"keysview","KV"));
+    vtValuesView=addt((new ViewType(a,false))->set(ContainerView,false,"valuesview","VV"));
+    vtGlobalRef=addt((new GlobalRefType)->set(Unmanaged,false,"GlobalRef","GR"));
     
     // anything which is an object, where the type holds a prototype,
     // needs to be down here
@@ -81,6 +99,9 @@ void Types::createTypes(API *a){
     vtIterObj=addt((new IterObjectType(a))->set(Complex,false,"iteratorobject","IO"));
     vtDictionary=addt((new DictionaryType(a))->set(Complex,true,"dictionary","Dict"));
     vtList=addt((new ListType(a))->set(Complex,true,"list","LST"));
+    vtInt32Array=addt((new TypedArrayType(a,TA_INT32))->set(Complex,true,"int32array","I32A"));
+    vtFloat32Array=addt((new TypedArrayType(a,TA_FLOAT32))->set(Complex,true,"float32array","F32A"));
+    vtFloat64Array=addt((new TypedArrayType(a,TA_FLOAT64))->set(Complex,true,"float64array","F64A"));
 }
 
 void Types::deleteTypes(){
@@ -235,6 +256,12 @@ u32 StringType::getHash(const Value *v) const {
     return fastHash(s,strlen(s));
 }
 
+void GlobalRefType::store(Value *ref,Value *v){
+    if(((GlobalVars *)ref->d2.s)->isLocked())
+        throw Exception("cannot change global variables while threads are attached");
+    RefType::store(ref,v);
+}
+
 char *StringConstType::getStr(const Value *v) const {
     return (char *)Value::consts->getStr(v->d.u);
 }
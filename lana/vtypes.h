@@ -225,6 +225,9 @@ struct FloatType : public SimpleHashableType {
 
 /// the type for references to variables
 struct RefType : public Type {
+    RefType(){
+        isRef = true;
+    }
     virtual Value *deref(Value *v){
         return (Value *)v->d.s;
     }
@@ -234,6 +237,12 @@ struct RefType : public Type {
     }
 };
 
+/// the type for references to global variables, which can't be
+/// stored through while threads are attached (see thread.h)
+struct GlobalRefType : public RefType {
+    virtual void store(Value *ref,Value *v);
+};
+
 /// the type for boolean values
 struct BooleanType : public SimpleHashableType {
     virtual bool getBool(const Value *v) const {
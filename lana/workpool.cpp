@@ -0,0 +1,234 @@
+/** @file
+ * The work pool's threads, and how they share out a job's items
+ * (see workpool.h).
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "api.h"
+#include "language.h"
+#include "vm.h"
+#include "vars.h"
+#include "workpool.h"
+
+using namespace lana;
+
+/// the pool the calling thread belongs to, if any
+static __thread WorkPool *threadPool = NULL;
+
+WorkPool::WorkPool(API *a,int n){
+    api = a;
+    nthreads = n<1 ? 1 : n;
+    generation = 0;
+    running = 0;
+    quit = false;
+    job = NULL;
+    jobSes = NULL;
+    failed = false;
+    error[0] = 0;
+    pthread_mutex_init(&m,NULL);
+    pthread_cond_init(&go,NULL);
+    pthread_cond_init(&done,NULL);
+
+    workers = new Worker[nthreads];
+    for(int i=0;i<nthreads;i++){
+        Worker *w = workers+i;
+        w->pool = this;
+        w->ses = NULL;
+        w->lo = w->hi = 0;
+        pthread_create(&w->thread,NULL,threadMain,w);
+    }
+}
+
+WorkPool::~WorkPool(){
+    pthread_mutex_lock(&m);
+    quit = true;
+    pthread_cond_broadcast(&go);
+    pthread_mutex_unlock(&m);
+    for(int i=0;i<nthreads;i++)
+        pthread_join(workers[i].thread,NULL);
+    delete [] workers;
+
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&go);
+    pthread_mutex_destroy(&m);
+}
+
+void *WorkPool::threadMain(void *p){
+    Worker *w = (Worker *)p;
+    WorkPool *pool = w->pool;
+    threadPool = pool;
+
+    // the pool counts us as running code while it has a job for us
+    pool->api->lana->attachThread(false);
+    w->ses = new Session(pool->api);
+
+    int seen = 0;
+    pthread_mutex_lock(&pool->m);
+    for(;;){
+        while(!pool->quit && pool->generation==seen)
+            pthread_cond_wait(&pool->go,&pool->m);
+        if(pool->quit)
+            break;
+        seen = pool->generation;
+
+        pthread_mutex_unlock(&pool->m);
+        pool->work(w);
+        pthread_mutex_lock(&pool->m);
+
+        if(!--pool->running)
+            pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->m);
+
+    delete w->ses;
+    pool->api->lana->detachThread();
+    return NULL;
+}
+
+void WorkPool::run(WorkJob *j,Session *ses,int n,int g){
+    if(threadPool==this)
+        throw Exception("the work pool's threads can't give it work themselves");
+    if(n<=0)
+        return;
+
+    Language *lana = api->lana;
+    pthread_mutex_lock(&m);
+    // another thread could be using the pool
+    while(job)
+        pthread_cond_wait(&done,&m);
+
+    lana->beginThreaded();
+    job = j;
+    jobSes = ses;
+    grain = g<1 ? 1 : g;
+    __atomic_store_n(&failed,false,__ATOMIC_RELAXED);
+    error[0] = 0;
+    // each thread starts with an equal share
+    for(int i=0;i<nthreads;i++){
+        Worker *w = workers+i;
+        MutexLock l(w->lock);
+        w->lo = (int)(((long long)n*i)/nthreads);
+        w->hi = (int)(((long long)n*(i+1))/nthreads);
+    }
+    running = nthreads;
+    generation++;
+    pthread_cond_broadcast(&go);
+
+    while(running)
+        pthread_cond_wait(&done,&m);
+    job = NULL;
+    jobSes = NULL;
+    lana->endThreaded();
+    // wake anyone waiting to use the pool
+    pthread_cond_broadcast(&done);
+    pthread_mutex_unlock(&m);
+
+    if(failed)
+        throw Exception(error);
+}
+
+void WorkPool::work(Worker *w){
+    try {
+        copySession(w->ses);
+        int from,to;
+        while(!__atomic_load_n(&failed,__ATOMIC_RELAXED)){
+            if(!take(w,&from,&to)){
+                if(!steal(w))
+                    break;
+                continue;
+            }
+            job->runRange(w->ses,from,to);
+        }
+    } catch(Exception &e) {
+        pthread_mutex_lock(&m);
+        if(!failed){
+            strncpy(error,e.what(),sizeof(error)-1);
+            error[sizeof(error)-1] = 0;
+            __atomic_store_n(&failed,true,__ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&m);
+    }
+}
+
+bool WorkPool::take(Worker *w,int *from,int *to){
+    MutexLock l(w->lock);
+    if(w->lo >= w->hi)
+        return false;
+    *from = w->lo;
+    *to = w->hi-w->lo > grain ? w->lo+grain : w->hi;
+    w->lo = *to;
+    return true;
+}
+
+bool WorkPool::steal(Worker *w){
+    for(;;){
+        // find the thread with most left; this is only a guess, as
+        // they're changing, so it's checked again under its lock
+        Worker *victim = NULL;
+        int most = 0;
+        for(int i=0;i<nthreads;i++){
+            Worker *v = workers+i;
+            if(v==w)
+                continue;
+            MutexLock l(v->lock);
+            if(v->hi-v->lo > most){
+                most = v->hi-v->lo;
+                victim = v;
+            }
+        }
+        if(!victim)
+            return false;
+
+        int lo,hi;
+        {
+            MutexLock l(victim->lock);
+            int left = victim->hi-victim->lo;
+            if(left<=0)
+                continue; // it got there first; look again
+            lo = victim->lo + left/2;
+            hi = victim->hi;
+            victim->hi = lo;
+        }
+        MutexLock l(w->lock);
+        w->lo = lo;
+        w->hi = hi;
+        return true;
+    }
+}
+
+void WorkPool::copySession(Session *dest){
+    Vars *src = jobSes->vars;
+    Vars *d = dest->vars;
+
+    // functions refer to session variables by slot, so each must be
+    // in the same slot in both
+    IteratorPtr<int> iterator(src->createIterator());
+    for(iterator->first();!iterator->isDone();iterator->next()){
+        int i = iterator->current();
+        int name = src->getName(i);
+        int j = d->find(name);
+        if(j<0)
+            j = d->create(name);
+        if(j!=i)
+            throw Exception("session variables can't be copied to the work pool");
+        Value *v = d->get(j);
+        if(!copyAcross(v,src->get(i)))
+            v->clr();
+    }
+}
+
+bool WorkPool::copyAcross(Value *dest,Value *src){
+    // frozen objects and immortal strings aren't counted or changed, so
+    // can be shared
+    if(src->isShareable()){
+        *dest = *src;
+        return true;
+    }
+    if(src->getAllocType()==SimpleMalloc && src->isStr()){
+        dest->setStrClone(src->getStr());
+        return true;
+    }
+    return false;
+}
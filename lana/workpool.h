@@ -0,0 +1,125 @@
+/**
+ * @file
+ * The work pool, a set of threads which run Lana code in parallel for
+ * pmap(), pfilter() and preduce().
+ *
+ * Each of the pool's threads is attached to the API with a VM and a
+ * session of its own (see thread.h), and waits for work. A job is a
+ * number of items, handed out as ranges: each thread starts with an
+ * equal share, and takes a few items at a time from the front of it.
+ * A thread which runs out steals the back half of the largest share
+ * left, so that the threads finish together even when the items take
+ * different times to run.
+ *
+ * The thread which runs a job waits until it's finished, so while it
+ * runs nothing else is using the values it was given. The threads can
+ * read them, but mustn't copy anything reference counted from them -
+ * see copyAcross().
+ */
+
+#ifndef __WORKPOOL_H
+#define __WORKPOOL_H
+
+#include "thread.h"
+
+namespace lana {
+
+/// a job for a WorkPool: a number of items, run in ranges by the
+/// pool's threads
+
+class WorkJob {
+public:
+    virtual ~WorkJob(){}
+
+    /// run the items from "from" up to (but not including) "to" in a
+    /// thread of the pool, in the session given. Errors are thrown as
+    /// usual.
+    virtual void runRange(class Session *ses,int from,int to)=0;
+};
+
+/// a pool of threads, each with its own VM and session, which run
+/// WorkJobs
+
+class WorkPool {
+public:
+    /// start n threads for an API
+    WorkPool(class API *a,int n);
+    /// stop and delete the threads
+    ~WorkPool();
+
+    /// get the number of threads
+    int getThreadCount(){
+        return nthreads;
+    }
+
+    /// run a job of n items, taking grain of them at a time, and
+    /// return when they've all been run. The threads' sessions are
+    /// given copies of what copyAcross() can copy of the variables in
+    /// ses, so that functions defined in it can be called. If any range
+    /// throws, no more are started and the first error is thrown here
+    /// as a RuntimeException.
+    void run(WorkJob *job,class Session *ses,int n,int grain);
+
+    /// copy a value which belongs to another thread, which mustn't be
+    /// using it. Numbers, booleans, functions and other values which
+    /// aren't reference counted, such as frozen objects, are copied as
+    /// they are, and strings are duplicated; anything else can't be, so
+    /// false is returned and dest is left alone.
+    static bool copyAcross(class Value *dest,class Value *src);
+
+private:
+    /// one of the threads
+    struct Worker {
+        WorkPool *pool;
+        pthread_t thread;
+        class Session *ses; //!< its session, made by the thread itself
+        Mutex lock;         //!< held to change its range
+        int lo,hi;          //!< the items it has left to run
+    };
+
+    /// the thread's main loop
+    static void *threadMain(void *w);
+    /// run the current job in a thread
+    void work(Worker *w);
+    /// take the next few items from the front of a thread's range,
+    /// returning false if there are none
+    bool take(Worker *w,int *from,int *to);
+    /// steal the back half of the largest range left into a thread's
+    /// own range, returning false if there's nothing left to steal
+    bool steal(Worker *w);
+    /// copy the variables of the job's session into a thread's
+    void copySession(class Session *dest);
+
+    class API *api;
+    int nthreads;
+    Worker *workers;
+
+    pthread_mutex_t m;   //!< held to change the fields below
+    pthread_cond_t go;   //!< signalled when there's a new job, or to quit
+    pthread_cond_t done; //!< signalled when the last thread finishes
+    int generation;      //!< incremented for each job
+    int running;         //!< the number of threads still on this one
+    bool quit;           //!< set when the threads should exit
+
+    WorkJob *job;        //!< the current job
+    class Session *jobSes; //!< the session it was run from
+    int grain;           //!< how many items to take at a time
+    bool failed;         //!< set when a range has thrown
+    char error[1024];    //!< the first error thrown
+};
+
+/// call fn on each item of a list in the work pool, setting result to
+/// a list of what it returns, or (if filter is set) of the items for
+/// which it returns true; see parallel.cpp
+void parallelMap(class API *api,class List *l,class Value *fn,
+                 class Value *result,bool filter);
+
+/// fold a list with fn, starting with init, in the work pool. Ranges of
+/// the list are folded separately and the results folded in order, so
+/// fn must be associative.
+void parallelReduce(class API *api,class List *l,class Value *fn,
+                    class Value *init,class Value *result);
+
+}
+
+#endif /* __WORKPOOL_H */
@@ -0,0 +1,47 @@
+#include "tests.h"
+#include "lana/actor.h"
+
+void TestFixtureLana::testActors(){
+    ses->feedFile("files/actors.l");
+
+    // an actor which fails makes join() throw, once
+    ses->feed("abad = function(x)");
+    ses->feed("    return x.nothing");
+    ses->feed("end");
+    ses->feed("aid = spawn(abad,1)");
+    CPPUNIT_ASSERT_THROW(ses->feed("join(aid)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("join(aid)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("join(self())"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("join(9999)"),lana::RuntimeException);
+
+    // finished actors aren't sent anything
+    ses->feed("assert(!send(aid,1))");
+    CPPUNIT_ASSERT_THROW(ses->feed("send(9999,1)"),lana::RuntimeException);
+
+    // typed arrays can't be sent, passed to an actor or returned
+    CPPUNIT_ASSERT_THROW(ses->feed("send(0,int32array(4))"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("spawn(tri,int32array(4))"),lana::RuntimeException);
+    ses->feed("mkarr = function(x)");
+    ses->feed("    return int32array(x)");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("join(spawn(mkarr,4))"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("spawn(3,4)"),lana::RuntimeException);
+
+    // the C++ API, sending to the API's own thread
+    lana::ActorSystem *as = api->getActors();
+    CPPUNIT_ASSERT(as->self()==0);
+    lana::Value v,r;
+    CPPUNIT_ASSERT(!as->receive(&r,0));
+    v.setStrClone("hello");
+    CPPUNIT_ASSERT(as->send(0,&v));
+    v.setInt(3);
+    CPPUNIT_ASSERT(as->send(0,&v));
+    CPPUNIT_ASSERT(as->receive(&r,10));
+    CPPUNIT_ASSERT(!strcmp(r.getStr(),"hello"));
+    CPPUNIT_ASSERT(as->receive(&r));
+    CPPUNIT_ASSERT(r.getInt()==3);
+    CPPUNIT_ASSERT(!as->receive(&r,10));
+
+    // and nothing is left running
+    CPPUNIT_ASSERT(api->getThreadCount()==0);
+}
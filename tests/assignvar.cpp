@@ -23,8 +23,27 @@ void TestFixtureLana::testAssignVar(){
         ses->feed("boz=bar");
         CPPUNIT_ASSERT_BOOLTEST("boz==\"hello world\"",true);
         CPPUNIT_ASSERT_BOOLTEST("boz==\"Hello world\"",false); // case independence
-        
-        
+
+        // variables which are read are loaded as copies, and only turned
+        // into references when assigned to - check the odder cases.
+        ses->feed("bar=3");
+        ses->feed("boz=bar");
+        CPPUNIT_ASSERT_INTVAR("boz",3);
+        ses->feed("(bar)=4");
+        CPPUNIT_ASSERT_INTVAR("bar",4);
+        ses->feed("boz=bar+boz");
+        CPPUNIT_ASSERT_INTVAR("boz",7);
+
+        ses->feed("assignf = function(x)");
+        ses->feed("    y = x");
+        ses->feed("    x = x+1");
+        ses->feed("    return x*10+y");
+        ses->feed("end");
+        ses->feed("bar=assignf(boz)");
+        CPPUNIT_ASSERT_INTVAR("bar",87);
+        CPPUNIT_ASSERT_INTVAR("boz",7);
+
+
     } catch(lana::Exception &e){
         const char *s = ses->getLastLine();
         char buf[1024];
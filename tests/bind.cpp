@@ -0,0 +1,92 @@
+#include "tests.h"
+
+// functions bound by testBinding()
+
+static int bdnotes = 0;
+
+static int bdadd(int a,int b){
+    return a+b;
+}
+static float bdmix(int a,float b,bool c){
+    return c ? a*b : a-b;
+}
+static bool bdodd(int i){
+    return i%2!=0;
+}
+static const char *bdgreet(const char *s){
+    static char buf[64];
+    snprintf(buf,64,"hello %s",s);
+    return buf;
+}
+static void bdnote(int n){
+    bdnotes += n;
+}
+static int bdseven(){
+    return 7;
+}
+static const char *bdtype(lana::Value *v){
+    return v->type->getName(false);
+}
+
+void TestFixtureLana::testBinding(){
+    api->bind("bdadd",&bdadd);
+    api->bind("bdmix",&bdmix);
+    api->bind("bdodd",&bdodd);
+    api->bind("bdgreet",&bdgreet);
+    api->bind("bdnote",&bdnote);
+    api->bind("bdseven",&bdseven);
+    api->bind("bdtype",&bdtype);
+    
+    // each kind of argument and result, with arguments converted as
+    // the API's pop methods would
+    ses->feed("bdr = bdadd(3,4)");
+    CPPUNIT_ASSERT_INTVAR("bdr",7);
+    ses->feed("bdr = bdadd(\"30\",2.9)");
+    CPPUNIT_ASSERT_INTVAR("bdr",32);
+    ses->feed("bdr = int(bdmix(3,2.5,true)*10)");
+    CPPUNIT_ASSERT_INTVAR("bdr",75);
+    ses->feed("bdr = int(bdmix(3,2.5,false)*10)");
+    CPPUNIT_ASSERT_INTVAR("bdr",5);
+    ses->feed("bdr = bdseven()+bdseven()");
+    CPPUNIT_ASSERT_INTVAR("bdr",14);
+    CPPUNIT_ASSERT_BOOLTEST("bdodd(3)",true);
+    CPPUNIT_ASSERT_BOOLTEST("bdodd(4)",false);
+    CPPUNIT_ASSERT_BOOLTEST("bdgreet(\"world\")==\"hello world\"",true);
+    CPPUNIT_ASSERT_BOOLTEST("bdgreet(12)==\"hello 12\"",true);
+    CPPUNIT_ASSERT_BOOLTEST("bdtype(list())==bdtype(list())",true);
+    CPPUNIT_ASSERT_BOOLTEST("bdtype(1)!=bdtype(1.0)",true);
+    ses->feed("bdnote(5)");
+    CPPUNIT_ASSERT(bdnotes==5);
+    
+    // called many times from a function, through its call sites, as an
+    // expression and as a statement, and from C++ through a handle
+    ses->feed("bdloop = function(n)");
+    ses->feed("    t = 0");
+    ses->feed("    for i in range(0,n)");
+    ses->feed("        t = bdadd(t,i)");
+    ses->feed("        bdnote(1)");
+    ses->feed("    endfor");
+    ses->feed("    return t");
+    ses->feed("end");
+    ses->feed("bdr = bdloop(1000)");
+    CPPUNIT_ASSERT_INTVAR("bdr",499500);
+    CPPUNIT_ASSERT(bdnotes==1005);
+    lana::Value a,b;
+    a.setInt(20);
+    b.setInt(22);
+    CPPUNIT_ASSERT(api->call(api->getFunction("bdadd"),a,b).getInt()==42);
+    
+    // the core library's bound functions
+    ses->feed("bdr = int(pow(2,10)+sin(0)+cos(0))");
+    CPPUNIT_ASSERT_INTVAR("bdr",1025);
+    ses->feed("bdr = int(float(\"2.5\")*2)");
+    CPPUNIT_ASSERT_INTVAR("bdr",5);
+    
+    // errors
+    CPPUNIT_ASSERT_THROW(ses->feed("bdr = bdadd(1)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("bdr = bdodd(bdodd)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("bdr = bdmix(1,2,3)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("bdr = bdadd(bdundefined,1)"),lana::RuntimeException);
+    ses->feed("bdr = bdadd(1,1)");
+    CPPUNIT_ASSERT_INTVAR("bdr",2);
+}
@@ -0,0 +1,69 @@
+#include "tests.h"
+
+/// make an integer value
+static lana::Value intval(int i){
+    lana::Value v;
+    v.setInt(i);
+    return v;
+}
+
+void TestFixtureLana::testCallHandles(){
+    ses->feed("chcount = 0");
+    ses->feed("chadd = function(a,b)");
+    ses->feed("    chcount = chcount+1");
+    ses->feed("    return a+b");
+    ses->feed("end");
+    ses->feed("$chdouble = function(x)");
+    ses->feed("    return x*2");
+    ses->feed("end");
+    ses->feed("chnothing = procedure()");
+    ses->feed("    chcount = -1");
+    ses->feed("end");
+    
+    // session and global functions, which can use session variables
+    lana::CallHandle add = api->getFunction("chadd",ses);
+    lana::CallHandle dbl = api->getFunction("$chdouble");
+    CPPUNIT_ASSERT(api->call(add,intval(1),intval(2)).getInt()==3);
+    CPPUNIT_ASSERT(api->call(add,intval(10),intval(-4)).getInt()==6);
+    CPPUNIT_ASSERT_INTVAR("chcount",2);
+    CPPUNIT_ASSERT(api->call(dbl,intval(21)).getInt()==42);
+    
+    // natives, and the general form
+    lana::CallHandle in = api->getFunction("int");
+    lana::Value args[1];
+    args[0].setFloat(3.7f);
+    lana::Value res;
+    api->call(in,1,args,&res);
+    CPPUNIT_ASSERT(res.getInt()==3);
+    
+    // procedures return nothing
+    lana::CallHandle nothing = api->getFunction("chnothing",ses);
+    api->call(nothing,0,NULL,&res);
+    CPPUNIT_ASSERT(!res.type);
+    CPPUNIT_ASSERT_INTVAR("chcount",-1);
+    
+    // redefining the function changes what the handle calls, and it can
+    // be got before it's defined at all
+    lana::CallHandle later = api->getFunction("chlater",ses);
+    CPPUNIT_ASSERT_THROW(api->call(later),lana::RuntimeException);
+    ses->feed("chlater = function()");
+    ses->feed("    return 5");
+    ses->feed("end");
+    CPPUNIT_ASSERT(api->call(later).getInt()==5);
+    ses->feed("chadd = function(a,b)");
+    ses->feed("    return a*b");
+    ses->feed("end");
+    CPPUNIT_ASSERT(api->call(add,intval(3),intval(4)).getInt()==12);
+    
+    // errors are runtime exceptions, after which everything still works
+    CPPUNIT_ASSERT_THROW(api->call(add,intval(3)),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(api->call(dbl,args[0],args[0]),lana::RuntimeException);
+    ses->feed("chbad = function(x)");
+    ses->feed("    return x.nosuchthing");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(api->call(api->getFunction("chbad",ses),intval(1)),
+                         lana::RuntimeException);
+    CPPUNIT_ASSERT(api->call(dbl,intval(4)).getInt()==8);
+    ses->feed("chres = chadd(6,7)");
+    CPPUNIT_ASSERT_INTVAR("chres",42);
+}
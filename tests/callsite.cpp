@@ -0,0 +1,32 @@
+#include "tests.h"
+
+void TestFixtureLana::testCallSites(){
+    ses->feedFile("files/callsite.l");
+    
+    // a call site which has called a function must still check the
+    // arguments of a different one. Inlining is turned off so that
+    // it's the call site which makes the call.
+    api->setInlineLimits(0,0);
+    ses->feed("one = function(x)");
+    ses->feed("    return x");
+    ses->feed("end");
+    ses->feed("callone = function()");
+    ses->feed("    return one(1)");
+    ses->feed("end");
+    ses->feed("res = callone()");
+    ses->feed("res = callone()");
+    CPPUNIT_ASSERT_INTVAR("res",1);
+    ses->feed("one = function(x,y)");
+    ses->feed("    return x+y");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("res = callone()"),lana::RuntimeException);
+    
+    // and calling something which isn't a function at all
+    ses->feed("one = 1");
+    CPPUNIT_ASSERT_THROW(ses->feed("res = callone()"),lana::RuntimeException);
+    ses->feed("one = function(x)");
+    ses->feed("    return x+1");
+    ses->feed("end");
+    ses->feed("res = callone()");
+    CPPUNIT_ASSERT_INTVAR("res",2);
+}
@@ -2,4 +2,12 @@
 
 void TestFixtureLana::testDicts(){
     ses->feedFile("files/dicts.l");
+    
+    // sizes which can't be reserved are errors, leaving the dictionary
+    // as it was
+    ses->feed("rd = dict()");
+    ses->feed("rd[1] = 2");
+    CPPUNIT_ASSERT_THROW(ses->feed("rd.reserve(0-1)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("rd.reserve(2000000000)"),lana::RuntimeException);
+    ses->feed("assertInt(2,rd[1])");
 }
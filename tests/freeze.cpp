@@ -0,0 +1,62 @@
+#include "tests.h"
+
+void TestFixtureLana::testFreeze(){
+    api->setWorkThreads(2);
+    ses->feedFile("files/freeze.l");
+    
+    // frozen globals can be read by functions on the register VM too
+    api->setFlags(LOP_REGISTERVM);
+    ses->feed("assertStr(\"row2\",pmap(nums,gread)[2])");
+    ses->feed("assertStr(\"row1\",pmap(nums,gcopy)[1])");
+    api->setFlags(0);
+    
+    // nothing frozen can be changed, whichever way it's tried
+    CPPUNIT_ASSERT_THROW(ses->feed("table[\"key1\"] = 0"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("table[\"new\"] = 0"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("del(table[\"key1\"])"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("table.update(dict())"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("table[\"key1\"][0] = 7"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("sorted.push(7)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("sorted.pop()"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("sorted.sort()"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("del(sorted[0])"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("thing.own = 3"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("proto.base = 3"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("del(thing.own)"),lana::RuntimeException);
+    
+    // including inside functions, where list stores have a quicker path
+    ses->feed("setfirst = procedure(l,v)");
+    ses->feed("    l[0] = v");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("setfirst(sorted,7)"),lana::RuntimeException);
+    ses->feed("assertInt(1,sorted[0])");
+    ses->feed("unfrozen = list()");
+    ses->feed("unfrozen.push(0)");
+    ses->feed("setfirst(unfrozen,7)");
+    ses->feed("assertInt(7,unfrozen[0])");
+    
+    // if anything can't be frozen, nothing is
+    ses->feed("mixed = dict()");
+    ses->feed("mixed[\"l\"] = list()");
+    ses->feed("mixed[\"a\"] = int32array(4)");
+    CPPUNIT_ASSERT_THROW(ses->feed("freeze(mixed)"),lana::RuntimeException);
+    ses->feed("assert(!isfrozen(mixed))");
+    ses->feed("assert(!isfrozen(mixed[\"l\"]))");
+    ses->feed("mixed[\"l\"].push(1)");
+    CPPUNIT_ASSERT_THROW(ses->feed("freeze(int32array(4))"),lana::RuntimeException);
+    
+    // the C++ API
+    ses->feed("cstr = \"run\"+\"time\"");
+    lana::Value *v = ses->getSesVar("cstr");
+    CPPUNIT_ASSERT(!api->isFrozen(v));
+    api->freeze(v);
+    CPPUNIT_ASSERT(api->isFrozen(v));
+    ses->feed("cstr2 = cstr");
+    ses->feed("assertStr(\"runtime\",cstr2)");
+    v = ses->getSesVar("unfrozen");
+    api->freeze(v);
+    CPPUNIT_ASSERT(api->isFrozen(v));
+    CPPUNIT_ASSERT_THROW(ses->feed("unfrozen.push(1)"),lana::RuntimeException);
+    
+    api->setWorkThreads(0);
+}
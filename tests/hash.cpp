@@ -1,5 +1,6 @@
 #include "tests.h"
 #include "lana/hash.h"
+#include "lana/intkeyedhash.h"
 #include "lana/value.h"
 
 
@@ -88,7 +89,69 @@ void TestFixtureLana::testHash(){
         CPPUNIT_ASSERT_EQUAL(i<20?i*3+31:-9999,q);
     }
     setIntByInt(2000,2);
-        
+    
+    // after deleting most of the keys, the table should have shrunk
+    CPPUNIT_ASSERT(hash->mask+1 <= 128);
+    
+    // churn - keep 100 distinct keys alive while adding and deleting
+    // lots of others. Neither the size nor the dummy count should grow
+    // without bound.
+    for(int i=0;i<100000;i++){
+        setIntByInt(10000+i,i);
+        if(i>=100)
+            del(10000+i-100);
+    }
+    CPPUNIT_ASSERT(hash->mask+1 <= 512);
+    CPPUNIT_ASSERT((hash->fill-hash->used)*4 <= hash->mask+1);
+    for(int i=100000-100;i<100000;i++)
+        CPPUNIT_ASSERT_EQUAL(i,getIntByInt(10000+i));
+    
+    hash->compact();
+    CPPUNIT_ASSERT_EQUAL(hash->used,hash->fill);
+    CPPUNIT_ASSERT(hash->mask+1 <= 256);
+    CPPUNIT_ASSERT_EQUAL(99999,getIntByInt(10000+99999));
+    
+    // reserving room means no resize while filling
+    lana::Hash *old = hash;
+    hash = new lana::Hash;
+    hash->reserve(5000);
+    CPPUNIT_ASSERT(hash->capacity()>=5000);
+    unsigned int size = hash->mask+1;
+    for(int i=0;i<5000;i++)
+        setIntByInt(i,i);
+    CPPUNIT_ASSERT_EQUAL(size,hash->mask+1);
+    
+    // update from the churned table (100 keys, plus "foo", "bar" and
+    // 0-19 which we already have), then copy the lot
+    hash->update(old);
+    CPPUNIT_ASSERT_EQUAL(5102u,hash->used);
+    CPPUNIT_ASSERT_EQUAL(99999,getIntByInt(10000+99999));
+    lana::Hash *copy = new lana::Hash;
+    copy->copyFrom(hash);
+    delete hash;
+    hash = copy;
+    CPPUNIT_ASSERT_EQUAL(5102u,hash->used);
+    CPPUNIT_ASSERT_EQUAL(4999,getIntByInt(4999));
+    CPPUNIT_ASSERT_EQUAL(99999,getIntByInt(10000+99999));
+    delete old;
     
     delete hash;
+    
+    // the same churn on an int-keyed hash; this used to fill up
+    // with dummies and hang
+    lana::IntKeyedHash<int> ih;
+    for(int i=0;i<100000;i++){
+        *ih.set(i) = i;
+        if(i>=100)
+            CPPUNIT_ASSERT(ih.del(i-100));
+    }
+    CPPUNIT_ASSERT_EQUAL(100u,ih.used);
+    CPPUNIT_ASSERT(ih.mask+1 <= 512);
+    CPPUNIT_ASSERT(ih.find(99999));
+    CPPUNIT_ASSERT_EQUAL(99999,*ih.getval());
+    CPPUNIT_ASSERT(!ih.find(0));
+    
+    for(int i=100000-100;i<100000;i++)
+        ih.del(i);
+    CPPUNIT_ASSERT_EQUAL((unsigned int)INITIAL_SIZE,ih.mask+1);
 }
@@ -0,0 +1,96 @@
+#include "tests.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/// get how many kilobytes of the calling process's memory are its own,
+/// having been written to since it was forked, or -1 if that can't be
+/// found out here
+static int privateDirtyKB(){
+    FILE *f = fopen("/proc/self/smaps_rollup","r");
+    if(!f)
+        f = fopen("/proc/self/smaps","r");
+    if(!f)
+        return -1;
+    char buf[256];
+    int kb = 0;
+    while(fgets(buf,sizeof(buf),f)){
+        if(!strncmp(buf,"Private_Dirty:",14))
+            kb += atoi(buf+14);
+    }
+    fclose(f);
+    return kb;
+}
+
+/// fork, and run n requests in the child, returning how many more
+/// kilobytes it stopped sharing with us while it did, or -1 if that
+/// can't be found out (or the requests failed)
+static int unsharedAfterRequests(lana::Session *ses,int n){
+    int fds[2];
+    if(pipe(fds))
+        return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid<0)
+        return -1;
+    if(!pid){
+        close(fds[0]);
+        int kb = -1;
+        try {
+            int before = privateDirtyKB();
+            for(int i=0;i<n;i++)
+                ses->feed("r = bigrequest()");
+            int after = privateDirtyKB();
+            if(before>=0 && after>=0)
+                kb = after-before;
+        } catch(...){
+        }
+        if(write(fds[1],&kb,sizeof(kb))){}
+        // don't run any destructors, which would touch the heap
+        _exit(0);
+    }
+    close(fds[1]);
+    int kb;
+    if(read(fds[0],&kb,sizeof(kb))!=sizeof(kb))
+        kb = -1;
+    close(fds[0]);
+    waitpid(pid,NULL,0);
+    return kb;
+}
+
+void TestFixtureLana::testImmortal(){
+    ses->feedFile("files/immortal.l");
+    CPPUNIT_ASSERT_THROW(ses->feed("r = pmap(nums,gpush)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("kept.push(2)"),lana::RuntimeException);
+    ses->feed("assertInt(0,size($gkept))");
+    
+    // once frozen, they can be shared
+    ses->feed("$gkept = freeze($gkept)");
+    ses->feed("assertInt(3,pmap(nums,gsize)[3])");
+
+    // the C++ API
+    ses->feed("more = mktable(10)");
+    CPPUNIT_ASSERT(api->makeHeapImmortal(ses)==11);
+    ses->feed("assert(isfrozen(more[\"key3\"][1]))");
+
+    // a process which forks after making its heap immortal shares more
+    // of it with its children, as reading the heap doesn't write to it
+    ses->feed("big = mktable(5000)");
+    ses->feed("bigrequest = function()");
+    ses->feed("    s = sumtable(big)");
+    ses->feed("    x = gc()");
+    ses->feed("    return s");
+    ses->feed("end");
+    int mortal = unsharedAfterRequests(ses,10);
+    ses->feed("made = immortalize()");
+    int immortal = unsharedAfterRequests(ses,10);
+    // the child unshares whatever it writes to, which with a mortal heap
+    // is every object it reads. This can't be measured everywhere - nor
+    // under ThreadSanitizer, which writes to memory of its own whenever
+    // the heap is read.
+#ifndef __SANITIZE_THREAD__
+    if(mortal>=0 && immortal>=0)
+        CPPUNIT_ASSERT(immortal*2<mortal);
+#endif
+}
@@ -0,0 +1,76 @@
+#include "tests.h"
+
+/// run inlloop(n) and return the number of instructions it took
+static int countInstructions(lana::API *api,lana::Session *ses){
+    api->resetInstructionCount();
+    ses->feed("inlres = inlloop(100)");
+    return api->getInstructionCount();
+}
+
+/// define inlloop(), which calls small functions. Inlining is done when
+/// it's compiled, so this has to be done again when the limits change.
+static void defineLoop(lana::Session *ses){
+    ses->feed("inlloop = function(n)");
+    ses->feed("    t = 0");
+    ses->feed("    i = 0");
+    ses->feed("    while i<n");
+    ses->feed("        t = t+inlsq(inlclamp(i,10,20))");
+    ses->feed("        i = i+1");
+    ses->feed("    endwhile");
+    ses->feed("    return t");
+    ses->feed("end");
+}
+
+void TestFixtureLana::testInlining(){
+    // the script must give the same results with and without inlining,
+    // each with a fresh API because it redefines its functions
+    for(int inl=0;inl<2;inl++){
+        delete ses;
+        delete api;
+        delete h;
+        api = new lana::API();
+        ses = new lana::Session(api);
+        h = new AsserterHost(api);
+        
+        if(!inl)
+            api->setInlineLimits(0,0);
+        ses->feedFile("files/inline.l");
+    }
+    
+    // inlined calls should run fewer instructions
+    ses->feed("inlsq = function(x)");
+    ses->feed("    return x*x");
+    ses->feed("end");
+    ses->feed("inlclamp = function(x,lo,hi)");
+    ses->feed("    if x<lo");
+    ses->feed("        return lo");
+    ses->feed("    elseif x>hi");
+    ses->feed("        return hi");
+    ses->feed("    endif");
+    ses->feed("    return x");
+    ses->feed("end");
+    
+    api->setInlineLimits(0,0);
+    defineLoop(ses);
+    int callct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("inlres",35185);
+    api->setInlineLimits(32,256);
+    defineLoop(ses);
+    int inlct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("inlres",35185);
+    CPPUNIT_ASSERT(inlct < callct);
+    
+    // inlclamp() is too big for this limit, but inlsq() isn't
+    api->setInlineLimits(8,256);
+    defineLoop(ses);
+    int bigct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("inlres",35185);
+    CPPUNIT_ASSERT(inlct < bigct && bigct < callct);
+    
+    // and redefining a function which was inlined calls the new one
+    ses->feed("inlsq = function(x)");
+    ses->feed("    return x");
+    ses->feed("end");
+    countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("inlres",1845);
+}
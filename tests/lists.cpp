@@ -7,4 +7,12 @@ void TestFixtureEmpty::testLists() {
 
 void TestFixtureLana::testListObjects(){
     ses->feedFile("files/lists.l");
+    
+    // sizes which can't be reserved are errors, leaving the list as it
+    // was
+    ses->feed("rl = list()");
+    ses->feed("rl.push(3)");
+    CPPUNIT_ASSERT_THROW(ses->feed("rl.reserve(0-1)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("rl.reserve(2000000000)"),lana::RuntimeException);
+    ses->feed("assertInt(3,rl[0])");
 }
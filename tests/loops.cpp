@@ -12,6 +12,7 @@ void TestFixtureLana::testLoops(){
     ses->feedFile("files/loops.l");
     ses->feedFile("files/nestedloops.l");
     ses->feedFile("files/range.l");
+    ses->feedFile("files/forloops.l");
 }
         
         
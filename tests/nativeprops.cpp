@@ -0,0 +1,91 @@
+#include "tests.h"
+#include "lana/object.h"
+#include "lana/language.h"
+#include "lana/ser.h"
+
+/// a native object whose fields are properties, described by a table
+/// rather than getprop() and setprop()
+
+class Ship : public lana::Object {
+public:
+    Ship(lana::API *a) : lana::Object(a) {
+        crew = 3;
+        cargo = 0;
+        speed = 0;
+        docked = false;
+        name = NULL;
+        escort = NULL;
+        setNativeProperties(props);
+    }
+    
+    static void reg(lana::API *a){
+        registerNativeProperties(a,props);
+        a->globalNativeFunction("createShip",0,true,&Ship::create);
+    }
+    
+    virtual void serialise(lana::Serialiser *s,const char *nm,FILE *out) {
+        fprintf(out,"%s%s = createShip()\n",s->lana->indents(),nm);
+    }
+    
+    int crew;
+    int cargo;
+    float speed;
+    bool docked;
+    char *name;
+    lana::Object *escort;
+    
+    static lana::NativeProperty props[];
+    
+private:
+    static void create(lana::API *a){
+        a->pushObj(new Ship(a));
+    }
+};
+
+lana::NativeProperty Ship::props[] = {
+    NATIVE_READONLY_PROPERTY(Ship,crew,lana::NP_INT),
+    NATIVE_PROPERTY(Ship,cargo,lana::NP_INT),
+    NATIVE_PROPERTY(Ship,speed,lana::NP_FLOAT),
+    NATIVE_PROPERTY(Ship,docked,lana::NP_BOOL),
+    NATIVE_PROPERTY(Ship,name,lana::NP_STRING),
+    NATIVE_PROPERTY(Ship,escort,lana::NP_OBJECT),
+    {NULL}
+};
+
+void TestFixtureLana::testNativeProperties(){
+    Ship::reg(api);
+    
+    // on both VMs
+    ses->feedFile("files/nativeprops.l");
+    api->setFlags(LOP_REGISTERVM);
+    ses->feedFile("files/nativeprops.l");
+    api->setFlags(0);
+    
+    // the fields themselves are what changed
+    Ship *s = (Ship *)ses->getSesVar("npship")->getObj();
+    CPPUNIT_ASSERT(s->cargo==12);
+    CPPUNIT_ASSERT(s->speed==15.0f);
+    CPPUNIT_ASSERT(s->docked);
+    CPPUNIT_ASSERT(!strcmp(s->name,"Hoodie"));
+    CPPUNIT_ASSERT(s->escort == ses->getSesVar("npother")->getObj());
+    s->cargo = 99;
+    CPPUNIT_ASSERT_BOOLTEST("npship.cargo == 99",true);
+    
+    // read-only and unset fields
+    CPPUNIT_ASSERT_THROW(ses->feed("npship.crew = 4"),lana::RuntimeException);
+    ses->feed("npnew = createShip()");
+    CPPUNIT_ASSERT_THROW(ses->feed("npx = npnew.name"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("npnew.escort = 1"),lana::RuntimeException);
+    CPPUNIT_ASSERT_BOOLTEST("defined(npnew.name)",false);
+    CPPUNIT_ASSERT_BOOLTEST("defined(npship.name)",true);
+    
+    // the fields are serialised
+    ses->feed("$npsaved = npship");
+    ses->feed("savevar $npsaved \"tmpnp\"");
+    ses->feed("$npsaved = 0");
+    ses->feed("npship = 0");
+    ses->feed("load \"tmpnp\"");
+    CPPUNIT_ASSERT_BOOLTEST("$npsaved.cargo == 99",true);
+    CPPUNIT_ASSERT_BOOLTEST("$npsaved.name == \"Hoodie\"",true);
+    CPPUNIT_ASSERT_BOOLTEST("$npsaved.escort.cargo == 8",true);
+}
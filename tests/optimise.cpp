@@ -0,0 +1,55 @@
+#include "tests.h"
+#include "lana/language.h"
+
+/// run optcount() and return the number of instructions it took
+static int countInstructions(lana::API *api,lana::Session *ses){
+    api->resetInstructionCount();
+    ses->feed("optres = optcount(10)");
+    return api->getInstructionCount();
+}
+
+/// define optcount(), which is compiled when it's defined, so this has
+/// to be done again whenever the optimiser is turned on or off
+static void defineCount(lana::Session *ses){
+    ses->feed("optcount = function(n)");
+    ses->feed("    t = 0");
+    ses->feed("    while true");
+    ses->feed("        # keep going until n runs out");
+    ses->feed("        n = n-1");
+    ses->feed("        if n<0");
+    ses->feed("            break");
+    ses->feed("        endif");
+    ses->feed("        t = t+(2*3+1)");
+    ses->feed("    endwhile");
+    ses->feed("    return t");
+    ses->feed("end");
+}
+
+void TestFixtureLana::testOptimiser(){
+    // the script must give the same results with and without the
+    // optimiser, on both VMs
+    ses->feedFile("files/optimise.l");
+    api->setFlags(LOP_NOOPTIMISE);
+    ses->feedFile("files/optimise.l");
+    api->setFlags(LOP_REGISTERVM);
+    ses->feedFile("files/optimise.l");
+
+    // the optimised code should run fewer instructions
+    api->setFlags(LOP_NOOPTIMISE);
+    defineCount(ses);
+    int plainct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("optres",70);
+    api->setFlags(0);
+    defineCount(ses);
+    int optct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("optres",70);
+    CPPUNIT_ASSERT(optct < plainct);
+
+    // but the function should still be recreated as it was written
+    const char *block = ses->getSesVar("optcount")->getPtr();
+    char *src = api->lana->recreateFunction((lana::instruction *)(block+sizeof(int)),0,ses);
+    CPPUNIT_ASSERT(strstr(src,"while true"));
+    CPPUNIT_ASSERT(strstr(src,"# keep going until n runs out"));
+    CPPUNIT_ASSERT(strstr(src,"t = t+(2*3+1)"));
+    free(src);
+}
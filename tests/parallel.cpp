@@ -0,0 +1,46 @@
+#include "tests.h"
+
+void TestFixtureLana::testParallel(){
+    api->setWorkThreads(4);
+    ses->feedFile("files/parallel.l");
+    
+    // objects can't be passed to another thread, or back
+    ses->feed("pobjs = list()");
+    ses->feed("pobjs.push(create())");
+    CPPUNIT_ASSERT_THROW(ses->feed("pr = pmap(pobjs,sq)"),lana::RuntimeException);
+    ses->feed("mkobj = function(x)");
+    ses->feed("    return create()");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("pr = pmap(big,mkobj)"),lana::RuntimeException);
+    CPPUNIT_ASSERT_THROW(ses->feed("pr = pmap(3,sq)"),lana::RuntimeException);
+    
+    // errors in any thread stop the job, and are thrown here
+    ses->feed("pbad = function(x)");
+    ses->feed("    if x==567");
+    ses->feed("        return x.nothing");
+    ses->feed("    endif");
+    ses->feed("    return x");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("pr = pmap(big,pbad)"),lana::RuntimeException);
+    
+    // globals can't be changed while the pool is running
+    ses->feed("psetg = function(x)");
+    ses->feed("    $pscale = x");
+    ses->feed("    return x");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("pr = pmap(big,psetg)"),lana::RuntimeException);
+    
+    // but can once it's finished, and it still works
+    CPPUNIT_ASSERT(api->getThreadCount()==0);
+    ses->feed("$pscale = 5");
+    ses->feed("pr = pmap(big,gtimes)[3]");
+    CPPUNIT_ASSERT_INTVAR("pr",15);
+    
+    // with any number of threads
+    api->setWorkThreads(1);
+    ses->feed("pr = preduce(pmap(big,sq),add,0)");
+    CPPUNIT_ASSERT_INTVAR("pr",332833500);
+    api->setWorkThreads(7);
+    ses->feed("pr = size(pfilter(big,even))");
+    CPPUNIT_ASSERT_INTVAR("pr",500);
+}
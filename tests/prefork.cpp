@@ -0,0 +1,148 @@
+#include "tests.h"
+#include "lana/prefork.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+/// read from a connection until it's closed or a line ends
+static void readReply(int fd,char *buf,int size,bool oneLine){
+    int len = 0,n;
+    while(len<size-1 && (n=read(fd,buf+len,size-1-len))>0){
+        len += n;
+        if(oneLine && buf[len-1]=='\n')
+            break;
+    }
+    buf[len] = 0;
+}
+
+/// send requests to a server over a socket pair, returning what
+/// serveConnection() did and the replies
+static bool serveAll(lana::PreforkServer *s,const char *reqs,char *replies,int size){
+    int sv[2];
+    CPPUNIT_ASSERT(!socketpair(AF_UNIX,SOCK_STREAM,0,sv));
+    CPPUNIT_ASSERT(write(sv[0],reqs,strlen(reqs))==(int)strlen(reqs));
+    shutdown(sv[0],SHUT_WR);
+    bool r = s->serveConnection(sv[1]);
+    close(sv[1]);
+    readReply(sv[0],replies,size,false);
+    close(sv[0]);
+    return r;
+}
+
+/// make one request of a server listening at a path
+static void request(const char *path,const char *req,char *reply,int size){
+    int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    struct sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,path);
+    CPPUNIT_ASSERT(!connect(fd,(struct sockaddr *)&addr,sizeof(addr)));
+    CPPUNIT_ASSERT(write(fd,req,strlen(req))==(int)strlen(req));
+    readReply(fd,reply,size,true);
+    close(fd);
+}
+
+void TestFixtureLana::testPrefork(){
+    ses->feedFile("files/prefork.l");
+    char buf[1024];
+
+    // requests on a connection, with numbers, strings and escapes
+    lana::PreforkServer s(api,ses);
+    CPPUNIT_ASSERT(serveAll(&s,
+                            "add\t1\t2\n"
+                            "greet\tbob\r\n"
+                            "add\t1.5\t-2\n"
+                            "greet\ta\\tb\\\\c\n"
+                            "nothing\t1\n"
+                            "add\t1\n",
+                            buf,sizeof(buf)));
+    CPPUNIT_ASSERT(!strncmp(buf,
+                            "ok\t3\n"
+                            "ok\thello bob\n"
+                            "ok\t-0.5",25));
+    CPPUNIT_ASSERT(strstr(buf,
+                          "ok\thello a\\tb\\\\c\n"
+                          "error\tthere is no function called 'nothing'\n"
+                          "error\t")!=NULL);
+    serveAll(&s,"broken\n",buf,sizeof(buf));
+    CPPUNIT_ASSERT(!strncmp(buf,"error\t",6));
+    char *r = s.runRequest("greet\tx");
+    CPPUNIT_ASSERT(!strcmp(r,"ok\thello x\n"));
+    free(r);
+    
+    // a procedure's reply is empty; integers too big for an int are
+    // floats, and hex isn't read as a number
+    CPPUNIT_ASSERT(serveAll(&s,
+                            "quiet\n"
+                            "echo\t-2147483648\n"
+                            "echo\t99999999999\n"
+                            "echo\t0x10\n",
+                            buf,sizeof(buf)));
+    CPPUNIT_ASSERT(!strcmp(buf,
+                           "ok\t\n"
+                           "ok\t-2147483648\n"
+                           "ok\t99999997952.000000\n"
+                           "ok\t0x10\n"));
+
+    // a worker stops once it's answered enough requests, leaving the
+    // rest unanswered
+    lana::PreforkServer limited(api,ses);
+    limited.maxRequests = 2;
+    CPPUNIT_ASSERT(!serveAll(&limited,"bump\nbump\nbump\n",buf,sizeof(buf)));
+    CPPUNIT_ASSERT(!strcmp(buf,"ok\t1\nok\t2\n"));
+    ses->feed("counter.n = 0");
+
+    // the whole server, in a process of its own with two workers which
+    // are restarted every two requests: so each request is answered by
+    // a worker which has answered at most one other
+    char path[64];
+    sprintf(path,"/tmp/lanatest-%d.sock",(int)getpid());
+    int lfd = lana::PreforkServer::listenUnix(path);
+    fflush(stdout);
+    pid_t pid = fork();
+    if(!pid){
+        limited.run(lfd,2);
+        _exit(0);
+    }
+    close(lfd);
+    for(int i=0;i<6;i++){
+        request(path,"bump\n",buf,sizeof(buf));
+        CPPUNIT_ASSERT(!strcmp(buf,"ok\t1\n") || !strcmp(buf,"ok\t2\n"));
+    }
+    kill(pid,SIGTERM);
+    int status;
+    CPPUNIT_ASSERT(waitpid(pid,&status,0)==pid);
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status)==0);
+    unlink(path);
+
+    // workers which can't accept connections, here on a socket which
+    // isn't listening, are started again after longer and longer waits
+    // until the server gives up
+    int sv[2];
+    CPPUNIT_ASSERT(!socketpair(AF_UNIX,SOCK_STREAM,0,sv));
+    struct timeval start,end;
+    gettimeofday(&start,NULL);
+    fflush(stdout);
+    pid = fork();
+    if(!pid){
+        try {
+            limited.run(sv[0],1);
+        } catch(lana::Exception &e){
+            _exit(3);
+        }
+        _exit(0);
+    }
+    CPPUNIT_ASSERT(waitpid(pid,&status,0)==pid);
+    gettimeofday(&end,NULL);
+    close(sv[0]);
+    close(sv[1]);
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status)==3);
+    int waited = (end.tv_sec-start.tv_sec)*1000+(end.tv_usec-start.tv_usec)/1000;
+    int least = 0;
+    for(int i=0,w=lana::PreforkServer::MINBACKOFF;i<lana::PreforkServer::MAXFAILURES-1;i++,w*=2)
+        least += w;
+    CPPUNIT_ASSERT(waited>=least);
+}
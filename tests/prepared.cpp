@@ -0,0 +1,115 @@
+#include "tests.h"
+
+void TestFixtureLana::testPreparedStatements(){
+    ses->feed("psx = 0");
+    ses->feed("$psg = 0");
+    ses->feed("psf = function(x)");
+    ses->feed("    return x+1");
+    ses->feed("end");
+    
+    // a statement runs again with the variables' new values
+    lana::Statement *inc = ses->prepare("psx = psx+1");
+    lana::Statement *acc = ses->prepare("$psg = $psg+psf(psx)");
+    CPPUNIT_ASSERT(!strcmp(inc->getSource(),"psx = psx+1"));
+    for(int i=0;i<3;i++){
+        ses->execute(inc);
+        ses->execute(acc);
+    }
+    CPPUNIT_ASSERT_INTVAR("psx",3);
+    CPPUNIT_ASSERT(api->findGlobal("$psg")->getInt()==9);
+    ses->feed("psx = 10");
+    ses->execute(inc);
+    CPPUNIT_ASSERT_INTVAR("psx",11);
+    
+    // an expression's value can be fetched, and redefining a function
+    // changes what a statement calls
+    lana::Statement *expr = ses->prepare("psf(psx)*2");
+    lana::Value res;
+    ses->execute(expr,&res);
+    CPPUNIT_ASSERT(res.getInt()==24);
+    ses->feed("psf = function(x)");
+    ses->feed("    return x-1");
+    ses->feed("end");
+    ses->execute(expr,&res);
+    CPPUNIT_ASSERT(res.getInt()==20);
+    ses->execute(inc,&res);
+    CPPUNIT_ASSERT(!res.type);
+    
+    // lines which aren't complete statements can't be prepared, and
+    // errors leave everything working
+    CPPUNIT_ASSERT_THROW(ses->prepare("psx = (1+"),lana::ParseException);
+    CPPUNIT_ASSERT_THROW(ses->prepare("psh = function(x)"),lana::ParseException);
+    CPPUNIT_ASSERT(!ses->awaitingInput());
+    lana::Statement *bad = ses->prepare("psx = psx.nosuchthing");
+    CPPUNIT_ASSERT_THROW(ses->execute(bad),lana::RuntimeException);
+    ses->execute(inc);
+    CPPUNIT_ASSERT_INTVAR("psx",13);
+    ses->feed("psy = psx*2");
+    CPPUNIT_ASSERT_INTVAR("psy",26);
+    
+    // a statement belongs to the session which prepared it
+    lana::Session *other = new lana::Session(api);
+    CPPUNIT_ASSERT_THROW(other->execute(inc),lana::Exception);
+    delete other;
+    
+    delete inc;
+    delete acc;
+    delete expr;
+    delete bad;
+    
+    // with the cache on, lines fed again must still see new values and
+    // functions, including when lines are dropped from the cache
+    ses->setStatementCache(2);
+    ses->feed("psc = 0");
+    for(int i=0;i<5;i++){
+        ses->feed("psc = psc+1");
+        ses->feed("psd = psf(psc)");
+        if(i%2)
+            ses->feed("pse = psc*10");
+    }
+    CPPUNIT_ASSERT_INTVAR("psc",5);
+    CPPUNIT_ASSERT_INTVAR("psd",4);
+    CPPUNIT_ASSERT_INTVAR("pse",40);
+    ses->feed("psf = function(x)");
+    ses->feed("    return x*100");
+    ses->feed("end");
+    ses->feed("psd = psf(psc)");
+    CPPUNIT_ASSERT_INTVAR("psd",500);
+    
+    // the line ending a function isn't cached as a statement of its own
+    ses->feed("psf = function(x)");
+    ses->feed("    return x*1000");
+    ses->feed("end");
+    ses->feed("psd = psf(psc)");
+    CPPUNIT_ASSERT_INTVAR("psd",5000);
+    
+    // nor are lines which fail to compile, while lines which fail to run
+    // run again when fed again, giving the line they're fed as
+    CPPUNIT_ASSERT_THROW(ses->feed("psc = (1+"),lana::ParseException);
+    CPPUNIT_ASSERT_THROW(ses->feed("psc = (1+"),lana::ParseException);
+    int lines[2];
+    for(int i=0;i<2;i++){
+        lines[i] = -1;
+        try {
+            ses->feed("psc = psq(1)");
+        } catch(lana::RuntimeException &e){
+            lines[i] = e.line;
+        }
+        ses->feed("psz = 0");
+    }
+    CPPUNIT_ASSERT(lines[0]>0);
+    CPPUNIT_ASSERT(lines[1]==lines[0]+1);
+    ses->feed("psq = function(x)");
+    ses->feed("    return x");
+    ses->feed("end");
+    ses->feed("psc = psq(1)");
+    CPPUNIT_ASSERT_INTVAR("psc",1);
+    
+    // changing the flags compiles lines again
+    api->setFlags(LOP_NOOPTIMISE);
+    ses->feed("psc = psc+1");
+    api->setFlags(0);
+    ses->feed("psc = psc+1");
+    CPPUNIT_ASSERT_INTVAR("psc",3);
+    ses->setStatementCache(0);
+}
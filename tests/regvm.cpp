@@ -0,0 +1,70 @@
+#include "tests.h"
+
+/// scripts which are run again with functions on the register VM, which
+/// must behave exactly as they do on the stack VM
+static const char *regvmFiles[] = {
+    "files/regvm.l",
+    "files/userfuncs1.l",
+    "files/usermethods.l",
+    "files/loops.l",
+    "files/nestedloops.l",
+    "files/range.l",
+    "files/forloops.l",
+    "files/lists.l",
+    "files/dicts.l",
+    "files/goto.l",
+    "files/strings.l",
+    NULL
+};
+
+/// run countf(100) and return the number of instructions it took
+static int countInstructions(lana::API *api,lana::Session *ses){
+    api->resetInstructionCount();
+    ses->feed("countres = countf(100)");
+    return api->getInstructionCount();
+}
+
+void TestFixtureLana::testRegisterVM(){
+    // first on the stack VM, to check the script itself is right
+    api->setFlags(0);
+    ses->feedFile("files/regvm.l");
+
+    // the register VM should do the same work in far fewer instructions
+    ses->feed("countf = function(n)");
+    ses->feed("    t = 0");
+    ses->feed("    i = 0");
+    ses->feed("    while i<n");
+    ses->feed("        t = t+i*2");
+    ses->feed("        i = i+1");
+    ses->feed("    endwhile");
+    ses->feed("    return t");
+    ses->feed("end");
+
+    int stackct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("countres",9900);
+    api->setFlags(LOP_REGISTERVM);
+    int regct = countInstructions(api,ses);
+    CPPUNIT_ASSERT_INTVAR("countres",9900);
+    CPPUNIT_ASSERT(regct*2 < stackct);
+
+    // code the register VM can't make sense of is left to the stack VM,
+    // which reports the error
+    api->setFlags(0);
+    CPPUNIT_ASSERT_THROW(ses->feed("x = badassign(0)"),lana::RuntimeException);
+    api->setFlags(LOP_REGISTERVM);
+    CPPUNIT_ASSERT_THROW(ses->feed("x = badassign(0)"),lana::RuntimeException);
+
+    // now the scripts, each with a fresh API because some of them
+    // check the garbage count
+    for(const char **f=regvmFiles;*f;f++){
+        delete ses;
+        delete api;
+        delete h;
+        api = new lana::API();
+        ses = new lana::Session(api);
+        h = new AsserterHost(api);
+
+        api->setFlags(LOP_REGISTERVM);
+        ses->feedFile(*f);
+    }
+}
@@ -0,0 +1,148 @@
+#include "tests.h"
+#include "lana/sched.h"
+
+/// a native which calls back into Lana
+class CallbackHost : public lana::Host {
+public:
+    CallbackHost(lana::API *a,lana::Session *s) : lana::Host(a) {
+        tri = a->getFunction("tri",s);
+        a->globalNativeHostedMethod("calltri",1,true,this,(lana::HOSTMETHOD)&CallbackHost::calltri);
+    }
+private:
+    lana::CallHandle tri;
+    
+    // call tri() in the session, returning one more than it returns
+    void calltri(){
+        lana::Value arg;
+        arg.setInt(api->popInt());
+        api->pushInt(api->call(tri,arg).getInt()+1);
+    }
+};
+
+void TestFixtureLana::testScheduler(){
+    CallbackHost h(api,ses);
+    ses->feedFile("files/sched.l");
+    lana::Scheduler s(api,100);
+    lana::Value arg,r;
+
+    // natives which call back into Lana, as tasks and called by them,
+    // finish the call they make within a turn
+    s.quantum = 3;
+    arg.setInt(100);
+    int c = s.add(ses,api->findGlobal("calltri"),1,&arg);
+    int v = s.add(ses,ses->getSesVar("vianative"),1,&arg);
+    s.run();
+    s.getResult(c,&r);
+    CPPUNIT_ASSERT(r.getInt()==5051);
+    s.getResult(v,&r);
+    CPPUNIT_ASSERT(r.getInt()==5052);
+    s.quantum = 100;
+
+    // a task which never finishes doesn't stop the others finishing
+    int f = s.add(ses,ses->getSesVar("forever"),0,NULL);
+    arg.setInt(1000);
+    int t = s.add(ses,ses->getSesVar("tri"),1,&arg);
+    int turns = 0;
+    while(!s.isFinished(t)){
+        CPPUNIT_ASSERT(s.step());
+        turns++;
+    }
+    CPPUNIT_ASSERT(turns>10);
+    CPPUNIT_ASSERT(!s.isFinished(f));
+    CPPUNIT_ASSERT(s.running()==1);
+    s.getResult(t,&r);
+    CPPUNIT_ASSERT(r.getInt()==500500);
+    CPPUNIT_ASSERT_THROW(s.getResult(t,&r),lana::Exception);
+    s.cancel(f);
+    CPPUNIT_ASSERT(!s.step());
+
+    // turns are in proportion to priority
+    int a = s.add(ses,ses->getSesVar("counta"),0,NULL);
+    int b = s.add(ses,ses->getSesVar("countb"),0,NULL,3);
+    for(int i=0;i<200;i++)
+        s.step();
+    s.cancel(a);
+    s.cancel(b);
+    ses->feed("ca = counts.a");
+    ses->feed("cb = counts.b");
+    int ca = ses->getSesVar("ca")->getInt();
+    int cb = ses->getSesVar("cb")->getInt();
+    CPPUNIT_ASSERT(ca>0 && cb>2*ca && cb<4*ca);
+
+    // many tasks, of every kind, all finish however short the turns,
+    // even while code runs between them
+    int quanta[3] = {1,7,1000};
+    for(int q=0;q<3;q++){
+        s.quantum = quanta[q];
+        int ids[100];
+        for(int i=0;i<100;i++){
+            arg.setInt(i);
+            switch(i%5){
+            case 0:
+                ids[i] = s.add(ses,ses->getSesVar("tri"),1,&arg);
+                break;
+            case 1:
+                arg.setInt(300);
+                ids[i] = s.add(ses,ses->getSesVar("deep"),1,&arg,2);
+                break;
+            case 2:
+                arg.setInt(50);
+                ids[i] = s.add(ses,ses->getSesVar("sortrev"),1,&arg);
+                break;
+            case 3:
+                ids[i] = s.add(ses,api->findGlobal("gc"),0,NULL);
+                break;
+            case 4:
+                ids[i] = s.add(ses,ses->getSesVar("holder"),1,&arg);
+                break;
+            }
+        }
+        int n = 0;
+        while(s.step()){
+            if(!(n++%50))
+                ses->feed("x = gc()");
+        }
+        for(int i=0;i<100;i++){
+            s.getResult(ids[i],&r);
+            switch(i%5){
+            case 0:
+                CPPUNIT_ASSERT(r.getInt()==i*(i+1)/2);
+                break;
+            case 1:
+                CPPUNIT_ASSERT(r.getInt()==310);
+                break;
+            case 2:
+                CPPUNIT_ASSERT(r.getInt()==49000);
+                break;
+            case 4:
+                CPPUNIT_ASSERT(r.getInt()==2*i+1);
+                break;
+            }
+        }
+    }
+
+    // errors are kept until the result is asked for
+    arg.setInt(3);
+    int e = s.add(ses,ses->getSesVar("broken"),1,&arg);
+    arg.setInt(100000);
+    int o = s.add(ses,ses->getSesVar("deep"),1,&arg);
+    s.run();
+    CPPUNIT_ASSERT(s.isFinished(e) && s.isFinished(o));
+    CPPUNIT_ASSERT_THROW(s.getResult(e,&r),lana::Exception);
+    CPPUNIT_ASSERT_THROW(s.getResult(o,&r),lana::Exception);
+    CPPUNIT_ASSERT_THROW(s.add(ses,&arg,0,NULL),lana::Exception);
+    CPPUNIT_ASSERT_THROW(s.cancel(9999),lana::Exception);
+
+    // and nothing a task held is left behind when it's stopped
+    ses->feed("before = gc()");
+    {
+        lana::Scheduler s2(api,10);
+        arg.setInt(100000);
+        s2.add(ses,ses->getSesVar("holder"),1,&arg);
+        s2.add(ses,ses->getSesVar("deep"),1,&arg);
+        for(int i=0;i<20;i++)
+            s2.step();
+    }
+    ses->feed("assertInt(before,gc())");
+    ses->feed("assertInt(10,adder.add(0))");
+}
@@ -0,0 +1,25 @@
+#include "tests.h"
+
+void TestFixtureLana::testStacks(){
+    // deep calls on both VMs
+    ses->feedFile("files/stacks.l");
+    api->setFlags(LOP_REGISTERVM);
+    ses->feedFile("files/stacks.l");
+    api->setFlags(0);
+    
+    // a session's depth limit stops runaway recursion
+    ses->feed("runaway = function(n)");
+    ses->feed("    return 1+runaway(n+1)");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("res = runaway(0)"),lana::RuntimeException);
+    ses->setStackLimits(100,lana::Session::DEFAULTMAXSTACKVALUES);
+    CPPUNIT_ASSERT_THROW(ses->feed("res = sumr(200)"),lana::RuntimeException);
+    ses->feed("res = sumr(50)");
+    CPPUNIT_ASSERT_INTVAR("res",1275);
+    
+    // as does its limit on the size of the stacks
+    ses->setStackLimits(lana::Session::DEFAULTMAXDEPTH,1000);
+    CPPUNIT_ASSERT_THROW(ses->feed("res = wide(200)"),lana::RuntimeException);
+    ses->feed("res = wide(10)");
+    CPPUNIT_ASSERT_INTVAR("res",62);
+}
@@ -0,0 +1,31 @@
+#include "tests.h"
+
+void TestFixtureLana::testTailCalls(){
+    ses->feedFile("files/tailcall.l");
+    
+    // without the optimiser the same recursion hits the depth limit
+    api->setFlags(LOP_NOOPTIMISE);
+    ses->feed("deep = function(n)");
+    ses->feed("    if n==0");
+    ses->feed("        return 0");
+    ses->feed("    endif");
+    ses->feed("    return deep(n-1)");
+    ses->feed("end");
+    CPPUNIT_ASSERT_THROW(ses->feed("res = deep(10000)"),lana::RuntimeException);
+    
+    // but it runs with it
+    api->setFlags(0);
+    ses->feed("deep = function(n)");
+    ses->feed("    if n==0");
+    ses->feed("        return 0");
+    ses->feed("    endif");
+    ses->feed("    return deep(n-1)");
+    ses->feed("end");
+    ses->feed("res = deep(10000)");
+    CPPUNIT_ASSERT_INTVAR("res",0);
+    
+    // and the register VM makes the call as usual
+    api->setFlags(LOP_REGISTERVM);
+    ses->feed("res = deep(50)");
+    CPPUNIT_ASSERT_INTVAR("res",0);
+}
@@ -60,6 +60,25 @@ class TestFixtureLana : public CppUnit::TestFixture {
     CPPUNIT_TEST(testSerialisation);
     CPPUNIT_TEST(testUserObjects);
     CPPUNIT_TEST(testListObjects);
+    CPPUNIT_TEST(testSimdKernels);
+    CPPUNIT_TEST(testTypedArrays);
+    CPPUNIT_TEST(testRegisterVM);
+    CPPUNIT_TEST(testOptimiser);
+    CPPUNIT_TEST(testInlining);
+    CPPUNIT_TEST(testCallSites);
+    CPPUNIT_TEST(testTailCalls);
+    CPPUNIT_TEST(testStacks);
+    CPPUNIT_TEST(testCallHandles);
+    CPPUNIT_TEST(testPreparedStatements);
+    CPPUNIT_TEST(testBinding);
+    CPPUNIT_TEST(testNativeProperties);
+    CPPUNIT_TEST(testThreads);
+    CPPUNIT_TEST(testParallel);
+    CPPUNIT_TEST(testActors);
+    CPPUNIT_TEST(testFreeze);
+    CPPUNIT_TEST(testImmortal);
+    CPPUNIT_TEST(testPrefork);
+    CPPUNIT_TEST(testScheduler);
     CPPUNIT_TEST_SUITE_END();
     
     
@@ -97,6 +116,25 @@ public:
     void testSerialisation();
     void testUserObjects();
     void testListObjects();
+    void testSimdKernels();
+    void testTypedArrays();
+    void testRegisterVM();
+    void testOptimiser();
+    void testInlining();
+    void testCallSites();
+    void testTailCalls();
+    void testStacks();
+    void testCallHandles();
+    void testPreparedStatements();
+    void testBinding();
+    void testNativeProperties();
+    void testThreads();
+    void testParallel();
+    void testActors();
+    void testFreeze();
+    void testImmortal();
+    void testPrefork();
+    void testScheduler();
 };
 
 inline void checkStrEqual(const char *a,
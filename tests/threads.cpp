@@ -0,0 +1,161 @@
+#include <pthread.h>
+
+#include "tests.h"
+#include "lana/exception.h"
+
+/// the number of threads run at once
+static const int THREADS = 4;
+/// the number of calls each makes through a handle
+static const int CALLS = 500;
+
+/// what one thread was given, and what it found. CppUnit's asserts
+/// can't be used off the main thread, so it just records failures.
+struct ThreadTest {
+    lana::API *api;
+    int n;                      //!< which thread this is
+    pthread_barrier_t *attached; //!< waited on once every thread is attached
+    pthread_barrier_t *checked;  //!< waited on once the main thread has checked
+    const char *failed;         //!< the first thing which went wrong, or NULL
+};
+
+/// does feeding a line throw?
+static bool feedThrows(lana::Session *s,const char *line){
+    try {
+        s->feed(line);
+    } catch(lana::Exception &e){
+        return true;
+    }
+    return false;
+}
+
+static void *threadTestMain(void *p){
+    ThreadTest *t = (ThreadTest *)p;
+    lana::API *api = t->api;
+
+    api->attachThread();
+    pthread_barrier_wait(t->attached);
+    pthread_barrier_wait(t->checked);
+
+    lana::Session *s = new lana::Session(api);
+    try {
+        // compile and run code of its own, calling a global function
+        // defined by the main thread, which makes lists and dictionaries
+        s->feed("tloop = function(n)");
+        s->feed("    t = 0");
+        s->feed("    for i in range(1,n+1)");
+        s->feed("        t = t + $tsum(i)");
+        s->feed("    endfor");
+        s->feed("    return t");
+        s->feed("end");
+        s->feed("tres = tloop(50)");
+        if(s->getSesVar("tres")->getInt()!=44200)
+            t->failed = "wrong result from feeding";
+
+        // and through a call handle
+        lana::CallHandle h = api->getFunction("$tsum");
+        lana::Value a;
+        for(int i=0;i<CALLS && !t->failed;i++){
+            a.setInt(i+t->n);
+            int r = api->call(h,a).getInt();
+            if(r!=(i+t->n)*(i+t->n+1))
+                t->failed = "wrong result from a call handle";
+        }
+
+        // objects it makes are its own, and collected by its own detector
+        s->feed("tgc = gc()");
+        s->feed("tcyc = create()");
+        s->feed("tcyc.self = tcyc");
+        s->feed("tcyc = 0");
+        s->feed("tgc = gc()-tgc");
+        if(s->getSesVar("tgc")->getInt()!=0)
+            t->failed = "cycle not collected";
+
+        // globals can be read, but not changed or created, and those
+        // holding objects can't be read at all
+        s->feed("tlim = $tlimit");
+        if(s->getSesVar("tlim")->getInt()!=100)
+            t->failed = "wrong value read from a global";
+        if(!feedThrows(s,"$tlimit = 1"))
+            t->failed = "global changed while threads were attached";
+        if(!feedThrows(s,"$tnew = 1"))
+            t->failed = "global created while threads were attached";
+        if(!feedThrows(s,"tobj = $tobj"))
+            t->failed = "object read from a global by another thread";
+        if(!feedThrows(s,"tobj = $tsum()"))
+            t->failed = "no error from a bad call";
+
+        // and it still works after all that
+        s->feed("tres = $tsum(10)");
+        if(s->getSesVar("tres")->getInt()!=110)
+            t->failed = "wrong result after errors";
+    } catch(lana::Exception &e){
+        t->failed = "unexpected exception";
+    }
+    delete s;
+    api->detachThread();
+    return NULL;
+}
+
+void TestFixtureLana::testThreads(){
+    ses->feed("$tlimit = 100");
+    ses->feed("$tobj = create()");
+    ses->feed("$tobj.x = 1");
+    ses->feed("$tdict = dict()");
+    ses->feed("$tdict[\"k\"] = 2");
+    ses->feed("$tsum = function(n)");
+    ses->feed("    l = list()");
+    ses->feed("    l.push(n)");
+    ses->feed("    l.push(n+1)");
+    ses->feed("    d = dict()");
+    ses->feed("    d[\"x\"] = l");
+    ses->feed("    return d[\"x\"][0]*d[\"x\"][1]");
+    ses->feed("end");
+    CPPUNIT_ASSERT(api->getThreadCount()==0);
+
+    pthread_barrier_t attached,checked;
+    pthread_barrier_init(&attached,NULL,THREADS+1);
+    pthread_barrier_init(&checked,NULL,THREADS+1);
+
+    pthread_t threads[THREADS];
+    ThreadTest tests[THREADS];
+    for(int i=0;i<THREADS;i++){
+        tests[i].api = api;
+        tests[i].n = i;
+        tests[i].attached = &attached;
+        tests[i].checked = &checked;
+        tests[i].failed = NULL;
+        pthread_create(threads+i,NULL,threadTestMain,tests+i);
+    }
+
+    // while they're attached, this thread can't change globals either,
+    // though it can read them through references (checked after
+    // they've finished, so that a failure can't leave them waiting)
+    pthread_barrier_wait(&attached);
+    int attachedCount = api->getThreadCount();
+    bool changed = !feedThrows(ses,"$tlimit = 1");
+    bool read = !feedThrows(ses,"tread = $tobj.x+$tdict[\"k\"]") &&
+        !feedThrows(ses,"tdef = defined($tdict[\"k\"])");
+    pthread_barrier_wait(&checked);
+
+    for(int i=0;i<THREADS;i++)
+        pthread_join(threads[i],NULL);
+    pthread_barrier_destroy(&attached);
+    pthread_barrier_destroy(&checked);
+
+    CPPUNIT_ASSERT(attachedCount==THREADS);
+    CPPUNIT_ASSERT(!changed);
+    CPPUNIT_ASSERT(read);
+    CPPUNIT_ASSERT_INTVAR("tread",3);
+    CPPUNIT_ASSERT(api->findGlobal("$tlimit")->getInt()==100);
+    for(int i=0;i<THREADS;i++){
+        if(tests[i].failed)
+            CPPUNIT_FAIL(tests[i].failed);
+    }
+
+    // once they've all gone, it can again
+    CPPUNIT_ASSERT(api->getThreadCount()==0);
+    ses->feed("$tlimit = 5");
+    CPPUNIT_ASSERT(api->findGlobal("$tlimit")->getInt()==5);
+    ses->feed("$tnew = $tsum(3)");
+    CPPUNIT_ASSERT(api->findGlobal("$tnew")->getInt()==12);
+}
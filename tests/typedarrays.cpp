@@ -0,0 +1,82 @@
+#include "tests.h"
+#include "lana/simd.h"
+
+// sizes which give empty arrays, arrays shorter than a vector, and
+// arrays with a tail after the last whole vector for every set
+
+static const int sizes[] = {0,1,3,7,8,9,31,100,1001};
+
+/// check one kernel set against the scalar set for one element type;
+/// the values are small integers so the float results are exact.
+template <class T> static void checkKernels(const lana::SimdKernels<T> *k,
+                                            const lana::SimdKernels<T> *ref){
+    for(unsigned int s=0;s<sizeof(sizes)/sizeof(int);s++){
+        int n = sizes[s];
+        T *a = new T[n+1];
+        T *b = new T[n+1];
+        T *c = new T[n+1];
+        T *d = new T[n+1];
+        for(int i=0;i<n;i++){
+            a[i] = (T)((i*7)%13-6);
+            b[i] = (T)((i*5)%11-5);
+        }
+        
+        CPPUNIT_ASSERT(k->sum(a,n)==ref->sum(a,n));
+        CPPUNIT_ASSERT(k->dot(a,b,n)==ref->dot(a,b,n));
+        if(n){
+            CPPUNIT_ASSERT(k->min(a,n)==ref->min(a,n));
+            CPPUNIT_ASSERT(k->max(a,n)==ref->max(a,n));
+        }
+        
+        memcpy(c,a,n*sizeof(T));
+        memcpy(d,a,n*sizeof(T));
+        k->scale(c,n,3);
+        ref->scale(d,n,3);
+        CPPUNIT_ASSERT(!memcmp(c,d,n*sizeof(T)));
+        k->axpy(c,b,n,-2);
+        ref->axpy(d,b,n,-2);
+        CPPUNIT_ASSERT(!memcmp(c,d,n*sizeof(T)));
+        k->add(c,c,b,n);
+        ref->add(d,d,b,n);
+        CPPUNIT_ASSERT(!memcmp(c,d,n*sizeof(T)));
+        k->mul(c,c,a,n);
+        ref->mul(d,d,a,n);
+        CPPUNIT_ASSERT(!memcmp(c,d,n*sizeof(T)));
+        k->prefixSum(c,n);
+        ref->prefixSum(d,n);
+        CPPUNIT_ASSERT(!memcmp(c,d,n*sizeof(T)));
+        
+        delete [] a;
+        delete [] b;
+        delete [] c;
+        delete [] d;
+    }
+}
+
+void TestFixtureLana::testSimdKernels(){
+    const lana::SimdKernelSet *ref = lana::simd::scalarKernels();
+    const char *names[] = {"sse2","avx2"};
+    
+    for(int i=0;i<2;i++){
+        const lana::SimdKernelSet *k = lana::simd::find(names[i]);
+        if(!k){
+            printf("%s kernels not available\n",names[i]);
+            continue;
+        }
+        checkKernels(&k->i32,&ref->i32);
+        checkKernels(&k->f32,&ref->f32);
+        checkKernels(&k->f64,&ref->f64);
+    }
+}
+
+void TestFixtureLana::testTypedArrays(){
+    // run the script with every available set of kernels
+    const char *names[] = {"scalar","sse2","avx2"};
+    const lana::SimdKernelSet *prev = lana::simd::kernels();
+    
+    for(int i=0;i<3;i++){
+        if(lana::simd::select(names[i]))
+            ses->feedFile("files/typedarrays.l");
+    }
+    lana::simd::select(prev->name);
+}